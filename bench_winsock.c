@@ -0,0 +1,731 @@
+/*
+ * Winsock2 Linux Wrapper Benchmark Program
+ * Measures wrapper calls against the equivalent raw Linux calls
+ *
+ * Usage: bench_winsock [--json]
+ *   --json  one JSON object per benchmark on stdout, for regression tracking
+ */
+
+#include "winsock2.h"
+#include "ws2tcpip.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#define BENCH_ADDRESSES 1024
+#define BENCH_SAMPLES   200
+#define BENCH_MESSAGE   64
+
+static SOCKADDR_STORAGE g_addrs[BENCH_ADDRESSES];
+static char g_strings[BENCH_ADDRESSES][64];
+static LPSTR g_string_ptrs[BENCH_ADDRESSES];
+static volatile int g_sink;
+
+static int g_json = 0;
+static const char* g_group = "";
+static double g_samples[BENCH_SAMPLES];
+
+/* A connected pair; datagram pairs also carry the peer address of b */
+typedef struct BenchPair {
+    SOCKET a;
+    SOCKET b;
+    struct sockaddr_storage to;
+    int tolen;
+} BenchPair;
+
+/* Benchmark function declarations */
+void bench_setup(void);
+void bench_string_to_address(void);
+void bench_address_to_string(void);
+void bench_stream_io(void);
+void bench_datagram_io(void);
+void bench_events(void);
+void bench_event_select(void);
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static int compare_double(const void* a, const void* b)
+{
+    double x;
+    double y;
+    x = *(const double*)a;
+    y = *(const double*)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/* Nearest-rank percentile of the sorted samples */
+static double percentile(int count, double p)
+{
+    int rank;
+    rank = (int)(p * (double)count + 0.999999) - 1;
+    if (rank < 0) {
+        rank = 0;
+    }
+    if (rank >= count) {
+        rank = count - 1;
+    }
+    return g_samples[rank];
+}
+
+static void bench_group(const char* title)
+{
+    g_group = title;
+    if (!g_json) {
+        printf("[BENCH] %s\n", title);
+    }
+}
+
+static void bench_group_end(void)
+{
+    if (!g_json) {
+        printf("\n");
+    }
+}
+
+/*
+ * Run fn in samples batches of batch operations each. fn runs the loop
+ * itself and returns the operations it performed, so the clock and the
+ * call through fn stay out of the per-op cost; percentiles are therefore
+ * over batch means, not single calls.
+ */
+static void bench_case(const char* name, long (*fn)(void* ctx, long n), void* ctx,
+                       long batch, int samples)
+{
+    double start;
+    double end;
+    double total_ns;
+    double ns_per_op;
+    long total_ops;
+    long ops;
+    int i;
+
+    fn(ctx, batch);
+
+    total_ns = 0;
+    total_ops = 0;
+    for (i = 0; i < samples; i++) {
+        start = now_ns();
+        ops = fn(ctx, batch);
+        end = now_ns();
+        g_samples[i] = (end - start) / (double)(ops > 0 ? ops : 1);
+        total_ns += end - start;
+        total_ops += ops;
+    }
+    qsort(g_samples, (size_t)samples, sizeof(double), compare_double);
+    ns_per_op = total_ns / (double)(total_ops > 0 ? total_ops : 1);
+
+    if (g_json) {
+        printf("{\"group\":\"%s\",\"name\":\"%s\",\"ns_per_op\":%.1f,\"ops_per_s\":%.0f,"
+               "\"p50_ns\":%.1f,\"p90_ns\":%.1f,\"p99_ns\":%.1f,\"p999_ns\":%.1f,"
+               "\"samples\":%d,\"batch\":%ld}\n",
+               g_group, name, ns_per_op, 1e9 / ns_per_op,
+               percentile(samples, 0.50), percentile(samples, 0.90),
+               percentile(samples, 0.99), percentile(samples, 0.999),
+               samples, batch);
+    } else {
+        printf("  %-36s %8.1f ns/op %11.0f ops/s  p50 %8.1f  p99 %8.1f  p99.9 %8.1f\n",
+               name, ns_per_op, 1e9 / ns_per_op, percentile(samples, 0.50),
+               percentile(samples, 0.99), percentile(samples, 0.999));
+    }
+}
+
+int main(int argc, char** argv)
+{
+    WSADATA wsaData;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            g_json = 1;
+        } else {
+            fprintf(stderr, "usage: %s [--json]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (!g_json) {
+        printf("=======================================================\n");
+        printf("Linux Winsock2 Wrapper Benchmarks\n");
+        printf("=======================================================\n\n");
+    }
+
+    WSAStartup(MAKEWORD(2, 2), &wsaData);
+
+    bench_setup();
+    bench_string_to_address();
+    bench_address_to_string();
+    bench_stream_io();
+    bench_datagram_io();
+    bench_events();
+    bench_event_select();
+
+    WSACleanup();
+
+    if (!g_json) {
+        printf("=======================================================\n");
+        printf("All benchmarks completed!\n");
+        printf("=======================================================\n");
+    }
+
+    return 0;
+}
+
+/* Build a mixed IPv4/IPv6 address set with ports */
+void bench_setup(void)
+{
+    unsigned int seed;
+    int i;
+
+    seed = 12345;
+    for (i = 0; i < BENCH_ADDRESSES; i++) {
+        memset(&g_addrs[i], 0, sizeof(g_addrs[i]));
+        seed = seed * 1103515245u + 12345u;
+
+        if (i % 4 != 0) {
+            struct sockaddr_in* sin;
+            sin = (struct sockaddr_in*)&g_addrs[i];
+            sin->sin_family = AF_INET;
+            sin->sin_addr.s_addr = htonl(seed);
+            sin->sin_port = htons((unsigned short)(1024 + i));
+            inet_ntop(AF_INET, &sin->sin_addr, g_strings[i], sizeof(g_strings[i]));
+        } else {
+            struct sockaddr_in6* sin6;
+            int j;
+            sin6 = (struct sockaddr_in6*)&g_addrs[i];
+            sin6->sin6_family = AF_INET6;
+            sin6->sin6_addr.s6_addr[0] = 0x20;
+            sin6->sin6_addr.s6_addr[1] = 0x01;
+            for (j = 8; j < 16; j++) {
+                seed = seed * 1103515245u + 12345u;
+                sin6->sin6_addr.s6_addr[j] = (unsigned char)(seed >> 16);
+            }
+            inet_ntop(AF_INET6, &sin6->sin6_addr, g_strings[i], sizeof(g_strings[i]));
+        }
+        g_string_ptrs[i] = g_strings[i];
+    }
+}
+
+/* ============================================================================
+ * Address Conversion
+ * ============================================================================ */
+
+static long run_inet_pton(void* ctx, long n)
+{
+    unsigned char raw[16];
+    long i;
+
+    (void)ctx;
+    for (i = 0; i < n; i++) {
+        g_sink += inet_pton(g_addrs[i % BENCH_ADDRESSES].ss_family,
+                            g_strings[i % BENCH_ADDRESSES], raw);
+    }
+    return n;
+}
+
+static long run_string_to_address(void* ctx, long n)
+{
+    SOCKADDR_STORAGE out;
+    INT len;
+    long i;
+
+    (void)ctx;
+    for (i = 0; i < n; i++) {
+        len = sizeof(out);
+        g_sink += WSAStringToAddressA(g_strings[i % BENCH_ADDRESSES],
+                                      g_addrs[i % BENCH_ADDRESSES].ss_family, NULL,
+                                      (LPSOCKADDR)&out, &len);
+    }
+    return n;
+}
+
+static long run_string_to_address_batch(void* ctx, long n)
+{
+    static SOCKADDR_STORAGE out[BENCH_ADDRESSES];
+    long i;
+
+    (void)ctx;
+    for (i = 0; i < n; i += BENCH_ADDRESSES) {
+        g_sink += WSAStringToAddressBatchA(g_string_ptrs, BENCH_ADDRESSES,
+                                           AF_UNSPEC, out, NULL);
+    }
+    return i;
+}
+
+/* WSAStringToAddressA versus inet_pton */
+void bench_string_to_address(void)
+{
+    bench_group("String to address");
+    bench_case("glibc inet_pton", run_inet_pton, NULL, BENCH_ADDRESSES, BENCH_SAMPLES);
+    bench_case("WSAStringToAddressA", run_string_to_address, NULL,
+               BENCH_ADDRESSES, BENCH_SAMPLES);
+    bench_case("WSAStringToAddressBatchA (AF_UNSPEC)", run_string_to_address_batch, NULL,
+               BENCH_ADDRESSES, BENCH_SAMPLES);
+    bench_group_end();
+}
+
+static long run_inet_ntop(void* ctx, long n)
+{
+    char buffer[80];
+    char ip[INET6_ADDRSTRLEN];
+    struct sockaddr_in* sin;
+    struct sockaddr_in6* sin6;
+    long i;
+
+    (void)ctx;
+    for (i = 0; i < n; i++) {
+        if (g_addrs[i % BENCH_ADDRESSES].ss_family == AF_INET) {
+            sin = (struct sockaddr_in*)&g_addrs[i % BENCH_ADDRESSES];
+            inet_ntop(AF_INET, &sin->sin_addr, ip, sizeof(ip));
+            g_sink += snprintf(buffer, sizeof(buffer), "%s:%d", ip, ntohs(sin->sin_port));
+        } else {
+            sin6 = (struct sockaddr_in6*)&g_addrs[i % BENCH_ADDRESSES];
+            inet_ntop(AF_INET6, &sin6->sin6_addr, ip, sizeof(ip));
+            g_sink += snprintf(buffer, sizeof(buffer), "%s", ip);
+        }
+    }
+    return n;
+}
+
+static long run_address_to_string(void* ctx, long n)
+{
+    char buffer[80];
+    DWORD len;
+    long i;
+
+    (void)ctx;
+    for (i = 0; i < n; i++) {
+        len = sizeof(buffer);
+        g_sink += WSAAddressToStringA((LPSOCKADDR)&g_addrs[i % BENCH_ADDRESSES],
+                                      sizeof(g_addrs[0]), NULL, buffer, &len);
+    }
+    return n;
+}
+
+static long run_address_to_string_batch(void* ctx, long n)
+{
+    static char batch[BENCH_ADDRESSES][64];
+    long i;
+
+    (void)ctx;
+    for (i = 0; i < n; i += BENCH_ADDRESSES) {
+        g_sink += WSAAddressToStringBatchA(g_addrs, BENCH_ADDRESSES,
+                                           batch[0], sizeof(batch[0]), NULL);
+    }
+    return i;
+}
+
+/* WSAAddressToStringA versus inet_ntop plus snprintf */
+void bench_address_to_string(void)
+{
+    bench_group("Address to string");
+    bench_case("glibc inet_ntop + snprintf", run_inet_ntop, NULL,
+               BENCH_ADDRESSES, BENCH_SAMPLES);
+    bench_case("WSAAddressToStringA", run_address_to_string, NULL,
+               BENCH_ADDRESSES, BENCH_SAMPLES);
+    bench_case("WSAAddressToStringBatchA", run_address_to_string_batch, NULL,
+               BENCH_ADDRESSES, BENCH_SAMPLES);
+    bench_group_end();
+}
+
+/* ============================================================================
+ * Socket I/O
+ *
+ * One operation is a BENCH_MESSAGE-byte send on one end of a pair and
+ * the matching receive on the other, so buffers never fill up.
+ * ============================================================================ */
+
+static long run_send_recv(void* ctx, long n)
+{
+    BenchPair* p;
+    char buffer[BENCH_MESSAGE];
+    long i;
+
+    p = (BenchPair*)ctx;
+    memset(buffer, 'x', sizeof(buffer));
+    for (i = 0; i < n; i++) {
+        send(p->a, buffer, sizeof(buffer), 0);
+        g_sink += (int)recv(p->b, buffer, sizeof(buffer), MSG_WAITALL);
+    }
+    return n;
+}
+
+static long run_wsa_send_recv(void* ctx, long n)
+{
+    BenchPair* p;
+    char buffer[BENCH_MESSAGE];
+    WSABUF buf;
+    DWORD bytes;
+    DWORD flags;
+    long i;
+
+    p = (BenchPair*)ctx;
+    memset(buffer, 'x', sizeof(buffer));
+    buf.buf = buffer;
+    buf.len = sizeof(buffer);
+    for (i = 0; i < n; i++) {
+        WSASend(p->a, &buf, 1, &bytes, 0, NULL, NULL);
+        flags = MSG_WAITALL;
+        WSARecv(p->b, &buf, 1, &bytes, &flags, NULL, NULL);
+        g_sink += (int)bytes;
+    }
+    return n;
+}
+
+static long run_sendto_recvfrom(void* ctx, long n)
+{
+    BenchPair* p;
+    char buffer[BENCH_MESSAGE];
+    struct sockaddr_storage from;
+    socklen_t fromlen;
+    long i;
+
+    p = (BenchPair*)ctx;
+    memset(buffer, 'x', sizeof(buffer));
+    for (i = 0; i < n; i++) {
+        sendto(p->a, buffer, sizeof(buffer), 0, (struct sockaddr*)&p->to, (socklen_t)p->tolen);
+        fromlen = sizeof(from);
+        g_sink += (int)recvfrom(p->b, buffer, sizeof(buffer), 0,
+                                (struct sockaddr*)&from, &fromlen);
+    }
+    return n;
+}
+
+static long run_wsa_sendto_recvfrom(void* ctx, long n)
+{
+    BenchPair* p;
+    char buffer[BENCH_MESSAGE];
+    struct sockaddr_storage from;
+    WSABUF buf;
+    DWORD bytes;
+    DWORD flags;
+    int fromlen;
+    long i;
+
+    p = (BenchPair*)ctx;
+    memset(buffer, 'x', sizeof(buffer));
+    buf.buf = buffer;
+    buf.len = sizeof(buffer);
+    for (i = 0; i < n; i++) {
+        WSASendTo(p->a, &buf, 1, &bytes, 0, (struct sockaddr*)&p->to, p->tolen, NULL, NULL);
+        flags = 0;
+        fromlen = sizeof(from);
+        WSARecvFrom(p->b, &buf, 1, &bytes, &flags, (struct sockaddr*)&from, &fromlen,
+                    NULL, NULL);
+        g_sink += (int)bytes;
+    }
+    return n;
+}
+
+static long run_sendmsg_recvmsg(void* ctx, long n)
+{
+    BenchPair* p;
+    char buffer[BENCH_MESSAGE];
+    struct sockaddr_storage from;
+    struct msghdr msg;
+    struct iovec iov;
+    long i;
+
+    p = (BenchPair*)ctx;
+    memset(buffer, 'x', sizeof(buffer));
+    iov.iov_base = buffer;
+    iov.iov_len = sizeof(buffer);
+    for (i = 0; i < n; i++) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_name = &p->to;
+        msg.msg_namelen = (socklen_t)p->tolen;
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        sendmsg(p->a, &msg, 0);
+        msg.msg_name = &from;
+        msg.msg_namelen = sizeof(from);
+        g_sink += (int)recvmsg(p->b, &msg, 0);
+    }
+    return n;
+}
+
+static long run_wsa_sendmsg_recvmsg(void* ctx, long n)
+{
+    BenchPair* p;
+    char buffer[BENCH_MESSAGE];
+    struct sockaddr_storage from;
+    WSAMSG msg;
+    WSABUF buf;
+    DWORD bytes;
+    long i;
+
+    p = (BenchPair*)ctx;
+    memset(buffer, 'x', sizeof(buffer));
+    buf.buf = buffer;
+    buf.len = sizeof(buffer);
+    for (i = 0; i < n; i++) {
+        memset(&msg, 0, sizeof(msg));
+        msg.name = (LPSOCKADDR)&p->to;
+        msg.namelen = p->tolen;
+        msg.lpBuffers = &buf;
+        msg.dwBufferCount = 1;
+        WSASendMsg(p->a, &msg, 0, &bytes, NULL, NULL);
+        msg.name = (LPSOCKADDR)&from;
+        msg.namelen = sizeof(from);
+        WSARecvMsg(p->b, &msg, &bytes, NULL, NULL);
+        g_sink += (int)bytes;
+    }
+    return n;
+}
+
+/* Connected TCP pair over 127.0.0.1 */
+static int tcp_pair(BenchPair* p)
+{
+    struct sockaddr_in addr;
+    socklen_t len;
+    SOCKET listener;
+    int one;
+
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    len = sizeof(addr);
+    if (bind(listener, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        listen(listener, 1) < 0 ||
+        getsockname(listener, (struct sockaddr*)&addr, &len) < 0) {
+        closesocket(listener);
+        return -1;
+    }
+
+    p->a = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(p->a, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        closesocket(p->a);
+        closesocket(listener);
+        return -1;
+    }
+    p->b = accept(listener, NULL, NULL);
+    closesocket(listener);
+
+    one = 1;
+    setsockopt(p->a, IPPROTO_TCP, TCP_NODELAY, (char*)&one, sizeof(one));
+    return p->b == INVALID_SOCKET ? -1 : 0;
+}
+
+/* Unconnected UDP pair over 127.0.0.1; a sends to b */
+static int udp_pair(BenchPair* p)
+{
+    struct sockaddr_in addr;
+    socklen_t len;
+
+    p->a = socket(AF_INET, SOCK_DGRAM, 0);
+    p->b = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    len = sizeof(addr);
+    if (bind(p->b, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        getsockname(p->b, (struct sockaddr*)&addr, &len) < 0) {
+        return -1;
+    }
+    memcpy(&p->to, &addr, sizeof(addr));
+    p->tolen = (int)len;
+    return 0;
+}
+
+static void close_pair(BenchPair* p)
+{
+    closesocket(p->a);
+    closesocket(p->b);
+}
+
+/* WSASend/WSARecv versus send/recv on a socketpair and over TCP loopback */
+void bench_stream_io(void)
+{
+    BenchPair pair;
+    int fds[2];
+
+    bench_group("Stream I/O (socketpair)");
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0) {
+        pair.a = fds[0];
+        pair.b = fds[1];
+        bench_case("send + recv", run_send_recv, &pair, 64, BENCH_SAMPLES);
+        bench_case("WSASend + WSARecv", run_wsa_send_recv, &pair, 64, BENCH_SAMPLES);
+        close_pair(&pair);
+    }
+    bench_group_end();
+
+    bench_group("Stream I/O (TCP loopback)");
+    if (tcp_pair(&pair) == 0) {
+        bench_case("send + recv", run_send_recv, &pair, 64, BENCH_SAMPLES);
+        bench_case("WSASend + WSARecv", run_wsa_send_recv, &pair, 64, BENCH_SAMPLES);
+        close_pair(&pair);
+    }
+    bench_group_end();
+}
+
+/* Datagram calls with addresses, over UDP loopback */
+void bench_datagram_io(void)
+{
+    BenchPair pair;
+
+    bench_group("Datagram I/O (UDP loopback)");
+    if (udp_pair(&pair) == 0) {
+        bench_case("sendto + recvfrom", run_sendto_recvfrom, &pair, 64, BENCH_SAMPLES);
+        bench_case("WSASendTo + WSARecvFrom", run_wsa_sendto_recvfrom, &pair,
+                   64, BENCH_SAMPLES);
+        bench_case("sendmsg + recvmsg", run_sendmsg_recvmsg, &pair, 64, BENCH_SAMPLES);
+        bench_case("WSASendMsg + WSARecvMsg", run_wsa_sendmsg_recvmsg, &pair,
+                   64, BENCH_SAMPLES);
+    }
+    close_pair(&pair);
+    bench_group_end();
+}
+
+/* ============================================================================
+ * Event Objects
+ * ============================================================================ */
+
+static long run_eventfd_set_reset(void* ctx, long n)
+{
+    uint64_t value;
+    int fd;
+    long i;
+
+    fd = *(int*)ctx;
+    for (i = 0; i < n; i++) {
+        value = 1;
+        g_sink += (int)write(fd, &value, sizeof(value));
+        g_sink += (int)read(fd, &value, sizeof(value));
+    }
+    return n;
+}
+
+static long run_wsa_set_reset(void* ctx, long n)
+{
+    WSAEVENT event;
+    long i;
+
+    event = *(WSAEVENT*)ctx;
+    for (i = 0; i < n; i++) {
+        g_sink += WSASetEvent(event);
+        g_sink += WSAResetEvent(event);
+    }
+    return n;
+}
+
+static long run_poll_signaled(void* ctx, long n)
+{
+    struct pollfd pfd;
+    long i;
+
+    pfd.fd = *(int*)ctx;
+    pfd.events = POLLIN;
+    for (i = 0; i < n; i++) {
+        g_sink += poll(&pfd, 1, 0);
+    }
+    return n;
+}
+
+static long run_wsa_wait_signaled(void* ctx, long n)
+{
+    WSAEVENT event;
+    long i;
+
+    event = *(WSAEVENT*)ctx;
+    for (i = 0; i < n; i++) {
+        g_sink += (int)WSAWaitForMultipleEvents(1, &event, FALSE, 0, FALSE);
+    }
+    return n;
+}
+
+/* WSASetEvent/WSAResetEvent/WSAWaitForMultipleEvents versus eventfd */
+void bench_events(void)
+{
+    WSAEVENT event;
+    uint64_t value;
+    int fd;
+
+    bench_group("Event objects");
+
+    fd = eventfd(0, EFD_CLOEXEC);
+    event = WSACreateEvent();
+    bench_case("eventfd write + read", run_eventfd_set_reset, &fd, 256, BENCH_SAMPLES);
+    bench_case("WSASetEvent + WSAResetEvent", run_wsa_set_reset, &event, 256, BENCH_SAMPLES);
+
+    /* Waits on an already signaled event, so only the call itself is timed */
+    value = 1;
+    g_sink += (int)write(fd, &value, sizeof(value));
+    WSASetEvent(event);
+    bench_case("poll (signaled eventfd)", run_poll_signaled, &fd, 256, BENCH_SAMPLES);
+    bench_case("WSAWaitForMultipleEvents (signaled)", run_wsa_wait_signaled, &event,
+               256, BENCH_SAMPLES);
+
+    WSACloseEvent(event);
+    close(fd);
+    bench_group_end();
+}
+
+/* ============================================================================
+ * Readiness Registration
+ * ============================================================================ */
+
+typedef struct BenchRegistration {
+    SOCKET s;
+    WSAEVENT event;
+    int epfd;
+} BenchRegistration;
+
+static long run_epoll_add_del(void* ctx, long n)
+{
+    BenchRegistration* r;
+    struct epoll_event ev;
+    long i;
+
+    r = (BenchRegistration*)ctx;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = r->s;
+    for (i = 0; i < n; i++) {
+        g_sink += epoll_ctl(r->epfd, EPOLL_CTL_ADD, r->s, &ev);
+        g_sink += epoll_ctl(r->epfd, EPOLL_CTL_DEL, r->s, NULL);
+    }
+    return n;
+}
+
+static long run_event_select(void* ctx, long n)
+{
+    BenchRegistration* r;
+    long i;
+
+    r = (BenchRegistration*)ctx;
+    for (i = 0; i < n; i++) {
+        g_sink += WSAEventSelect(r->s, r->event, FD_READ | FD_CLOSE);
+        g_sink += WSAEventSelect(r->s, NULL, 0);
+    }
+    return n;
+}
+
+/* Registering and cancelling WSAEventSelect versus epoll_ctl */
+void bench_event_select(void)
+{
+    BenchRegistration r;
+    BenchPair pair;
+
+    bench_group("Readiness registration");
+    if (udp_pair(&pair) == 0) {
+        r.s = pair.b;
+        r.event = WSACreateEvent();
+        r.epfd = epoll_create1(EPOLL_CLOEXEC);
+        bench_case("epoll_ctl ADD + DEL", run_epoll_add_del, &r, 64, BENCH_SAMPLES);
+        bench_case("WSAEventSelect + cancel", run_event_select, &r, 4, 50);
+        close(r.epfd);
+        WSACloseEvent(r.event);
+    }
+    close_pair(&pair);
+    bench_group_end();
+}
@@ -0,0 +1,541 @@
+/*
+ * Winsock2 Linux Wrapper Fuzz Harness
+ * libFuzzer/AFL entry point for the hand-written parsers and copy loops:
+ * WSAStringToAddressA/W, WSAAddressToStringA/W, GetAddrInfoW result
+ * conversion and WSARecvMsg buffer and control-buffer handling
+ *
+ * Build: make fuzz        clang libFuzzer binary with ASan and UBSan
+ *        make fuzz_files  file-driven binary for any compiler with ASan and
+ *                         UBSan; runs each file named on the command line
+ *                         (stdin without arguments) once, so it replays a
+ *                         corpus or crash and serves AFL:
+ *                         make fuzz_files CC=afl-clang-fast
+ *
+ * The first input byte picks the target and the rest is its input. Every
+ * output buffer is followed by canary bytes, and each target checks what
+ * it produced against glibc or a round trip, aborting on a mismatch so
+ * the fuzzer keeps the input.
+ */
+
+#include "winsock2.h"
+#include "ws2tcpip.h"
+#include "mswsock.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <wchar.h>
+#include <sys/un.h>
+
+#define FUZZ_CANARY      0xA5
+#define FUZZ_CANARY_LEN  16
+#define FUZZ_MAX_STRING  512
+#define FUZZ_MAX_PAYLOAD 4096
+#define FUZZ_MAX_BUFFERS 8
+#define FUZZ_MAX_WIDE_ADDRESS 64    /* Longest string WSAStringToAddressW converts */
+
+#define FUZZ_CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "fuzz_winsock: %s:%d: check failed: %s\n", \
+                    __FILE__, __LINE__, #cond); \
+            abort(); \
+        } \
+    } while (0)
+
+static void canary_fill(unsigned char* p)
+{
+    memset(p, FUZZ_CANARY, FUZZ_CANARY_LEN);
+}
+
+static int canary_intact(const unsigned char* p)
+{
+    int i;
+
+    for (i = 0; i < FUZZ_CANARY_LEN; i++) {
+        if (p[i] != FUZZ_CANARY) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Exactly size bytes plus a terminator, so ASan catches any overread */
+static char* copy_string(const uint8_t* data, size_t size)
+{
+    char* s;
+
+    if (size > FUZZ_MAX_STRING) {
+        size = FUZZ_MAX_STRING;
+    }
+    s = (char*)malloc(size + 1);
+    memcpy(s, data, size);
+    s[size] = '\0';
+    return s;
+}
+
+static wchar_t* widen(const char* s)
+{
+    wchar_t* w;
+    size_t len;
+    size_t i;
+
+    len = strlen(s);
+    w = (wchar_t*)malloc((len + 1) * sizeof(wchar_t));
+    for (i = 0; i <= len; i++) {
+        w[i] = (wchar_t)(unsigned char)s[i];
+    }
+    return w;
+}
+
+static int is_ascii(const char* s)
+{
+    while (*s != '\0') {
+        if ((unsigned char)*s >= 0x80) {
+            return 0;
+        }
+        s++;
+    }
+    return 1;
+}
+
+static int pick_family(uint8_t b)
+{
+    switch (b & 3) {
+    case 0:
+        return AF_INET;
+    case 1:
+        return AF_INET6;
+    case 2:
+        return AF_UNSPEC;
+    default:
+        return b;
+    }
+}
+
+/* Address, port and (IPv6) scope of two sockaddrs match */
+static int same_endpoint(const struct sockaddr* a, const struct sockaddr* b)
+{
+    const struct sockaddr_in6* a6;
+    const struct sockaddr_in6* b6;
+
+    if (a->sa_family != b->sa_family) {
+        return 0;
+    }
+    if (a->sa_family == AF_INET) {
+        return memcmp(&((const struct sockaddr_in*)a)->sin_addr,
+                      &((const struct sockaddr_in*)b)->sin_addr, 4) == 0 &&
+               ((const struct sockaddr_in*)a)->sin_port == ((const struct sockaddr_in*)b)->sin_port;
+    }
+    a6 = (const struct sockaddr_in6*)a;
+    b6 = (const struct sockaddr_in6*)b;
+    return memcmp(&a6->sin6_addr, &b6->sin6_addr, 16) == 0 &&
+           a6->sin6_port == b6->sin6_port && a6->sin6_scope_id == b6->sin6_scope_id;
+}
+
+/* ============================================================================
+ * WSAStringToAddressA / WSAStringToAddressW
+ * ============================================================================ */
+
+/* data: family selector, address length, string */
+static void fuzz_string_to_address(const uint8_t* data, size_t size)
+{
+    unsigned char out[sizeof(struct sockaddr_storage) + FUZZ_CANARY_LEN];
+    unsigned char again[sizeof(struct sockaddr_storage)];
+    unsigned char expect[16];
+    char text[128];
+    char* str;
+    wchar_t* wstr;
+    DWORD text_len;
+    INT given;
+    INT len;
+    INT wlen;
+    int family;
+    int rc;
+    int wrc;
+
+    if (size < 2) {
+        return;
+    }
+    family = pick_family(data[0]);
+    given = data[1] % (sizeof(struct sockaddr_storage) + 1);
+    str = copy_string(data + 2, size - 2);
+
+    memset(out, 0, sizeof(out));
+    canary_fill(out + given);
+    len = given;
+    rc = WSAStringToAddressA(str, family, NULL, (LPSOCKADDR)out, &len);
+    FUZZ_CHECK(canary_intact(out + given));
+
+    if (rc == 0) {
+        FUZZ_CHECK(family == AF_INET || family == AF_INET6);
+        FUZZ_CHECK(len <= given);
+        FUZZ_CHECK(((struct sockaddr*)out)->sa_family == family);
+
+        /* Round trip through the formatter and back */
+        text_len = sizeof(text);
+        FUZZ_CHECK(WSAAddressToStringA((LPSOCKADDR)out, (DWORD)len, NULL, text, &text_len) == 0);
+        FUZZ_CHECK(text_len == strlen(text) + 1);
+        len = sizeof(again);
+        FUZZ_CHECK(WSAStringToAddressA(text, family, NULL, (LPSOCKADDR)again, &len) == 0);
+        FUZZ_CHECK(same_endpoint((struct sockaddr*)out, (struct sockaddr*)again));
+    }
+
+    /* Without a port, scope or brackets the answer is inet_pton's */
+    if (given >= (INT)sizeof(struct sockaddr_in6) && strpbrk(str, "[%") == NULL &&
+        (family == AF_INET6 || (family == AF_INET && strchr(str, ':') == NULL))) {
+        FUZZ_CHECK((rc == 0) == (inet_pton(family, str, expect) == 1));
+        if (rc == 0 && family == AF_INET) {
+            FUZZ_CHECK(memcmp(&((struct sockaddr_in*)out)->sin_addr, expect, 4) == 0);
+        } else if (rc == 0) {
+            FUZZ_CHECK(memcmp(&((struct sockaddr_in6*)out)->sin6_addr, expect, 16) == 0);
+        }
+    }
+
+    /* The wide form agrees with the narrow one on ASCII input that fits its buffer */
+    if (is_ascii(str) && strlen(str) <= FUZZ_MAX_WIDE_ADDRESS) {
+        wstr = widen(str);
+        memset(again, 0, sizeof(again));
+        wlen = given;
+        wrc = WSAStringToAddressW(wstr, family, NULL, (LPSOCKADDR)again, &wlen);
+        FUZZ_CHECK(wrc == rc);
+        if (rc == 0) {
+            FUZZ_CHECK(wlen == len);
+            FUZZ_CHECK(same_endpoint((struct sockaddr*)out, (struct sockaddr*)again));
+        }
+        free(wstr);
+    }
+
+    free(str);
+}
+
+/* ============================================================================
+ * WSAAddressToStringA / WSAAddressToStringW
+ * ============================================================================ */
+
+/* data: family selector, address length, output length, sockaddr bytes */
+static void fuzz_address_to_string(const uint8_t* data, size_t size)
+{
+    struct sockaddr_storage ss;
+    unsigned char again[sizeof(struct sockaddr_storage)];
+    char out[64 + FUZZ_CANARY_LEN];
+    wchar_t wout[64 + FUZZ_CANARY_LEN];
+    char ntop[INET6_ADDRSTRLEN];
+    DWORD addr_len;
+    DWORD given;
+    DWORD len;
+    DWORD wlen;
+    INT parse_len;
+    int family;
+    int rc;
+    int wrc;
+    DWORD i;
+
+    if (size < 3) {
+        return;
+    }
+    family = pick_family(data[0]);
+    addr_len = data[1] % (sizeof(ss) + 1);
+    given = data[2] % 65;
+
+    memset(&ss, 0, sizeof(ss));
+    memcpy(&ss, data + 3, size - 3 < sizeof(ss) ? size - 3 : sizeof(ss));
+    ss.ss_family = (sa_family_t)family;
+
+    memset(out, 0, sizeof(out));
+    canary_fill((unsigned char*)out + given);
+    len = given;
+    rc = WSAAddressToStringA((LPSOCKADDR)&ss, addr_len, NULL, out, &len);
+    FUZZ_CHECK(canary_intact((unsigned char*)out + given));
+
+    if (rc == 0) {
+        FUZZ_CHECK(family == AF_INET || family == AF_INET6);
+        FUZZ_CHECK(len <= given && len == strlen(out) + 1);
+
+        /* The address part is inet_ntop's */
+        FUZZ_CHECK(inet_ntop(family, family == AF_INET ?
+                             (const void*)&((struct sockaddr_in*)&ss)->sin_addr :
+                             (const void*)&((struct sockaddr_in6*)&ss)->sin6_addr,
+                             ntop, sizeof(ntop)) != NULL);
+        FUZZ_CHECK(strstr(out, ntop) == out + (out[0] == '['));
+
+        parse_len = sizeof(again);
+        FUZZ_CHECK(WSAStringToAddressA(out, family, NULL, (LPSOCKADDR)again, &parse_len) == 0);
+        FUZZ_CHECK(same_endpoint((struct sockaddr*)&ss, (struct sockaddr*)again));
+    } else if (WSAGetLastError() == WSAEFAULT && (family == AF_INET || family == AF_INET6) &&
+               addr_len >= (family == AF_INET ? sizeof(struct sockaddr_in) :
+                                                sizeof(struct sockaddr_in6))) {
+        /* Too small a buffer reports the size needed */
+        FUZZ_CHECK(len > given);
+    }
+
+    for (i = 0; i < FUZZ_CANARY_LEN; i++) {
+        wout[given + i] = (wchar_t)FUZZ_CANARY;
+    }
+    wlen = given;
+    wrc = WSAAddressToStringW((LPSOCKADDR)&ss, addr_len, NULL, wout, &wlen);
+    for (i = 0; i < FUZZ_CANARY_LEN; i++) {
+        FUZZ_CHECK(wout[given + i] == (wchar_t)FUZZ_CANARY);
+    }
+    FUZZ_CHECK(wrc == rc);
+    if (rc == 0) {
+        FUZZ_CHECK(wlen == len);
+        for (i = 0; i < len; i++) {
+            FUZZ_CHECK(wout[i] == (wchar_t)(unsigned char)out[i]);
+        }
+    }
+}
+
+/* ============================================================================
+ * GetAddrInfoW
+ * ============================================================================ */
+
+/* data: family selector, flags, node, NUL, service. Numeric only: no DNS */
+static void fuzz_getaddrinfo_w(const uint8_t* data, size_t size)
+{
+    struct addrinfo hints;
+    struct addrinfo* result;
+    struct addrinfo* a;
+    ADDRINFOW whints;
+    ADDRINFOW* wresult;
+    ADDRINFOW* w;
+    const uint8_t* nul;
+    char* node;
+    char* service;
+    wchar_t* wnode;
+    wchar_t* wservice;
+    int rc;
+    int wrc;
+    size_t i;
+
+    if (size < 2) {
+        return;
+    }
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = pick_family(data[0]) == AF_INET ? AF_INET :
+                      pick_family(data[0]) == AF_INET6 ? AF_INET6 : AF_UNSPEC;
+    hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV | (data[1] & (AI_PASSIVE | AI_CANONNAME));
+    hints.ai_socktype = (data[1] & 0x10) ? SOCK_DGRAM : (data[1] & 0x20) ? SOCK_STREAM : 0;
+
+    data += 2;
+    size -= 2;
+    nul = (const uint8_t*)memchr(data, 0, size);
+    node = copy_string(data, nul != NULL ? (size_t)(nul - data) : size);
+    service = nul != NULL ? copy_string(nul + 1, size - (size_t)(nul + 1 - data)) : NULL;
+    if (!is_ascii(node) || strlen(node) >= 255 ||
+        (service != NULL && (!is_ascii(service) || strlen(service) >= 255))) {
+        free(node);
+        free(service);
+        return;
+    }
+    wnode = widen(node);
+    wservice = service != NULL ? widen(service) : NULL;
+
+    memset(&whints, 0, sizeof(whints));
+    whints.ai_flags = hints.ai_flags;
+    whints.ai_family = hints.ai_family;
+    whints.ai_socktype = hints.ai_socktype;
+
+    rc = getaddrinfo(node, service, &hints, &result);
+    wrc = GetAddrInfoW(wnode, wservice, &whints, &wresult);
+    FUZZ_CHECK((rc == 0) == (wrc == 0));
+
+    if (rc == 0) {
+        for (a = result, w = wresult; a != NULL && w != NULL; a = a->ai_next, w = w->ai_next) {
+            FUZZ_CHECK(w->ai_family == a->ai_family && w->ai_socktype == a->ai_socktype &&
+                       w->ai_protocol == a->ai_protocol && w->ai_addrlen == a->ai_addrlen);
+            FUZZ_CHECK(w->ai_addr != NULL && memcmp(w->ai_addr, a->ai_addr, a->ai_addrlen) == 0);
+            FUZZ_CHECK((w->ai_canonname == NULL) == (a->ai_canonname == NULL));
+            if (a->ai_canonname != NULL) {
+                for (i = 0; i <= strlen(a->ai_canonname); i++) {
+                    FUZZ_CHECK(w->ai_canonname[i] == (wchar_t)(unsigned char)a->ai_canonname[i]);
+                }
+            }
+        }
+        FUZZ_CHECK(a == NULL && w == NULL);
+        freeaddrinfo(result);
+        FreeAddrInfoW(wresult);
+    }
+
+    free(wnode);
+    free(wservice);
+    free(node);
+    free(service);
+}
+
+/* ============================================================================
+ * WSARecvMsg
+ * ============================================================================ */
+
+/*
+ * data: buffer count, control length, one length byte per buffer, payload.
+ * The datagram goes over an AF_UNIX pair with SO_PASSCRED, so every
+ * message carries an SCM_CREDENTIALS control message to truncate.
+ */
+static void fuzz_recv_msg(const uint8_t* data, size_t size)
+{
+    static SOCKET pair[2] = { INVALID_SOCKET, INVALID_SOCKET };
+    unsigned char* arena;
+    unsigned char* control;
+    WSABUF bufs[FUZZ_MAX_BUFFERS];
+    WSAMSG msg;
+    struct cmsghdr* cmsg;
+    struct ucred cred;
+    DWORD count;
+    DWORD control_len;
+    DWORD received;
+    size_t payload_len;
+    size_t total;
+    size_t offset;
+    size_t copied;
+    size_t n;
+    int on;
+    DWORD i;
+
+    if (size < 2) {
+        return;
+    }
+    if (pair[0] == INVALID_SOCKET) {
+        int fds[2];
+        FUZZ_CHECK(socketpair(AF_UNIX, SOCK_DGRAM, 0, fds) == 0);
+        pair[0] = fds[0];
+        pair[1] = fds[1];
+        on = 1;
+        setsockopt(pair[1], SOL_SOCKET, SO_PASSCRED, (const char*)&on, sizeof(on));
+    }
+
+    count = data[0] % (FUZZ_MAX_BUFFERS + 1);
+    control_len = data[1] % 97;
+    data += 2;
+    size -= 2;
+    if (size < count) {
+        return;
+    }
+
+    /* Each buffer is followed by a canary */
+    total = 0;
+    for (i = 0; i < count; i++) {
+        total += data[i] + FUZZ_CANARY_LEN;
+    }
+    arena = (unsigned char*)malloc(total + 1);
+    offset = 0;
+    for (i = 0; i < count; i++) {
+        bufs[i].buf = (char*)arena + offset;
+        bufs[i].len = data[i];
+        memset(arena + offset, 0, data[i]);
+        canary_fill(arena + offset + data[i]);
+        offset += data[i] + FUZZ_CANARY_LEN;
+    }
+    data += count;
+    size -= count;
+    payload_len = size < FUZZ_MAX_PAYLOAD ? size : FUZZ_MAX_PAYLOAD;
+
+    control = (unsigned char*)malloc(control_len + FUZZ_CANARY_LEN);
+    memset(control, 0, control_len);
+    canary_fill(control + control_len);
+
+    FUZZ_CHECK(send(pair[0], (const char*)data, (int)payload_len, 0) == (int)payload_len);
+
+    memset(&msg, 0, sizeof(msg));
+    msg.lpBuffers = count > 0 ? bufs : NULL;
+    msg.dwBufferCount = count;
+    msg.Control.buf = (char*)control;
+    msg.Control.len = control_len;
+    FUZZ_CHECK(WSARecvMsg(pair[1], &msg, &received, NULL, NULL) == 0);
+
+    /* Data lands in order up to the buffer space, the rest is truncated */
+    copied = 0;
+    for (i = 0; i < count; i++) {
+        FUZZ_CHECK(canary_intact((unsigned char*)bufs[i].buf + bufs[i].len));
+        n = payload_len - copied < bufs[i].len ? payload_len - copied : bufs[i].len;
+        FUZZ_CHECK(memcmp(bufs[i].buf, data + copied, n) == 0);
+        copied += n;
+    }
+    FUZZ_CHECK(received == copied);
+    FUZZ_CHECK(((msg.dwFlags & MSG_TRUNC) != 0) == (copied < payload_len));
+
+    FUZZ_CHECK(canary_intact(control + control_len));
+    FUZZ_CHECK(msg.Control.len <= control_len);
+    FUZZ_CHECK(((msg.dwFlags & MSG_CTRUNC) != 0) == (control_len < CMSG_LEN(sizeof(cred))));
+    if ((msg.dwFlags & MSG_CTRUNC) == 0) {
+        cmsg = (struct cmsghdr*)control;
+        FUZZ_CHECK(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_CREDENTIALS);
+        memcpy(&cred, CMSG_DATA(cmsg), sizeof(cred));
+        FUZZ_CHECK(cred.pid == getpid());
+    }
+
+    free(control);
+    free(arena);
+}
+
+/* ============================================================================
+ * Entry Points
+ * ============================================================================ */
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    if (size < 1) {
+        return 0;
+    }
+    switch (data[0] % 4) {
+    case 0:
+        fuzz_string_to_address(data + 1, size - 1);
+        break;
+    case 1:
+        fuzz_address_to_string(data + 1, size - 1);
+        break;
+    case 2:
+        fuzz_getaddrinfo_w(data + 1, size - 1);
+        break;
+    default:
+        fuzz_recv_msg(data + 1, size - 1);
+        break;
+    }
+    return 0;
+}
+
+#ifndef WSA_FUZZ_LIBFUZZER
+
+static int run_file(FILE* f)
+{
+    uint8_t* data;
+    size_t size;
+    size_t capacity;
+    size_t n;
+
+    capacity = 4096;
+    size = 0;
+    data = (uint8_t*)malloc(capacity);
+    while ((n = fread(data + size, 1, capacity - size, f)) > 0) {
+        size += n;
+        if (size == capacity) {
+            capacity *= 2;
+            data = (uint8_t*)realloc(data, capacity);
+        }
+    }
+    LLVMFuzzerTestOneInput(data, size);
+    free(data);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    FILE* f;
+    int i;
+
+    if (argc < 2) {
+        return run_file(stdin);
+    }
+    for (i = 1; i < argc; i++) {
+        f = fopen(argv[i], "rb");
+        if (f == NULL) {
+            fprintf(stderr, "Cannot open %s\n", argv[i]);
+            return 1;
+        }
+        run_file(f);
+        fclose(f);
+    }
+    return 0;
+}
+
+#endif /* WSA_FUZZ_LIBFUZZER */
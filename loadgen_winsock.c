@@ -0,0 +1,701 @@
+/*
+ * Winsock2 Linux Wrapper Load Generator
+ * Loopback TCP echo server and client driven through the Winsock API,
+ * reporting throughput, connection rate and a latency histogram
+ *
+ * Usage: loadgen_winsock [-c conns] [-t threads] [-s size] [-p depth]
+ *                        [-d seconds] [-k rounds] [--json]
+ *   -c  concurrent connections (64)
+ *   -t  client threads, and as many server workers (2)
+ *   -s  message size in bytes (64)
+ *   -p  messages in flight per connection (1)
+ *   -d  duration of the run in seconds (5)
+ *   -k  reconnect after this many round trips, 0 to keep connections (0)
+ *   --json  print the results as one JSON object
+ *
+ * The server accepts with AcceptEx and echoes with WSARecv/WSASend; both
+ * sides multiplex their sockets with WSAPoll. Completion ports are not
+ * available in this library and WSAEventSelect waits stop at
+ * WSA_MAXIMUM_WAIT_EVENTS, so WSAPoll is the scalable readiness call here.
+ */
+
+#include "winsock2.h"
+#include "ws2tcpip.h"
+#include "mswsock.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#define LOADGEN_RECV_BUFFER 65536
+#define LOADGEN_MAX_THREADS 64
+
+/* Log-linear latency buckets: exact below 16 ns, then 8 per power of two */
+#define HIST_SUB_BITS 3
+#define HIST_BUCKETS  320
+
+typedef struct LoadStats {
+    unsigned long long messages;
+    unsigned long long connects;
+    unsigned long long errors;
+    unsigned long long hist[HIST_BUCKETS];
+    unsigned long long max_ns;
+} LoadStats;
+
+/* One client connection and the send times of its messages in flight */
+typedef struct ClientConn {
+    SOCKET s;
+    long long* issued;          /* Ring of -p send times */
+    int head;
+    int inflight;
+    long to_send;               /* Bytes issued but not yet written */
+    long received;              /* Bytes of the current reply received */
+    long rounds;                /* Round trips since connecting */
+    int draining;               /* Waiting for replies before reconnecting */
+} ClientConn;
+
+typedef struct ClientThread {
+    pthread_t thread;
+    int count;
+    LoadStats stats;
+} ClientThread;
+
+/* Sockets handed over by the acceptor are picked up on the next poll */
+typedef struct ServerWorker {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    SOCKET* incoming;
+    int incoming_count;
+    int incoming_capacity;
+} ServerWorker;
+
+static int g_conns = 64;
+static int g_threads = 2;
+static long g_size = 64;
+static int g_depth = 1;
+static double g_duration = 5.0;
+static long g_reconnect = 0;
+static int g_json = 0;
+
+static struct sockaddr_in g_server_addr;
+static SOCKET g_listener = INVALID_SOCKET;
+static ServerWorker g_workers[LOADGEN_MAX_THREADS];
+static pthread_barrier_t g_start_barrier;
+static int g_stop = 0;
+static int g_server_stop = 0;
+static char* g_payload;
+
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* ============================================================================
+ * Latency Histogram
+ * ============================================================================ */
+
+static int hist_index(unsigned long long ns)
+{
+    int msb;
+    int index;
+
+    if (ns < (1ULL << (HIST_SUB_BITS + 1))) {
+        return (int)ns;
+    }
+    msb = 63 - __builtin_clzll(ns);
+    index = (1 << (HIST_SUB_BITS + 1)) + (msb - HIST_SUB_BITS - 1) * (1 << HIST_SUB_BITS) +
+            (int)((ns >> (msb - HIST_SUB_BITS)) & ((1 << HIST_SUB_BITS) - 1));
+    return index < HIST_BUCKETS ? index : HIST_BUCKETS - 1;
+}
+
+/* Highest value that falls in bucket index */
+static unsigned long long hist_high(int index)
+{
+    int msb;
+    int sub;
+
+    if (index < (1 << (HIST_SUB_BITS + 1))) {
+        return (unsigned long long)index;
+    }
+    index -= 1 << (HIST_SUB_BITS + 1);
+    msb = index / (1 << HIST_SUB_BITS) + HIST_SUB_BITS + 1;
+    sub = index % (1 << HIST_SUB_BITS);
+    return (((unsigned long long)((1 << HIST_SUB_BITS) + sub + 1)) << (msb - HIST_SUB_BITS)) - 1;
+}
+
+static void hist_record(LoadStats* stats, long long ns)
+{
+    if (ns < 0) {
+        ns = 0;
+    }
+    stats->hist[hist_index((unsigned long long)ns)]++;
+    if ((unsigned long long)ns > stats->max_ns) {
+        stats->max_ns = (unsigned long long)ns;
+    }
+}
+
+static unsigned long long hist_percentile(const LoadStats* stats, double p)
+{
+    unsigned long long rank;
+    unsigned long long seen;
+    int i;
+
+    if (stats->messages == 0) {
+        return 0;
+    }
+    rank = (unsigned long long)(p * (double)stats->messages);
+    if (rank == 0) {
+        rank = 1;
+    }
+    seen = 0;
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        seen += stats->hist[i];
+        if (seen >= rank) {
+            return hist_high(i) < stats->max_ns ? hist_high(i) : stats->max_ns;
+        }
+    }
+    return stats->max_ns;
+}
+
+static void format_ns(char* out, size_t len, double ns)
+{
+    if (ns < 1e3) {
+        snprintf(out, len, "%.0fns", ns);
+    } else if (ns < 1e6) {
+        snprintf(out, len, "%.1fus", ns / 1e3);
+    } else if (ns < 1e9) {
+        snprintf(out, len, "%.2fms", ns / 1e6);
+    } else {
+        snprintf(out, len, "%.2fs", ns / 1e9);
+    }
+}
+
+/* ============================================================================
+ * Echo Server
+ * ============================================================================ */
+
+static void* server_worker_thread(void* arg)
+{
+    ServerWorker* w;
+    WSAPOLLFD* fds;
+    WSAPOLLFD* grown;
+    char* buffer;
+    WSABUF buf;
+    DWORD bytes;
+    DWORD sent;
+    DWORD flags;
+    int capacity;
+    int count;
+    int ready;
+    int i;
+
+    w = (ServerWorker*)arg;
+    buffer = (char*)malloc(LOADGEN_RECV_BUFFER);
+    fds = NULL;
+    capacity = 0;
+    count = 0;
+
+    while (!__atomic_load_n(&g_server_stop, __ATOMIC_RELAXED)) {
+        pthread_mutex_lock(&w->mutex);
+        if (count + w->incoming_count > capacity) {
+            grown = (WSAPOLLFD*)realloc(fds, (size_t)(count + w->incoming_count + 64) *
+                                              sizeof(WSAPOLLFD));
+            if (grown != NULL) {
+                fds = grown;
+                capacity = count + w->incoming_count + 64;
+            }
+        }
+        /* Whatever does not fit stays queued for the next pass */
+        for (i = 0; i < w->incoming_count && count < capacity; i++) {
+            fds[count].fd = w->incoming[i];
+            fds[count].events = POLLRDNORM;
+            fds[count].revents = 0;
+            count++;
+        }
+        memmove(w->incoming, w->incoming + i, (size_t)(w->incoming_count - i) * sizeof(SOCKET));
+        w->incoming_count -= i;
+        pthread_mutex_unlock(&w->mutex);
+
+        ready = WSAPoll(fds, (ULONG)count, 10);
+        if (ready <= 0) {
+            continue;
+        }
+
+        /* Backwards, so a closed entry can be replaced by the last one */
+        for (i = count - 1; i >= 0; i--) {
+            if (fds[i].revents == 0) {
+                continue;
+            }
+            buf.buf = buffer;
+            buf.len = LOADGEN_RECV_BUFFER;
+            flags = 0;
+            if (WSARecv(fds[i].fd, &buf, 1, &bytes, &flags, NULL, NULL) == SOCKET_ERROR ||
+                bytes == 0) {
+                closesocket(fds[i].fd);
+                fds[i] = fds[--count];
+                continue;
+            }
+            buf.len = bytes;
+            while (buf.len > 0) {
+                if (WSASend(fds[i].fd, &buf, 1, &sent, 0, NULL, NULL) == SOCKET_ERROR) {
+                    break;
+                }
+                buf.buf += sent;
+                buf.len -= sent;
+            }
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        closesocket(fds[i].fd);
+    }
+    free(fds);
+    free(buffer);
+    return NULL;
+}
+
+static void* server_accept_thread(void* arg)
+{
+    ServerWorker* w;
+    SOCKET* grown;
+    SOCKET accepted;
+    DWORD received;
+    int next;
+    int one;
+
+    (void)arg;
+    next = 0;
+
+    while (!__atomic_load_n(&g_server_stop, __ATOMIC_RELAXED)) {
+        accepted = WSASocket(AF_INET, SOCK_STREAM, IPPROTO_TCP, NULL, 0, 0);
+        if (accepted == INVALID_SOCKET) {
+            break;
+        }
+        if (!AcceptEx(g_listener, accepted, NULL, 0, 0, 0, &received, NULL)) {
+            closesocket(accepted);
+            continue;
+        }
+        one = 1;
+        setsockopt(accepted, IPPROTO_TCP, TCP_NODELAY, (char*)&one, sizeof(one));
+
+        w = &g_workers[next];
+        next = (next + 1) % g_threads;
+        pthread_mutex_lock(&w->mutex);
+        if (w->incoming_count == w->incoming_capacity) {
+            grown = (SOCKET*)realloc(w->incoming, (size_t)(w->incoming_capacity + 64) *
+                                                  sizeof(SOCKET));
+            if (grown == NULL) {
+                pthread_mutex_unlock(&w->mutex);
+                closesocket(accepted);
+                continue;
+            }
+            w->incoming = grown;
+            w->incoming_capacity += 64;
+        }
+        w->incoming[w->incoming_count++] = accepted;
+        pthread_mutex_unlock(&w->mutex);
+    }
+    return NULL;
+}
+
+/* ============================================================================
+ * Client
+ * ============================================================================ */
+
+static int client_connect(ClientConn* c, LoadStats* stats)
+{
+    unsigned long nonblocking;
+    int one;
+
+    c->s = WSASocket(AF_INET, SOCK_STREAM, IPPROTO_TCP, NULL, 0, 0);
+    if (c->s == INVALID_SOCKET) {
+        stats->errors++;
+        return -1;
+    }
+    if (connect(c->s, (struct sockaddr*)&g_server_addr, sizeof(g_server_addr)) == SOCKET_ERROR) {
+        closesocket(c->s);
+        c->s = INVALID_SOCKET;
+        stats->errors++;
+        return -1;
+    }
+    one = 1;
+    setsockopt(c->s, IPPROTO_TCP, TCP_NODELAY, (char*)&one, sizeof(one));
+    nonblocking = 1;
+    ioctlsocket(c->s, FIONBIO, &nonblocking);
+
+    c->head = 0;
+    c->inflight = 0;
+    c->to_send = 0;
+    c->received = 0;
+    c->rounds = 0;
+    c->draining = 0;
+    stats->connects++;
+    return 0;
+}
+
+static void client_issue(ClientConn* c, long long now)
+{
+    c->issued[(c->head + c->inflight) % g_depth] = now;
+    c->inflight++;
+    c->to_send += g_size;
+}
+
+/* Write as much of the issued data as the socket takes; -1 on error */
+static int client_flush(ClientConn* c)
+{
+    WSABUF buf;
+    DWORD sent;
+
+    while (c->to_send > 0) {
+        buf.buf = g_payload;
+        buf.len = (ULONG)(c->to_send < g_size ? c->to_send : g_size);
+        if (WSASend(c->s, &buf, 1, &sent, 0, NULL, NULL) == SOCKET_ERROR) {
+            return WSAGetLastError() == WSAEWOULDBLOCK ? 0 : -1;
+        }
+        c->to_send -= (long)sent;
+    }
+    return 0;
+}
+
+/* Read replies and record their round trips; -1 on error or close */
+static int client_drain(ClientConn* c, char* buffer, LoadStats* stats)
+{
+    WSABUF buf;
+    DWORD bytes;
+    DWORD flags;
+    long long now;
+
+    while (1) {
+        buf.buf = buffer;
+        buf.len = LOADGEN_RECV_BUFFER;
+        flags = 0;
+        if (WSARecv(c->s, &buf, 1, &bytes, &flags, NULL, NULL) == SOCKET_ERROR) {
+            return WSAGetLastError() == WSAEWOULDBLOCK ? 0 : -1;
+        }
+        if (bytes == 0) {
+            return -1;
+        }
+
+        now = now_ns();
+        c->received += (long)bytes;
+        while (c->received >= g_size && c->inflight > 0) {
+            c->received -= g_size;
+            hist_record(stats, now - c->issued[c->head]);
+            stats->messages++;
+            c->head = (c->head + 1) % g_depth;
+            c->inflight--;
+            c->rounds++;
+
+            if (g_reconnect > 0 && c->rounds % g_reconnect == 0) {
+                c->draining = 1;
+            }
+            if (!c->draining && !__atomic_load_n(&g_stop, __ATOMIC_RELAXED)) {
+                client_issue(c, now);
+            }
+        }
+    }
+}
+
+static void* client_thread(void* arg)
+{
+    ClientThread* t;
+    ClientConn* conns;
+    WSAPOLLFD* fds;
+    char* buffer;
+    long long now;
+    int failed;
+    int i;
+    int j;
+
+    t = (ClientThread*)arg;
+    conns = (ClientConn*)calloc((size_t)t->count, sizeof(ClientConn));
+    fds = (WSAPOLLFD*)calloc((size_t)t->count, sizeof(WSAPOLLFD));
+    buffer = (char*)malloc(LOADGEN_RECV_BUFFER);
+
+    for (i = 0; i < t->count; i++) {
+        conns[i].issued = (long long*)calloc((size_t)g_depth, sizeof(long long));
+        client_connect(&conns[i], &t->stats);
+    }
+
+    pthread_barrier_wait(&g_start_barrier);
+
+    now = now_ns();
+    for (i = 0; i < t->count; i++) {
+        for (j = 0; j < g_depth && conns[i].s != INVALID_SOCKET; j++) {
+            client_issue(&conns[i], now);
+        }
+    }
+
+    while (!__atomic_load_n(&g_stop, __ATOMIC_RELAXED)) {
+        for (i = 0; i < t->count; i++) {
+            failed = conns[i].s == INVALID_SOCKET || client_flush(&conns[i]) < 0;
+
+            /* All replies in: start over on a fresh connection */
+            if (!failed && conns[i].draining && conns[i].inflight == 0) {
+                closesocket(conns[i].s);
+                failed = client_connect(&conns[i], &t->stats) < 0;
+                now = now_ns();
+                for (j = 0; j < g_depth && !failed; j++) {
+                    client_issue(&conns[i], now);
+                }
+                failed = failed || client_flush(&conns[i]) < 0;
+            }
+            if (failed && conns[i].s != INVALID_SOCKET) {
+                t->stats.errors++;
+                closesocket(conns[i].s);
+                conns[i].s = INVALID_SOCKET;
+            }
+
+            fds[i].fd = conns[i].s;
+            fds[i].events = (short)(POLLRDNORM | (conns[i].to_send > 0 ? POLLWRNORM : 0));
+            fds[i].revents = 0;
+        }
+
+        if (WSAPoll(fds, (ULONG)t->count, 100) <= 0) {
+            continue;
+        }
+
+        for (i = 0; i < t->count; i++) {
+            if (conns[i].s == INVALID_SOCKET || !(fds[i].revents & (POLLRDNORM | POLLHUP | POLLERR))) {
+                continue;
+            }
+            if (client_drain(&conns[i], buffer, &t->stats) < 0) {
+                t->stats.errors++;
+                closesocket(conns[i].s);
+                conns[i].s = INVALID_SOCKET;
+            }
+        }
+    }
+
+    for (i = 0; i < t->count; i++) {
+        if (conns[i].s != INVALID_SOCKET) {
+            closesocket(conns[i].s);
+        }
+        free(conns[i].issued);
+    }
+    free(buffer);
+    free(fds);
+    free(conns);
+    return NULL;
+}
+
+/* ============================================================================
+ * Report
+ * ============================================================================ */
+
+static void report(const LoadStats* total, double setup_ns, double run_ns)
+{
+    unsigned long long rows[64];
+    unsigned long long reconnects;
+    unsigned long long high;
+    char a[32];
+    char b[32];
+    double msg_rate;
+    double mbytes;
+    int bars;
+    int i;
+
+    reconnects = total->connects > (unsigned long long)g_conns ?
+                 total->connects - (unsigned long long)g_conns : 0;
+    msg_rate = (double)total->messages / (run_ns / 1e9);
+    mbytes = msg_rate * (double)g_size / 1e6;
+
+    if (g_json) {
+        printf("{\"connections\":%d,\"threads\":%d,\"message_size\":%ld,\"pipeline\":%d,"
+               "\"duration_s\":%.3f,\"setup_conn_per_s\":%.0f,\"reconnects\":%llu,"
+               "\"reconnect_per_s\":%.0f,\"errors\":%llu,\"messages\":%llu,"
+               "\"msg_per_s\":%.0f,\"mbytes_per_s\":%.2f,\"p50_ns\":%llu,\"p90_ns\":%llu,"
+               "\"p99_ns\":%llu,\"p999_ns\":%llu,\"max_ns\":%llu}\n",
+               g_conns, g_threads, g_size, g_depth, run_ns / 1e9,
+               (double)g_conns / (setup_ns / 1e9), reconnects,
+               (double)reconnects / (run_ns / 1e9), total->errors, total->messages,
+               msg_rate, mbytes,
+               hist_percentile(total, 0.50), hist_percentile(total, 0.90),
+               hist_percentile(total, 0.99), hist_percentile(total, 0.999),
+               total->max_ns);
+        return;
+    }
+
+    printf("Loopback echo: %d connections, %d threads, %ld-byte messages, pipeline %d, %.1f s\n\n",
+           g_conns, g_threads, g_size, g_depth, run_ns / 1e9);
+    format_ns(a, sizeof(a), setup_ns);
+    printf("  %-14s %d in %s (%.0f conn/s)\n", "connect", g_conns, a,
+           (double)g_conns / (setup_ns / 1e9));
+    if (g_reconnect > 0) {
+        printf("  %-14s %llu (%.0f conn/s)\n", "reconnects", reconnects,
+               (double)reconnects / (run_ns / 1e9));
+    }
+    printf("  %-14s %llu (%.0f msg/s)\n", "messages", total->messages, msg_rate);
+    printf("  %-14s %.2f MB/s each way\n", "throughput", mbytes);
+    printf("  %-14s %llu\n", "errors", total->errors);
+
+    printf("\n  Latency");
+    format_ns(a, sizeof(a), (double)hist_percentile(total, 0.50));
+    printf("  p50 %s", a);
+    format_ns(a, sizeof(a), (double)hist_percentile(total, 0.90));
+    printf("  p90 %s", a);
+    format_ns(a, sizeof(a), (double)hist_percentile(total, 0.99));
+    printf("  p99 %s", a);
+    format_ns(a, sizeof(a), (double)hist_percentile(total, 0.999));
+    printf("  p99.9 %s", a);
+    format_ns(a, sizeof(a), (double)total->max_ns);
+    printf("  max %s\n\n", a);
+
+    /* One row per power of two */
+    memset(rows, 0, sizeof(rows));
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        high = hist_high(i);
+        rows[high > 0 ? 63 - __builtin_clzll(high) : 0] += total->hist[i];
+    }
+    for (i = 0; i < 64; i++) {
+        if (rows[i] == 0) {
+            continue;
+        }
+        format_ns(a, sizeof(a), i == 0 ? 0.0 : (double)(1ULL << i));
+        format_ns(b, sizeof(b), (double)(2ULL << i));
+        bars = (int)(50.0 * (double)rows[i] / (double)total->messages + 0.5);
+        printf("  %8s - %-8s %10llu %5.1f%% %.*s\n", a, b, rows[i],
+               100.0 * (double)rows[i] / (double)total->messages, bars,
+               "##################################################");
+    }
+}
+
+/* ============================================================================
+ * Main
+ * ============================================================================ */
+
+static int parse_args(int argc, char** argv)
+{
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            g_json = 1;
+        } else if (i + 1 < argc && strcmp(argv[i], "-c") == 0) {
+            g_conns = atoi(argv[++i]);
+        } else if (i + 1 < argc && strcmp(argv[i], "-t") == 0) {
+            g_threads = atoi(argv[++i]);
+        } else if (i + 1 < argc && strcmp(argv[i], "-s") == 0) {
+            g_size = atol(argv[++i]);
+        } else if (i + 1 < argc && strcmp(argv[i], "-p") == 0) {
+            g_depth = atoi(argv[++i]);
+        } else if (i + 1 < argc && strcmp(argv[i], "-d") == 0) {
+            g_duration = atof(argv[++i]);
+        } else if (i + 1 < argc && strcmp(argv[i], "-k") == 0) {
+            g_reconnect = atol(argv[++i]);
+        } else {
+            return -1;
+        }
+    }
+
+    if (g_conns < 1 || g_threads < 1 || g_threads > LOADGEN_MAX_THREADS ||
+        g_size < 1 || g_depth < 1 || g_duration <= 0 || g_reconnect < 0) {
+        return -1;
+    }
+    if (g_threads > g_conns) {
+        g_threads = g_conns;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    WSADATA wsaData;
+    ClientThread* clients;
+    LoadStats total;
+    pthread_t acceptor;
+    struct timespec pause;
+    socklen_t len;
+    long long setup_start;
+    long long run_start;
+    long long run_end;
+    int i;
+    int j;
+
+    if (parse_args(argc, argv) < 0) {
+        fprintf(stderr, "usage: %s [-c conns] [-t threads] [-s size] [-p depth] "
+                "[-d seconds] [-k rounds] [--json]\n", argv[0]);
+        return 2;
+    }
+
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        fprintf(stderr, "WSAStartup failed\n");
+        return 1;
+    }
+
+    g_payload = (char*)malloc((size_t)g_size);
+    memset(g_payload, 'x', (size_t)g_size);
+
+    /* Echo server on an ephemeral loopback port */
+    g_listener = WSASocket(AF_INET, SOCK_STREAM, IPPROTO_TCP, NULL, 0, 0);
+    memset(&g_server_addr, 0, sizeof(g_server_addr));
+    g_server_addr.sin_family = AF_INET;
+    g_server_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    len = sizeof(g_server_addr);
+    if (g_listener == INVALID_SOCKET ||
+        bind(g_listener, (struct sockaddr*)&g_server_addr, sizeof(g_server_addr)) == SOCKET_ERROR ||
+        listen(g_listener, SOMAXCONN) == SOCKET_ERROR ||
+        getsockname(g_listener, (struct sockaddr*)&g_server_addr, &len) == SOCKET_ERROR) {
+        fprintf(stderr, "Could not start the echo server (%d)\n", WSAGetLastError());
+        WSACleanup();
+        return 1;
+    }
+
+    for (i = 0; i < g_threads; i++) {
+        pthread_mutex_init(&g_workers[i].mutex, NULL);
+        pthread_create(&g_workers[i].thread, NULL, server_worker_thread, &g_workers[i]);
+    }
+    pthread_create(&acceptor, NULL, server_accept_thread, NULL);
+
+    /* Clients connect, then start together once every connection is up */
+    clients = (ClientThread*)calloc((size_t)g_threads, sizeof(ClientThread));
+    pthread_barrier_init(&g_start_barrier, NULL, (unsigned int)g_threads + 1);
+    setup_start = now_ns();
+    for (i = 0; i < g_threads; i++) {
+        clients[i].count = (i + 1) * g_conns / g_threads - i * g_conns / g_threads;
+        pthread_create(&clients[i].thread, NULL, client_thread, &clients[i]);
+    }
+    pthread_barrier_wait(&g_start_barrier);
+    run_start = now_ns();
+
+    pause.tv_sec = (time_t)g_duration;
+    pause.tv_nsec = (long)((g_duration - (double)pause.tv_sec) * 1e9);
+    nanosleep(&pause, NULL);
+    __atomic_store_n(&g_stop, 1, __ATOMIC_RELAXED);
+
+    memset(&total, 0, sizeof(total));
+    for (i = 0; i < g_threads; i++) {
+        pthread_join(clients[i].thread, NULL);
+        total.messages += clients[i].stats.messages;
+        total.connects += clients[i].stats.connects;
+        total.errors += clients[i].stats.errors;
+        for (j = 0; j < HIST_BUCKETS; j++) {
+            total.hist[j] += clients[i].stats.hist[j];
+        }
+        if (clients[i].stats.max_ns > total.max_ns) {
+            total.max_ns = clients[i].stats.max_ns;
+        }
+    }
+    run_end = now_ns();
+
+    /* Shutting the listener down wakes the acceptor blocked in AcceptEx */
+    __atomic_store_n(&g_server_stop, 1, __ATOMIC_RELAXED);
+    shutdown(g_listener, SD_BOTH);
+    pthread_join(acceptor, NULL);
+    for (i = 0; i < g_threads; i++) {
+        pthread_join(g_workers[i].thread, NULL);
+        free(g_workers[i].incoming);
+    }
+    closesocket(g_listener);
+
+    report(&total, (double)(run_start - setup_start), (double)(run_end - run_start));
+
+    pthread_barrier_destroy(&g_start_barrier);
+    free(clients);
+    free(g_payload);
+    WSACleanup();
+    return 0;
+}
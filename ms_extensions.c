@@ -6,6 +6,7 @@
 #ifdef __linux__
 
 #include "winsock2_api.h"
+#include "wsa_internal.h"
 #include "ws2tcpip.h"
 #include "mswsock.h"
 #include <sys/sendfile.h>
@@ -29,6 +30,8 @@ BOOL WINAPI AcceptEx(
     socklen_t addrlen;
     int result;
     ssize_t recv_result;
+    long long record_start;
+    WSA_STATS_SCOPE(AcceptEx);
 
     (void)lpOverlapped; /* Overlapped I/O not fully supported */
     (void)dwLocalAddressLength;
@@ -37,18 +40,26 @@ BOOL WINAPI AcceptEx(
     /* First, we need to accept the connection on sAcceptSocket */
     /* Since sAcceptSocket should already be created, we'll use dup2 to replace it */
 
+    recv_result = 0;
+    WSA_PROBE2(acceptex__start, sListenSocket, sAcceptSocket);
+
     addrlen = sizeof(addr);
-    result = accept((int)sListenSocket, (struct sockaddr*)&addr, &addrlen);
+    record_start = WSA_RECORD_START();
+    result = wsa_listener_accept(sListenSocket, (struct sockaddr*)&addr, &addrlen);
+    WSA_RECORD(AcceptEx, sListenSocket, dwReceiveDataLength,
+               result < 0 ? -1 : (long long)sAcceptSocket, record_start);
 
     if (result < 0) {
-        g_wsa_last_error = WSAECONNREFUSED;
+        set_wsa_error_from_errno();
+        WSA_PROBE3(acceptex__done, sAcceptSocket, -1, g_wsa_last_error);
         return FALSE;
     }
 
     /* Duplicate the accepted socket to sAcceptSocket */
     if (dup2(result, (int)sAcceptSocket) < 0) {
+        set_wsa_error_from_errno();
         close(result);
-        g_wsa_last_error = WSAEINVAL;
+        WSA_PROBE3(acceptex__done, sAcceptSocket, -1, g_wsa_last_error);
         return FALSE;
     }
 
@@ -61,10 +72,13 @@ BOOL WINAPI AcceptEx(
                           dwReceiveDataLength, 0);
 
         if (recv_result < 0) {
-            g_wsa_last_error = WSAECONNRESET;
+            set_wsa_error_from_errno();
+            WSA_PROBE3(acceptex__done, sAcceptSocket, -1, g_wsa_last_error);
             return FALSE;
         }
 
+        WSA_STATS_BYTES(recv_result);
+        wsa_socket_count_recv(sAcceptSocket, recv_result);
         if (lpdwBytesReceived != NULL) {
             *lpdwBytesReceived = (DWORD)recv_result;
         }
@@ -86,6 +100,7 @@ BOOL WINAPI AcceptEx(
         memcpy((char*)lpOutputBuffer + dwLocalAddressLength, &addr, dwRemoteAddressLength);
     }
 
+    WSA_PROBE3(acceptex__done, sAcceptSocket, recv_result, 0);
     g_wsa_last_error = 0;
     return TRUE;
 }
@@ -136,7 +151,9 @@ BOOL WINAPI TransmitFile(
 {
     off_t offset;
     ssize_t sent;
+    long long total;
     int fd;
+    WSA_STATS_SCOPE(TransmitFile);
 
     (void)nNumberOfBytesPerSend;
     (void)lpOverlapped;
@@ -144,15 +161,20 @@ BOOL WINAPI TransmitFile(
 
     fd = (int)(intptr_t)hFile;
 
+    total = 0;
+    WSA_PROBE2(transmitfile__start, hSocket, nNumberOfBytesToWrite);
+
     /* Send head buffer if provided */
     if (lpTransmitBuffers != NULL && lpTransmitBuffers->Head != NULL &&
         lpTransmitBuffers->HeadLength > 0) {
         sent = send((int)hSocket, lpTransmitBuffers->Head,
                    lpTransmitBuffers->HeadLength, 0);
         if (sent < 0) {
-            g_wsa_last_error = WSAECONNRESET;
+            set_wsa_error_from_errno();
+            WSA_PROBE3(transmitfile__done, hSocket, -1, g_wsa_last_error);
             return FALSE;
         }
+        total += sent;
     }
 
     /* Send file data */
@@ -160,9 +182,12 @@ BOOL WINAPI TransmitFile(
         offset = 0;
         sent = sendfile((int)hSocket, fd, &offset, nNumberOfBytesToWrite);
         if (sent < 0) {
-            g_wsa_last_error = WSAECONNRESET;
+            set_wsa_error_from_errno();
+            WSA_PROBE3(transmitfile__done, hSocket, -1, g_wsa_last_error);
             return FALSE;
         }
+        WSA_STATS_BYTES(sent);
+        total += sent;
     }
 
     /* Send tail buffer if provided */
@@ -171,11 +196,14 @@ BOOL WINAPI TransmitFile(
         sent = send((int)hSocket, lpTransmitBuffers->Tail,
                    lpTransmitBuffers->TailLength, 0);
         if (sent < 0) {
-            g_wsa_last_error = WSAECONNRESET;
+            set_wsa_error_from_errno();
+            WSA_PROBE3(transmitfile__done, hSocket, -1, g_wsa_last_error);
             return FALSE;
         }
+        total += sent;
     }
 
+    WSA_PROBE3(transmitfile__done, hSocket, total, 0);
     g_wsa_last_error = 0;
     return TRUE;
 }
@@ -195,18 +223,27 @@ BOOL WINAPI ConnectEx(
 {
     int result;
     ssize_t sent;
+    long long record_start;
+    WSA_STATS_SCOPE(ConnectEx);
 
     (void)lpOverlapped;
 
+    sent = 0;
+    WSA_PROBE2(connectex__start, s, dwSendDataLength);
+
     /* Perform connection */
+    record_start = WSA_RECORD_START();
     result = connect((int)s, name, (socklen_t)namelen);
+    WSA_RECORD(ConnectEx, s, dwSendDataLength, result, record_start);
 
     if (result < 0) {
         if (errno == EINPROGRESS) {
             g_wsa_last_error = WSA_IO_PENDING;
+            WSA_PROBE3(connectex__done, s, -1, g_wsa_last_error);
             return FALSE;
         }
-        g_wsa_last_error = WSAECONNREFUSED;
+        set_wsa_error_from_errno();
+        WSA_PROBE3(connectex__done, s, -1, g_wsa_last_error);
         return FALSE;
     }
 
@@ -214,9 +251,12 @@ BOOL WINAPI ConnectEx(
     if (lpSendBuffer != NULL && dwSendDataLength > 0) {
         sent = send((int)s, lpSendBuffer, dwSendDataLength, 0);
         if (sent < 0) {
-            g_wsa_last_error = WSAECONNRESET;
+            set_wsa_error_from_errno();
+            WSA_PROBE3(connectex__done, s, -1, g_wsa_last_error);
             return FALSE;
         }
+        WSA_STATS_BYTES(sent);
+        wsa_socket_count_send(s, sent);
         if (lpdwBytesSent != NULL) {
             *lpdwBytesSent = (DWORD)sent;
         }
@@ -226,6 +266,7 @@ BOOL WINAPI ConnectEx(
         }
     }
 
+    WSA_PROBE3(connectex__done, s, sent, 0);
     g_wsa_last_error = 0;
     return TRUE;
 }
@@ -245,11 +286,14 @@ BOOL WINAPI DisconnectEx(
     (void)lpOverlapped;
     (void)dwReserved;
 
+    WSA_PROBE2(disconnectex__start, s, dwFlags);
+
     /* Shutdown the connection */
     result = shutdown((int)s, SHUT_RDWR);
 
     if (result < 0) {
-        g_wsa_last_error = WSAENOTCONN;
+        set_wsa_error_from_errno();
+        WSA_PROBE3(disconnectex__done, s, -1, g_wsa_last_error);
         return FALSE;
     }
 
@@ -258,6 +302,7 @@ BOOL WINAPI DisconnectEx(
         close((int)s);
     }
 
+    WSA_PROBE3(disconnectex__done, s, 0, 0);
     g_wsa_last_error = 0;
     return TRUE;
 }
@@ -292,7 +337,7 @@ BOOL WINAPI TransmitPackets(
             sent = send((int)hSocket, lpPacketArray[i].pBuffer,
                        lpPacketArray[i].cLength, 0);
             if (sent < 0) {
-                g_wsa_last_error = WSAECONNRESET;
+                set_wsa_error_from_errno();
                 return FALSE;
             }
         } else if (lpPacketArray[i].dwElFlags & TP_ELEMENT_FILE) {
@@ -305,7 +350,7 @@ BOOL WINAPI TransmitPackets(
 
             sent = sendfile((int)hSocket, fd, &offset, lpPacketArray[i].cLength);
             if (sent < 0) {
-                g_wsa_last_error = WSAECONNRESET;
+                set_wsa_error_from_errno();
                 return FALSE;
             }
         }
@@ -425,15 +470,41 @@ BOOL WSAAPI WSAGetOverlappedResult(SOCKET s, LPWSAOVERLAPPED lpOverlapped,
                                    DWORD* lpcbTransfer, BOOL fWait,
                                    DWORD* lpdwFlags)
 {
+    ULONG_PTR status;
+
     (void)s;
-    (void)lpOverlapped;
-    (void)lpcbTransfer;
-    (void)fWait;
-    (void)lpdwFlags;
 
-    /* Overlapped I/O not fully supported */
-    g_wsa_last_error = WSAEOPNOTSUPP;
-    return FALSE;
+    if (lpOverlapped == NULL || lpcbTransfer == NULL || lpdwFlags == NULL) {
+        g_wsa_last_error = WSAEFAULT;
+        return FALSE;
+    }
+
+    /* Completions store Internal last, so InternalHigh is valid after it */
+    status = __atomic_load_n(&lpOverlapped->Internal, __ATOMIC_ACQUIRE);
+    while (status == STATUS_PENDING) {
+        if (!fWait) {
+            g_wsa_last_error = WSA_IO_INCOMPLETE;
+            return FALSE;
+        }
+        if (lpOverlapped->hEvent != NULL) {
+            WSAWaitForMultipleEvents_internal(1, &lpOverlapped->hEvent, TRUE, WSA_INFINITE, FALSE);
+        } else {
+            poll(NULL, 0, 1);
+        }
+        status = __atomic_load_n(&lpOverlapped->Internal, __ATOMIC_ACQUIRE);
+    }
+
+    *lpcbTransfer = (DWORD)lpOverlapped->InternalHigh;
+    *lpdwFlags = 0;
+
+    /* Internal holds the WSA error code of a failed operation */
+    if (status != 0) {
+        g_wsa_last_error = (int)status;
+        return FALSE;
+    }
+
+    g_wsa_last_error = 0;
+    return TRUE;
 }
 
 #endif /* __linux__ */
@@ -0,0 +1,121 @@
+/*
+ * mstcpip.h - Microsoft TCP/IP specific definitions for Winsock2
+ * Compatible header for compiling Windows socket applications on Linux
+ */
+
+#ifndef _MSTCPIP_H
+#define _MSTCPIP_H
+
+#include "ws2tcpip.h"
+
+#ifdef __linux__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef __GNUC__
+#pragma GCC visibility push(default)
+#endif
+
+/* ============================================================================
+ * Vendor IOCTL Codes
+ * ============================================================================ */
+
+#define SIO_KEEPALIVE_VALS      _WSAIOW(IOC_VENDOR,4)
+#define SIO_LOOPBACK_FAST_PATH  _WSAIOW(IOC_VENDOR,16)
+#define SIO_TCP_INFO            _WSAIORW(IOC_VENDOR,39)
+
+/*
+ * Wrapper extension: DWORD input, the number of SO_REUSEPORT listeners
+ * (0 = one per CPU) that accept() on this socket draws from. Issue it
+ * before bind().
+ */
+#define SIO_ACCEPT_SHARDS       _WSAIOW(IOC_VENDOR,0x1000)
+
+/*
+ * Wrapper extension: an array of IP_ADDRESS_PREFIX whose packets the
+ * kernel drops before they reach the socket, so denied peers never
+ * complete a handshake. Replaces the previous list; an empty one removes it.
+ */
+#define SIO_ACCEPT_DENYLIST     _WSAIOW(IOC_VENDOR,0x1001)
+
+/*
+ * Wrapper extension: no input, a WSA_SOCKET_STATS for the socket as
+ * output. WSAEnumSocketStats returns the same record for every open
+ * socket the library has seen.
+ */
+#define SIO_SOCKET_STATS        _WSAIOR(IOC_VENDOR,0x1002)
+
+typedef struct _IP_ADDRESS_PREFIX {
+    SOCKADDR_INET Prefix;
+    BYTE PrefixLength;
+} IP_ADDRESS_PREFIX, *PIP_ADDRESS_PREFIX;
+
+/* SIO_KEEPALIVE_VALS input; times in milliseconds */
+struct tcp_keepalive {
+    ULONG onoff;
+    ULONG keepalivetime;
+    ULONG keepaliveinterval;
+};
+
+/* TCP_INFO_v0.State values */
+typedef enum _TCPSTATE {
+    TCPSTATE_CLOSED,
+    TCPSTATE_LISTEN,
+    TCPSTATE_SYN_SENT,
+    TCPSTATE_SYN_RCVD,
+    TCPSTATE_ESTABLISHED,
+    TCPSTATE_FIN_WAIT_1,
+    TCPSTATE_FIN_WAIT_2,
+    TCPSTATE_CLOSE_WAIT,
+    TCPSTATE_CLOSING,
+    TCPSTATE_LAST_ACK,
+    TCPSTATE_TIME_WAIT,
+    TCPSTATE_MAX
+} TCPSTATE;
+
+/*
+ * SIO_SOCKET_STATS output. Traffic counts cover the WSASend/WSARecv
+ * family, AcceptEx and ConnectEx since the socket was opened; plain
+ * send()/recv() go straight to the kernel and are not seen.
+ */
+typedef struct _WSA_SOCKET_STATS {
+    SOCKET Socket;
+    INT Family;
+    INT Type;
+    INT Protocol;
+    LONG EventSelectMask;       /* WSAEventSelect lNetworkEvents, 0 if none */
+    LONG AsyncSelectMask;       /* WSAAsyncSelect lEvent, 0 if none */
+    DWORD PendingOverlapped;    /* Overlapped requests not yet completed */
+    ULONGLONG BytesSent;
+    ULONGLONG BytesReceived;
+    ULONGLONG MessagesSent;     /* Successful send calls */
+    ULONGLONG MessagesReceived;
+    ULONGLONG SendWouldBlock;   /* Send calls that failed with WSAEWOULDBLOCK */
+    ULONGLONG ReceiveWouldBlock;
+    BOOL TcpInfoValid;          /* TCP sockets only */
+    TCP_INFO_v0 TcpInfo;
+} WSA_SOCKET_STATS, *PWSA_SOCKET_STATS, *LPWSA_SOCKET_STATS;
+
+/*
+ * Fill lpStats with up to *lpdwCount records, one per open socket, and
+ * set *lpdwCount to the number written. When the buffer is too small it
+ * fails with WSAEFAULT and *lpdwCount holds the number needed.
+ */
+int WSAAPI WSAEnumSocketStats(LPWSA_SOCKET_STATS lpStats, DWORD* lpdwCount);
+
+#ifdef __GNUC__
+#pragma GCC visibility pop
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#else
+/* On Windows, include the real mstcpip.h */
+#include <mstcpip.h>
+#endif
+
+#endif /* _MSTCPIP_H */
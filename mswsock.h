@@ -15,6 +15,10 @@
 extern "C" {
 #endif
 
+#ifdef __GNUC__
+#pragma GCC visibility push(default)
+#endif
+
 /* ============================================================================
  * GUIDs for Extension Functions
  * ============================================================================ */
@@ -250,6 +254,13 @@ BOOL WINAPI TransmitPackets(
     DWORD dwFlags
 );
 
+/* Always fails with WSAEINVAL; use WSAIoctl(SIO_GET_EXTENSION_FUNCTION_POINTER) */
+int WSAAPI WSAGetExtensionFunctionPointer(
+    SOCKET s,
+    const GUID* lpGuid,
+    void** lpfnFunction
+);
+
 /* Completion port functions */
 typedef HANDLE (WINAPI *LPFN_CREATEIOCOMPLETIONPORT)(
     HANDLE FileHandle,
@@ -304,6 +315,10 @@ BOOL WINAPI GetQueuedCompletionStatusEx(
     BOOL fAlertable
 );
 
+#ifdef __GNUC__
+#pragma GCC visibility pop
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,664 @@
+/*
+ * Winsock2 Linux Wrapper Property Tests
+ * Differential tests of the address and message paths against glibc on
+ * generated inputs: WSAStringToAddressA and InetPtonA against inet_pton,
+ * WSAAddressToStringA/W against inet_ntop, GetAddrInfoW against
+ * getaddrinfo, and WSARecvMsg control-buffer truncation against the
+ * kernel's rules
+ *
+ * Usage: proptest_winsock [-n cases] [-s seed]
+ *   -n  cases per property (20000)
+ *   -s  generator seed (time of day); printed so a failure can be rerun
+ *
+ * Generated strings are mostly well-formed and then mutated (leading
+ * zeros, out-of-range fields, misplaced separators, stray characters),
+ * so both the accept and the reject paths are covered. The first
+ * counterexample of each property is printed and the exit status is 1.
+ */
+
+#include "winsock2.h"
+#include "ws2tcpip.h"
+#include "mswsock.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <wchar.h>
+
+#define PROP_CANARY     0xA5
+#define PROP_CANARY_LEN 16
+
+static long g_cases = 20000;
+static unsigned long long g_seed = 0;
+static unsigned long long g_rng;
+static int g_failures = 0;
+
+/* xorshift64*: small, fast and reproducible from the seed */
+static unsigned long long rng_next(void)
+{
+    g_rng ^= g_rng >> 12;
+    g_rng ^= g_rng << 25;
+    g_rng ^= g_rng >> 27;
+    return g_rng * 0x2545F4914F6CDD1DULL;
+}
+
+static unsigned int rng_below(unsigned int n)
+{
+    return (unsigned int)(rng_next() % n);
+}
+
+static int fail(const char* property, const char* input, const char* detail)
+{
+    if (g_failures++ < 20) {
+        printf("  FAILED %s: input \"%s\": %s\n", property, input, detail);
+    }
+    return -1;
+}
+
+/* ============================================================================
+ * Generators
+ * ============================================================================ */
+
+/* Replace, insert or delete one character */
+static void mutate(char* s, size_t cap)
+{
+    static const char chars[] = "0123456789abcdefABCDEF:.[]% xg-";
+    size_t len;
+    size_t at;
+
+    len = strlen(s);
+    at = len > 0 ? rng_below((unsigned int)len + 1) : 0;
+    switch (rng_below(3)) {
+    case 0:
+        if (at < len) {
+            s[at] = chars[rng_below(sizeof(chars) - 1)];
+        }
+        break;
+    case 1:
+        if (len + 1 < cap) {
+            memmove(s + at + 1, s + at, len - at + 1);
+            s[at] = chars[rng_below(sizeof(chars) - 1)];
+        }
+        break;
+    default:
+        if (at < len) {
+            memmove(s + at, s + at + 1, len - at);
+        }
+        break;
+    }
+}
+
+static void gen_ipv4(char* out, size_t cap)
+{
+    int n;
+    int i;
+
+    n = 0;
+    for (i = 0; i < 4; i++) {
+        switch (rng_below(8)) {
+        case 0:
+            n += snprintf(out + n, cap - (size_t)n, "0%u", rng_below(10));
+            break;
+        case 1:
+            n += snprintf(out + n, cap - (size_t)n, "%u", 250 + rng_below(10));
+            break;
+        default:
+            n += snprintf(out + n, cap - (size_t)n, "%u", rng_below(256));
+            break;
+        }
+        if (i < 3) {
+            n += snprintf(out + n, cap - (size_t)n, ".");
+        }
+    }
+    if (rng_below(4) == 0) {
+        mutate(out, cap);
+    }
+}
+
+/* Random words with zero runs, then rendered with or without "::" */
+static void gen_ipv6(char* out, size_t cap)
+{
+    unsigned int words[8];
+    int run_start;
+    int run_len;
+    int tail_v4;
+    int n;
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        words[i] = rng_below(3) == 0 ? 0 : rng_below(4) == 0 ? rng_below(16) : rng_below(65536);
+    }
+    run_start = rng_below(8);
+    run_len = rng_below(9 - (unsigned int)run_start);
+    for (i = run_start; i < run_start + run_len; i++) {
+        words[i] = 0;
+    }
+    tail_v4 = rng_below(5) == 0;
+
+    n = 0;
+    for (i = 0; i < (tail_v4 ? 6 : 8); i++) {
+        if (run_len >= 1 && rng_below(2) == 0 && i == run_start) {
+            n += snprintf(out + n, cap - (size_t)n, "%s:", i == 0 ? ":" : "");
+            i += run_len - 1;
+            if (i == (tail_v4 ? 5 : 7)) {
+                n += snprintf(out + n, cap - (size_t)n, "%s", tail_v4 ? "" : ":");
+                if (!tail_v4) {
+                    out[--n] = '\0';
+                }
+            }
+            continue;
+        }
+        n += snprintf(out + n, cap - (size_t)n, rng_below(2) ? "%x" : "%X", words[i]);
+        if (i < (tail_v4 ? 5 : 7) || tail_v4) {
+            n += snprintf(out + n, cap - (size_t)n, ":");
+        }
+    }
+    if (tail_v4) {
+        gen_ipv4(out + n, cap - (size_t)n);
+    }
+    if (rng_below(4) == 0) {
+        mutate(out, cap);
+    }
+}
+
+static void gen_port(char* out, size_t cap)
+{
+    switch (rng_below(6)) {
+    case 0:
+        snprintf(out, cap, "%u", 65530 + rng_below(10));
+        break;
+    case 1:
+        snprintf(out, cap, "0%u", rng_below(1000));
+        break;
+    case 2:
+        snprintf(out, cap, "%s", rng_below(2) ? "" : "x1");
+        break;
+    default:
+        snprintf(out, cap, "%u", rng_below(65536));
+        break;
+    }
+}
+
+/* Decimal without sign, no larger than max: the grammar the library accepts */
+static int decimal_ok(const char* s, unsigned long max, unsigned long* out)
+{
+    unsigned long v;
+
+    if (*s == '\0') {
+        return 0;
+    }
+    v = 0;
+    for (; *s != '\0'; s++) {
+        if (*s < '0' || *s > '9') {
+            return 0;
+        }
+        v = v * 10 + (unsigned long)(*s - '0');
+        if (v > max) {
+            return 0;
+        }
+    }
+    *out = v;
+    return 1;
+}
+
+/* ============================================================================
+ * WSAStringToAddressA against inet_pton
+ * ============================================================================ */
+
+/*
+ * Oracle for "v6[%scope]" and "[v6[%scope]][:port]": the brackets, scope
+ * and port are split off by hand and the address is left to inet_pton.
+ * Mutations can move any separator, so the whole text is judged.
+ */
+static int expect_ipv6(const char* text, unsigned char* addr,
+                       unsigned long* port, unsigned long* scope)
+{
+    char host[160];
+    char* close;
+    char* pct;
+
+    snprintf(host, sizeof(host), "%s", text[0] == '[' ? text + 1 : text);
+    *port = 0;
+    *scope = 0;
+    if (text[0] == '[') {
+        close = strchr(host, ']');
+        if (close == NULL) {
+            return 0;
+        }
+        if (close[1] != '\0' && (close[1] != ':' || !decimal_ok(close + 2, 65535, port))) {
+            return 0;
+        }
+        *close = '\0';
+    }
+    pct = strchr(host, '%');
+    if (pct != NULL) {
+        if (!decimal_ok(pct + 1, 0xFFFFFFFFUL, scope)) {
+            return 0;
+        }
+        *pct = '\0';
+    }
+    return inet_pton(AF_INET6, host, addr) == 1;
+}
+
+static int check_string_to_address(void)
+{
+    struct sockaddr_storage ss;
+    unsigned char expect[16];
+    char addr[96];
+    char port[16];
+    char scope_text[16];
+    char text[160];
+    char* colon;
+    unsigned long port_value;
+    unsigned long scope_value;
+    int expect_ok;
+    int family;
+    int bracket;
+    int scope;
+    INT len;
+    int rc;
+
+    family = rng_below(2) ? AF_INET : AF_INET6;
+    port_value = 0;
+    scope_value = 0;
+    if (family == AF_INET) {
+        gen_ipv4(addr, sizeof(addr));
+        port[0] = '\0';
+        if (rng_below(2)) {
+            gen_port(port, sizeof(port));
+        }
+        snprintf(text, sizeof(text), "%s%s%s", addr, rng_below(8) && port[0] == '\0' ? "" : ":", port);
+        /* A mutation may have put the colon in the address: judge the text as a whole */
+        colon = strchr(text, ':');
+        if (colon != NULL) {
+            *colon = '\0';
+        }
+        expect_ok = inet_pton(AF_INET, text, expect) == 1 &&
+                    (colon == NULL || decimal_ok(colon + 1, 65535, &port_value));
+        if (colon != NULL) {
+            *colon = ':';
+        }
+    } else {
+        gen_ipv6(addr, sizeof(addr));
+        bracket = rng_below(2);
+        scope = rng_below(4) == 0;
+        port[0] = '\0';
+        if (bracket) {
+            gen_port(port, sizeof(port));
+        }
+        scope_text[0] = '\0';
+        if (scope) {
+            snprintf(scope_text, sizeof(scope_text), "%%%u", rng_below(100));
+        }
+        snprintf(text, sizeof(text), "%s%s%s%s%s", bracket ? "[" : "", addr, scope_text,
+                 bracket ? "]:" : "", port);
+        expect_ok = expect_ipv6(text, expect, &port_value, &scope_value);
+    }
+
+    memset(&ss, 0, sizeof(ss));
+    len = sizeof(ss);
+    rc = WSAStringToAddressA(text, family, NULL, (LPSOCKADDR)&ss, &len);
+    if ((rc == 0) != expect_ok) {
+        return fail("string-to-address", text, expect_ok ? "rejected, inet_pton accepts" :
+                                                           "accepted, inet_pton rejects");
+    }
+    if (rc != 0) {
+        return 0;
+    }
+    if (family == AF_INET) {
+        if (memcmp(&((struct sockaddr_in*)&ss)->sin_addr, expect, 4) != 0 ||
+            ntohs(((struct sockaddr_in*)&ss)->sin_port) != port_value) {
+            return fail("string-to-address", text, "address or port differs");
+        }
+    } else if (memcmp(&((struct sockaddr_in6*)&ss)->sin6_addr, expect, 16) != 0 ||
+               ntohs(((struct sockaddr_in6*)&ss)->sin6_port) != port_value ||
+               ((struct sockaddr_in6*)&ss)->sin6_scope_id != scope_value) {
+        return fail("string-to-address", text, "address, port or scope differs");
+    }
+    return 0;
+}
+
+/* ============================================================================
+ * WSAAddressToStringA/W against inet_ntop
+ * ============================================================================ */
+
+static int check_address_to_string(void)
+{
+    struct sockaddr_storage ss;
+    struct sockaddr_in* sin;
+    struct sockaddr_in6* sin6;
+    char expect[96];
+    char ntop[INET6_ADDRSTRLEN];
+    char out[96 + PROP_CANARY_LEN];
+    wchar_t wout[96];
+    DWORD given;
+    DWORD len;
+    DWORD wlen;
+    unsigned int port;
+    unsigned int scope;
+    int i;
+
+    memset(&ss, 0, sizeof(ss));
+    port = rng_below(3) == 0 ? 0 : rng_below(65536);
+    if (rng_below(2)) {
+        sin = (struct sockaddr_in*)&ss;
+        sin->sin_family = AF_INET;
+        sin->sin_addr.s_addr = (in_addr_t)rng_next();
+        sin->sin_port = htons((unsigned short)port);
+        inet_ntop(AF_INET, &sin->sin_addr, ntop, sizeof(ntop));
+        snprintf(expect, sizeof(expect), port ? "%s:%u" : "%s", ntop, port);
+    } else {
+        sin6 = (struct sockaddr_in6*)&ss;
+        sin6->sin6_family = AF_INET6;
+        for (i = 0; i < 16; i += 2) {
+            if (rng_below(3) != 0) {
+                sin6->sin6_addr.s6_addr[i] = (unsigned char)rng_next();
+                sin6->sin6_addr.s6_addr[i + 1] = (unsigned char)rng_next();
+            }
+        }
+        /* v4-mapped and v4-compatible forms have their own text */
+        if (rng_below(8) == 0) {
+            memset(sin6->sin6_addr.s6_addr, 0, 10);
+            sin6->sin6_addr.s6_addr[10] = rng_below(2) ? 0xff : 0;
+            sin6->sin6_addr.s6_addr[11] = sin6->sin6_addr.s6_addr[10];
+        }
+        scope = rng_below(4) == 0 ? rng_below(1000) : 0;
+        sin6->sin6_port = htons((unsigned short)port);
+        sin6->sin6_scope_id = scope;
+        inet_ntop(AF_INET6, &sin6->sin6_addr, ntop, sizeof(ntop));
+        snprintf(expect, sizeof(expect), "%s%s", port ? "[" : "", ntop);
+        if (scope != 0) {
+            snprintf(expect + strlen(expect), sizeof(expect) - strlen(expect), "%%%u", scope);
+        }
+        if (port != 0) {
+            snprintf(expect + strlen(expect), sizeof(expect) - strlen(expect), "]:%u", port);
+        }
+    }
+
+    /* Too small, exact and roomy buffers */
+    switch (rng_below(3)) {
+    case 0:
+        given = rng_below((unsigned int)strlen(expect) + 1);
+        break;
+    case 1:
+        given = (DWORD)strlen(expect) + 1;
+        break;
+    default:
+        given = 96;
+        break;
+    }
+    memset(out + given, PROP_CANARY, PROP_CANARY_LEN);
+    len = given;
+    if (WSAAddressToStringA((LPSOCKADDR)&ss, sizeof(ss), NULL, out, &len) != 0) {
+        if (given > strlen(expect) || WSAGetLastError() != WSAEFAULT || len != strlen(expect) + 1) {
+            return fail("address-to-string", expect, "failed or misreported the length needed");
+        }
+    } else if (strcmp(out, expect) != 0 || len != strlen(expect) + 1) {
+        return fail("address-to-string", expect, out);
+    }
+    for (i = 0; i < PROP_CANARY_LEN; i++) {
+        if ((unsigned char)out[given + i] != PROP_CANARY) {
+            return fail("address-to-string", expect, "wrote past the buffer");
+        }
+    }
+
+    wlen = given;
+    if (WSAAddressToStringW((LPSOCKADDR)&ss, sizeof(ss), NULL, wout, &wlen) != 0) {
+        if (given > strlen(expect) || wlen != strlen(expect) + 1) {
+            return fail("address-to-string-w", expect, "failed or misreported the length needed");
+        }
+        return 0;
+    }
+    for (i = 0; i <= (int)strlen(expect); i++) {
+        if (wout[i] != (wchar_t)(unsigned char)expect[i]) {
+            return fail("address-to-string-w", expect, "wide text differs");
+        }
+    }
+    return 0;
+}
+
+/* ============================================================================
+ * GetAddrInfoW against getaddrinfo
+ * ============================================================================ */
+
+static int check_getaddrinfo_w(void)
+{
+    struct addrinfo hints;
+    struct addrinfo* result;
+    struct addrinfo* a;
+    ADDRINFOW whints;
+    ADDRINFOW* wresult;
+    ADDRINFOW* w;
+    char node[96];
+    char service[16];
+    wchar_t wnode[96];
+    wchar_t wservice[16];
+    int rc;
+    int wrc;
+    int i;
+
+    if (rng_below(2)) {
+        gen_ipv4(node, sizeof(node));
+    } else {
+        gen_ipv6(node, sizeof(node));
+    }
+    gen_port(service, sizeof(service));
+    for (i = 0; i <= (int)strlen(node); i++) {
+        wnode[i] = (wchar_t)(unsigned char)node[i];
+    }
+    for (i = 0; i <= (int)strlen(service); i++) {
+        wservice[i] = (wchar_t)(unsigned char)service[i];
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV | (rng_below(2) ? AI_CANONNAME : 0);
+    hints.ai_family = rng_below(3) == 0 ? AF_INET : rng_below(2) ? AF_INET6 : AF_UNSPEC;
+    hints.ai_socktype = rng_below(3) == 0 ? SOCK_STREAM : rng_below(2) ? SOCK_DGRAM : 0;
+    memset(&whints, 0, sizeof(whints));
+    whints.ai_flags = hints.ai_flags;
+    whints.ai_family = hints.ai_family;
+    whints.ai_socktype = hints.ai_socktype;
+
+    rc = getaddrinfo(node, service, &hints, &result);
+    wrc = GetAddrInfoW(wnode, wservice, &whints, &wresult);
+    if ((rc == 0) != (wrc == 0)) {
+        return fail("getaddrinfo-w", node, "success differs from getaddrinfo");
+    }
+    if (rc != 0) {
+        return 0;
+    }
+
+    for (a = result, w = wresult; a != NULL && w != NULL; a = a->ai_next, w = w->ai_next) {
+        if (w->ai_family != a->ai_family || w->ai_socktype != a->ai_socktype ||
+            w->ai_protocol != a->ai_protocol || w->ai_addrlen != a->ai_addrlen ||
+            w->ai_addr == NULL || memcmp(w->ai_addr, a->ai_addr, a->ai_addrlen) != 0 ||
+            (w->ai_canonname == NULL) != (a->ai_canonname == NULL)) {
+            break;
+        }
+        if (a->ai_canonname != NULL) {
+            for (i = 0; i <= (int)strlen(a->ai_canonname); i++) {
+                if (w->ai_canonname[i] != (wchar_t)(unsigned char)a->ai_canonname[i]) {
+                    break;
+                }
+            }
+            if (i <= (int)strlen(a->ai_canonname)) {
+                break;
+            }
+        }
+    }
+    rc = a == NULL && w == NULL ? 0 : fail("getaddrinfo-w", node, "result lists differ");
+    freeaddrinfo(result);
+    FreeAddrInfoW(wresult);
+    return rc;
+}
+
+/* ============================================================================
+ * WSARecvMsg control buffer
+ * ============================================================================ */
+
+/*
+ * Every datagram on an AF_UNIX pair with SO_PASSCRED carries one
+ * SCM_CREDENTIALS message. Whatever the control length, nothing is
+ * written past it, the length returned does not exceed it and
+ * MSG_CTRUNC is set exactly when the message does not fit.
+ */
+static int check_recv_msg(SOCKET sender, SOCKET receiver)
+{
+    unsigned char control[128 + PROP_CANARY_LEN];
+    char payload[64];
+    char data[64];
+    char detail[96];
+    WSABUF buf;
+    WSAMSG msg;
+    DWORD control_len;
+    DWORD received;
+    int truncated;
+    int i;
+
+    control_len = rng_below(97);
+    memset(control, 0, sizeof(control));
+    memset(control + control_len, PROP_CANARY, PROP_CANARY_LEN);
+    for (i = 0; i < (int)sizeof(payload); i++) {
+        payload[i] = (char)rng_next();
+    }
+    send(sender, payload, sizeof(payload), 0);
+
+    buf.buf = data;
+    buf.len = sizeof(data);
+    memset(&msg, 0, sizeof(msg));
+    msg.lpBuffers = &buf;
+    msg.dwBufferCount = 1;
+    msg.Control.buf = (char*)control;
+    msg.Control.len = control_len;
+    snprintf(detail, sizeof(detail), "control length %lu", (unsigned long)control_len);
+
+    if (WSARecvMsg(receiver, &msg, &received, NULL, NULL) != 0 ||
+        received != sizeof(payload) || memcmp(data, payload, sizeof(payload)) != 0) {
+        return fail("recvmsg-control", detail, "data not received intact");
+    }
+    for (i = 0; i < PROP_CANARY_LEN; i++) {
+        if (control[control_len + i] != PROP_CANARY) {
+            return fail("recvmsg-control", detail, "wrote past the control buffer");
+        }
+    }
+    truncated = (msg.dwFlags & MSG_CTRUNC) != 0;
+    if (msg.Control.len > control_len ||
+        truncated != (control_len < CMSG_LEN(sizeof(struct ucred)))) {
+        return fail("recvmsg-control", detail, "control length or MSG_CTRUNC wrong");
+    }
+    if (!truncated && (((struct cmsghdr*)control)->cmsg_level != SOL_SOCKET ||
+                       ((struct cmsghdr*)control)->cmsg_type != SCM_CREDENTIALS)) {
+        return fail("recvmsg-control", detail, "control message garbled");
+    }
+    return 0;
+}
+
+/* ============================================================================
+ * Main
+ * ============================================================================ */
+
+/* ============================================================================
+ * InetPtonA against inet_pton
+ * ============================================================================ */
+
+/* The whole buffer is compared, so a rejected string must leave it untouched */
+static int check_inet_pton(void)
+{
+    unsigned char got[16];
+    unsigned char expect[16];
+    char text[96];
+    int family;
+    int rc;
+    int expect_rc;
+
+    family = rng_below(2) ? AF_INET : AF_INET6;
+    if (family == AF_INET) {
+        gen_ipv4(text, sizeof(text));
+    } else {
+        gen_ipv6(text, sizeof(text));
+    }
+
+    memset(got, PROP_CANARY, sizeof(got));
+    memset(expect, PROP_CANARY, sizeof(expect));
+    rc = InetPtonA(family, text, got);
+    expect_rc = inet_pton(family, text, expect);
+    if (rc != expect_rc) {
+        return fail("inet-pton", text, expect_rc == 1 ? "rejected, inet_pton accepts" :
+                                                        "accepted, inet_pton rejects");
+    }
+    if (memcmp(got, expect, sizeof(got)) != 0) {
+        return fail("inet-pton", text, rc == 1 ? "address differs" : "buffer written on failure");
+    }
+    return 0;
+}
+
+static int parse_args(int argc, char** argv)
+{
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (i + 1 < argc && strcmp(argv[i], "-n") == 0) {
+            g_cases = atol(argv[++i]);
+        } else if (i + 1 < argc && strcmp(argv[i], "-s") == 0) {
+            g_seed = strtoull(argv[++i], NULL, 0);
+        } else {
+            return -1;
+        }
+    }
+    return g_cases > 0 ? 0 : -1;
+}
+
+int main(int argc, char** argv)
+{
+    static const struct {
+        const char* name;
+        int (*check)(void);
+    } properties[] = {
+        { "WSAStringToAddressA vs inet_pton", check_string_to_address },
+        { "InetPtonA vs inet_pton", check_inet_pton },
+        { "WSAAddressToStringA/W vs inet_ntop", check_address_to_string },
+        { "GetAddrInfoW vs getaddrinfo", check_getaddrinfo_w },
+    };
+    WSADATA wsaData;
+    int fds[2];
+    int on;
+    int before;
+    long n;
+    size_t p;
+
+    if (parse_args(argc, argv) < 0) {
+        fprintf(stderr, "usage: %s [-n cases] [-s seed]\n", argv[0]);
+        return 2;
+    }
+    if (g_seed == 0) {
+        g_seed = (unsigned long long)time(NULL);
+    }
+    WSAStartup(MAKEWORD(2, 2), &wsaData);
+    printf("Property tests: %ld cases each, seed %llu\n", g_cases, g_seed);
+
+    for (p = 0; p < sizeof(properties) / sizeof(properties[0]); p++) {
+        g_rng = g_seed * 0x9E3779B97F4A7C15ULL + p + 1;
+        before = g_failures;
+        for (n = 0; n < g_cases && properties[p].check() == 0; n++) {
+        }
+        printf("  %-38s %s\n", properties[p].name, g_failures == before ? "ok" : "FAILED");
+    }
+
+    g_rng = g_seed * 0x9E3779B97F4A7C15ULL + p + 1;
+    before = g_failures;
+    if (socketpair(AF_UNIX, SOCK_DGRAM, 0, fds) == 0) {
+        on = 1;
+        setsockopt(fds[1], SOL_SOCKET, SO_PASSCRED, (const char*)&on, sizeof(on));
+        for (n = 0; n < g_cases && check_recv_msg(fds[0], fds[1]) == 0; n++) {
+        }
+        close(fds[0]);
+        close(fds[1]);
+    } else {
+        fail("recvmsg-control", "socketpair", "could not create the socket pair");
+    }
+    printf("  %-38s %s\n", "WSARecvMsg control truncation", g_failures == before ? "ok" : "FAILED");
+
+    WSACleanup();
+    return g_failures == 0 ? 0 : 1;
+}
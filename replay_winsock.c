@@ -0,0 +1,632 @@
+/*
+ * Winsock2 Linux Wrapper Trace Replay
+ * Re-drives a trace written by the call recorder (WSAStartRecording or
+ * WSA_RECORD=<path>) against loopback and compares the time each call
+ * took when recorded with the time it takes now
+ *
+ * Usage: replay_winsock [-w] [-l loops] [--json] trace
+ *   -w  keep the recorded gaps between calls instead of replaying flat out
+ *   -l  replay the trace this many times (1)
+ *   --json  print the results as one JSON object
+ *
+ * Every recorded socket becomes one end of a loopback pair: TCP through a
+ * local listener, UDP as two connected datagram sockets. A send pushes the
+ * recorded number of bytes and the peer drains them; a receive has the
+ * peer send the recorded number of bytes first. All sends replay through
+ * WSASend and all receives through WSARecv, one thread, in timestamp
+ * order. Calls other than socket lifecycle and I/O are counted but not
+ * replayed.
+ */
+
+#include "winsock2.h"
+#include "ws2tcpip.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define REPLAY_CHUNK     65536
+#define REPLAY_MAX_DGRAM 65507
+
+typedef enum ReplayKind {
+    REPLAY_SKIP = 0,
+    REPLAY_SOCKET,
+    REPLAY_CONNECT,
+    REPLAY_ACCEPT,          /* iResult is the accepted socket */
+    REPLAY_SEND,
+    REPLAY_SEND_DGRAM,
+    REPLAY_RECV,
+    REPLAY_RECV_DGRAM,
+    REPLAY_CLOSE
+} ReplayKind;
+
+typedef struct ReplayFunction {
+    char name[WSA_TRACE_NAME_LEN];
+    ReplayKind kind;
+    unsigned long long recorded;
+    unsigned long long recorded_ns;
+    unsigned long long replayed;
+    unsigned long long replayed_ns;
+    unsigned long long bytes;
+    unsigned long long max_ns;
+} ReplayFunction;
+
+/* Loopback pair standing in for one recorded socket */
+typedef struct ReplaySocket {
+    SOCKET ours;
+    SOCKET peer;
+    int type;               /* Recorded type, 0 if not seen */
+} ReplaySocket;
+
+static int g_wait = 0;
+static int g_loops = 1;
+static int g_json = 0;
+static const char* g_path = NULL;
+
+static ReplayFunction* g_functions;
+static DWORD g_function_count;
+static WSATRACERECORD* g_records;
+static size_t g_record_count;
+static ULONGLONG g_dropped;
+static ReplaySocket* g_sockets;
+static int g_socket_count;
+static SOCKET g_listener = INVALID_SOCKET;
+static struct sockaddr_in g_listen_addr;
+static unsigned long long g_errors = 0;
+static char g_buffer[REPLAY_CHUNK];
+
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void format_ns(char* out, size_t len, double ns)
+{
+    if (ns < 1e3) {
+        snprintf(out, len, "%.0fns", ns);
+    } else if (ns < 1e6) {
+        snprintf(out, len, "%.1fus", ns / 1e3);
+    } else if (ns < 1e9) {
+        snprintf(out, len, "%.2fms", ns / 1e6);
+    } else {
+        snprintf(out, len, "%.2fs", ns / 1e9);
+    }
+}
+
+/* ============================================================================
+ * Trace Loading
+ * ============================================================================ */
+
+static ReplayKind kind_of(const char* name)
+{
+    static const struct {
+        const char* name;
+        ReplayKind kind;
+    } kinds[] = {
+        { "WSASocketA", REPLAY_SOCKET },
+        { "WSAConnect", REPLAY_CONNECT },
+        { "ConnectEx", REPLAY_CONNECT },
+        { "WSAAccept", REPLAY_ACCEPT },
+        { "AcceptEx", REPLAY_ACCEPT },
+        { "WSASend", REPLAY_SEND },
+        { "WSASendMsg", REPLAY_SEND },
+        { "WSASendTo", REPLAY_SEND_DGRAM },
+        { "WSARecv", REPLAY_RECV },
+        { "WSARecvMsg", REPLAY_RECV },
+        { "WSARecvFrom", REPLAY_RECV_DGRAM },
+        { "closesocket", REPLAY_CLOSE },
+    };
+    size_t i;
+
+    for (i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++) {
+        if (strcmp(name, kinds[i].name) == 0) {
+            return kinds[i].kind;
+        }
+    }
+    return REPLAY_SKIP;
+}
+
+/* Threads record in parallel; merge their records back into call order */
+static int compare_records(const void* a, const void* b)
+{
+    const WSATRACERECORD* x = (const WSATRACERECORD*)a;
+    const WSATRACERECORD* y = (const WSATRACERECORD*)b;
+
+    if (x->ullTimestampNs != y->ullTimestampNs) {
+        return x->ullTimestampNs < y->ullTimestampNs ? -1 : 1;
+    }
+    return (int)x->wThread - (int)y->wThread;
+}
+
+static int load_trace(const char* path)
+{
+    WSATRACEHEADER header;
+    FILE* f;
+    size_t capacity;
+    DWORD i;
+    int max_socket;
+
+    f = fopen(path, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return -1;
+    }
+    if (fread(&header, sizeof(header), 1, f) != 1 ||
+        memcmp(header.szMagic, WSA_TRACE_MAGIC, sizeof(header.szMagic)) != 0 ||
+        header.dwVersion != WSA_TRACE_VERSION ||
+        header.dwRecordSize != sizeof(WSATRACERECORD) ||
+        header.dwFunctionCount == 0 || header.dwFunctionCount > 0xFFFF) {
+        fprintf(stderr, "%s is not a version %d call trace\n", path, WSA_TRACE_VERSION);
+        fclose(f);
+        return -1;
+    }
+    g_dropped = header.ullDropped;
+
+    g_function_count = header.dwFunctionCount;
+    g_functions = (ReplayFunction*)calloc(g_function_count, sizeof(ReplayFunction));
+    for (i = 0; i < g_function_count; i++) {
+        if (fread(g_functions[i].name, WSA_TRACE_NAME_LEN, 1, f) != 1) {
+            fprintf(stderr, "%s is truncated\n", path);
+            fclose(f);
+            return -1;
+        }
+        g_functions[i].name[WSA_TRACE_NAME_LEN - 1] = '\0';
+        g_functions[i].kind = kind_of(g_functions[i].name);
+    }
+
+    /* A trace cut short by a crash ends in a partial record; ignore it */
+    capacity = 4096;
+    g_records = (WSATRACERECORD*)malloc(capacity * sizeof(WSATRACERECORD));
+    g_record_count = 0;
+    max_socket = 0;
+    while (fread(&g_records[g_record_count], sizeof(WSATRACERECORD), 1, f) == 1) {
+        if (g_records[g_record_count].wFunction >= g_function_count) {
+            continue;
+        }
+        if (g_records[g_record_count].iSocket > max_socket) {
+            max_socket = g_records[g_record_count].iSocket;
+        }
+        if (g_functions[g_records[g_record_count].wFunction].kind == REPLAY_ACCEPT &&
+            g_records[g_record_count].iResult > max_socket) {
+            max_socket = g_records[g_record_count].iResult;
+        }
+        if (++g_record_count == capacity) {
+            capacity *= 2;
+            g_records = (WSATRACERECORD*)realloc(g_records, capacity * sizeof(WSATRACERECORD));
+        }
+    }
+    fclose(f);
+
+    qsort(g_records, g_record_count, sizeof(WSATRACERECORD), compare_records);
+
+    g_socket_count = max_socket + 1;
+    g_sockets = (ReplaySocket*)calloc((size_t)g_socket_count, sizeof(ReplaySocket));
+    for (i = 0; i < (DWORD)g_socket_count; i++) {
+        g_sockets[i].ours = INVALID_SOCKET;
+        g_sockets[i].peer = INVALID_SOCKET;
+    }
+    return 0;
+}
+
+/* ============================================================================
+ * Loopback Pairs
+ * ============================================================================ */
+
+static int set_nonblocking(SOCKET s)
+{
+    u_long on = 1;
+    return ioctlsocket(s, FIONBIO, &on);
+}
+
+static int open_tcp_pair(ReplaySocket* rs)
+{
+    rs->ours = WSASocket(AF_INET, SOCK_STREAM, IPPROTO_TCP, NULL, 0, 0);
+    if (rs->ours == INVALID_SOCKET ||
+        connect(rs->ours, (struct sockaddr*)&g_listen_addr, sizeof(g_listen_addr)) == SOCKET_ERROR) {
+        return -1;
+    }
+    rs->peer = accept(g_listener, NULL, NULL);
+    if (rs->peer == INVALID_SOCKET) {
+        return -1;
+    }
+    return 0;
+}
+
+static int open_udp_pair(ReplaySocket* rs)
+{
+    struct sockaddr_in a;
+    struct sockaddr_in b;
+    socklen_t len;
+
+    rs->ours = WSASocket(AF_INET, SOCK_DGRAM, IPPROTO_UDP, NULL, 0, 0);
+    rs->peer = WSASocket(AF_INET, SOCK_DGRAM, IPPROTO_UDP, NULL, 0, 0);
+    if (rs->ours == INVALID_SOCKET || rs->peer == INVALID_SOCKET) {
+        return -1;
+    }
+    memset(&a, 0, sizeof(a));
+    a.sin_family = AF_INET;
+    a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    b = a;
+    len = sizeof(a);
+    if (bind(rs->ours, (struct sockaddr*)&a, sizeof(a)) == SOCKET_ERROR ||
+        getsockname(rs->ours, (struct sockaddr*)&a, &len) == SOCKET_ERROR) {
+        return -1;
+    }
+    len = sizeof(b);
+    if (bind(rs->peer, (struct sockaddr*)&b, sizeof(b)) == SOCKET_ERROR ||
+        getsockname(rs->peer, (struct sockaddr*)&b, &len) == SOCKET_ERROR ||
+        connect(rs->ours, (struct sockaddr*)&b, sizeof(b)) == SOCKET_ERROR ||
+        connect(rs->peer, (struct sockaddr*)&a, sizeof(a)) == SOCKET_ERROR) {
+        return -1;
+    }
+    return 0;
+}
+
+static void close_pair(ReplaySocket* rs)
+{
+    if (rs->ours != INVALID_SOCKET) {
+        closesocket(rs->ours);
+    }
+    if (rs->peer != INVALID_SOCKET) {
+        closesocket(rs->peer);
+    }
+    rs->ours = INVALID_SOCKET;
+    rs->peer = INVALID_SOCKET;
+}
+
+/* Pair for recorded socket s, opened on first use */
+static ReplaySocket* get_pair(int s, int type)
+{
+    ReplaySocket* rs;
+    int rc;
+
+    if (s < 0 || s >= g_socket_count) {
+        return NULL;
+    }
+    rs = &g_sockets[s];
+    if (rs->ours != INVALID_SOCKET) {
+        return rs;
+    }
+    if (rs->type == 0) {
+        rs->type = type;
+    }
+    rc = rs->type == SOCK_DGRAM ? open_udp_pair(rs) : open_tcp_pair(rs);
+    if (rc < 0 || set_nonblocking(rs->ours) < 0 || set_nonblocking(rs->peer) < 0) {
+        close_pair(rs);
+        g_errors++;
+        return NULL;
+    }
+    return rs;
+}
+
+static void drain(SOCKET s)
+{
+    while (recv(s, g_buffer, sizeof(g_buffer), 0) > 0) {
+    }
+}
+
+/* ============================================================================
+ * Replay
+ * ============================================================================ */
+
+/* Push size bytes from our end; returns the time spent in WSASend */
+static long long replay_send(ReplaySocket* rs, long long size)
+{
+    WSABUF buf;
+    DWORD sent;
+    long long elapsed;
+    long long start;
+    int rc;
+
+    elapsed = 0;
+    buf.buf = g_buffer;
+    if (rs->type == SOCK_DGRAM && size > REPLAY_MAX_DGRAM) {
+        size = REPLAY_MAX_DGRAM;
+    }
+    do {
+        buf.len = (u_long)(size < REPLAY_CHUNK ? size : REPLAY_CHUNK);
+        start = now_ns();
+        rc = WSASend(rs->ours, &buf, 1, &sent, 0, NULL, NULL);
+        elapsed += now_ns() - start;
+        if (rc == SOCKET_ERROR) {
+            if (WSAGetLastError() != WSAEWOULDBLOCK) {
+                g_errors++;
+                break;
+            }
+            sent = 0;
+        }
+        size -= (long long)sent;
+        drain(rs->peer);
+    } while (size > 0);
+    return elapsed;
+}
+
+/* Have the peer send size bytes and receive them; returns the time spent in WSARecv */
+static long long replay_recv(ReplaySocket* rs, long long size)
+{
+    WSABUF buf;
+    DWORD received;
+    DWORD flags;
+    long long elapsed;
+    long long start;
+    long long chunk;
+    long long pending;
+    int rc;
+
+    elapsed = 0;
+    buf.buf = g_buffer;
+    buf.len = sizeof(g_buffer);
+    if (rs->type == SOCK_DGRAM && size > REPLAY_MAX_DGRAM) {
+        size = REPLAY_MAX_DGRAM;
+    }
+
+    /* Nothing queued: the recorded call would have blocked */
+    if (size <= 0) {
+        flags = 0;
+        start = now_ns();
+        WSARecv(rs->ours, &buf, 1, &received, &flags, NULL, NULL);
+        return now_ns() - start;
+    }
+
+    while (size > 0) {
+        chunk = size < REPLAY_CHUNK ? size : REPLAY_CHUNK;
+        if (send(rs->peer, g_buffer, (int)chunk, 0) != (int)chunk) {
+            g_errors++;
+            break;
+        }
+        for (pending = chunk; pending > 0; pending -= (long long)received) {
+            flags = 0;
+            start = now_ns();
+            rc = WSARecv(rs->ours, &buf, 1, &received, &flags, NULL, NULL);
+            elapsed += now_ns() - start;
+            if (rc == SOCKET_ERROR || received == 0) {
+                g_errors++;
+                return elapsed;
+            }
+        }
+        size -= chunk;
+    }
+    return elapsed;
+}
+
+static void replay_record(const WSATRACERECORD* r)
+{
+    ReplayFunction* fn;
+    ReplaySocket* rs;
+    long long elapsed;
+    long long bytes;
+
+    fn = &g_functions[r->wFunction];
+    fn->recorded++;
+    fn->recorded_ns += r->dwDurationNs;
+    if (fn->kind == REPLAY_SKIP || r->iSocket < 0 || r->iSocket >= g_socket_count) {
+        return;
+    }
+
+    rs = &g_sockets[r->iSocket];
+    elapsed = -1;
+    bytes = 0;
+    switch (fn->kind) {
+    case REPLAY_SOCKET:
+        /* The descriptor was reused: whatever it was before is gone */
+        close_pair(rs);
+        rs->type = r->iResult >= 0 ? (int)r->dwSize : 0;
+        break;
+    case REPLAY_CONNECT:
+        if (r->iResult >= 0 && rs->ours == INVALID_SOCKET) {
+            elapsed = now_ns();
+            rs = get_pair(r->iSocket, SOCK_STREAM);
+            elapsed = now_ns() - elapsed;
+        }
+        break;
+    case REPLAY_ACCEPT:
+        if (r->iResult >= 0 && r->iResult < g_socket_count) {
+            close_pair(&g_sockets[r->iResult]);
+            g_sockets[r->iResult].type = SOCK_STREAM;
+            elapsed = now_ns();
+            rs = get_pair(r->iResult, SOCK_STREAM);
+            elapsed = now_ns() - elapsed;
+        }
+        break;
+    case REPLAY_SEND:
+    case REPLAY_SEND_DGRAM:
+        rs = get_pair(r->iSocket, fn->kind == REPLAY_SEND_DGRAM ? SOCK_DGRAM : SOCK_STREAM);
+        if (rs != NULL && r->iResult >= 0) {
+            bytes = r->iResult;
+            elapsed = replay_send(rs, bytes);
+        }
+        break;
+    case REPLAY_RECV:
+    case REPLAY_RECV_DGRAM:
+        rs = get_pair(r->iSocket, fn->kind == REPLAY_RECV_DGRAM ? SOCK_DGRAM : SOCK_STREAM);
+        /* A receive that returned end of stream has nothing to replay */
+        if (rs != NULL && (r->iResult > 0 || r->iError == WSAEWOULDBLOCK)) {
+            bytes = r->iResult > 0 ? r->iResult : 0;
+            elapsed = replay_recv(rs, bytes);
+        }
+        break;
+    case REPLAY_CLOSE:
+        if (rs->ours != INVALID_SOCKET) {
+            elapsed = now_ns();
+            close_pair(rs);
+            elapsed = now_ns() - elapsed;
+        }
+        rs->type = 0;
+        break;
+    default:
+        break;
+    }
+
+    if (elapsed >= 0) {
+        fn->replayed++;
+        fn->replayed_ns += (unsigned long long)elapsed;
+        fn->bytes += (unsigned long long)bytes;
+        if ((unsigned long long)elapsed > fn->max_ns) {
+            fn->max_ns = (unsigned long long)elapsed;
+        }
+    }
+}
+
+static void replay_all(void)
+{
+    struct timespec pause;
+    long long start;
+    long long due;
+    size_t i;
+    int j;
+
+    start = now_ns();
+    for (i = 0; i < g_record_count; i++) {
+        if (g_wait) {
+            due = start + (long long)(g_records[i].ullTimestampNs - g_records[0].ullTimestampNs) -
+                  now_ns();
+            if (due > 0) {
+                pause.tv_sec = (time_t)(due / 1000000000LL);
+                pause.tv_nsec = (long)(due % 1000000000LL);
+                nanosleep(&pause, NULL);
+            }
+        }
+        replay_record(&g_records[i]);
+    }
+    for (j = 0; j < g_socket_count; j++) {
+        close_pair(&g_sockets[j]);
+        g_sockets[j].type = 0;
+    }
+}
+
+/* ============================================================================
+ * Report
+ * ============================================================================ */
+
+static void report(double run_ns)
+{
+    const ReplayFunction* fn;
+    char a[32];
+    char b[32];
+    char c[32];
+    DWORD i;
+    int first;
+
+    if (g_json) {
+        printf("{\"records\":%lu,\"dropped\":%llu,\"loops\":%d,\"duration_s\":%.3f,"
+               "\"errors\":%llu,\"functions\":[",
+               (unsigned long)g_record_count, (unsigned long long)g_dropped, g_loops,
+               run_ns / 1e9, g_errors);
+        first = 1;
+        for (i = 0; i < g_function_count; i++) {
+            fn = &g_functions[i];
+            if (fn->recorded == 0) {
+                continue;
+            }
+            printf("%s{\"name\":\"%s\",\"recorded\":%llu,\"recorded_mean_ns\":%.0f,"
+                   "\"replayed\":%llu,\"replayed_mean_ns\":%.0f,\"max_ns\":%llu,\"bytes\":%llu}",
+                   first ? "" : ",", fn->name, fn->recorded,
+                   (double)fn->recorded_ns / (double)fn->recorded, fn->replayed,
+                   fn->replayed ? (double)fn->replayed_ns / (double)fn->replayed : 0.0,
+                   fn->max_ns, fn->bytes);
+            first = 0;
+        }
+        printf("]}\n");
+        return;
+    }
+
+    format_ns(a, sizeof(a), run_ns);
+    printf("Replayed %s: %lu records x %d in %s, %llu dropped while recording, %llu errors\n\n",
+           g_path, (unsigned long)g_record_count, g_loops, a,
+           (unsigned long long)g_dropped, g_errors);
+    printf("  %-22s %10s %10s %10s %10s %10s %12s\n", "function", "recorded", "mean",
+           "replayed", "mean", "max", "bytes");
+    for (i = 0; i < g_function_count; i++) {
+        fn = &g_functions[i];
+        if (fn->recorded == 0) {
+            continue;
+        }
+        format_ns(a, sizeof(a), (double)fn->recorded_ns / (double)fn->recorded);
+        if (fn->replayed == 0) {
+            printf("  %-22s %10llu %10s %10s\n", fn->name, fn->recorded, a,
+                   fn->kind == REPLAY_SKIP || fn->kind == REPLAY_SOCKET ? "-" : "0");
+            continue;
+        }
+        format_ns(b, sizeof(b), (double)fn->replayed_ns / (double)fn->replayed);
+        format_ns(c, sizeof(c), (double)fn->max_ns);
+        printf("  %-22s %10llu %10s %10llu %10s %10s %12llu\n", fn->name, fn->recorded, a,
+               fn->replayed, b, c, fn->bytes);
+    }
+}
+
+/* ============================================================================
+ * Main
+ * ============================================================================ */
+
+static int parse_args(int argc, char** argv)
+{
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            g_json = 1;
+        } else if (strcmp(argv[i], "-w") == 0) {
+            g_wait = 1;
+        } else if (i + 1 < argc && strcmp(argv[i], "-l") == 0) {
+            g_loops = atoi(argv[++i]);
+        } else if (argv[i][0] != '-' && g_path == NULL) {
+            g_path = argv[i];
+        } else {
+            return -1;
+        }
+    }
+    return g_path != NULL && g_loops >= 1 ? 0 : -1;
+}
+
+int main(int argc, char** argv)
+{
+    WSADATA wsaData;
+    socklen_t len;
+    long long run_start;
+    long long run_end;
+    int i;
+
+    if (parse_args(argc, argv) < 0) {
+        fprintf(stderr, "usage: %s [-w] [-l loops] [--json] trace\n", argv[0]);
+        return 2;
+    }
+    if (load_trace(g_path) < 0) {
+        return 1;
+    }
+
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        fprintf(stderr, "WSAStartup failed\n");
+        return 1;
+    }
+
+    g_listener = WSASocket(AF_INET, SOCK_STREAM, IPPROTO_TCP, NULL, 0, 0);
+    memset(&g_listen_addr, 0, sizeof(g_listen_addr));
+    g_listen_addr.sin_family = AF_INET;
+    g_listen_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    len = sizeof(g_listen_addr);
+    if (g_listener == INVALID_SOCKET ||
+        bind(g_listener, (struct sockaddr*)&g_listen_addr, sizeof(g_listen_addr)) == SOCKET_ERROR ||
+        listen(g_listener, SOMAXCONN) == SOCKET_ERROR ||
+        getsockname(g_listener, (struct sockaddr*)&g_listen_addr, &len) == SOCKET_ERROR) {
+        fprintf(stderr, "Could not start the loopback listener (%d)\n", WSAGetLastError());
+        WSACleanup();
+        return 1;
+    }
+
+    run_start = now_ns();
+    for (i = 0; i < g_loops; i++) {
+        replay_all();
+    }
+    run_end = now_ns();
+
+    report((double)(run_end - run_start));
+
+    closesocket(g_listener);
+    WSACleanup();
+    free(g_sockets);
+    free(g_records);
+    free(g_functions);
+    return g_errors == 0 ? 0 : 1;
+}
@@ -5,6 +5,8 @@
 
 #include "winsock2.h"
 #include "ws2tcpip.h"
+#include "mswsock.h"
+#include "mstcpip.h"
 #include <stdio.h>
 #include <string.h>
 
@@ -12,10 +14,29 @@
 void test_initialization(void);
 void test_socket_creation(void);
 void test_address_conversion(void);
+void test_address_strings(void);
 void test_name_resolution(void);
+void test_batch_reverse_lookup(void);
+void test_connect_by_name(void);
 void test_server_client(void);
 void test_select(void);
+void test_select_high_fd(void);
+void test_error_mapping(void);
+void test_wsapoll(void);
+void test_async_select(void);
+void test_address_change_notify(void);
+void test_interface_query(void);
+void test_tcp_ioctls(void);
+void test_accept_shards(void);
+void test_conditional_accept(void);
 void test_socket_options(void);
+void test_sockopt_translation(void);
+void test_socket_table(void);
+void test_close_teardown(void);
+void test_call_stats(void);
+void test_socket_stats(void);
+void test_call_recorder(void);
+void test_pooled_records(void);
 
 int main(void)
 {
@@ -26,9 +47,28 @@ int main(void)
     test_initialization();
     test_socket_creation();
     test_address_conversion();
+    test_address_strings();
     test_name_resolution();
+    test_batch_reverse_lookup();
     test_socket_options();
+    test_sockopt_translation();
+    test_socket_table();
+    test_close_teardown();
+    test_call_stats();
+    test_socket_stats();
+    test_call_recorder();
+    test_pooled_records();
     test_select();
+    test_select_high_fd();
+    test_error_mapping();
+    test_wsapoll();
+    test_async_select();
+    test_address_change_notify();
+    test_interface_query();
+    test_tcp_ioctls();
+    test_accept_shards();
+    test_conditional_accept();
+    test_connect_by_name();
     test_server_client();
 
     printf("\n=======================================================\n");
@@ -120,6 +160,92 @@ void test_address_conversion(void)
     printf("  SUCCESS: inet_ntop() returned: %s\n\n", ip_str);
 }
 
+/* Test WSAStringToAddress/WSAAddressToString round trips */
+void test_address_strings(void)
+{
+    static const char* inputs[] = {
+        "192.168.1.10:8080",
+        "10.0.0.1",
+        "[2001:db8::1]:443",
+        "fe80::1%2",
+        "[::ffff:127.0.0.1]:53"
+    };
+    SOCKADDR_STORAGE addrs[5];
+    char strings[5][64];
+    INT errors[5];
+    char buffer[64];
+    wchar_t wbuffer[64];
+    DWORD buflen;
+    INT addrlen;
+    int i;
+
+    printf("[TEST] WSAStringToAddress/WSAAddressToString\n");
+
+    for (i = 0; i < 5; i++) {
+        int af;
+        af = (inputs[i][0] == '[' || strchr(inputs[i], '%') != NULL) ? AF_INET6 : AF_INET;
+        addrlen = sizeof(addrs[i]);
+        if (WSAStringToAddressA((LPSTR)inputs[i], af, NULL,
+                                (LPSOCKADDR)&addrs[i], &addrlen) != 0) {
+            printf("  FAILED: WSAStringToAddressA(\"%s\") error: %d\n",
+                   inputs[i], WSAGetLastError());
+            return;
+        }
+        buflen = sizeof(buffer);
+        if (WSAAddressToStringA((LPSOCKADDR)&addrs[i], addrlen, NULL,
+                                buffer, &buflen) != 0 ||
+            strcmp(buffer, inputs[i]) != 0) {
+            printf("  FAILED: round trip of \"%s\" gave \"%s\"\n", inputs[i], buffer);
+            return;
+        }
+    }
+
+    printf("  SUCCESS: %d addresses round-tripped\n", i);
+
+    addrlen = sizeof(addrs[0]);
+    if (WSAStringToAddressA("::1:80", AF_INET, NULL,
+                            (LPSOCKADDR)&addrs[0], &addrlen) != SOCKET_ERROR ||
+        WSAGetLastError() != WSAEINVAL) {
+        printf("  FAILED: malformed IPv4 string was accepted\n");
+        return;
+    }
+
+    printf("  SUCCESS: malformed string rejected with WSAEINVAL\n");
+
+    if (WSAStringToAddressBatchA((LPSTR*)inputs, 5, AF_UNSPEC, addrs, errors) != 5 ||
+        WSAAddressToStringBatchA(addrs, 5, strings[0], sizeof(strings[0]), errors) != 5) {
+        printf("  FAILED: batch conversion error: %d\n", errors[0]);
+        return;
+    }
+
+    for (i = 0; i < 5; i++) {
+        if (strcmp(strings[i], inputs[i]) != 0) {
+            printf("  FAILED: batch round trip of \"%s\" gave \"%s\"\n",
+                   inputs[i], strings[i]);
+            return;
+        }
+    }
+
+    printf("  SUCCESS: batch conversion round-tripped %d addresses\n", i);
+
+    /* "[2001:db8::1]:443" needs 18 characters with the terminator */
+    buflen = 4;
+    if (WSAAddressToStringW((LPSOCKADDR)&addrs[2], sizeof(addrs[2]), NULL,
+                            wbuffer, &buflen) != SOCKET_ERROR ||
+        WSAGetLastError() != WSAEFAULT || buflen != 18) {
+        printf("  FAILED: short wide buffer gave length %lu\n", (unsigned long)buflen);
+        return;
+    }
+    if (WSAAddressToStringW((LPSOCKADDR)&addrs[2], sizeof(addrs[2]), NULL,
+                            wbuffer, &buflen) != 0 || wbuffer[0] != L'[' || wbuffer[17] != L'\0' ||
+        InetNtopW(AF_INET6, &((struct sockaddr_in6*)&addrs[2])->sin6_addr, wbuffer, 4) != NULL) {
+        printf("  FAILED: wide conversion did not respect the buffer length\n");
+        return;
+    }
+
+    printf("  SUCCESS: wide conversions report the length needed\n\n");
+}
+
 /* Test name resolution */
 void test_name_resolution(void)
 {
@@ -176,6 +302,54 @@ void test_name_resolution(void)
     printf("\n");
 }
 
+/* Test GetNameInfoBatchA de-duplication and ordering */
+void test_batch_reverse_lookup(void)
+{
+    SOCKADDR_STORAGE addrs[4];
+    char nodes[4][NI_MAXHOST];
+    INT results[4];
+    int resolved;
+    int i;
+
+    printf("[TEST] Batch reverse lookup (GetNameInfoBatchA)\n");
+
+    /* Two loopback entries, a duplicate of the first, and an unsupported family */
+    memset(addrs, 0, sizeof(addrs));
+    for (i = 0; i < 3; i++) {
+        struct sockaddr_in* sin;
+        sin = (struct sockaddr_in*)&addrs[i];
+        sin->sin_family = AF_INET;
+        sin->sin_addr.s_addr = htonl(i == 1 ? 0x7F000002 : INADDR_LOOPBACK);
+    }
+    addrs[3].ss_family = AF_PACKET;
+
+    resolved = GetNameInfoBatchA(addrs, 4, nodes[0], sizeof(nodes[0]),
+                                 NI_NUMERICHOST, results);
+    if (resolved != 3 || strcmp(nodes[0], "127.0.0.1") != 0 ||
+        strcmp(nodes[1], "127.0.0.2") != 0 || results[3] == 0) {
+        printf("  FAILED: numeric batch returned %d\n", resolved);
+        return;
+    }
+
+    printf("  SUCCESS: numeric batch resolved %d of 4 in input order\n", resolved);
+
+    resolved = GetNameInfoBatchA(addrs, 4, nodes[0], sizeof(nodes[0]), 0, results);
+    if (resolved == SOCKET_ERROR || strcmp(nodes[0], nodes[2]) != 0 || results[3] == 0) {
+        printf("  FAILED: reverse batch returned %d\n", resolved);
+        return;
+    }
+
+    printf("  SUCCESS: reverse batch resolved %d of 4 (127.0.0.1 -> %s)\n",
+           resolved, nodes[0]);
+
+    if (GetNameInfoBatchA(addrs, 0x80000000u, nodes[0], sizeof(nodes[0]), 0, results) !=
+        SOCKET_ERROR || WSAGetLastError() != WSAEINVAL) {
+        printf("  FAILED: oversized batch not rejected\n\n");
+    } else {
+        printf("  SUCCESS: oversized batch rejected\n\n");
+    }
+}
+
 /* Test socket options */
 void test_socket_options(void)
 {
@@ -229,6 +403,567 @@ void test_socket_options(void)
     printf("\n");
 }
 
+/* Test Windows option names and value formats */
+void test_sockopt_translation(void)
+{
+    SOCKET sock;
+    SOCKET udp;
+    DWORD timeout;
+    DWORD max_size;
+    char flag;
+    int optval;
+    int optlen;
+
+    printf("[TEST] Socket option translation\n");
+
+    sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+    /* SO_RCVTIMEO as DWORD milliseconds */
+    timeout = 2500;
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (char*)&timeout, sizeof(timeout));
+    timeout = 0;
+    optlen = sizeof(timeout);
+    if (getsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (char*)&timeout, &optlen) == SOCKET_ERROR ||
+        timeout != 2500 || optlen != (int)sizeof(DWORD)) {
+        printf("  FAILED: SO_RCVTIMEO round trip gave %lu ms\n", (unsigned long)timeout);
+    } else {
+        printf("  SUCCESS: SO_RCVTIMEO 2500 ms\n");
+    }
+
+    /* Buffer sizes read back as set */
+    optval = 65536;
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, (char*)&optval, sizeof(optval));
+    optval = 0;
+    optlen = sizeof(optval);
+    getsockopt(sock, SOL_SOCKET, SO_RCVBUF, (char*)&optval, &optlen);
+    if (optval != 65536) {
+        printf("  FAILED: SO_RCVBUF reads back %d\n", optval);
+    } else {
+        printf("  SUCCESS: SO_RCVBUF reads back 65536\n");
+    }
+    optlen = 2;
+    if (getsockopt(sock, SOL_SOCKET, SO_RCVBUF, (char*)&optval, &optlen) != SOCKET_ERROR ||
+        WSAGetLastError() != WSAEFAULT) {
+        printf("  FAILED: SO_RCVBUF into 2 bytes not rejected\n");
+    } else {
+        printf("  SUCCESS: SO_RCVBUF into 2 bytes fails with WSAEFAULT\n");
+    }
+
+    /* One-byte BOOL */
+    flag = 1;
+    optval = 0;
+    optlen = sizeof(optval);
+    if (setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag)) == SOCKET_ERROR ||
+        getsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (char*)&optval, &optlen) == SOCKET_ERROR ||
+        optval == 0) {
+        printf("  FAILED: TCP_NODELAY from a one-byte BOOL\n");
+    } else {
+        printf("  SUCCESS: TCP_NODELAY from a one-byte BOOL\n");
+    }
+
+    /* SO_EXCLUSIVEADDRUSE excludes SO_REUSEADDR */
+    optval = 1;
+    setsockopt(sock, SOL_SOCKET, SO_EXCLUSIVEADDRUSE, (char*)&optval, sizeof(optval));
+    optval = 0;
+    optlen = sizeof(optval);
+    getsockopt(sock, SOL_SOCKET, SO_EXCLUSIVEADDRUSE, (char*)&optval, &optlen);
+    flag = 1;
+    if (optval != 1 ||
+        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag)) != SOCKET_ERROR ||
+        WSAGetLastError() != WSAEINVAL) {
+        printf("  FAILED: SO_EXCLUSIVEADDRUSE\n");
+    } else {
+        printf("  SUCCESS: SO_EXCLUSIVEADDRUSE set, SO_REUSEADDR refused\n");
+    }
+
+    udp = socket(AF_INET, SOCK_DGRAM, 0);
+    max_size = 0;
+    optlen = sizeof(max_size);
+    if (getsockopt(udp, SOL_SOCKET, SO_MAX_MSG_SIZE, (char*)&max_size, &optlen) == SOCKET_ERROR ||
+        max_size != 65507) {
+        printf("  FAILED: SO_MAX_MSG_SIZE %lu\n", (unsigned long)max_size);
+    } else {
+        printf("  SUCCESS: SO_MAX_MSG_SIZE 65507 for UDP\n");
+    }
+
+    closesocket(udp);
+    closesocket(sock);
+    printf("\n");
+}
+
+/* Test that per-socket state does not leak to the next owner of a descriptor */
+void test_socket_table(void)
+{
+    WSANETWORKEVENTS events;
+    WSAEVENT event;
+    SOCKET first;
+    SOCKET second;
+    DWORD max_msg;
+    int optlen;
+    int value;
+
+    printf("[TEST] Socket table\n");
+
+    event = WSACreateEvent();
+    first = socket(AF_INET, SOCK_STREAM, 0);
+    value = 1;
+    setsockopt(first, SOL_SOCKET, SO_CONDITIONAL_ACCEPT, &value, sizeof(value));
+    optlen = sizeof(max_msg);
+    getsockopt(first, SOL_SOCKET, SO_MAX_MSG_SIZE, &max_msg, &optlen);
+    WSAEventSelect(first, event, FD_READ);
+    closesocket(first);
+
+    second = socket(AF_INET, SOCK_DGRAM, 0);
+    if (second != first) {
+        printf("  SKIPPED: Descriptor %d not reused\n\n", (int)first);
+        closesocket(second);
+        WSACloseEvent(event);
+        return;
+    }
+
+    value = -1;
+    optlen = sizeof(value);
+    getsockopt(second, SOL_SOCKET, SO_CONDITIONAL_ACCEPT, &value, &optlen);
+    max_msg = 0;
+    optlen = sizeof(max_msg);
+    getsockopt(second, SOL_SOCKET, SO_MAX_MSG_SIZE, &max_msg, &optlen);
+    if (value != 0 || max_msg != 65507) {
+        printf("  FAILED: Reused descriptor saw stale state (%d, %lu)\n",
+               value, (unsigned long)max_msg);
+    } else {
+        printf("  SUCCESS: Reused descriptor starts with fresh options and type\n");
+    }
+
+    if (WSAEnumNetworkEvents(second, NULL, &events) != SOCKET_ERROR) {
+        printf("  FAILED: WSAEventSelect state survived closesocket()\n");
+    } else {
+        printf("  SUCCESS: WSAEventSelect state retired by closesocket()\n");
+    }
+
+    closesocket(second);
+    WSACloseEvent(event);
+    printf("\n");
+}
+
+static int thread_count(void)
+{
+    char line[128];
+    FILE* f;
+    int threads;
+
+    threads = -1;
+    f = fopen("/proc/self/status", "r");
+    if (f == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "Threads: %d", &threads) == 1) {
+            break;
+        }
+    }
+    fclose(f);
+    return threads;
+}
+
+/* Test that closesocket() releases notification state and keeps SO_LINGER */
+void test_close_teardown(void)
+{
+    struct sockaddr_in addr;
+    struct linger lin;
+    WSAEVENT event;
+    WSAEVENT idle;
+    SOCKET listener;
+    SOCKET client;
+    SOCKET server;
+    char byte;
+    socklen_t len;
+    int before;
+    int after;
+    int i;
+
+    printf("[TEST] closesocket() teardown\n");
+
+    event = WSACreateEvent();
+    idle = WSACreateEvent();
+
+    /* Every WSAEventSelect monitor must go away with its socket */
+    before = thread_count();
+    for (i = 0; i < 64; i++) {
+        client = socket(AF_INET, SOCK_STREAM, 0);
+        WSAEventSelect(client, event, FD_READ | FD_CLOSE);
+        closesocket(client);
+    }
+    after = thread_count();
+    for (i = 0; i < 20 && after > before; i++) {
+        WSAWaitForMultipleEvents(1, &idle, FALSE, 50, FALSE);
+        after = thread_count();
+    }
+    if (after > before) {
+        printf("  FAILED: %d threads before churn, %d after\n", before, after);
+    } else {
+        printf("  SUCCESS: Thread count stable over socket churn\n");
+    }
+
+    /* SO_LINGER with a zero timeout still resets the connection */
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    len = sizeof(addr);
+    bind(listener, (struct sockaddr*)&addr, sizeof(addr));
+    listen(listener, 1);
+    getsockname(listener, (struct sockaddr*)&addr, &len);
+
+    client = socket(AF_INET, SOCK_STREAM, 0);
+    connect(client, (struct sockaddr*)&addr, sizeof(addr));
+    server = accept(listener, NULL, NULL);
+    WSAEventSelect(server, event, FD_READ | FD_CLOSE);
+    lin.l_onoff = 1;
+    lin.l_linger = 0;
+    setsockopt(server, SOL_SOCKET, SO_LINGER, (char*)&lin, sizeof(lin));
+    closesocket(server);
+
+    if (recv(client, &byte, 1, 0) != SOCKET_ERROR) {
+        printf("  FAILED: Peer of an abortive close saw an orderly shutdown\n");
+    } else {
+        printf("  SUCCESS: SO_LINGER abortive close preserved\n");
+    }
+
+    closesocket(client);
+    closesocket(listener);
+    WSACloseEvent(idle);
+    WSACloseEvent(event);
+    printf("\n");
+}
+
+/* Test per-function call statistics (only live in a STATS=1 build) */
+void test_call_stats(void)
+{
+    WSACALLSTATS stats[64];
+    SOCKET sock;
+    DWORD count;
+    DWORD i;
+    ULONGLONG calls;
+    int found;
+
+    printf("[TEST] Call statistics\n");
+
+    if (WSASetCallStats(TRUE) == SOCKET_ERROR) {
+        if (WSAGetLastError() == WSAEOPNOTSUPP) {
+            printf("  SUCCESS: Statistics not compiled in (WSAEOPNOTSUPP)\n\n");
+        } else {
+            printf("  FAILED: WSASetCallStats error %d\n\n", WSAGetLastError());
+        }
+        return;
+    }
+
+    WSAResetCallStats();
+    for (i = 0; i < 10; i++) {
+        sock = WSASocketA(AF_INET, SOCK_DGRAM, 0, NULL, 0, 0);
+        closesocket(sock);
+    }
+    ioctlsocket(INVALID_SOCKET, FIONBIO, NULL);
+
+    count = sizeof(stats) / sizeof(stats[0]);
+    if (WSAGetCallStats(stats, &count) == SOCKET_ERROR) {
+        printf("  FAILED: WSAGetCallStats error %d\n\n", WSAGetLastError());
+        return;
+    }
+    found = 0;
+    for (i = 0; i < count; i++) {
+        calls = stats[i].ullCalls;
+        if (strcmp(stats[i].pszFunction, "WSASocketA") == 0 && calls == 10) {
+            found++;
+        }
+        if (strcmp(stats[i].pszFunction, "ioctlsocket") == 0 &&
+            calls == 1 && stats[i].ullErrors == 1) {
+            found++;
+        }
+    }
+    if (found == 2) {
+        printf("  SUCCESS: Calls and errors counted since reset\n");
+    } else {
+        printf("  FAILED: Unexpected counters after reset\n");
+    }
+
+    WSASetCallStats(FALSE);
+    printf("\n");
+}
+
+/* Test SIO_SOCKET_STATS and WSAEnumSocketStats */
+void test_socket_stats(void)
+{
+    struct sockaddr_in addr;
+    WSA_SOCKET_STATS stats;
+    WSA_SOCKET_STATS* all;
+    WSAEVENT event;
+    SOCKET listener;
+    SOCKET client;
+    SOCKET server;
+    WSABUF wsabuf;
+    char data[100];
+    u_long nonblocking;
+    DWORD bytes;
+    DWORD flags;
+    DWORD count;
+    DWORD i;
+    socklen_t len;
+    int found;
+
+    printf("[TEST] Per-socket statistics\n");
+
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    len = sizeof(addr);
+    bind(listener, (struct sockaddr*)&addr, sizeof(addr));
+    listen(listener, 1);
+    getsockname(listener, (struct sockaddr*)&addr, &len);
+    client = socket(AF_INET, SOCK_STREAM, 0);
+    connect(client, (struct sockaddr*)&addr, sizeof(addr));
+    server = accept(listener, NULL, NULL);
+
+    event = WSACreateEvent();
+    WSAEventSelect(server, event, FD_READ | FD_CLOSE);
+    nonblocking = 1;
+    ioctlsocket(client, FIONBIO, &nonblocking);
+
+    memset(data, 'x', sizeof(data));
+    wsabuf.buf = data;
+    wsabuf.len = sizeof(data);
+    for (i = 0; i < 3; i++) {
+        WSASend(client, &wsabuf, 1, &bytes, 0, NULL, NULL);
+    }
+    flags = 0;
+    WSARecv(client, &wsabuf, 1, &bytes, &flags, NULL, NULL);
+
+    if (WSAIoctl(client, SIO_SOCKET_STATS, NULL, 0, &stats, sizeof(stats),
+                 &bytes, NULL, NULL) == SOCKET_ERROR) {
+        printf("  FAILED: SIO_SOCKET_STATS error %d\n", WSAGetLastError());
+    } else if (stats.BytesSent != 300 || stats.MessagesSent != 3 ||
+               stats.ReceiveWouldBlock != 1 || stats.MessagesReceived != 0) {
+        printf("  FAILED: Client counters %llu bytes / %llu sends / %llu would-block\n",
+               (unsigned long long)stats.BytesSent, (unsigned long long)stats.MessagesSent,
+               (unsigned long long)stats.ReceiveWouldBlock);
+    } else if (!stats.TcpInfoValid || stats.TcpInfo.State != TCPSTATE_ESTABLISHED) {
+        printf("  FAILED: TCP_INFO missing from socket statistics\n");
+    } else {
+        printf("  SUCCESS: Traffic, would-block and TCP_INFO reported\n");
+    }
+
+    if (WSAIoctl(server, SIO_SOCKET_STATS, NULL, 0, &stats, sizeof(stats),
+                 &bytes, NULL, NULL) == SOCKET_ERROR ||
+        stats.EventSelectMask != (FD_READ | FD_CLOSE)) {
+        printf("  FAILED: Event select mask not reported\n");
+    } else {
+        printf("  SUCCESS: Event select mask reported\n");
+    }
+
+    count = 0;
+    WSAEnumSocketStats(NULL, &count);
+    all = (WSA_SOCKET_STATS*)malloc(count * sizeof(WSA_SOCKET_STATS));
+    found = 0;
+    if (all != NULL && WSAEnumSocketStats(all, &count) == 0) {
+        for (i = 0; i < count; i++) {
+            if (all[i].Socket == client && all[i].BytesSent == 300) {
+                found++;
+            }
+            if (all[i].Socket == server) {
+                found++;
+            }
+        }
+    }
+    if (found == 2) {
+        printf("  SUCCESS: Both ends enumerated\n");
+    } else {
+        printf("  FAILED: Enumeration missed a socket\n");
+    }
+    free(all);
+
+    closesocket(client);
+    closesocket(server);
+    closesocket(listener);
+    WSACloseEvent(event);
+    printf("\n");
+}
+
+/* Test the call recorder and the trace it writes */
+void test_call_recorder(void)
+{
+    const char* path = "/tmp/test_winsock_trace.trc";
+    struct sockaddr_in addr;
+    WSATRACEHEADER header;
+    WSATRACERECORD record;
+    char names[64][WSA_TRACE_NAME_LEN];
+    SOCKET sock;
+    WSABUF wsabuf;
+    char data[32];
+    DWORD bytes;
+    DWORD i;
+    FILE* f;
+    int sends;
+    int closes;
+
+    printf("[TEST] Call recorder\n");
+
+    if (WSAStopRecording() != SOCKET_ERROR || WSAGetLastError() != WSAEINVAL) {
+        printf("  FAILED: WSAStopRecording without a recording should fail\n");
+    }
+    if (WSAStartRecording(path) == SOCKET_ERROR) {
+        printf("  FAILED: WSAStartRecording error %d\n\n", WSAGetLastError());
+        return;
+    }
+    if (WSAStartRecording(path) != SOCKET_ERROR || WSAGetLastError() != WSAEALREADY) {
+        printf("  FAILED: Second WSAStartRecording should fail with WSAEALREADY\n");
+    }
+
+    sock = WSASocketA(AF_INET, SOCK_DGRAM, 0, NULL, 0, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(9);
+    memset(data, 'x', sizeof(data));
+    wsabuf.buf = data;
+    wsabuf.len = sizeof(data);
+    for (i = 0; i < 3; i++) {
+        WSASendTo(sock, &wsabuf, 1, &bytes, 0, (struct sockaddr*)&addr, sizeof(addr), NULL, NULL);
+    }
+    closesocket(sock);
+    WSAStopRecording();
+
+    f = fopen(path, "rb");
+    if (f == NULL || fread(&header, sizeof(header), 1, f) != 1 ||
+        memcmp(header.szMagic, WSA_TRACE_MAGIC, sizeof(header.szMagic)) != 0 ||
+        header.dwRecordSize != sizeof(WSATRACERECORD) || header.dwFunctionCount > 64 ||
+        fread(names, WSA_TRACE_NAME_LEN, header.dwFunctionCount, f) != header.dwFunctionCount) {
+        printf("  FAILED: Trace header not written\n\n");
+        if (f != NULL) {
+            fclose(f);
+        }
+        remove(path);
+        return;
+    }
+    sends = 0;
+    closes = 0;
+    while (fread(&record, sizeof(record), 1, f) == 1) {
+        if (record.iSocket != (INT)sock || record.wFunction >= header.dwFunctionCount) {
+            continue;
+        }
+        if (strcmp(names[record.wFunction], "WSASendTo") == 0 &&
+            record.dwSize == sizeof(data) && record.iResult == (INT)sizeof(data)) {
+            sends++;
+        }
+        if (strcmp(names[record.wFunction], "closesocket") == 0) {
+            closes++;
+        }
+    }
+    fclose(f);
+    remove(path);
+
+    if (sends == 3 && closes == 1 && header.ullDropped == 0) {
+        printf("  SUCCESS: Sends and close recorded with sizes and results\n");
+    } else {
+        printf("  FAILED: Trace holds %d sends and %d closes\n", sends, closes);
+    }
+    printf("\n");
+}
+
+/* Test the paths whose records come from pools: scatter/gather and events */
+void test_pooled_records(void)
+{
+    struct sockaddr_in addr;
+    WSABUF bufs[100];
+    WSAEVENT events[100];
+    SOCKET receiver;
+    SOCKET sender;
+    char out[100];
+    char in[100];
+    char addr_bytes[32];
+    DWORD counts[2] = { 3, 100 };
+    DWORD bytes;
+    DWORD flags;
+    DWORD i;
+    DWORD n;
+    socklen_t len;
+    int ok;
+
+    printf("[TEST] Pooled records\n");
+
+    receiver = socket(AF_INET, SOCK_DGRAM, 0);
+    sender = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    len = sizeof(addr);
+    bind(receiver, (struct sockaddr*)&addr, sizeof(addr));
+    getsockname(receiver, (struct sockaddr*)&addr, &len);
+    connect(sender, (struct sockaddr*)&addr, sizeof(addr));
+
+    /* 3 buffers fit a pooled iovec array, 100 take the malloc path */
+    ok = 1;
+    for (n = 0; n < 2; n++) {
+        for (i = 0; i < counts[n]; i++) {
+            out[i] = (char)('a' + i % 26);
+            bufs[i].buf = &out[i];
+            bufs[i].len = 1;
+        }
+        if (WSASend(sender, bufs, counts[n], &bytes, 0, NULL, NULL) == SOCKET_ERROR ||
+            bytes != counts[n]) {
+            ok = 0;
+            continue;
+        }
+        memset(in, 0, sizeof(in));
+        for (i = 0; i < counts[n]; i++) {
+            bufs[i].buf = &in[i];
+        }
+        flags = 0;
+        if (WSARecv(receiver, bufs, counts[n], &bytes, &flags, NULL, NULL) == SOCKET_ERROR ||
+            bytes != counts[n] || memcmp(in, out, counts[n]) != 0) {
+            ok = 0;
+        }
+    }
+    if (ok) {
+        printf("  SUCCESS: Scatter/gather with pooled and heap iovec arrays\n");
+    } else {
+        printf("  FAILED: Scatter/gather data mismatch\n");
+    }
+
+    /* Freed events are handed out again; each must start unsignaled */
+    ok = 1;
+    for (n = 0; n < 3; n++) {
+        for (i = 0; i < 100; i++) {
+            events[i] = WSACreateEvent();
+            if (events[i] == NULL ||
+                WSAWaitForMultipleEvents(1, &events[i], FALSE, 0, FALSE) != WSA_WAIT_TIMEOUT) {
+                ok = 0;
+            }
+        }
+        for (i = 0; i < 100; i++) {
+            WSASetEvent(events[i]);
+            WSACloseEvent(events[i]);
+        }
+    }
+    if (ok) {
+        printf("  SUCCESS: Recycled event objects start unsignaled\n");
+    } else {
+        printf("  FAILED: Recycled event object was signaled\n");
+    }
+
+    memset(addr_bytes, 0, sizeof(addr_bytes));
+    if (WSAAsyncGetHostByAddr(NULL, 0, addr_bytes, sizeof(addr_bytes), AF_INET,
+                              out, sizeof(out)) == NULL &&
+        WSAGetLastError() == WSAEFAULT) {
+        printf("  SUCCESS: Oversized lookup address rejected\n");
+    } else {
+        printf("  FAILED: Oversized lookup address accepted\n");
+    }
+
+    closesocket(sender);
+    closesocket(receiver);
+    printf("\n");
+}
+
 /* Test select function */
 void test_select(void)
 {
@@ -267,6 +1002,781 @@ void test_select(void)
     printf("\n");
 }
 
+/* Test select() on a descriptor beyond the POSIX FD_SETSIZE */
+void test_select_high_fd(void)
+{
+    SOCKET pair[2];
+    SOCKET high;
+    fd_set readfds;
+    struct timeval timeout;
+    int result;
+
+    printf("[TEST] select() with high-numbered socket\n");
+
+    if (WSASocketPair(AF_UNIX, SOCK_STREAM, 0, pair) == SOCKET_ERROR) {
+        printf("  FAILED: WSASocketPair error %d\n\n", WSAGetLastError());
+        return;
+    }
+
+    high = fcntl(pair[0], F_DUPFD, 4000);
+    if (high == INVALID_SOCKET) {
+        printf("  SKIPPED: Descriptor limit too low\n\n");
+        closesocket(pair[0]);
+        closesocket(pair[1]);
+        return;
+    }
+    send(pair[1], "x", 1, 0);
+
+    FD_ZERO(&readfds);
+    FD_SET(pair[1], &readfds);
+    FD_SET(high, &readfds);
+    FD_SET(high, &readfds);
+
+    timeout.tv_sec = 1;
+    timeout.tv_usec = 0;
+
+    result = select(0, &readfds, NULL, NULL, &timeout);
+    if (result != 1 || readfds.fd_count != 1 || !FD_ISSET(high, &readfds) ||
+        FD_ISSET(pair[1], &readfds)) {
+        printf("  FAILED: select() returned %d, error %d\n", result, WSAGetLastError());
+    } else {
+        printf("  SUCCESS: Socket %d reported readable\n", high);
+    }
+
+    FD_ZERO(&readfds);
+    if (select(0, &readfds, NULL, NULL, &timeout) != SOCKET_ERROR ||
+        WSAGetLastError() != WSAEINVAL) {
+        printf("  FAILED: Empty sets should fail with WSAEINVAL\n");
+    }
+
+    closesocket(high);
+    closesocket(pair[0]);
+    closesocket(pair[1]);
+    printf("\n");
+}
+
+/* Test errno translation on non-blocking sockets */
+void test_error_mapping(void)
+{
+    SOCKET pair[2];
+    SOCKET listener;
+    SOCKET accepted;
+    struct sockaddr_in addr;
+    char buffer[16];
+    WSABUF wsabuf;
+    DWORD received;
+    DWORD flags;
+    unsigned long nonblocking;
+
+    printf("[TEST] errno to WSA error translation\n");
+
+    if (WSASocketPair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, pair) == SOCKET_ERROR) {
+        printf("  FAILED: WSASocketPair error %d\n\n", WSAGetLastError());
+        return;
+    }
+
+    wsabuf.buf = buffer;
+    wsabuf.len = sizeof(buffer);
+    flags = 0;
+    if (WSARecv(pair[0], &wsabuf, 1, &received, &flags, NULL, NULL) != SOCKET_ERROR ||
+        WSAGetLastError() != WSAEWOULDBLOCK) {
+        printf("  FAILED: WSARecv on empty socket gave %d\n", WSAGetLastError());
+    } else {
+        printf("  SUCCESS: WSARecv reports WSAEWOULDBLOCK\n");
+    }
+    closesocket(pair[0]);
+    closesocket(pair[1]);
+
+    /* AcceptEx with no pending connection must not look like a refusal */
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    accepted = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    nonblocking = 1;
+    if (bind(listener, (struct sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR ||
+        listen(listener, 1) == SOCKET_ERROR ||
+        ioctlsocket(listener, FIONBIO, &nonblocking) == SOCKET_ERROR) {
+        printf("  FAILED: Could not set up listener\n");
+    } else if (AcceptEx(listener, accepted, NULL, 0, 0, 0, &received, NULL) ||
+               WSAGetLastError() != WSAEWOULDBLOCK) {
+        printf("  FAILED: AcceptEx gave %d, expected WSAEWOULDBLOCK\n", WSAGetLastError());
+    } else {
+        printf("  SUCCESS: AcceptEx reports WSAEWOULDBLOCK\n");
+    }
+    closesocket(accepted);
+    closesocket(listener);
+
+    printf("\n");
+}
+
+/* Test WSAPoll in both the poll() and the epoll-backed mode */
+void test_wsapoll(void)
+{
+    SOCKET pair[2];
+    WSAPOLLFD fds[3];
+    DWORD mode;
+    int round;
+
+    printf("[TEST] WSAPoll\n");
+
+    for (mode = WSA_POLL_MODE_POLL; mode <= WSA_POLL_MODE_EPOLL; mode++) {
+        WSASetPollMode(mode);
+
+        /* Run twice so the epoll mode also reuses a closed descriptor number */
+        for (round = 0; round < 2; round++) {
+            if (WSASocketPair(AF_UNIX, SOCK_STREAM, 0, pair) == SOCKET_ERROR) {
+                printf("  FAILED: WSASocketPair error %d\n", WSAGetLastError());
+                return;
+            }
+            send(pair[1], "x", 1, 0);
+
+            fds[0].fd = pair[0];
+            fds[0].events = POLLRDNORM;
+            fds[1].fd = pair[1];
+            fds[1].events = POLLOUT;
+            fds[2].fd = -1;
+            fds[2].events = POLLIN;
+
+            if (WSAPoll(fds, 3, 1000) != 2 ||
+                !(fds[0].revents & POLLIN) || !(fds[0].revents & POLLRDNORM) ||
+                !(fds[1].revents & POLLWRNORM) || fds[2].revents != 0) {
+                printf("  FAILED: mode %u revents 0x%x 0x%x 0x%x\n", (unsigned)mode,
+                       fds[0].revents, fds[1].revents, fds[2].revents);
+            }
+
+            closesocket(pair[0]);
+            closesocket(pair[1]);
+        }
+
+        /* A closed descriptor is reported as POLLNVAL */
+        fds[0].fd = pair[0];
+        fds[0].events = POLLIN;
+        if (WSAPoll(fds, 1, 0) != 1 || fds[0].revents != POLLNVAL) {
+            printf("  FAILED: mode %u closed fd revents 0x%x\n", (unsigned)mode, fds[0].revents);
+        }
+
+        printf("  SUCCESS: WSAPoll mode %u\n", (unsigned)mode);
+    }
+
+    WSASetPollMode(WSA_POLL_MODE_POLL);
+    printf("\n");
+}
+
+/* Test WSAAsyncSelect message delivery */
+void test_async_select(void)
+{
+    HANDLE hWnd;
+    SOCKET listener;
+    SOCKET client;
+    SOCKET server;
+    struct sockaddr_in addr;
+    socklen_t len;
+    WSAASYNCMSG msgs[4];
+    char buffer[16];
+    int n;
+
+    printf("[TEST] WSAAsyncSelect message queue\n");
+
+    hWnd = (HANDLE)&hWnd;
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    len = sizeof(addr);
+    if (bind(listener, (struct sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR ||
+        listen(listener, 4) == SOCKET_ERROR ||
+        getsockname(listener, (struct sockaddr*)&addr, &len) == SOCKET_ERROR ||
+        WSAAsyncSelect(listener, hWnd, 0x401, FD_ACCEPT) == SOCKET_ERROR) {
+        printf("  FAILED: Could not set up listener (%d)\n\n", WSAGetLastError());
+        closesocket(listener);
+        return;
+    }
+
+    /* Registered before connect(): FD_CONNECT then FD_WRITE */
+    client = socket(AF_INET, SOCK_STREAM, 0);
+    WSAAsyncSelect(client, hWnd, 0x402, FD_CONNECT | FD_WRITE | FD_CLOSE);
+    WSAConnect(client, (struct sockaddr*)&addr, sizeof(addr), NULL, NULL, NULL, NULL);
+
+    server = INVALID_SOCKET;
+    n = 0;
+    while (n < 3 && WSAGetAsyncMessage(&msgs[n], hWnd, 2000)) {
+        if (msgs[n].message == 0x401 && WSAGETSELECTEVENT(msgs[n].lParam) == FD_ACCEPT) {
+            server = accept(listener, NULL, NULL);
+        }
+        n++;
+    }
+    if (n != 3 || server == INVALID_SOCKET) {
+        printf("  FAILED: Expected FD_ACCEPT, FD_CONNECT and FD_WRITE, got %d messages\n", n);
+    } else {
+        printf("  SUCCESS: FD_ACCEPT, FD_CONNECT and FD_WRITE delivered\n");
+    }
+
+    /* Data arriving while FD_READ is outstanding posts nothing more */
+    WSAAsyncSelect(server, hWnd, 0x403, FD_READ | FD_CLOSE);
+    send(client, "ab", 2, 0);
+    WSAPoll(NULL, 0, 100);
+    send(client, "c", 1, 0);
+    WSAPoll(NULL, 0, 100);
+    n = WSAGetAsyncMessages(hWnd, msgs, 4, 2000);
+    if (n != 1 || WSAGETSELECTEVENT(msgs[0].lParam) != FD_READ ||
+        msgs[0].wParam != (UINT_PTR)server) {
+        printf("  FAILED: Expected a single FD_READ, got %d messages\n", n);
+    } else {
+        printf("  SUCCESS: Single FD_READ until re-enabled\n");
+    }
+    recv(server, buffer, sizeof(buffer), 0);
+
+    closesocket(client);
+    n = WSAGetAsyncMessages(hWnd, msgs, 4, 2000);
+    if (n < 1 || WSAGETSELECTEVENT(msgs[n - 1].lParam) != FD_CLOSE) {
+        printf("  FAILED: No FD_CLOSE after peer close\n");
+    } else {
+        printf("  SUCCESS: FD_CLOSE delivered\n");
+    }
+
+    WSAAsyncSelect(server, hWnd, 0, 0);
+    closesocket(server);
+    closesocket(listener);
+    printf("\n");
+}
+
+/* Test SIO_ADDRESS_LIST_CHANGE / SIO_ROUTING_INTERFACE_CHANGE requests */
+void test_address_change_notify(void)
+{
+    WSAOVERLAPPED ov;
+    WSAEVENT event;
+    SOCKET sock;
+    DWORD bytes;
+    DWORD flags;
+    int result;
+
+    printf("[TEST] Address/route change notification\n");
+
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    event = WSACreateEvent();
+    memset(&ov, 0, sizeof(ov));
+    ov.hEvent = event;
+
+    result = WSAIoctl(sock, SIO_ADDRESS_LIST_CHANGE, NULL, 0, NULL, 0, &bytes, &ov, NULL);
+    if (result != SOCKET_ERROR || WSAGetLastError() != WSA_IO_PENDING) {
+        printf("  FAILED: Overlapped request returned %d (%d)\n", result, WSAGetLastError());
+    } else if (WSAGetOverlappedResult(sock, &ov, &bytes, FALSE, &flags) ||
+               WSAGetLastError() != WSA_IO_INCOMPLETE || HasOverlappedIoCompleted(&ov)) {
+        printf("  FAILED: Request not reported as incomplete\n");
+    } else {
+        printf("  SUCCESS: Overlapped request pending\n");
+    }
+
+    /* Non-blocking socket: armed for FD_ROUTING_INTERFACE_CHANGE */
+    WSAEventSelect(sock, event, FD_ROUTING_INTERFACE_CHANGE);
+    result = WSAIoctl(sock, SIO_ROUTING_INTERFACE_CHANGE, NULL, 0, NULL, 0, &bytes, NULL, NULL);
+    if (result != SOCKET_ERROR || WSAGetLastError() != WSAEWOULDBLOCK) {
+        printf("  FAILED: Non-blocking request returned %d (%d)\n", result, WSAGetLastError());
+    } else {
+        printf("  SUCCESS: Non-blocking request armed\n");
+    }
+
+    /* closesocket() aborts the overlapped request */
+    WSAResetEvent(event);
+    closesocket(sock);
+    if (WSAWaitForMultipleEvents(1, &event, FALSE, 0, FALSE) != WSA_WAIT_EVENT_0 ||
+        ov.Internal != WSA_OPERATION_ABORTED) {
+        printf("  FAILED: Request not aborted by closesocket() (%lu)\n",
+               (unsigned long)ov.Internal);
+    } else {
+        printf("  SUCCESS: closesocket() completed the request with WSA_OPERATION_ABORTED\n");
+    }
+
+    WSACloseEvent(event);
+    printf("\n");
+}
+
+/* Test SIO_ADDRESS_LIST_QUERY / SIO_ROUTING_INTERFACE_QUERY */
+void test_interface_query(void)
+{
+    char buffer[2048];
+    LPSOCKET_ADDRESS_LIST list;
+    struct sockaddr_in dest;
+    struct sockaddr_in* sin;
+    struct sockaddr_in source;
+    SOCKET sock;
+    DWORD bytes;
+    DWORD needed;
+    int found;
+    int i;
+
+    printf("[TEST] Address list and routing interface queries\n");
+
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+
+    /* Too small: WSAEFAULT with the size required */
+    if (WSAIoctl(sock, SIO_ADDRESS_LIST_QUERY, NULL, 0, buffer, 4, &needed, NULL, NULL) != SOCKET_ERROR ||
+        WSAGetLastError() != WSAEFAULT || needed <= 4) {
+        printf("  FAILED: Undersized buffer not rejected\n");
+    } else if (WSAIoctl(sock, SIO_ADDRESS_LIST_QUERY, NULL, 0, buffer, sizeof(buffer),
+                        &bytes, NULL, NULL) == SOCKET_ERROR || bytes != needed) {
+        printf("  FAILED: SIO_ADDRESS_LIST_QUERY (%d)\n", WSAGetLastError());
+    } else {
+        list = (LPSOCKET_ADDRESS_LIST)buffer;
+        found = 0;
+        for (i = 0; i < list->iAddressCount; i++) {
+            sin = (struct sockaddr_in*)list->Address[i].lpSockaddr;
+            if (sin->sin_family == AF_INET && sin->sin_addr.s_addr == htonl(INADDR_LOOPBACK)) {
+                found = 1;
+            }
+        }
+        if (found) {
+            printf("  SUCCESS: %d IPv4 addresses, loopback included\n", list->iAddressCount);
+        } else {
+            printf("  FAILED: 127.0.0.1 missing from %d addresses\n", list->iAddressCount);
+        }
+    }
+
+    memset(&dest, 0, sizeof(dest));
+    dest.sin_family = AF_INET;
+    dest.sin_addr.s_addr = htonl(0x7F000005); /* 127.0.0.5 */
+    if (WSAIoctl(sock, SIO_ROUTING_INTERFACE_QUERY, &dest, sizeof(dest),
+                 &source, sizeof(source), &bytes, NULL, NULL) == SOCKET_ERROR) {
+        printf("  FAILED: SIO_ROUTING_INTERFACE_QUERY (%d)\n", WSAGetLastError());
+    } else if (source.sin_addr.s_addr != htonl(INADDR_LOOPBACK)) {
+        printf("  FAILED: Unexpected source for 127.0.0.5\n");
+    } else {
+        printf("  SUCCESS: 127.0.0.5 routed from 127.0.0.1\n");
+    }
+
+    closesocket(sock);
+    printf("\n");
+}
+
+/* Test SIO_KEEPALIVE_VALS, SIO_TCP_INFO and SIO_LOOPBACK_FAST_PATH */
+void test_tcp_ioctls(void)
+{
+    struct tcp_keepalive ka;
+    struct sockaddr_in addr;
+    TCP_INFO_v0 info;
+    SOCKET listener;
+    SOCKET client;
+    SOCKET udp;
+    socklen_t len;
+    DWORD version;
+    DWORD bytes;
+    int enable;
+    int optlen;
+    int idle;
+    int interval;
+
+    printf("[TEST] TCP vendor ioctls\n");
+
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    client = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    len = sizeof(addr);
+    bind(listener, (struct sockaddr*)&addr, sizeof(addr));
+    listen(listener, 1);
+    getsockname(listener, (struct sockaddr*)&addr, &len);
+
+    enable = 1;
+    if (WSAIoctl(client, SIO_LOOPBACK_FAST_PATH, &enable, sizeof(enable),
+                 NULL, 0, &bytes, NULL, NULL) == SOCKET_ERROR) {
+        printf("  FAILED: SIO_LOOPBACK_FAST_PATH (%d)\n", WSAGetLastError());
+    } else {
+        printf("  SUCCESS: SIO_LOOPBACK_FAST_PATH accepted\n");
+    }
+
+    if (connect(client, (struct sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR) {
+        printf("  FAILED: connect() (%d)\n\n", WSAGetLastError());
+        closesocket(client);
+        closesocket(listener);
+        return;
+    }
+
+    ka.onoff = 1;
+    ka.keepalivetime = 30000;
+    ka.keepaliveinterval = 1500;
+    idle = 0;
+    interval = 0;
+    if (WSAIoctl(client, SIO_KEEPALIVE_VALS, &ka, sizeof(ka), NULL, 0, &bytes, NULL, NULL) == SOCKET_ERROR) {
+        printf("  FAILED: SIO_KEEPALIVE_VALS (%d)\n", WSAGetLastError());
+    } else {
+        optlen = sizeof(idle);
+        getsockopt(client, IPPROTO_TCP, TCP_KEEPIDLE, &idle, &optlen);
+        optlen = sizeof(interval);
+        getsockopt(client, IPPROTO_TCP, TCP_KEEPINTVL, &interval, &optlen);
+        if (idle == 30 && interval == 2) {
+            printf("  SUCCESS: Keepalive 30000/1500 ms -> %d/%d s\n", idle, interval);
+        } else {
+            printf("  FAILED: Keepalive idle %d, interval %d\n", idle, interval);
+        }
+    }
+
+    version = 0;
+    if (WSAIoctl(client, SIO_TCP_INFO, &version, sizeof(version), &info, sizeof(info),
+                 &bytes, NULL, NULL) == SOCKET_ERROR) {
+        printf("  FAILED: SIO_TCP_INFO (%d)\n", WSAGetLastError());
+    } else if (info.State != TCPSTATE_ESTABLISHED || info.Mss == 0 || bytes != sizeof(info)) {
+        printf("  FAILED: SIO_TCP_INFO state %lu, mss %lu\n",
+               (unsigned long)info.State, (unsigned long)info.Mss);
+    } else {
+        printf("  SUCCESS: SIO_TCP_INFO established, mss %lu, rtt %lu us\n",
+               (unsigned long)info.Mss, (unsigned long)info.RttUs);
+    }
+
+    udp = socket(AF_INET, SOCK_DGRAM, 0);
+    if (WSAIoctl(udp, SIO_TCP_INFO, &version, sizeof(version), &info, sizeof(info),
+                 &bytes, NULL, NULL) != SOCKET_ERROR || WSAGetLastError() != WSAEOPNOTSUPP) {
+        printf("  FAILED: SIO_TCP_INFO on UDP not rejected\n");
+    } else {
+        printf("  SUCCESS: SIO_TCP_INFO on UDP rejected\n");
+    }
+
+    closesocket(udp);
+    closesocket(client);
+    closesocket(listener);
+    printf("\n");
+}
+
+/* Test SIO_ACCEPT_SHARDS: every connection is accepted through the one SOCKET */
+void test_accept_shards(void)
+{
+    struct sockaddr_in addr;
+    SOCKET listener;
+    SOCKET bound;
+    SOCKET clients[6];
+    SOCKET servers[6];
+    WSAEVENT event;
+    socklen_t len;
+    u_long nonblock;
+    DWORD shards;
+    DWORD bytes;
+    int accepted;
+    int one;
+    int i;
+
+    printf("[TEST] Accept shards\n");
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    shards = 4;
+    bound = socket(AF_INET, SOCK_STREAM, 0);
+    bind(bound, (struct sockaddr*)&addr, sizeof(addr));
+    if (WSAIoctl(bound, SIO_ACCEPT_SHARDS, &shards, sizeof(shards),
+                 NULL, 0, &bytes, NULL, NULL) != SOCKET_ERROR ||
+        WSAGetLastError() != WSAEINVAL) {
+        printf("  FAILED: SIO_ACCEPT_SHARDS after bind() not rejected\n");
+    } else {
+        printf("  SUCCESS: SIO_ACCEPT_SHARDS after bind() rejected\n");
+    }
+    closesocket(bound);
+
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (WSAIoctl(listener, SIO_ACCEPT_SHARDS, &shards, sizeof(shards),
+                 NULL, 0, &bytes, NULL, NULL) == SOCKET_ERROR) {
+        printf("  FAILED: SIO_ACCEPT_SHARDS (%d)\n\n", WSAGetLastError());
+        closesocket(listener);
+        return;
+    }
+    len = sizeof(addr);
+    bind(listener, (struct sockaddr*)&addr, sizeof(addr));
+    listen(listener, 16);
+    getsockname(listener, (struct sockaddr*)&addr, &len);
+
+    /* The first accept creates the other shards */
+    nonblock = 1;
+    ioctlsocket(listener, FIONBIO, &nonblock);
+    if (WSAAccept(listener, NULL, NULL, NULL, 0) != INVALID_SOCKET ||
+        WSAGetLastError() != WSAEWOULDBLOCK) {
+        printf("  FAILED: Empty sharded listener did not return WSAEWOULDBLOCK\n");
+    }
+
+    for (i = 0; i < 6; i++) {
+        clients[i] = socket(AF_INET, SOCK_STREAM, 0);
+        connect(clients[i], (struct sockaddr*)&addr, sizeof(addr));
+    }
+
+    accepted = 0;
+    for (i = 0; i < 6; i++) {
+        servers[i] = WSAAccept(listener, NULL, NULL, NULL, 0);
+        if (servers[i] != INVALID_SOCKET) {
+            accepted++;
+        }
+    }
+    if (accepted == 6 && WSAAccept(listener, NULL, NULL, NULL, 0) == INVALID_SOCKET &&
+        WSAGetLastError() == WSAEWOULDBLOCK) {
+        printf("  SUCCESS: All 6 connections accepted from the sharded listener\n");
+    } else {
+        printf("  FAILED: Accepted %d of 6 connections\n", accepted);
+    }
+
+    /* FD_ACCEPT cannot cover the hidden shards */
+    event = WSACreateEvent();
+    if (WSAEventSelect(listener, event, FD_ACCEPT) == SOCKET_ERROR &&
+        WSAGetLastError() == WSAEINVAL) {
+        printf("  SUCCESS: WSAEventSelect() on a sharded listener rejected\n");
+    } else {
+        printf("  FAILED: WSAEventSelect() on a sharded listener not rejected\n");
+    }
+    WSACloseEvent(event);
+
+    /* Back in blocking mode, accept waits on every shard */
+    closesocket(clients[0]);
+    closesocket(servers[0]);
+    nonblock = 0;
+    ioctlsocket(listener, FIONBIO, &nonblock);
+    clients[0] = socket(AF_INET, SOCK_STREAM, 0);
+    connect(clients[0], (struct sockaddr*)&addr, sizeof(addr));
+    servers[0] = WSAAccept(listener, NULL, NULL, NULL, 0);
+    if (servers[0] != INVALID_SOCKET) {
+        printf("  SUCCESS: Blocking accept() on the sharded listener\n");
+    } else {
+        printf("  FAILED: Blocking accept() on the sharded listener (%d)\n", WSAGetLastError());
+    }
+
+    for (i = 0; i < 6; i++) {
+        closesocket(clients[i]);
+        if (servers[i] != INVALID_SOCKET) {
+            closesocket(servers[i]);
+        }
+    }
+    closesocket(listener);
+
+    /* No hidden shard may still be listening on the port */
+    one = 1;
+    bound = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(bound, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(bound, (struct sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR) {
+        printf("  FAILED: Port still in use after closesocket() (%d)\n", WSAGetLastError());
+    } else {
+        printf("  SUCCESS: closesocket() released every shard\n");
+    }
+    closesocket(bound);
+    printf("\n");
+}
+
+/* Condition function returning dwCallbackData, recording the caller's port */
+static u_short g_condition_port;
+
+static int CALLBACK accept_condition(LPWSABUF lpCallerId, LPWSABUF lpCallerData,
+                                     LPQOS lpSQOS, LPQOS lpGQOS,
+                                     LPWSABUF lpCalleeId, LPWSABUF lpCalleeData,
+                                     GROUP* g, DWORD_PTR dwCallbackData)
+{
+    (void)lpCallerData;
+    (void)lpSQOS;
+    (void)lpGQOS;
+    (void)lpCalleeData;
+    (void)g;
+
+    g_condition_port = 0;
+    if (lpCallerId != NULL && lpCallerId->len >= sizeof(struct sockaddr_in) &&
+        lpCalleeId != NULL && lpCalleeId->len >= sizeof(struct sockaddr_in)) {
+        g_condition_port = ntohs(((struct sockaddr_in*)lpCallerId->buf)->sin_port);
+    }
+    return (int)dwCallbackData;
+}
+
+/* Test WSAAccept condition functions and the SIO_ACCEPT_DENYLIST pre-filter */
+void test_conditional_accept(void)
+{
+    IP_ADDRESS_PREFIX deny;
+    struct sockaddr_in addr;
+    struct sockaddr_in local;
+    struct sockaddr_in peer;
+    WSAPOLLFD pfd;
+    SOCKET listener;
+    SOCKET client;
+    SOCKET server;
+    socklen_t len;
+    u_long nonblock;
+    DWORD bytes;
+    BOOL conditional;
+    int peer_len;
+    char byte;
+
+    printf("[TEST] Conditional accept\n");
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    len = sizeof(addr);
+    bind(listener, (struct sockaddr*)&addr, sizeof(addr));
+    listen(listener, 4);
+    getsockname(listener, (struct sockaddr*)&addr, &len);
+
+    /* CF_DEFER needs SO_CONDITIONAL_ACCEPT on the listener */
+    client = socket(AF_INET, SOCK_STREAM, 0);
+    connect(client, (struct sockaddr*)&addr, sizeof(addr));
+    server = WSAAccept(listener, NULL, NULL, accept_condition, CF_DEFER);
+    if (server != INVALID_SOCKET || WSAGetLastError() != WSAEINVAL) {
+        printf("  FAILED: CF_DEFER without SO_CONDITIONAL_ACCEPT not rejected\n");
+    }
+    closesocket(client);
+
+    /* CF_DEFER keeps the connection for the next call, as does a short addrlen */
+    conditional = TRUE;
+    setsockopt(listener, SOL_SOCKET, SO_CONDITIONAL_ACCEPT, (char*)&conditional, sizeof(conditional));
+    client = socket(AF_INET, SOCK_STREAM, 0);
+    connect(client, (struct sockaddr*)&addr, sizeof(addr));
+    len = sizeof(local);
+    getsockname(client, (struct sockaddr*)&local, &len);
+    server = WSAAccept(listener, NULL, NULL, accept_condition, CF_DEFER);
+    if (server != INVALID_SOCKET || WSAGetLastError() != WSATRY_AGAIN) {
+        printf("  FAILED: CF_DEFER did not return WSATRY_AGAIN\n");
+    }
+    peer_len = 4;
+    server = WSAAccept(listener, (struct sockaddr*)&peer, &peer_len, accept_condition, CF_ACCEPT);
+    if (server != INVALID_SOCKET || WSAGetLastError() != WSAEFAULT) {
+        printf("  FAILED: Short addrlen did not return WSAEFAULT\n");
+    }
+    server = WSAAccept(listener, NULL, NULL, accept_condition, CF_ACCEPT);
+    if (server == INVALID_SOCKET || g_condition_port != ntohs(local.sin_port)) {
+        printf("  FAILED: Deferred connection not offered again (%d)\n", WSAGetLastError());
+    } else {
+        printf("  SUCCESS: CF_DEFER then CF_ACCEPT, caller id port %u\n", g_condition_port);
+        closesocket(server);
+    }
+    closesocket(client);
+
+    /* CF_REJECT resets the peer */
+    client = socket(AF_INET, SOCK_STREAM, 0);
+    connect(client, (struct sockaddr*)&addr, sizeof(addr));
+    server = WSAAccept(listener, NULL, NULL, accept_condition, CF_REJECT);
+    if (server != INVALID_SOCKET || WSAGetLastError() != WSAECONNREFUSED) {
+        printf("  FAILED: CF_REJECT did not return WSAECONNREFUSED\n");
+    } else if (recv(client, &byte, 1, 0) != SOCKET_ERROR) {
+        printf("  FAILED: Rejected peer was not reset\n");
+    } else {
+        printf("  SUCCESS: CF_REJECT reset the peer\n");
+    }
+    closesocket(client);
+
+    /* Denied peers never complete the handshake */
+    memset(&deny, 0, sizeof(deny));
+    deny.Prefix.Ipv4.sin_family = AF_INET;
+    deny.Prefix.Ipv4.sin_addr.s_addr = htonl(0x7f000000);
+    deny.PrefixLength = 8;
+    if (WSAIoctl(listener, SIO_ACCEPT_DENYLIST, &deny, sizeof(deny),
+                 NULL, 0, &bytes, NULL, NULL) == SOCKET_ERROR) {
+        printf("  FAILED: SIO_ACCEPT_DENYLIST (%d)\n", WSAGetLastError());
+    } else {
+        client = socket(AF_INET, SOCK_STREAM, 0);
+        nonblock = 1;
+        ioctlsocket(client, FIONBIO, &nonblock);
+        connect(client, (struct sockaddr*)&addr, sizeof(addr));
+        pfd.fd = client;
+        pfd.events = POLLWRNORM;
+        pfd.revents = 0;
+        if (WSAPoll(&pfd, 1, 200) != 0) {
+            printf("  FAILED: Denied peer connected\n");
+        } else {
+            printf("  SUCCESS: SYN from 127.0.0.0/8 dropped by the denylist\n");
+        }
+        closesocket(client);
+
+        WSAIoctl(listener, SIO_ACCEPT_DENYLIST, NULL, 0, NULL, 0, &bytes, NULL, NULL);
+        client = socket(AF_INET, SOCK_STREAM, 0);
+        if (connect(client, (struct sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR) {
+            printf("  FAILED: Connect after clearing the denylist (%d)\n", WSAGetLastError());
+        } else {
+            printf("  SUCCESS: Empty denylist removes the filter\n");
+        }
+        closesocket(client);
+    }
+
+    closesocket(listener);
+    printf("\n");
+}
+
+/* Test WSAConnectByList/WSAConnectByNameA against a loopback listener */
+void test_connect_by_name(void)
+{
+    SOCKET listener;
+    SOCKET client;
+    struct sockaddr_in addr;
+    struct sockaddr_in closed;
+    struct sockaddr_storage remote;
+    DWORD remote_len;
+    SOCKET_ADDRESS_LIST* list;
+    unsigned char list_buf[sizeof(SOCKET_ADDRESS_LIST) + sizeof(SOCKET_ADDRESS)];
+    struct timeval timeout;
+    char port[16];
+    socklen_t len;
+
+    printf("[TEST] WSAConnectByList/WSAConnectByName\n");
+
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    len = sizeof(addr);
+    if (listener == INVALID_SOCKET ||
+        bind(listener, (struct sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR ||
+        listen(listener, 4) == SOCKET_ERROR ||
+        getsockname(listener, (struct sockaddr*)&addr, &len) == SOCKET_ERROR) {
+        printf("  FAILED: Could not set up listener\n\n");
+        return;
+    }
+
+    /* A refused candidate first; the race must move on to the listener */
+    closed = addr;
+    closed.sin_port = htons((unsigned short)(ntohs(addr.sin_port) == 65535 ? 1 : ntohs(addr.sin_port) + 1));
+    list = (SOCKET_ADDRESS_LIST*)list_buf;
+    list->iAddressCount = 2;
+    list->Address[0].lpSockaddr = (LPSOCKADDR)&closed;
+    list->Address[0].iSockaddrLength = sizeof(closed);
+    list->Address[1].lpSockaddr = (LPSOCKADDR)&addr;
+    list->Address[1].iSockaddrLength = sizeof(addr);
+
+    timeout.tv_sec = 5;
+    timeout.tv_usec = 0;
+
+    client = socket(AF_INET, SOCK_STREAM, 0);
+    remote_len = sizeof(remote);
+    if (!WSAConnectByList(client, list, NULL, NULL, &remote_len,
+                          (LPSOCKADDR)&remote, &timeout, NULL)) {
+        printf("  FAILED: WSAConnectByList error %d\n", WSAGetLastError());
+    } else if (((struct sockaddr_in*)&remote)->sin_port != addr.sin_port) {
+        printf("  FAILED: WSAConnectByList connected to the wrong candidate\n");
+    } else {
+        printf("  SUCCESS: WSAConnectByList skipped the refused candidate\n");
+    }
+    closesocket(client);
+
+    /* Dual-stack socket resolving a literal IPv4 name */
+    snprintf(port, sizeof(port), "%u", (unsigned)ntohs(addr.sin_port));
+    client = socket(AF_INET6, SOCK_STREAM, 0);
+    if (client == INVALID_SOCKET) {
+        client = socket(AF_INET, SOCK_STREAM, 0);
+    }
+    if (!WSAConnectByNameA(client, "127.0.0.1", port, NULL, NULL,
+                           NULL, NULL, &timeout, NULL)) {
+        printf("  FAILED: WSAConnectByNameA error %d\n", WSAGetLastError());
+    } else {
+        printf("  SUCCESS: WSAConnectByNameA connected to 127.0.0.1:%s\n", port);
+    }
+    closesocket(client);
+
+    /* Every candidate refused */
+    list->iAddressCount = 1;
+    client = socket(AF_INET, SOCK_STREAM, 0);
+    if (WSAConnectByList(client, list, NULL, NULL, NULL, NULL, &timeout, NULL) ||
+        WSAGetLastError() != WSAECONNREFUSED) {
+        printf("  FAILED: Expected WSAECONNREFUSED, got %d\n", WSAGetLastError());
+    } else {
+        printf("  SUCCESS: Refused list reports WSAECONNREFUSED\n");
+    }
+    closesocket(client);
+
+    closesocket(listener);
+    printf("\n");
+}
+
 /* Test basic server/client functionality */
 void test_server_client(void)
 {
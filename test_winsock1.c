@@ -6,6 +6,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <fcntl.h>
 
 void test_init_cleanup(void)
 {
@@ -288,6 +289,56 @@ void test_select(void)
     WSACleanup();
 }
 
+/* Test select() on a descriptor beyond the POSIX FD_SETSIZE */
+void test_select_high_fd(void)
+{
+    WSADATA wsaData;
+    int pair[2];
+    SOCKET high;
+    fd_set read_fds;
+    struct timeval timeout;
+    int result;
+
+    printf("\n[TEST] select() with high-numbered socket\n");
+
+    WSAStartup(MAKEWORD(1, 1), &wsaData);
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) {
+        printf("  FAILED: socketpair() failed\n");
+        WSACleanup();
+        return;
+    }
+
+    high = fcntl(pair[0], F_DUPFD, 4000);
+    if (high == INVALID_SOCKET) {
+        printf("  SKIPPED: Descriptor limit too low\n");
+        closesocket(pair[0]);
+        closesocket(pair[1]);
+        WSACleanup();
+        return;
+    }
+    send(pair[1], "x", 1, 0);
+
+    FD_ZERO(&read_fds);
+    FD_SET(pair[1], &read_fds);
+    FD_SET(high, &read_fds);
+
+    timeout.tv_sec = 1;
+    timeout.tv_usec = 0;
+
+    result = select(0, &read_fds, NULL, NULL, &timeout);
+    if (result != 1 || !FD_ISSET(high, &read_fds) || FD_ISSET(pair[1], &read_fds)) {
+        printf("  FAILED: select() returned %d, error %d\n", result, WSAGetLastError());
+    } else {
+        printf("  SUCCESS: Socket %d reported readable\n", high);
+    }
+
+    closesocket(high);
+    closesocket(pair[0]);
+    closesocket(pair[1]);
+    WSACleanup();
+}
+
 int main(void)
 {
     printf("=======================================================\n");
@@ -302,6 +353,7 @@ int main(void)
     test_socket_options();
     test_ioctlsocket();
     test_select();
+    test_select_high_fd();
 
     printf("\n\n=======================================================\n");
     printf("All Winsock 1.1 tests completed!\n");
@@ -19,6 +19,7 @@ extern "C" {
 typedef unsigned char BYTE;
 typedef unsigned short WORD;
 typedef unsigned int DWORD;
+typedef DWORD* LPDWORD;
 typedef int BOOL;
 typedef void* HANDLE;
 typedef void* PVOID;
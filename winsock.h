@@ -8,6 +8,16 @@
 
 #ifdef __linux__
 
+/*
+ * Winsock fd_set (count + SOCKET array) replaces the POSIX bitmap unless
+ * WSA_POSIX_FD_SET is defined, as in winsock2_api.h. Keep an FD_SETSIZE
+ * chosen by the application from being overridden by <sys/select.h>.
+ */
+#ifndef WSA_POSIX_FD_SET
+#pragma push_macro("FD_SETSIZE")
+#undef FD_SETSIZE
+#endif
+
 /* Include necessary system headers first */
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -23,12 +33,22 @@
 #include <string.h>
 #include <stdlib.h>
 
+#ifndef WSA_POSIX_FD_SET
+#undef FD_SETSIZE
+#pragma pop_macro("FD_SETSIZE")
+#endif
+
 #include "windows_types.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* Winsock 1.1 API stays exported from -fvisibility=hidden builds */
+#ifdef __GNUC__
+#pragma GCC visibility push(default)
+#endif
+
 /* ============================================================================
  * Winsock 1.1 Version and Basic Types
  * ============================================================================ */
@@ -42,6 +62,72 @@ typedef int SOCKET;
 #define INVALID_SOCKET  (-1)
 #define SOCKET_ERROR    (-1)
 
+/* ============================================================================
+ * fd_set
+ * ============================================================================ */
+
+#ifndef WSA_POSIX_FD_SET
+
+#ifndef FD_SETSIZE
+#define FD_SETSIZE      64
+#endif
+
+/* Windows layout, shared with winsock2_api.h: any descriptor number fits */
+typedef struct wsa_fd_set {
+    unsigned int fd_count;
+    SOCKET fd_array[FD_SETSIZE];
+} wsa_fd_set;
+
+#define fd_set wsa_fd_set
+
+#undef FD_CLR
+#undef FD_SET
+#undef FD_ZERO
+#undef FD_ISSET
+
+#define FD_CLR(fd, set) do { \
+    unsigned int __i; \
+    for (__i = 0; __i < ((fd_set*)(set))->fd_count; __i++) { \
+        if (((fd_set*)(set))->fd_array[__i] == (SOCKET)(fd)) { \
+            while (__i < ((fd_set*)(set))->fd_count - 1) { \
+                ((fd_set*)(set))->fd_array[__i] = ((fd_set*)(set))->fd_array[__i+1]; \
+                __i++; \
+            } \
+            ((fd_set*)(set))->fd_count--; \
+            break; \
+        } \
+    } \
+} while(0)
+
+#define FD_SET(fd, set) do { \
+    unsigned int __i; \
+    for (__i = 0; __i < ((fd_set*)(set))->fd_count; __i++) { \
+        if (((fd_set*)(set))->fd_array[__i] == (SOCKET)(fd)) { \
+            break; \
+        } \
+    } \
+    if (__i == ((fd_set*)(set))->fd_count) { \
+        if (((fd_set*)(set))->fd_count < FD_SETSIZE) { \
+            ((fd_set*)(set))->fd_array[__i] = (SOCKET)(fd); \
+            ((fd_set*)(set))->fd_count++; \
+        } \
+    } \
+} while(0)
+
+#define FD_ZERO(set) (((fd_set*)(set))->fd_count = 0)
+
+#define FD_ISSET(fd, set) __WSAFDIsSet((SOCKET)(fd), (fd_set*)(set))
+
+/* select() over Winsock fd_sets; nfds is ignored as on Windows */
+int WSAAPI WSASelect(int nfds, fd_set* readfds, fd_set* writefds,
+                     fd_set* exceptfds, const struct timeval* timeout);
+int WSAAPI __WSAFDIsSet(SOCKET fd, fd_set* set);
+
+#define select(nfds, readfds, writefds, exceptfds, timeout) \
+    WSASelect((nfds), (readfds), (writefds), (exceptfds), (timeout))
+
+#endif /* WSA_POSIX_FD_SET */
+
 /* ============================================================================
  * Winsock 1.1 Error Codes
  * ============================================================================ */
@@ -226,7 +312,7 @@ int WSAAPI closesocket(SOCKET s);
  * send(), recv(), sendto(), recvfrom()
  * shutdown(), getsockopt(), setsockopt()
  * getsockname(), getpeername()
- * select() - uses system fd_set
+ * select() maps to WSASelect() above unless WSA_POSIX_FD_SET is defined
  */
 
 /* Windows-specific ioctl wrapper */
@@ -285,6 +371,39 @@ int WSAAPI WSAAsyncSelect(SOCKET s, HANDLE hWnd, unsigned int wMsg, long lEvent)
 #define FD_CONNECT      0x10
 #define FD_CLOSE        0x20
 
+#ifndef _WSAASYNCMSG_DEFINED
+#define _WSAASYNCMSG_DEFINED
+
+/* Window message posted by WSAAsyncSelect, retrieved with WSAGetAsyncMessage */
+typedef struct _WSAASYNCMSG {
+    HANDLE hWnd;
+    unsigned int message;   /* wMsg given to WSAAsyncSelect */
+    UINT_PTR wParam;        /* Socket */
+    INT_PTR lParam;         /* WSAMAKESELECTREPLY(event, error) */
+    DWORD time;             /* Monotonic milliseconds when posted */
+} WSAASYNCMSG, *PWSAASYNCMSG, *LPWSAASYNCMSG;
+
+#define WSAMAKEASYNCREPLY(buflen, error) \
+    ((LONG)(((WORD)(buflen)) | (((DWORD)(WORD)(error)) << 16)))
+#define WSAMAKESELECTREPLY(event, error) \
+    ((LONG)(((WORD)(event)) | (((DWORD)(WORD)(error)) << 16)))
+#define WSAGETASYNCBUFLEN(lParam)  ((WORD)((DWORD_PTR)(lParam) & 0xFFFF))
+#define WSAGETASYNCERROR(lParam)   ((WORD)(((DWORD_PTR)(lParam) >> 16) & 0xFFFF))
+#define WSAGETSELECTEVENT(lParam)  ((WORD)((DWORD_PTR)(lParam) & 0xFFFF))
+#define WSAGETSELECTERROR(lParam)  ((WORD)(((DWORD_PTR)(lParam) >> 16) & 0xFFFF))
+
+/*
+ * Message queue emulation (GetMessage/PeekMessage). hWnd NULL takes
+ * messages for any window, oldest first.
+ */
+BOOL WSAAPI WSAGetAsyncMessage(LPWSAASYNCMSG lpMsg, HANDLE hWnd,
+                               DWORD dwMilliseconds);
+BOOL WSAAPI WSAPeekAsyncMessage(LPWSAASYNCMSG lpMsg, HANDLE hWnd, BOOL fRemove);
+int WSAAPI WSAGetAsyncMessages(HANDLE hWnd, LPWSAASYNCMSG lpMsgs,
+                               int nMaxMessages, DWORD dwMilliseconds);
+
+#endif /* _WSAASYNCMSG_DEFINED */
+
 /* ============================================================================
  * Winsock 1.1 Blocking Hook Functions
  * ============================================================================ */
@@ -311,6 +430,10 @@ BOOL WSAAPI WSAIsBlocking(void);
 
 /* Note: htons(), htonl(), ntohs(), ntohl() available from <arpa/inet.h> */
 
+#ifdef __GNUC__
+#pragma GCC visibility pop
+#endif
+
 #ifdef __cplusplus
 }
 #endif
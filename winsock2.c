@@ -6,6 +6,7 @@
 #ifdef __linux__
 
 #include "winsock2_api.h"
+#include "wsa_internal.h"
 #include <pthread.h>
 #include <sys/eventfd.h>
 #include <limits.h>
@@ -25,61 +26,51 @@ typedef struct WSAEventStruct {
     pthread_mutex_t mutex;
 } WSAEventStruct;
 
-/* Error code mapping from errno to WSA errors */
-static int errno_to_wsa_error(int err)
-{
-    switch (err) {
-        case 0: return 0;
-        case EINTR: return WSAEINTR;
-        case EBADF: return WSAEBADF;
-        case EACCES: return WSAEACCES;
-        case EFAULT: return WSAEFAULT;
-        case EINVAL: return WSAEINVAL;
-        case EMFILE: return WSAEMFILE;
-        case EWOULDBLOCK: return WSAEWOULDBLOCK;
-        case EINPROGRESS: return WSAEINPROGRESS;
-        case EALREADY: return WSAEALREADY;
-        case ENOTSOCK: return WSAENOTSOCK;
-        case EDESTADDRREQ: return WSAEDESTADDRREQ;
-        case EMSGSIZE: return WSAEMSGSIZE;
-        case EPROTOTYPE: return WSAEPROTOTYPE;
-        case ENOPROTOOPT: return WSAENOPROTOOPT;
-        case EPROTONOSUPPORT: return WSAEPROTONOSUPPORT;
-        case ESOCKTNOSUPPORT: return WSAESOCKTNOSUPPORT;
-        case EOPNOTSUPP: return WSAEOPNOTSUPP;
-        case EPFNOSUPPORT: return WSAEPFNOSUPPORT;
-        case EAFNOSUPPORT: return WSAEAFNOSUPPORT;
-        case EADDRINUSE: return WSAEADDRINUSE;
-        case EADDRNOTAVAIL: return WSAEADDRNOTAVAIL;
-        case ENETDOWN: return WSAENETDOWN;
-        case ENETUNREACH: return WSAENETUNREACH;
-        case ENETRESET: return WSAENETRESET;
-        case ECONNABORTED: return WSAECONNABORTED;
-        case ECONNRESET: return WSAECONNRESET;
-        case ENOBUFS: return WSAENOBUFS;
-        case EISCONN: return WSAEISCONN;
-        case ENOTCONN: return WSAENOTCONN;
-        case ESHUTDOWN: return WSAESHUTDOWN;
-        case ETOOMANYREFS: return WSAETOOMANYREFS;
-        case ETIMEDOUT: return WSAETIMEDOUT;
-        case ECONNREFUSED: return WSAECONNREFUSED;
-        case ELOOP: return WSAELOOP;
-        case ENAMETOOLONG: return WSAENAMETOOLONG;
-        case EHOSTDOWN: return WSAEHOSTDOWN;
-        case EHOSTUNREACH: return WSAEHOSTUNREACH;
-        case ENOTEMPTY: return WSAENOTEMPTY;
-        case EUSERS: return WSAEUSERS;
-        case EDQUOT: return WSAEDQUOT;
-        case ESTALE: return WSAESTALE;
-        case EREMOTE: return WSAEREMOTE;
-        default: return WSABASEERR + err;
-    }
-}
-
-static void set_wsa_error_from_errno(void)
-{
-    g_wsa_last_error = errno_to_wsa_error(errno);
-}
+/* Error code mapping from errno to WSA errors (see wsa_internal.h) */
+const unsigned short g_wsa_errno_table[WSA_ERRNO_TABLE_SIZE] = {
+    [EINTR]           = WSAEINTR,
+    [EBADF]           = WSAEBADF,
+    [EACCES]          = WSAEACCES,
+    [EFAULT]          = WSAEFAULT,
+    [EINVAL]          = WSAEINVAL,
+    [EMFILE]          = WSAEMFILE,
+    [EWOULDBLOCK]     = WSAEWOULDBLOCK,
+    [EINPROGRESS]     = WSAEINPROGRESS,
+    [EALREADY]        = WSAEALREADY,
+    [ENOTSOCK]        = WSAENOTSOCK,
+    [EDESTADDRREQ]    = WSAEDESTADDRREQ,
+    [EMSGSIZE]        = WSAEMSGSIZE,
+    [EPROTOTYPE]      = WSAEPROTOTYPE,
+    [ENOPROTOOPT]     = WSAENOPROTOOPT,
+    [EPROTONOSUPPORT] = WSAEPROTONOSUPPORT,
+    [ESOCKTNOSUPPORT] = WSAESOCKTNOSUPPORT,
+    [EOPNOTSUPP]      = WSAEOPNOTSUPP,
+    [EPFNOSUPPORT]    = WSAEPFNOSUPPORT,
+    [EAFNOSUPPORT]    = WSAEAFNOSUPPORT,
+    [EADDRINUSE]      = WSAEADDRINUSE,
+    [EADDRNOTAVAIL]   = WSAEADDRNOTAVAIL,
+    [ENETDOWN]        = WSAENETDOWN,
+    [ENETUNREACH]     = WSAENETUNREACH,
+    [ENETRESET]       = WSAENETRESET,
+    [ECONNABORTED]    = WSAECONNABORTED,
+    [ECONNRESET]      = WSAECONNRESET,
+    [ENOBUFS]         = WSAENOBUFS,
+    [EISCONN]         = WSAEISCONN,
+    [ENOTCONN]        = WSAENOTCONN,
+    [ESHUTDOWN]       = WSAESHUTDOWN,
+    [ETOOMANYREFS]    = WSAETOOMANYREFS,
+    [ETIMEDOUT]       = WSAETIMEDOUT,
+    [ECONNREFUSED]    = WSAECONNREFUSED,
+    [ELOOP]           = WSAELOOP,
+    [ENAMETOOLONG]    = WSAENAMETOOLONG,
+    [EHOSTDOWN]       = WSAEHOSTDOWN,
+    [EHOSTUNREACH]    = WSAEHOSTUNREACH,
+    [ENOTEMPTY]       = WSAENOTEMPTY,
+    [EUSERS]          = WSAEUSERS,
+    [EDQUOT]          = WSAEDQUOT,
+    [ESTALE]          = WSAESTALE,
+    [EREMOTE]         = WSAEREMOTE
+};
 
 /* ============================================================================
  * Core Initialization Functions
@@ -147,6 +138,7 @@ void WSAAPI WSASetLastError(int iError)
 {
     g_wsa_last_error = iError;
 }
+WSA_HIDDEN_DEF(WSASetLastError);
 
 /* ============================================================================
  * Windows-Specific Socket Functions
@@ -157,8 +149,14 @@ void WSAAPI WSASetLastError(int iError)
 int WSAAPI closesocket(SOCKET s)
 {
     int result;
+    long long record_start;
+    WSA_STATS_SCOPE(closesocket);
+
+    wsa_socket_close(s);
 
+    record_start = WSA_RECORD_START();
     result = close((int)s);
+    WSA_RECORD(closesocket, s, 0, result, record_start);
 
     if (result < 0) {
         set_wsa_error_from_errno();
@@ -171,12 +169,19 @@ int WSAAPI closesocket(SOCKET s)
 
 /* Note: getsockname and getpeername are available as POSIX functions */
 
-/* Note: getsockopt, setsockopt, ioctlsocket available as POSIX functions.
- * Windows ioctlsocket maps directly to Linux ioctl */
+/* getsockopt/setsockopt map to WSAGetSockOpt/WSASetSockOpt (wsa_sockopt.c).
+ * ioctlsocket maps directly to Linux ioctl, except FIONBIO on a sharded
+ * listener */
 
 int WSAAPI ioctlsocket(SOCKET s, long cmd, unsigned long* argp)
 {
     int result;
+    WSA_STATS_SCOPE(ioctlsocket);
+
+    if (cmd == (long)FIONBIO && argp != NULL && wsa_listener_fionbio(s, argp)) {
+        g_wsa_last_error = 0;
+        return 0;
+    }
 
     result = ioctl((int)s, (unsigned long)cmd, argp);
 
@@ -191,8 +196,8 @@ int WSAAPI ioctlsocket(SOCKET s, long cmd, unsigned long* argp)
 
 /* Note: send, recv, sendto, recvfrom available as POSIX functions */
 
-/* Note: FD_ISSET, FD_SET, FD_CLR, FD_ZERO available as POSIX macros from sys/select.h
- * select() available as POSIX function.
+/* Note: FD_ISSET, FD_SET, FD_CLR, FD_ZERO and select() map to the Winsock
+ * fd_set emulation in wsa_poll.c unless WSA_POSIX_FD_SET is defined.
  * Name resolution functions (gethostbyname, gethostbyaddr, gethostname,
  * getservbyname, getservbyport, getprotobyname, getprotobynumber) are
  * available as POSIX functions and can be used directly. */
@@ -8,6 +8,16 @@
 
 #ifdef __linux__
 
+/*
+ * Winsock fd_set (count + SOCKET array) replaces the POSIX bitmap unless
+ * WSA_POSIX_FD_SET is defined. Keep an FD_SETSIZE chosen by the
+ * application from being overridden by <sys/select.h>.
+ */
+#ifndef WSA_POSIX_FD_SET
+#pragma push_macro("FD_SETSIZE")
+#undef FD_SETSIZE
+#endif
+
 /* Include system headers first */
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -24,14 +34,31 @@
 #include <string.h>
 #include <stdlib.h>
 
+#ifndef WSA_POSIX_FD_SET
+#undef FD_SETSIZE
+#pragma pop_macro("FD_SETSIZE")
+#endif
+
 #include "windows_types.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-/* Thread-local storage for WSA last error */
+/* The API below stays exported from -fvisibility=hidden builds */
+#ifdef __GNUC__
+#pragma GCC visibility push(default)
+#endif
+
+/*
+ * Thread-local storage for WSA last error. Deprecated, use
+ * WSAGetLastError(); still exported for binaries built against it.
+ */
+#ifdef __GNUC__
+extern __thread int g_wsa_last_error __attribute__((deprecated("use WSAGetLastError()")));
+#else
 extern __thread int g_wsa_last_error;
+#endif
 
 /* ============================================================================
  * Socket Types and Constants
@@ -142,11 +169,35 @@ typedef int SOCKET;
 #define WSA_IO_INCOMPLETE       996
 #define WSA_OPERATION_ABORTED   995
 
+/* ============================================================================
+ * Socket Option Constants
+ * ============================================================================ */
+
+/*
+ * Options with no Linux counterpart. Standard names (SO_RCVTIMEO,
+ * TCP_NODELAY, ...) keep their Linux values; setsockopt()/getsockopt()
+ * translate Windows value formats for them (see wsa_sockopt.c).
+ */
+#ifndef SO_EXCLUSIVEADDRUSE
+#define SO_EXCLUSIVEADDRUSE         ((int)(~SO_REUSEADDR))
+#endif
+#ifndef SO_DONTLINGER
+#define SO_DONTLINGER               ((int)(~SO_LINGER))
+#endif
+#define SO_MAX_MSG_SIZE             0x2003
+#define SO_CONDITIONAL_ACCEPT       0x3002
+#define SO_UPDATE_ACCEPT_CONTEXT    0x700B
+#define SO_UPDATE_CONNECT_CONTEXT   0x7010
+
+/* Windows uses 14, which is IP_MTU on Linux */
+#define IP_DONTFRAGMENT             0x700E
+
 /* ============================================================================
  * IOCTL Constants
  * ============================================================================ */
 
 #define IOC_WS2 0x08000000
+#define IOC_VENDOR 0x18000000
 #define _WSAIO(x,y)   ((x)|(y))
 #define _WSAIOR(x,y)  (IOC_OUT|(x)|(y))
 #define _WSAIOW(x,y)  (IOC_IN|(x)|(y))
@@ -197,6 +248,16 @@ typedef struct sockaddr_in SOCKADDR_IN;
 typedef struct sockaddr_in* PSOCKADDR_IN;
 typedef struct sockaddr_in* LPSOCKADDR_IN;
 
+typedef struct _SOCKET_ADDRESS {
+    LPSOCKADDR lpSockaddr;
+    INT iSockaddrLength;
+} SOCKET_ADDRESS, *PSOCKET_ADDRESS, *LPSOCKET_ADDRESS;
+
+typedef struct _SOCKET_ADDRESS_LIST {
+    INT iAddressCount;
+    SOCKET_ADDRESS Address[1];
+} SOCKET_ADDRESS_LIST, *PSOCKET_ADDRESS_LIST, *LPSOCKET_ADDRESS_LIST;
+
 /* ============================================================================
  * WSABUF Structure
  * ============================================================================ */
@@ -236,6 +297,13 @@ typedef struct _OVERLAPPED {
     HANDLE hEvent;
 } OVERLAPPED, *LPOVERLAPPED;
 
+/* Internal holds STATUS_PENDING until the operation completes */
+#ifndef STATUS_PENDING
+#define STATUS_PENDING ((DWORD)0x00000103L)
+#endif
+#define HasOverlappedIoCompleted(lpOverlapped) \
+    (((DWORD)(lpOverlapped)->Internal) != STATUS_PENDING)
+
 typedef HANDLE WSAEVENT;
 typedef OVERLAPPED WSAOVERLAPPED;
 typedef LPOVERLAPPED LPWSAOVERLAPPED;
@@ -282,6 +350,85 @@ typedef struct _WSANETWORKEVENTS {
     int iErrorCode[FD_MAX_EVENTS];
 } WSANETWORKEVENTS, *LPWSANETWORKEVENTS;
 
+/* ============================================================================
+ * fd_set Structure
+ * ============================================================================ */
+
+#ifndef WSA_POSIX_FD_SET
+
+#ifndef FD_SETSIZE
+#define FD_SETSIZE      64
+#endif
+
+/*
+ * Windows layout: select() cost follows fd_count, not the highest
+ * descriptor, and FD_SETSIZE may be raised per translation unit.
+ */
+typedef struct wsa_fd_set {
+    unsigned int fd_count;
+    SOCKET fd_array[FD_SETSIZE];
+} wsa_fd_set;
+
+#define fd_set wsa_fd_set
+
+#undef FD_CLR
+#undef FD_SET
+#undef FD_ZERO
+#undef FD_ISSET
+
+#define FD_CLR(fd, set) do { \
+    unsigned int __i; \
+    for (__i = 0; __i < ((fd_set*)(set))->fd_count; __i++) { \
+        if (((fd_set*)(set))->fd_array[__i] == (SOCKET)(fd)) { \
+            while (__i < ((fd_set*)(set))->fd_count - 1) { \
+                ((fd_set*)(set))->fd_array[__i] = ((fd_set*)(set))->fd_array[__i+1]; \
+                __i++; \
+            } \
+            ((fd_set*)(set))->fd_count--; \
+            break; \
+        } \
+    } \
+} while(0)
+
+#define FD_SET(fd, set) do { \
+    unsigned int __i; \
+    for (__i = 0; __i < ((fd_set*)(set))->fd_count; __i++) { \
+        if (((fd_set*)(set))->fd_array[__i] == (SOCKET)(fd)) { \
+            break; \
+        } \
+    } \
+    if (__i == ((fd_set*)(set))->fd_count) { \
+        if (((fd_set*)(set))->fd_count < FD_SETSIZE) { \
+            ((fd_set*)(set))->fd_array[__i] = (SOCKET)(fd); \
+            ((fd_set*)(set))->fd_count++; \
+        } \
+    } \
+} while(0)
+
+#define FD_ZERO(set) (((fd_set*)(set))->fd_count = 0)
+
+#define FD_ISSET(fd, set) __WSAFDIsSet((SOCKET)(fd), (fd_set*)(set))
+
+#endif /* WSA_POSIX_FD_SET */
+
+/* ============================================================================
+ * WSAPOLLFD Structure
+ * ============================================================================ */
+
+/* Same layout as struct pollfd (SOCKET is an int), so arrays go to poll() as is */
+typedef struct pollfd WSAPOLLFD, *PWSAPOLLFD, *LPWSAPOLLFD;
+
+#ifndef POLLRDNORM
+#define POLLRDNORM      0x040
+#define POLLRDBAND      0x080
+#define POLLWRNORM      0x100
+#define POLLWRBAND      0x200
+#endif
+
+/* WSASetPollMode modes (per thread) */
+#define WSA_POLL_MODE_POLL  0   /* poll() on every call (default) */
+#define WSA_POLL_MODE_EPOLL 1   /* cached epoll registrations; close with closesocket() */
+
 /* ============================================================================
  * WSAPROTOCOL_INFO Structure
  * ============================================================================ */
@@ -389,6 +536,22 @@ typedef struct _QualityOfService {
     WSABUF ProviderSpecific;
 } QOS, *LPQOS;
 
+/* ============================================================================
+ * Conditional Accept
+ * ============================================================================ */
+
+typedef unsigned int GROUP;
+
+/* Condition function results for WSAAccept */
+#define CF_ACCEPT 0x0000
+#define CF_REJECT 0x0001
+#define CF_DEFER  0x0002
+
+typedef int (CALLBACK *LPCONDITIONPROC)(LPWSABUF lpCallerId, LPWSABUF lpCallerData,
+                                        LPQOS lpSQOS, LPQOS lpGQOS,
+                                        LPWSABUF lpCalleeId, LPWSABUF lpCalleeData,
+                                        GROUP* g, DWORD_PTR dwCallbackData);
+
 /* ============================================================================
  * Winsock API Functions
  * ============================================================================ */
@@ -419,12 +582,35 @@ SOCKET WSAAPI WSASocketW(int af, int type, int protocol,
 
 /* Extended connection functions */
 SOCKET WSAAPI WSAAccept(SOCKET s, struct sockaddr* addr, int* addrlen,
-                        void* lpfnCondition, DWORD_PTR dwCallbackData);
+                        LPCONDITIONPROC lpfnCondition, DWORD_PTR dwCallbackData);
 
 int WSAAPI WSAConnect(SOCKET s, const struct sockaddr* name, int namelen,
                       LPWSABUF lpCallerData, LPWSABUF lpCalleeData,
                       LPQOS lpSQOS, LPQOS lpGQOS);
 
+/* Connect to the first reachable address (Happy Eyeballs, RFC 8305) */
+BOOL WSAAPI WSAConnectByNameA(SOCKET s, LPCSTR nodename, LPCSTR servicename,
+                              LPDWORD LocalAddressLength, LPSOCKADDR LocalAddress,
+                              LPDWORD RemoteAddressLength, LPSOCKADDR RemoteAddress,
+                              const struct timeval* timeout,
+                              LPWSAOVERLAPPED Reserved);
+BOOL WSAAPI WSAConnectByNameW(SOCKET s, LPWSTR nodename, LPWSTR servicename,
+                              LPDWORD LocalAddressLength, LPSOCKADDR LocalAddress,
+                              LPDWORD RemoteAddressLength, LPSOCKADDR RemoteAddress,
+                              const struct timeval* timeout,
+                              LPWSAOVERLAPPED Reserved);
+BOOL WSAAPI WSAConnectByList(SOCKET s, PSOCKET_ADDRESS_LIST SocketAddress,
+                             LPDWORD LocalAddressLength, LPSOCKADDR LocalAddress,
+                             LPDWORD RemoteAddressLength, LPSOCKADDR RemoteAddress,
+                             const struct timeval* timeout,
+                             LPWSAOVERLAPPED Reserved);
+
+#ifdef UNICODE
+#define WSAConnectByName WSAConnectByNameW
+#else
+#define WSAConnectByName WSAConnectByNameA
+#endif
+
 /* Scatter-gather I/O */
 int WSAAPI WSASend(SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
                    DWORD* lpNumberOfBytesSent, DWORD dwFlags,
@@ -477,6 +663,43 @@ int WSAAPI WSAEventSelect(SOCKET s, WSAEVENT hEventObject, long lNetworkEvents);
 int WSAAPI WSAEnumNetworkEvents(SOCKET s, WSAEVENT hEventObject,
                                 LPWSANETWORKEVENTS lpNetworkEvents);
 
+/* Polling */
+int WSAAPI WSAPoll(LPWSAPOLLFD fdArray, ULONG fds, INT timeout);
+int WSAAPI WSASetPollMode(DWORD dwMode);
+
+#ifndef WSA_POSIX_FD_SET
+/* select() over Winsock fd_sets; nfds is ignored as on Windows */
+int WSAAPI WSASelect(int nfds, fd_set* readfds, fd_set* writefds,
+                     fd_set* exceptfds, const struct timeval* timeout);
+int WSAAPI __WSAFDIsSet(SOCKET fd, fd_set* set);
+
+#define select(nfds, readfds, writefds, exceptfds, timeout) \
+    WSASelect((nfds), (readfds), (writefds), (exceptfds), (timeout))
+#endif
+
+/* Socket options with Windows option names and value formats */
+int WSAAPI WSASetSockOpt(SOCKET s, int level, int optname,
+                         const char* optval, int optlen);
+int WSAAPI WSAGetSockOpt(SOCKET s, int level, int optname,
+                         char* optval, int* optlen);
+
+#ifndef WSA_POSIX_SOCKOPT
+#define setsockopt(s, level, optname, optval, optlen) \
+    WSASetSockOpt((s), (level), (optname), (const char*)(optval), (int)(optlen))
+#define getsockopt(s, level, optname, optval, optlen) \
+    WSAGetSockOpt((s), (level), (optname), (char*)(optval), (int*)(optlen))
+#endif
+
+/*
+ * Define WSA_WINSOCK_ACCEPT to route accept() through WSAAccept(), which
+ * sets WSAGetLastError() and draws from SIO_ACCEPT_SHARDS listeners. It is
+ * opt-in because the macro also rewrites members and methods named accept.
+ */
+#ifdef WSA_WINSOCK_ACCEPT
+#define accept(s, addr, addrlen) \
+    WSAAccept((s), (addr), (int*)(addrlen), NULL, 0)
+#endif
+
 /* Async functions */
 HANDLE WSAAPI WSAAsyncGetHostByName(HANDLE hWnd, unsigned int wMsg,
                                     const char* name, char* buf, int buflen);
@@ -497,6 +720,39 @@ int WSAAPI WSACancelAsyncRequest(HANDLE hAsyncTaskHandle);
 int WSAAPI WSAAsyncSelect(SOCKET s, HANDLE hWnd, unsigned int wMsg,
                           long lEvent);
 
+#ifndef _WSAASYNCMSG_DEFINED
+#define _WSAASYNCMSG_DEFINED
+
+/* Window message posted by WSAAsyncSelect, retrieved with WSAGetAsyncMessage */
+typedef struct _WSAASYNCMSG {
+    HANDLE hWnd;
+    unsigned int message;   /* wMsg given to WSAAsyncSelect */
+    UINT_PTR wParam;        /* Socket */
+    INT_PTR lParam;         /* WSAMAKESELECTREPLY(event, error) */
+    DWORD time;             /* Monotonic milliseconds when posted */
+} WSAASYNCMSG, *PWSAASYNCMSG, *LPWSAASYNCMSG;
+
+#define WSAMAKEASYNCREPLY(buflen, error) \
+    ((LONG)(((WORD)(buflen)) | (((DWORD)(WORD)(error)) << 16)))
+#define WSAMAKESELECTREPLY(event, error) \
+    ((LONG)(((WORD)(event)) | (((DWORD)(WORD)(error)) << 16)))
+#define WSAGETASYNCBUFLEN(lParam)  ((WORD)((DWORD_PTR)(lParam) & 0xFFFF))
+#define WSAGETASYNCERROR(lParam)   ((WORD)(((DWORD_PTR)(lParam) >> 16) & 0xFFFF))
+#define WSAGETSELECTEVENT(lParam)  ((WORD)((DWORD_PTR)(lParam) & 0xFFFF))
+#define WSAGETSELECTERROR(lParam)  ((WORD)(((DWORD_PTR)(lParam) >> 16) & 0xFFFF))
+
+/*
+ * Message queue emulation (GetMessage/PeekMessage). hWnd NULL takes
+ * messages for any window, oldest first.
+ */
+BOOL WSAAPI WSAGetAsyncMessage(LPWSAASYNCMSG lpMsg, HANDLE hWnd,
+                               DWORD dwMilliseconds);
+BOOL WSAAPI WSAPeekAsyncMessage(LPWSAASYNCMSG lpMsg, HANDLE hWnd, BOOL fRemove);
+int WSAAPI WSAGetAsyncMessages(HANDLE hWnd, LPWSAASYNCMSG lpMsgs,
+                               int nMaxMessages, DWORD dwMilliseconds);
+
+#endif /* _WSAASYNCMSG_DEFINED */
+
 /* Byte order conversion */
 int WSAAPI WSAHtonl(SOCKET s, unsigned long hostlong, unsigned long* lpnetlong);
 int WSAAPI WSAHtons(SOCKET s, unsigned short hostshort, unsigned short* lpnetshort);
@@ -537,6 +793,75 @@ BOOL WSAAPI WSAGetOverlappedResult(SOCKET s, LPWSAOVERLAPPED lpOverlapped,
 /* Socket pair (not in Windows but useful) */
 int WSAAPI WSASocketPair(int af, int type, int protocol, SOCKET socks[2]);
 
+/*
+ * Call statistics (not in Windows)
+ * Counted only by libraries built with WSA_STATS (make STATS=1); otherwise
+ * these fail with WSAEOPNOTSUPP. Collection starts with WSASetCallStats(TRUE)
+ * or WSA_STATS=1 in the environment; WSA_STATS_DUMP=<seconds> also writes
+ * WSADumpCallStats(2) at that interval. WSAGetCallStats and
+ * WSAGetErrorStats take the capacity in *lpdwCount and fail with WSAEFAULT,
+ * setting the required count, when it is too small.
+ */
+#define WSA_STATS_BUCKETS 160
+
+typedef struct _WSACALLSTATS {
+    const char* pszFunction;
+    ULONGLONG ullCalls;
+    ULONGLONG ullErrors;        /* Calls failing with anything but WSA_IO_PENDING */
+    ULONGLONG ullBytes;         /* Bytes sent or received */
+    ULONGLONG ullTotalNs;
+    ULONGLONG ullHistogram[WSA_STATS_BUCKETS];  /* See WSACallStatsBucketLimit */
+} WSACALLSTATS, *LPWSACALLSTATS;
+
+typedef struct _WSAERRORSTATS {
+    int iError;
+    ULONGLONG ullCount;
+} WSAERRORSTATS, *LPWSAERRORSTATS;
+
+int WSAAPI WSASetCallStats(BOOL fEnable);
+int WSAAPI WSAGetCallStats(LPWSACALLSTATS lpStats, DWORD* lpdwCount);
+int WSAAPI WSAGetErrorStats(LPWSAERRORSTATS lpStats, DWORD* lpdwCount);
+int WSAAPI WSAResetCallStats(void);
+int WSAAPI WSADumpCallStats(int fd);
+ULONGLONG WSAAPI WSACallStatsBucketLimit(DWORD dwBucket);
+ULONGLONG WSAAPI WSACallStatsPercentile(const WSACALLSTATS* lpStats, double dPercentile);
+
+/*
+ * Call recording (not in Windows)
+ * WSAStartRecording writes socket lifecycle and send/receive calls to a
+ * binary trace for replay_winsock; WSA_RECORD=<path> in the environment
+ * records the whole run. The file is a WSATRACEHEADER, dwFunctionCount
+ * NUL-padded names of WSA_TRACE_NAME_LEN bytes, then records in
+ * per-thread batches (sort by ullTimestampNs for the global order).
+ */
+#define WSA_TRACE_MAGIC     "WSATRACE"
+#define WSA_TRACE_VERSION   1
+#define WSA_TRACE_NAME_LEN  32
+
+typedef struct _WSATRACEHEADER {
+    char szMagic[8];
+    DWORD dwVersion;
+    DWORD dwRecordSize;         /* sizeof(WSATRACERECORD) */
+    DWORD dwFunctionCount;
+    DWORD dwReserved;
+    ULONGLONG ullStartTimeNs;   /* CLOCK_REALTIME when recording started */
+    ULONGLONG ullDropped;       /* Records lost to full buffers */
+} WSATRACEHEADER;
+
+typedef struct _WSATRACERECORD {
+    ULONGLONG ullTimestampNs;   /* Call entry, ns since recording started */
+    DWORD dwDurationNs;
+    WORD wFunction;             /* Index into the function names */
+    WORD wThread;               /* Recording thread, numbered from 0 */
+    INT iSocket;
+    INT iError;                 /* WSA error code when iResult is negative */
+    DWORD dwSize;               /* Bytes offered; socket type for WSASocketA */
+    INT iResult;                /* Bytes moved, new socket, 0, or -1 */
+} WSATRACERECORD;
+
+int WSAAPI WSAStartRecording(const char* pszPath);
+int WSAAPI WSAStopRecording(void);
+
 /* Event constants */
 #define WSA_INFINITE            0xFFFFFFFF
 #define WSA_WAIT_EVENT_0        0
@@ -544,6 +869,10 @@ int WSAAPI WSASocketPair(int af, int type, int protocol, SOCKET socks[2]);
 #define WSA_WAIT_TIMEOUT        0x00000102
 #define WSA_MAXIMUM_WAIT_EVENTS 64
 
+#ifdef __GNUC__
+#pragma GCC visibility pop
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -19,6 +19,10 @@
 extern "C" {
 #endif
 
+#ifdef __GNUC__
+#pragma GCC visibility push(default)
+#endif
+
 /* IPv6 addresses are already defined in netinet/in.h */
 typedef struct sockaddr_in6 SOCKADDR_IN6;
 typedef struct sockaddr_in6* PSOCKADDR_IN6;
@@ -29,6 +33,13 @@ typedef struct sockaddr_storage SOCKADDR_STORAGE;
 typedef struct sockaddr_storage* PSOCKADDR_STORAGE;
 typedef struct sockaddr_storage* LPSOCKADDR_STORAGE;
 
+/* IPv4 or IPv6 address, discriminated by si_family */
+typedef union _SOCKADDR_INET {
+    SOCKADDR_IN Ipv4;
+    SOCKADDR_IN6 Ipv6;
+    sa_family_t si_family;
+} SOCKADDR_INET, *PSOCKADDR_INET;
+
 /* addrinfo already defined in netdb.h */
 typedef struct addrinfo ADDRINFOA;
 typedef struct addrinfo* PADDRINFOA;
@@ -176,6 +187,29 @@ int WSAAPI GetNameInfoW(const SOCKADDR* pSockaddr, int SockaddrLength,
 #define GetNameInfo GetNameInfoA
 #endif
 
+/* Batch reverse lookup (not in Windows)
+ * Resolves dwCount addresses, de-duplicated and in parallel, into node
+ * buffers of NodeBufferSize characters each (entry i at
+ * pNodeBuffers + i * NodeBufferSize). lpiResults (optional) receives the
+ * per-entry GetNameInfo result and the return value is the number resolved.
+ * Answers are cached; WSASetNameInfoCacheParams sets the positive and
+ * negative TTLs in seconds (0 disables caching) and the worker limit. */
+int WSAAPI GetNameInfoBatchA(const SOCKADDR_STORAGE* lpAddresses, DWORD dwCount,
+                             char* pNodeBuffers, DWORD NodeBufferSize,
+                             INT Flags, INT* lpiResults);
+int WSAAPI GetNameInfoBatchW(const SOCKADDR_STORAGE* lpAddresses, DWORD dwCount,
+                             wchar_t* pNodeBuffers, DWORD NodeBufferSize,
+                             INT Flags, INT* lpiResults);
+int WSAAPI WSASetNameInfoCacheParams(DWORD dwPositiveTtl, DWORD dwNegativeTtl,
+                                     DWORD dwMaxWorkers);
+void WSAAPI WSAFlushNameInfoCache(void);
+
+#ifdef UNICODE
+#define GetNameInfoBatch GetNameInfoBatchW
+#else
+#define GetNameInfoBatch GetNameInfoBatchA
+#endif
+
 /* Address to string conversion */
 int WSAAPI WSAAddressToStringA(LPSOCKADDR lpsaAddress, DWORD dwAddressLength,
                                LPWSAPROTOCOL_INFOA lpProtocolInfo,
@@ -200,8 +234,25 @@ int WSAAPI WSAStringToAddressW(LPWSTR AddressString, INT AddressFamily,
 #define WSAStringToAddress WSAStringToAddressA
 #endif
 
+/* Batch address conversion (not in Windows)
+ * Each entry is converted independently; lpiErrors (optional) receives 0 or a
+ * WSA error code per entry and the return value is the number converted.
+ * WSAStringToAddressBatchA also accepts AF_UNSPEC to detect the family.
+ * WSAAddressToStringBatchA writes entry i at lpszStrings + i * dwStride. */
+int WSAAPI WSAStringToAddressBatchA(LPSTR* AddressStrings, DWORD dwCount,
+                                    INT AddressFamily,
+                                    LPSOCKADDR_STORAGE lpAddresses,
+                                    INT* lpiErrors);
+int WSAAPI WSAAddressToStringBatchA(const SOCKADDR_STORAGE* lpAddresses,
+                                    DWORD dwCount, LPSTR lpszStrings,
+                                    DWORD dwStride, INT* lpiErrors);
+
 /* Interface name/index functions (available from net/if.h as if_nametoindex/if_indextoname) */
 
+#ifdef __GNUC__
+#pragma GCC visibility pop
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -7,22 +7,500 @@
 
 #include "winsock2_api.h"
 #include "ws2tcpip.h"
+#include "wsa_internal.h"
 #include <wchar.h>
 #include <locale.h>
 #include <iconv.h>
 
-extern __thread int g_wsa_last_error;
-
 /* IPv6 address constants */
 const struct in6_addr in6addr_any = IN6ADDR_ANY_INIT;
 const struct in6_addr in6addr_loopback = IN6ADDR_LOOPBACK_INIT;
 
+/* ============================================================================
+ * Address Parsing and Formatting Fast Path
+ * Table-driven replacements for inet_pton/inet_ntop/atoi/snprintf used by
+ * WSAStringToAddress, WSAAddressToString and the batch variants below.
+ * ============================================================================ */
+
+/* Longest string produced: "[" + IPv6 with embedded IPv4 + "%" + scope + "]:" + port */
+#define WSA_SOCKADDR_STRLEN     (1 + 45 + 1 + 10 + 2 + 5 + 1)
+
+/* Hex digit value plus one, zero for non-hex characters */
+static const unsigned char g_hex_value1[256] = {
+    ['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+    ['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+    ['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+    ['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16
+};
+
+static const char g_hex_digits[] = "0123456789abcdef";
+
+static const char g_digit_pairs[] =
+    "00010203040506070809101112131415161718192021222324"
+    "25262728293031323334353637383940414243444546474849"
+    "50515253545556575859606162636465666768697071727374"
+    "75767778798081828384858687888990919293949596979899";
+
+#define IS_DIGIT(c) ((unsigned)((unsigned char)(c) - '0') < 10u)
+
+/*
+ * Strict dotted-quad parser with inet_pton semantics (no leading zeros).
+ * out is only written on success.
+ */
+static int parse_ipv4(const char* p, const char* end, unsigned char* out)
+{
+    unsigned char tmp[4];
+    int octets;
+    unsigned int val;
+    const char* start;
+
+    octets = 0;
+    while (1) {
+        start = p;
+        val = 0;
+        while (p < end && IS_DIGIT(*p)) {
+            val = val * 10 + (unsigned int)(*p - '0');
+            if (val > 255 || (p > start && *start == '0')) {
+                return -1;
+            }
+            p++;
+        }
+        if (p == start) {
+            return -1;
+        }
+        tmp[octets++] = (unsigned char)val;
+        if (octets == 4) {
+            if (p != end) {
+                return -1;
+            }
+            memcpy(out, tmp, sizeof(tmp));
+            return 0;
+        }
+        if (p == end || *p != '.') {
+            return -1;
+        }
+        p++;
+    }
+}
+
+/* IPv6 parser with inet_pton semantics, including an embedded IPv4 tail */
+static int parse_ipv6(const char* p, const char* end, unsigned char* out)
+{
+    unsigned char* tp;
+    unsigned char* endp;
+    unsigned char* colonp;
+    const char* group_start;
+    unsigned int val;
+    int digits;
+    unsigned int hv;
+
+    memset(out, 0, 16);
+    tp = out;
+    endp = out + 16;
+    colonp = NULL;
+
+    if (p < end && *p == ':') {
+        if (++p == end || *p != ':') {
+            return -1;
+        }
+    }
+
+    group_start = p;
+    val = 0;
+    digits = 0;
+
+    while (p < end) {
+        hv = g_hex_value1[(unsigned char)*p];
+        if (hv != 0) {
+            if (++digits > 4) {
+                return -1;
+            }
+            val = (val << 4) | (hv - 1);
+            p++;
+            continue;
+        }
+        if (*p == ':') {
+            p++;
+            group_start = p;
+            if (digits == 0) {
+                if (colonp != NULL) {
+                    return -1;
+                }
+                colonp = tp;
+                continue;
+            }
+            if (p == end || tp + 2 > endp) {
+                return -1;
+            }
+            *tp++ = (unsigned char)(val >> 8);
+            *tp++ = (unsigned char)val;
+            val = 0;
+            digits = 0;
+            continue;
+        }
+        if (*p == '.' && tp + 4 <= endp) {
+            if (parse_ipv4(group_start, end, tp) != 0) {
+                return -1;
+            }
+            tp += 4;
+            digits = 0;
+            break;
+        }
+        return -1;
+    }
+
+    if (digits != 0) {
+        if (tp + 2 > endp) {
+            return -1;
+        }
+        *tp++ = (unsigned char)(val >> 8);
+        *tp++ = (unsigned char)val;
+    }
+
+    if (colonp != NULL) {
+        size_t n;
+        if (tp == endp) {
+            return -1;
+        }
+        n = (size_t)(tp - colonp);
+        memmove(endp - n, colonp, n);
+        memset(colonp, 0, (size_t)(endp - n - colonp));
+        tp = endp;
+    }
+
+    return tp == endp ? 0 : -1;
+}
+
+/* Unsigned decimal with an upper bound, no sign or whitespace */
+static int parse_decimal(const char* p, const char* end, unsigned long max,
+                         unsigned long* out)
+{
+    unsigned long val;
+
+    if (p == end) {
+        return -1;
+    }
+
+    val = 0;
+    while (p < end) {
+        if (!IS_DIGIT(*p)) {
+            return -1;
+        }
+        val = val * 10 + (unsigned long)(*p - '0');
+        if (val > max) {
+            return -1;
+        }
+        p++;
+    }
+
+    *out = val;
+    return 0;
+}
+
+static char* format_decimal(char* out, unsigned long val)
+{
+    char tmp[10];
+    char* t;
+    size_t n;
+
+    t = tmp + sizeof(tmp);
+    while (val >= 100) {
+        unsigned long r;
+        r = val % 100;
+        val /= 100;
+        t -= 2;
+        t[0] = g_digit_pairs[r * 2];
+        t[1] = g_digit_pairs[r * 2 + 1];
+    }
+    if (val >= 10) {
+        t -= 2;
+        t[0] = g_digit_pairs[val * 2];
+        t[1] = g_digit_pairs[val * 2 + 1];
+    } else {
+        *--t = (char)('0' + val);
+    }
+
+    n = (size_t)(tmp + sizeof(tmp) - t);
+    memcpy(out, t, n);
+    return out + n;
+}
+
+static char* format_ipv4(char* out, const unsigned char* a)
+{
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        unsigned int v;
+        v = a[i];
+        if (v >= 100) {
+            *out++ = (char)('0' + v / 100);
+            v %= 100;
+            *out++ = g_digit_pairs[v * 2];
+            *out++ = g_digit_pairs[v * 2 + 1];
+        } else if (v >= 10) {
+            *out++ = g_digit_pairs[v * 2];
+            *out++ = g_digit_pairs[v * 2 + 1];
+        } else {
+            *out++ = (char)('0' + v);
+        }
+        if (i < 3) {
+            *out++ = '.';
+        }
+    }
+
+    return out;
+}
+
+/* RFC 5952 text form, matching inet_ntop output byte for byte */
+static char* format_ipv6(char* out, const unsigned char* a)
+{
+    unsigned int words[8];
+    int best_base;
+    int best_len;
+    int cur_base;
+    int cur_len;
+    int i;
+
+    best_base = -1;
+    best_len = 0;
+    cur_base = -1;
+    cur_len = 0;
+
+    for (i = 0; i < 8; i++) {
+        words[i] = ((unsigned int)a[i * 2] << 8) | a[i * 2 + 1];
+        if (words[i] == 0) {
+            if (cur_base == -1) {
+                cur_base = i;
+                cur_len = 1;
+            } else {
+                cur_len++;
+            }
+        } else if (cur_base != -1) {
+            if (best_base == -1 || cur_len > best_len) {
+                best_base = cur_base;
+                best_len = cur_len;
+            }
+            cur_base = -1;
+        }
+    }
+    if (cur_base != -1 && (best_base == -1 || cur_len > best_len)) {
+        best_base = cur_base;
+        best_len = cur_len;
+    }
+    if (best_len < 2) {
+        best_base = -1;
+    }
+
+    for (i = 0; i < 8; i++) {
+        unsigned int w;
+
+        if (best_base != -1 && i >= best_base && i < best_base + best_len) {
+            if (i == best_base) {
+                *out++ = ':';
+            }
+            continue;
+        }
+        if (i != 0) {
+            *out++ = ':';
+        }
+        if (i == 6 && best_base == 0 &&
+            (best_len == 6 || (best_len == 5 && words[5] == 0xffff))) {
+            return format_ipv4(out, a + 12);
+        }
+
+        w = words[i];
+        if (w >= 0x1000) {
+            *out++ = g_hex_digits[w >> 12];
+        }
+        if (w >= 0x100) {
+            *out++ = g_hex_digits[(w >> 8) & 0xf];
+        }
+        if (w >= 0x10) {
+            *out++ = g_hex_digits[(w >> 4) & 0xf];
+        }
+        *out++ = g_hex_digits[w & 0xf];
+    }
+
+    if (best_base != -1 && best_base + best_len == 8) {
+        *out++ = ':';
+    }
+
+    return out;
+}
+
+/*
+ * Parse "a.b.c.d[:port]", "v6[%scope]" or "[v6[%scope]][:port]".
+ * AF_UNSPEC picks the family from the string shape.
+ */
+static int string_to_sockaddr(const char* str, size_t len, int af,
+                              struct sockaddr_storage* out)
+{
+    const char* p;
+    const char* end;
+    const char* colon;
+    unsigned long port;
+    unsigned long scope;
+
+    p = str;
+    end = str + len;
+    port = 0;
+    scope = 0;
+
+    if (af == AF_UNSPEC) {
+        const char* first_colon;
+        first_colon = memchr(p, ':', len);
+        if (len > 0 && *p == '[') {
+            af = AF_INET6;
+        } else if (first_colon != NULL &&
+                   memchr(first_colon + 1, ':', (size_t)(end - first_colon - 1)) != NULL) {
+            af = AF_INET6;
+        } else {
+            af = AF_INET;
+        }
+    }
+
+    if (af == AF_INET) {
+        struct sockaddr_in* sin;
+
+        colon = memchr(p, ':', len);
+        if (colon != NULL) {
+            if (parse_decimal(colon + 1, end, 65535, &port) != 0) {
+                return -1;
+            }
+            end = colon;
+        }
+
+        sin = (struct sockaddr_in*)out;
+        memset(sin, 0, sizeof(*sin));
+        if (parse_ipv4(p, end, (unsigned char*)&sin->sin_addr) != 0) {
+            return -1;
+        }
+        sin->sin_family = AF_INET;
+        sin->sin_port = htons((uint16_t)port);
+        return 0;
+    }
+
+    if (af == AF_INET6) {
+        struct sockaddr_in6* sin6;
+        const char* pct;
+
+        if (p < end && *p == '[') {
+            const char* close;
+            close = memchr(p, ']', len);
+            if (close == NULL) {
+                return -1;
+            }
+            if (close + 1 < end) {
+                if (close[1] != ':' ||
+                    parse_decimal(close + 2, end, 65535, &port) != 0) {
+                    return -1;
+                }
+            }
+            p++;
+            end = close;
+        }
+
+        pct = memchr(p, '%', (size_t)(end - p));
+        if (pct != NULL) {
+            if (parse_decimal(pct + 1, end, 0xFFFFFFFFUL, &scope) != 0) {
+                return -1;
+            }
+            end = pct;
+        }
+
+        sin6 = (struct sockaddr_in6*)out;
+        memset(sin6, 0, sizeof(*sin6));
+        if (parse_ipv6(p, end, sin6->sin6_addr.s6_addr) != 0) {
+            return -1;
+        }
+        sin6->sin6_family = AF_INET6;
+        sin6->sin6_port = htons((uint16_t)port);
+        sin6->sin6_scope_id = (uint32_t)scope;
+        return 0;
+    }
+
+    return -1;
+}
+
+/*
+ * Format a sockaddr the way Windows does: the port is appended only when
+ * non-zero and IPv6 addresses with a port are bracketed.
+ * Returns the string length, or 0 for unsupported families.
+ */
+static size_t sockaddr_to_string(const struct sockaddr* sa, char* buffer)
+{
+    char* out;
+
+    out = buffer;
+
+    if (sa->sa_family == AF_INET) {
+        const struct sockaddr_in* sin;
+        sin = (const struct sockaddr_in*)sa;
+        out = format_ipv4(out, (const unsigned char*)&sin->sin_addr);
+        if (sin->sin_port != 0) {
+            *out++ = ':';
+            out = format_decimal(out, ntohs(sin->sin_port));
+        }
+    } else if (sa->sa_family == AF_INET6) {
+        const struct sockaddr_in6* sin6;
+        sin6 = (const struct sockaddr_in6*)sa;
+        if (sin6->sin6_port != 0) {
+            *out++ = '[';
+        }
+        out = format_ipv6(out, sin6->sin6_addr.s6_addr);
+        if (sin6->sin6_scope_id != 0) {
+            *out++ = '%';
+            out = format_decimal(out, sin6->sin6_scope_id);
+        }
+        if (sin6->sin6_port != 0) {
+            *out++ = ']';
+            *out++ = ':';
+            out = format_decimal(out, ntohs(sin6->sin6_port));
+        }
+    } else {
+        return 0;
+    }
+
+    *out = '\0';
+    return (size_t)(out - buffer);
+}
+
+static DWORD sockaddr_min_length(int af)
+{
+    if (af == AF_INET) {
+        return (DWORD)sizeof(struct sockaddr_in);
+    }
+    if (af == AF_INET6) {
+        return (DWORD)sizeof(struct sockaddr_in6);
+    }
+    return 0;
+}
+
 /* Note: inet_pton and inet_ntop are available as POSIX functions */
 
 int WSAAPI InetPtonA(int Family, const char* pszAddrString, void* pAddrBuf)
 {
-    return inet_pton(Family, pszAddrString, pAddrBuf);
+    const char* end;
+
+    end = pszAddrString + strlen(pszAddrString);
+
+    if (Family == AF_INET) {
+        return parse_ipv4(pszAddrString, end, (unsigned char*)pAddrBuf) == 0 ? 1 : 0;
+    }
+    if (Family == AF_INET6) {
+        unsigned char addr[16];
+        if (parse_ipv6(pszAddrString, end, addr) != 0) {
+            return 0;
+        }
+        memcpy(pAddrBuf, addr, sizeof(addr));
+        return 1;
+    }
+
+    g_wsa_last_error = WSAEAFNOSUPPORT;
+    errno = EAFNOSUPPORT;
+    return -1;
 }
+WSA_HIDDEN_DEF(InetPtonA);
 
 int WSAAPI InetPtonW(int Family, const wchar_t* pszAddrString, void* pAddrBuf)
 {
@@ -36,14 +514,41 @@ int WSAAPI InetPtonW(int Family, const wchar_t* pszAddrString, void* pAddrBuf)
         return -1;
     }
 
-    return inet_pton(Family, buffer, pAddrBuf);
+    /* Filled the buffer without a terminator: too long to be an address */
+    if (len == sizeof(buffer)) {
+        buffer[0] = '\0';
+    }
+
+    return InetPtonA_internal(Family, buffer, pAddrBuf);
 }
 
 const char* WSAAPI InetNtopA(int Family, const void* pAddr, char* pStringBuf,
                              size_t StringBufSize)
 {
-    return inet_ntop(Family, pAddr, pStringBuf, StringBufSize);
+    char buffer[INET6_ADDRSTRLEN];
+    size_t len;
+
+    if (Family == AF_INET) {
+        len = (size_t)(format_ipv4(buffer, (const unsigned char*)pAddr) - buffer);
+    } else if (Family == AF_INET6) {
+        len = (size_t)(format_ipv6(buffer, (const unsigned char*)pAddr) - buffer);
+    } else {
+        g_wsa_last_error = WSAEAFNOSUPPORT;
+        errno = EAFNOSUPPORT;
+        return NULL;
+    }
+
+    if (len >= StringBufSize) {
+        g_wsa_last_error = WSAEINVAL;
+        errno = ENOSPC;
+        return NULL;
+    }
+
+    memcpy(pStringBuf, buffer, len);
+    pStringBuf[len] = '\0';
+    return pStringBuf;
 }
+WSA_HIDDEN_DEF(InetNtopA);
 
 const wchar_t* WSAAPI InetNtopW(int Family, const void* pAddr, wchar_t* pStringBuf,
                                 size_t StringBufSize)
@@ -51,11 +556,17 @@ const wchar_t* WSAAPI InetNtopW(int Family, const void* pAddr, wchar_t* pStringB
     char buffer[INET6_ADDRSTRLEN];
     const char* result;
 
-    result = inet_ntop(Family, pAddr, buffer, sizeof(buffer));
+    result = InetNtopA_internal(Family, pAddr, buffer, sizeof(buffer));
     if (result == NULL) {
         return NULL;
     }
 
+    if (strlen(buffer) >= StringBufSize) {
+        g_wsa_last_error = WSAEINVAL;
+        errno = ENOSPC;
+        return NULL;
+    }
+
     /* Convert multibyte to wide string */
     if (mbstowcs(pStringBuf, buffer, StringBufSize) == (size_t)-1) {
         g_wsa_last_error = WSAEINVAL;
@@ -94,7 +605,7 @@ int WSAAPI GetAddrInfoW(const wchar_t* pNodeName, const wchar_t* pServiceName,
     /* Convert wide strings to multibyte */
     if (pNodeName != NULL) {
         len = wcstombs(node_buffer, pNodeName, sizeof(node_buffer));
-        if (len == (size_t)-1) {
+        if (len == (size_t)-1 || len == sizeof(node_buffer)) {
             g_wsa_last_error = WSAEINVAL;
             return WSAEINVAL;
         }
@@ -103,7 +614,7 @@ int WSAAPI GetAddrInfoW(const wchar_t* pNodeName, const wchar_t* pServiceName,
 
     if (pServiceName != NULL) {
         len = wcstombs(service_buffer, pServiceName, sizeof(service_buffer));
-        if (len == (size_t)-1) {
+        if (len == (size_t)-1 || len == sizeof(service_buffer)) {
             g_wsa_last_error = WSAEINVAL;
             return WSAEINVAL;
         }
@@ -277,10 +788,10 @@ int WSAAPI WSAAddressToStringA(LPSOCKADDR lpsaAddress, DWORD dwAddressLength,
                                LPSTR lpszAddressString,
                                DWORD* lpdwAddressStringLength)
 {
-    char buffer[INET6_ADDRSTRLEN + 16]; /* Address + port */
-    int af;
-    const char* result;
+    char buffer[WSA_SOCKADDR_STRLEN];
+    DWORD min_len;
     size_t len;
+    WSA_STATS_SCOPE(WSAAddressToStringA);
 
     (void)lpProtocolInfo;
 
@@ -289,76 +800,72 @@ int WSAAPI WSAAddressToStringA(LPSOCKADDR lpsaAddress, DWORD dwAddressLength,
         return SOCKET_ERROR;
     }
 
-    af = lpsaAddress->sa_family;
-
-    if (af == AF_INET) {
-        struct sockaddr_in* addr;
-        addr = (struct sockaddr_in*)lpsaAddress;
-        result = inet_ntop(AF_INET, &addr->sin_addr, buffer, sizeof(buffer));
-        if (result != NULL) {
-            len = strlen(buffer);
-            snprintf(buffer + len, sizeof(buffer) - len, ":%d", ntohs(addr->sin_port));
-        }
-    } else if (af == AF_INET6) {
-        struct sockaddr_in6* addr6;
-        addr6 = (struct sockaddr_in6*)lpsaAddress;
-        result = inet_ntop(AF_INET6, &addr6->sin6_addr, buffer, sizeof(buffer));
-        if (result != NULL) {
-            len = strlen(buffer);
-            snprintf(buffer + len, sizeof(buffer) - len, ":%d", ntohs(addr6->sin6_port));
-        }
-    } else {
+    min_len = sockaddr_min_length(lpsaAddress->sa_family);
+    if (min_len == 0) {
         g_wsa_last_error = WSAEAFNOSUPPORT;
         return SOCKET_ERROR;
     }
 
-    if (result == NULL) {
+    if (dwAddressLength < min_len) {
         g_wsa_last_error = WSAEFAULT;
         return SOCKET_ERROR;
     }
 
-    len = strlen(buffer) + 1;
+    len = sockaddr_to_string(lpsaAddress, buffer) + 1;
     if (*lpdwAddressStringLength < len) {
         *lpdwAddressStringLength = (DWORD)len;
         g_wsa_last_error = WSAEFAULT;
         return SOCKET_ERROR;
     }
 
-    strcpy(lpszAddressString, buffer);
+    memcpy(lpszAddressString, buffer, len);
     *lpdwAddressStringLength = (DWORD)len;
 
     g_wsa_last_error = 0;
     return 0;
 }
+WSA_HIDDEN_DEF(WSAAddressToStringA);
 
 int WSAAPI WSAAddressToStringW(LPSOCKADDR lpsaAddress, DWORD dwAddressLength,
                                LPWSAPROTOCOL_INFOW lpProtocolInfo,
                                LPWSTR lpszAddressString,
                                DWORD* lpdwAddressStringLength)
 {
-    char buffer[INET6_ADDRSTRLEN + 16];
+    char buffer[WSA_SOCKADDR_STRLEN];
     LPSTR temp_string;
     DWORD temp_length;
     int result;
 
+    if (lpszAddressString == NULL || lpdwAddressStringLength == NULL) {
+        g_wsa_last_error = WSAEFAULT;
+        return SOCKET_ERROR;
+    }
+
     temp_length = sizeof(buffer);
     temp_string = buffer;
 
-    result = WSAAddressToStringA(lpsaAddress, dwAddressLength,
-                                 (LPWSAPROTOCOL_INFOA)lpProtocolInfo,
-                                 temp_string, &temp_length);
+    result = WSAAddressToStringA_internal(lpsaAddress, dwAddressLength,
+                                          (LPWSAPROTOCOL_INFOA)lpProtocolInfo,
+                                          temp_string, &temp_length);
 
     if (result != 0) {
         return result;
     }
 
+    /* temp_length counts the terminator, as the caller's length must */
+    if (*lpdwAddressStringLength < temp_length) {
+        *lpdwAddressStringLength = temp_length;
+        g_wsa_last_error = WSAEFAULT;
+        return SOCKET_ERROR;
+    }
+
     /* Convert to wide string */
     if (mbstowcs(lpszAddressString, buffer, *lpdwAddressStringLength) == (size_t)-1) {
         g_wsa_last_error = WSAEINVAL;
         return SOCKET_ERROR;
     }
 
-    *lpdwAddressStringLength = (DWORD)(wcslen(lpszAddressString) + 1);
+    *lpdwAddressStringLength = temp_length;
 
     g_wsa_last_error = 0;
     return 0;
@@ -368,10 +875,9 @@ int WSAAPI WSAStringToAddressA(LPSTR AddressString, INT AddressFamily,
                                LPWSAPROTOCOL_INFOA lpProtocolInfo,
                                LPSOCKADDR lpAddress, INT* lpAddressLength)
 {
-    char* colon_pos;
-    char addr_only[INET6_ADDRSTRLEN];
-    int port;
-    int result;
+    struct sockaddr_storage storage;
+    INT min_len;
+    WSA_STATS_SCOPE(WSAStringToAddressA);
 
     (void)lpProtocolInfo;
 
@@ -380,80 +886,155 @@ int WSAAPI WSAStringToAddressA(LPSTR AddressString, INT AddressFamily,
         return SOCKET_ERROR;
     }
 
-    /* Find port separator */
-    colon_pos = strrchr(AddressString, ':');
-    port = 0;
-
-    if (colon_pos != NULL) {
-        size_t addr_len;
-        addr_len = colon_pos - AddressString;
-        if (addr_len >= sizeof(addr_only)) {
-            g_wsa_last_error = WSAEINVAL;
-            return SOCKET_ERROR;
-        }
-        memcpy(addr_only, AddressString, addr_len);
-        addr_only[addr_len] = '\0';
-        port = atoi(colon_pos + 1);
-    } else {
-        strncpy(addr_only, AddressString, sizeof(addr_only) - 1);
-        addr_only[sizeof(addr_only) - 1] = '\0';
-    }
-
-    if (AddressFamily == AF_INET) {
-        struct sockaddr_in* addr;
-        if (*lpAddressLength < (INT)sizeof(struct sockaddr_in)) {
-            *lpAddressLength = (INT)sizeof(struct sockaddr_in);
-            g_wsa_last_error = WSAEFAULT;
-            return SOCKET_ERROR;
-        }
-        addr = (struct sockaddr_in*)lpAddress;
-        memset(addr, 0, sizeof(*addr));
-        addr->sin_family = AF_INET;
-        addr->sin_port = htons((uint16_t)port);
-        result = inet_pton(AF_INET, addr_only, &addr->sin_addr);
-        *lpAddressLength = (INT)sizeof(struct sockaddr_in);
-    } else if (AddressFamily == AF_INET6) {
-        struct sockaddr_in6* addr6;
-        if (*lpAddressLength < (INT)sizeof(struct sockaddr_in6)) {
-            *lpAddressLength = (INT)sizeof(struct sockaddr_in6);
-            g_wsa_last_error = WSAEFAULT;
-            return SOCKET_ERROR;
-        }
-        addr6 = (struct sockaddr_in6*)lpAddress;
-        memset(addr6, 0, sizeof(*addr6));
-        addr6->sin6_family = AF_INET6;
-        addr6->sin6_port = htons((uint16_t)port);
-        result = inet_pton(AF_INET6, addr_only, &addr6->sin6_addr);
-        *lpAddressLength = (INT)sizeof(struct sockaddr_in6);
-    } else {
+    min_len = (INT)sockaddr_min_length(AddressFamily);
+    if (min_len == 0) {
         g_wsa_last_error = WSAEAFNOSUPPORT;
         return SOCKET_ERROR;
     }
 
-    if (result <= 0) {
+    if (*lpAddressLength < min_len) {
+        *lpAddressLength = min_len;
+        g_wsa_last_error = WSAEFAULT;
+        return SOCKET_ERROR;
+    }
+
+    *lpAddressLength = min_len;
+
+    if (string_to_sockaddr(AddressString, strlen(AddressString),
+                           AddressFamily, &storage) != 0) {
         g_wsa_last_error = WSAEINVAL;
         return SOCKET_ERROR;
     }
 
+    memcpy(lpAddress, &storage, (size_t)min_len);
+
     g_wsa_last_error = 0;
     return 0;
 }
+WSA_HIDDEN_DEF(WSAStringToAddressA);
 
 int WSAAPI WSAStringToAddressW(LPWSTR AddressString, INT AddressFamily,
                                LPWSAPROTOCOL_INFOW lpProtocolInfo,
                                LPSOCKADDR lpAddress, INT* lpAddressLength)
 {
-    char buffer[INET6_ADDRSTRLEN + 16];
+    char buffer[WSA_SOCKADDR_STRLEN];
+    size_t len;
+
+    if (AddressString == NULL) {
+        g_wsa_last_error = WSAEFAULT;
+        return SOCKET_ERROR;
+    }
 
-    /* Convert to multibyte */
-    if (wcstombs(buffer, AddressString, sizeof(buffer)) == (size_t)-1) {
+    /* Convert to multibyte; a string that fills the buffer is too long */
+    len = wcstombs(buffer, AddressString, sizeof(buffer));
+    if (len == (size_t)-1 || len == sizeof(buffer)) {
         g_wsa_last_error = WSAEINVAL;
         return SOCKET_ERROR;
     }
 
-    return WSAStringToAddressA(buffer, AddressFamily,
-                              (LPWSAPROTOCOL_INFOA)lpProtocolInfo,
-                              lpAddress, lpAddressLength);
+    return WSAStringToAddressA_internal(buffer, AddressFamily,
+                                        (LPWSAPROTOCOL_INFOA)lpProtocolInfo,
+                                        lpAddress, lpAddressLength);
+}
+
+/* ============================================================================
+ * Batch Address Conversion Functions
+ * ============================================================================ */
+
+int WSAAPI WSAStringToAddressBatchA(LPSTR* AddressStrings, DWORD dwCount,
+                                    INT AddressFamily,
+                                    LPSOCKADDR_STORAGE lpAddresses,
+                                    INT* lpiErrors)
+{
+    DWORD i;
+    int converted;
+
+    if (AddressStrings == NULL || lpAddresses == NULL) {
+        g_wsa_last_error = WSAEFAULT;
+        return SOCKET_ERROR;
+    }
+
+    if (AddressFamily != AF_UNSPEC && sockaddr_min_length(AddressFamily) == 0) {
+        g_wsa_last_error = WSAEAFNOSUPPORT;
+        return SOCKET_ERROR;
+    }
+
+    converted = 0;
+    for (i = 0; i < dwCount; i++) {
+        int error;
+
+        if (AddressStrings[i] == NULL) {
+            error = WSAEFAULT;
+        } else if (string_to_sockaddr(AddressStrings[i], strlen(AddressStrings[i]),
+                                      AddressFamily, &lpAddresses[i]) != 0) {
+            error = WSAEINVAL;
+        } else {
+            error = 0;
+            converted++;
+        }
+
+        if (error != 0) {
+            memset(&lpAddresses[i], 0, sizeof(lpAddresses[i]));
+        }
+        if (lpiErrors != NULL) {
+            lpiErrors[i] = error;
+        }
+    }
+
+    g_wsa_last_error = 0;
+    return converted;
+}
+
+int WSAAPI WSAAddressToStringBatchA(const SOCKADDR_STORAGE* lpAddresses,
+                                    DWORD dwCount, LPSTR lpszStrings,
+                                    DWORD dwStride, INT* lpiErrors)
+{
+    char buffer[WSA_SOCKADDR_STRLEN];
+    DWORD i;
+    int converted;
+
+    if (lpAddresses == NULL || lpszStrings == NULL || dwStride == 0) {
+        g_wsa_last_error = WSAEFAULT;
+        return SOCKET_ERROR;
+    }
+
+    converted = 0;
+    for (i = 0; i < dwCount; i++) {
+        char* dest;
+        size_t len;
+        int error;
+
+        dest = lpszStrings + (size_t)i * dwStride;
+
+        /* Format straight into the caller's slot when it is always large enough */
+        if (dwStride >= WSA_SOCKADDR_STRLEN) {
+            len = sockaddr_to_string((const struct sockaddr*)&lpAddresses[i], dest);
+        } else {
+            len = sockaddr_to_string((const struct sockaddr*)&lpAddresses[i], buffer);
+            if (len != 0 && len < dwStride) {
+                memcpy(dest, buffer, len + 1);
+            }
+        }
+
+        if (len == 0) {
+            error = WSAEAFNOSUPPORT;
+        } else if (len >= dwStride) {
+            error = WSAEFAULT;
+        } else {
+            error = 0;
+            converted++;
+        }
+
+        if (error != 0) {
+            dest[0] = '\0';
+        }
+        if (lpiErrors != NULL) {
+            lpiErrors[i] = error;
+        }
+    }
+
+    g_wsa_last_error = 0;
+    return converted;
 }
 
 /* ============================================================================
@@ -0,0 +1,33 @@
+/*
+ * Winsock Wrapper Internal Aliases
+ * Direct binding for exported functions the library calls itself. Kept
+ * apart from wsa_internal.h so the Winsock 1.1 sources, built on
+ * winsock.h, can use it too
+ */
+
+#ifndef _WSA_ALIAS_H
+#define _WSA_ALIAS_H
+
+#ifdef __linux__
+
+/*
+ * Calls from one part of the library to an exported function go through
+ * <name>_internal, a hidden alias of it. A call to the exported name
+ * from -fPIC code goes through the PLT, because an application could
+ * interpose its own definition, and it cannot be inlined. The alias
+ * always binds to the library's own definition: the call is direct,
+ * needs no symbol lookup at load time, and can be inlined within a file
+ * or under LTO. WSA_HIDDEN_DEF(name) defines the alias and comes after
+ * the function body, ahead of the calls in the same file;
+ * WSA_HIDDEN_PROTO(name) declares it for other files.
+ */
+#define WSA_HIDDEN_PROTO(name) \
+    extern __typeof(name) name##_internal __attribute__((visibility("hidden")))
+
+#define WSA_HIDDEN_DEF(name) \
+    extern __typeof(name) name##_internal \
+        __attribute__((alias(#name), visibility("hidden")))
+
+#endif /* __linux__ */
+
+#endif /* _WSA_ALIAS_H */
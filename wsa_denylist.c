@@ -0,0 +1,224 @@
+/*
+ * Accept Denylist for Winsock Wrapper
+ * Compiles SIO_ACCEPT_DENYLIST prefixes into a classic BPF socket filter,
+ * so the kernel drops packets (including SYNs) from denied peers before a
+ * connection is ever queued for accept
+ */
+
+#ifdef __linux__
+
+#include "winsock2_api.h"
+#include "wsa_internal.h"
+#include "mstcpip.h"
+#include <linux/filter.h>
+
+#define DENY_ACCEPT_PACKET 0xffffffffU
+#define DENY_DROP_PACKET   0
+
+/* Instructions per entry: load, mask and compare each word, then drop */
+#define DENY_V4_INSNS 4
+#define DENY_V6_INSNS(words) (3 * (words) + 1)
+
+/* Version dispatch (7), IPv4 load/store/accept (3) and IPv6 accept (1) */
+#define DENY_HEADER_INSNS 11
+
+typedef struct DenyFilter {
+    struct sock_filter* code;
+    unsigned int len;
+} DenyFilter;
+
+static void deny_emit(DenyFilter* f, unsigned short code,
+                      unsigned char jt, unsigned char jf, unsigned int k)
+{
+    f->code[f->len].code = code;
+    f->code[f->len].jt = jt;
+    f->code[f->len].jf = jf;
+    f->code[f->len].k = k;
+    f->len++;
+}
+
+static unsigned int prefix_mask(int bits)
+{
+    if (bits <= 0) {
+        return 0;
+    }
+    if (bits >= 32) {
+        return 0xffffffffU;
+    }
+    return ~(0xffffffffU >> bits);
+}
+
+/* 32-bit words of an IPv6 prefix that need comparing */
+static int v6_words(int prefix_len)
+{
+    return (prefix_len + 31) / 32;
+}
+
+/* IPv4-mapped IPv6 prefixes match the IPv4 packets of dual-stack listeners */
+static int entry_is_v4(const IP_ADDRESS_PREFIX* entry, unsigned int* addr, int* bits)
+{
+    const unsigned char* b;
+
+    if (entry->Prefix.si_family == AF_INET) {
+        *addr = ntohl(entry->Prefix.Ipv4.sin_addr.s_addr);
+        *bits = entry->PrefixLength;
+        return 1;
+    }
+    if (IN6_IS_ADDR_V4MAPPED(&entry->Prefix.Ipv6.sin6_addr) && entry->PrefixLength >= 96) {
+        b = entry->Prefix.Ipv6.sin6_addr.s6_addr;
+        *addr = ((unsigned int)b[12] << 24) | ((unsigned int)b[13] << 16) |
+                ((unsigned int)b[14] << 8) | (unsigned int)b[15];
+        *bits = entry->PrefixLength - 96;
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Layout: dispatch on the IP version nibble, then one block per family
+ * that drops on the first matching prefix and accepts at its end. Loads
+ * use SKF_NET_OFF because TCP runs the filter with data at the TCP header.
+ */
+static void deny_build(DenyFilter* f, const IP_ADDRESS_PREFIX* entries,
+                       DWORD count, unsigned int v4_len)
+{
+    const unsigned char* b;
+    unsigned int addr;
+    unsigned int word;
+    int bits;
+    int words;
+    int w;
+    DWORD i;
+
+    deny_emit(f, BPF_LD | BPF_B | BPF_ABS, 0, 0, (unsigned int)SKF_NET_OFF);
+    deny_emit(f, BPF_ALU | BPF_RSH | BPF_K, 0, 0, 4);
+    deny_emit(f, BPF_JMP | BPF_JEQ | BPF_K, 0, 1, 4);
+    deny_emit(f, BPF_JMP | BPF_JA, 0, 0, 3);            /* to the IPv4 block */
+    deny_emit(f, BPF_JMP | BPF_JEQ | BPF_K, 0, 1, 6);
+    deny_emit(f, BPF_JMP | BPF_JA, 0, 0, v4_len + 1);   /* to the IPv6 block */
+    deny_emit(f, BPF_RET | BPF_K, 0, 0, DENY_ACCEPT_PACKET);
+
+    /* IPv4: source address at offset 12, kept in M[0] */
+    deny_emit(f, BPF_LD | BPF_W | BPF_ABS, 0, 0, (unsigned int)(SKF_NET_OFF + 12));
+    deny_emit(f, BPF_ST, 0, 0, 0);
+    for (i = 0; i < count; i++) {
+        if (!entry_is_v4(&entries[i], &addr, &bits)) {
+            continue;
+        }
+        deny_emit(f, BPF_LD | BPF_MEM, 0, 0, 0);
+        deny_emit(f, BPF_ALU | BPF_AND | BPF_K, 0, 0, prefix_mask(bits));
+        deny_emit(f, BPF_JMP | BPF_JEQ | BPF_K, 0, 1, addr & prefix_mask(bits));
+        deny_emit(f, BPF_RET | BPF_K, 0, 0, DENY_DROP_PACKET);
+    }
+    deny_emit(f, BPF_RET | BPF_K, 0, 0, DENY_ACCEPT_PACKET);
+
+    /* IPv6: source address at offset 8 */
+    for (i = 0; i < count; i++) {
+        if (entries[i].Prefix.si_family != AF_INET6 ||
+            entry_is_v4(&entries[i], &addr, &bits)) {
+            continue;
+        }
+        b = entries[i].Prefix.Ipv6.sin6_addr.s6_addr;
+        words = v6_words(entries[i].PrefixLength);
+        for (w = 0; w < words; w++) {
+            word = ((unsigned int)b[4 * w] << 24) | ((unsigned int)b[4 * w + 1] << 16) |
+                   ((unsigned int)b[4 * w + 2] << 8) | (unsigned int)b[4 * w + 3];
+            bits = entries[i].PrefixLength - 32 * w;
+            deny_emit(f, BPF_LD | BPF_W | BPF_ABS, 0, 0,
+                      (unsigned int)(SKF_NET_OFF + 8 + 4 * w));
+            deny_emit(f, BPF_ALU | BPF_AND | BPF_K, 0, 0, prefix_mask(bits));
+            /* On mismatch skip the remaining words and the drop */
+            deny_emit(f, BPF_JMP | BPF_JEQ | BPF_K, 0,
+                      (unsigned char)(3 * (words - 1 - w) + 1),
+                      word & prefix_mask(bits));
+        }
+        deny_emit(f, BPF_RET | BPF_K, 0, 0, DENY_DROP_PACKET);
+    }
+    deny_emit(f, BPF_RET | BPF_K, 0, 0, DENY_ACCEPT_PACKET);
+}
+
+/* ============================================================================
+ * SIO_ACCEPT_DENYLIST
+ * ============================================================================ */
+
+int wsa_accept_denylist_ioctl(SOCKET s, LPVOID lpvInBuffer, DWORD cbInBuffer)
+{
+    const IP_ADDRESS_PREFIX* entries;
+    struct sock_fprog prog;
+    DenyFilter filter;
+    unsigned int v4_len;
+    unsigned int total;
+    unsigned int addr;
+    int bits;
+    int dummy;
+    DWORD count;
+    DWORD i;
+
+    if (cbInBuffer % sizeof(IP_ADDRESS_PREFIX) != 0 ||
+        (cbInBuffer != 0 && lpvInBuffer == NULL)) {
+        g_wsa_last_error = WSAEFAULT;
+        return SOCKET_ERROR;
+    }
+    entries = (const IP_ADDRESS_PREFIX*)lpvInBuffer;
+    count = cbInBuffer / sizeof(IP_ADDRESS_PREFIX);
+
+    if (count == 0) {
+        dummy = 0;
+        if (wsa_listener_setsockopt(s, SOL_SOCKET, SO_DETACH_FILTER,
+                                    &dummy, sizeof(dummy)) < 0 && errno != ENOENT) {
+            set_wsa_error_from_errno();
+            return SOCKET_ERROR;
+        }
+        g_wsa_last_error = 0;
+        return 0;
+    }
+
+    /* Validate and size the program before building it */
+    v4_len = 3;
+    total = DENY_HEADER_INSNS;
+    for (i = 0; i < count; i++) {
+        if (entry_is_v4(&entries[i], &addr, &bits)) {
+            if (bits > 32) {
+                g_wsa_last_error = WSAEINVAL;
+                return SOCKET_ERROR;
+            }
+            v4_len += DENY_V4_INSNS;
+            total += DENY_V4_INSNS;
+        } else if (entries[i].Prefix.si_family == AF_INET6) {
+            if (entries[i].PrefixLength > 128) {
+                g_wsa_last_error = WSAEINVAL;
+                return SOCKET_ERROR;
+            }
+            total += DENY_V6_INSNS(v6_words(entries[i].PrefixLength));
+        } else {
+            g_wsa_last_error = WSAEAFNOSUPPORT;
+            return SOCKET_ERROR;
+        }
+    }
+    if (total > BPF_MAXINSNS) {
+        g_wsa_last_error = WSAENOBUFS;
+        return SOCKET_ERROR;
+    }
+
+    filter.code = (struct sock_filter*)calloc(total, sizeof(struct sock_filter));
+    if (filter.code == NULL) {
+        g_wsa_last_error = WSAENOBUFS;
+        return SOCKET_ERROR;
+    }
+    filter.len = 0;
+    deny_build(&filter, entries, count, v4_len);
+
+    prog.len = (unsigned short)filter.len;
+    prog.filter = filter.code;
+    if (wsa_listener_setsockopt(s, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) < 0) {
+        set_wsa_error_from_errno();
+        free(filter.code);
+        return SOCKET_ERROR;
+    }
+
+    free(filter.code);
+    g_wsa_last_error = 0;
+    return 0;
+}
+
+#endif /* __linux__ */
@@ -6,14 +6,14 @@
 #ifdef __linux__
 
 #include "winsock2_api.h"
+#include "wsa_internal.h"
 #include <pthread.h>
 #include <sys/eventfd.h>
 #include <sys/epoll.h>
 #include <sys/time.h>
 #include <signal.h>
 #include <time.h>
-
-extern __thread int g_wsa_last_error;
+#include <limits.h>
 
 /* Event structure */
 typedef struct WSAEventStruct {
@@ -23,36 +23,38 @@ typedef struct WSAEventStruct {
     pthread_mutex_t mutex;
 } WSAEventStruct;
 
-/* Socket event mapping structure */
+/* WSAEventSelect state, hung off the socket record */
 typedef struct SocketEventMap {
     SOCKET sock;
+    unsigned int gen;       /* Close generation at registration */
     WSAEVENT event;
     long network_events;
+    long pending_events;    /* Raised by wsa_notify_network_event */
+    int pending_errors[FD_MAX_EVENTS];
     int epoll_fd;
     pthread_t thread;
     int running;
     pthread_mutex_t mutex;
-    struct SocketEventMap* next;
 } SocketEventMap;
 
-static SocketEventMap* g_socket_event_map = NULL;
 static pthread_mutex_t g_map_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t g_event_select_once = PTHREAD_ONCE_INIT;
 
-/* Async request structure */
+/* Async request structure; freed by its lookup thread when done */
 typedef struct AsyncRequest {
+    HANDLE handle;
     HANDLE hWnd;
     unsigned int wMsg;
     void* buffer;
     int buflen;
     int type; /* 0=host by name, 1=host by addr, 2=serv by name, etc */
-    char* name;
-    char* addr;
+    char name[256];
+    char addr[16];          /* Large enough for an in6_addr */
     int len;
     int addr_type;
     int port;
     char* proto;
     int number;
-    pthread_t thread;
     int cancelled;
     struct AsyncRequest* next;
 } AsyncRequest;
@@ -61,6 +63,10 @@ static AsyncRequest* g_async_requests = NULL;
 static pthread_mutex_t g_async_mutex = PTHREAD_MUTEX_INITIALIZER;
 static int g_async_handle_counter = 1;
 
+static WSAPool g_event_pool = WSA_POOL_INITIALIZER("WSAEVENT", sizeof(WSAEventStruct));
+static WSAPool g_event_map_pool = WSA_POOL_INITIALIZER("SocketEventMap", sizeof(SocketEventMap));
+static WSAPool g_async_request_pool = WSA_POOL_INITIALIZER("AsyncRequest", sizeof(AsyncRequest));
+
 /* ============================================================================
  * Event Functions
  * ============================================================================ */
@@ -76,7 +82,7 @@ WSAEVENT WSAAPI WSACreateEvent(void)
         return NULL;
     }
 
-    event = (WSAEventStruct*)malloc(sizeof(WSAEventStruct));
+    event = (WSAEventStruct*)wsa_pool_alloc(&g_event_pool);
     if (event == NULL) {
         close(efd);
         g_wsa_last_error = WSA_NOT_ENOUGH_MEMORY;
@@ -105,7 +111,7 @@ BOOL WSAAPI WSACloseEvent(WSAEVENT hEvent)
 
     close(event->eventfd);
     pthread_mutex_destroy(&event->mutex);
-    free(event);
+    wsa_pool_free(&g_event_pool, event);
 
     g_wsa_last_error = 0;
     return TRUE;
@@ -122,6 +128,7 @@ BOOL WSAAPI WSASetEvent(WSAEVENT hEvent)
     }
 
     event = (WSAEventStruct*)hEvent;
+    WSA_PROBE1(event__set, hEvent);
 
     pthread_mutex_lock(&event->mutex);
 
@@ -129,7 +136,7 @@ BOOL WSAAPI WSASetEvent(WSAEVENT hEvent)
         val = 1;
         if (write(event->eventfd, &val, sizeof(val)) != sizeof(val)) {
             pthread_mutex_unlock(&event->mutex);
-            g_wsa_last_error = WSAENETDOWN;
+            set_wsa_error_from_errno();
             return FALSE;
         }
         event->signaled = 1;
@@ -140,6 +147,7 @@ BOOL WSAAPI WSASetEvent(WSAEVENT hEvent)
     g_wsa_last_error = 0;
     return TRUE;
 }
+WSA_HIDDEN_DEF(WSASetEvent);
 
 BOOL WSAAPI WSAResetEvent(WSAEVENT hEvent)
 {
@@ -167,18 +175,18 @@ BOOL WSAAPI WSAResetEvent(WSAEVENT hEvent)
     g_wsa_last_error = 0;
     return TRUE;
 }
+WSA_HIDDEN_DEF(WSAResetEvent);
 
 DWORD WSAAPI WSAWaitForMultipleEvents(DWORD cEvents, const WSAEVENT* lphEvents,
                                       BOOL fWaitAll, DWORD dwTimeout,
                                       BOOL fAlertable)
 {
-    fd_set readfds;
-    struct timeval tv;
-    struct timeval* ptv;
-    int max_fd;
+    struct pollfd pfds[WSA_MAXIMUM_WAIT_EVENTS];
+    int timeout;
     DWORD i;
     int result;
     WSAEventStruct* event;
+    WSA_STATS_SCOPE(WSAWaitForMultipleEvents);
 
     (void)fWaitAll; /* Simplified implementation */
     (void)fAlertable;
@@ -188,33 +196,31 @@ DWORD WSAAPI WSAWaitForMultipleEvents(DWORD cEvents, const WSAEVENT* lphEvents,
         return WSA_WAIT_FAILED;
     }
 
-    FD_ZERO(&readfds);
-    max_fd = -1;
-
     for (i = 0; i < cEvents; i++) {
         if (lphEvents[i] == NULL) {
             g_wsa_last_error = WSA_INVALID_HANDLE;
             return WSA_WAIT_FAILED;
         }
         event = (WSAEventStruct*)lphEvents[i];
-        FD_SET(event->eventfd, &readfds);
-        if (event->eventfd > max_fd) {
-            max_fd = event->eventfd;
-        }
+        pfds[i].fd = event->eventfd;
+        pfds[i].events = POLLIN;
+        pfds[i].revents = 0;
     }
 
     if (dwTimeout == WSA_INFINITE) {
-        ptv = NULL;
+        timeout = -1;
+    } else if (dwTimeout > (DWORD)INT_MAX) {
+        timeout = INT_MAX;
     } else {
-        tv.tv_sec = dwTimeout / 1000;
-        tv.tv_usec = (dwTimeout % 1000) * 1000;
-        ptv = &tv;
+        timeout = (int)dwTimeout;
     }
 
-    result = select(max_fd + 1, &readfds, NULL, NULL, ptv);
+    WSA_PROBE2(event__wait__start, cEvents, dwTimeout);
+    result = poll(pfds, (nfds_t)cEvents, timeout);
+    WSA_PROBE3(event__wait__done, cEvents, result, WSA_PROBE_ERROR(result));
 
     if (result < 0) {
-        g_wsa_last_error = WSAENETDOWN;
+        set_wsa_error_from_errno();
         return WSA_WAIT_FAILED;
     }
 
@@ -223,10 +229,9 @@ DWORD WSAAPI WSAWaitForMultipleEvents(DWORD cEvents, const WSAEVENT* lphEvents,
         return WSA_WAIT_TIMEOUT;
     }
 
-    /* Find which event was signaled */
+    /* Lowest signaled index wins, as on Windows */
     for (i = 0; i < cEvents; i++) {
-        event = (WSAEventStruct*)lphEvents[i];
-        if (FD_ISSET(event->eventfd, &readfds)) {
+        if (pfds[i].revents & POLLIN) {
             g_wsa_last_error = 0;
             return WSA_WAIT_EVENT_0 + i;
         }
@@ -235,11 +240,63 @@ DWORD WSAAPI WSAWaitForMultipleEvents(DWORD cEvents, const WSAEVENT* lphEvents,
     g_wsa_last_error = 0;
     return WSA_WAIT_TIMEOUT;
 }
+WSA_HIDDEN_DEF(WSAWaitForMultipleEvents);
 
 /* ============================================================================
  * WSAEventSelect Implementation
  * ============================================================================ */
 
+/* WSAEventSelect state of s for its current generation; g_map_mutex held */
+static SocketEventMap* event_map_find(SOCKET s)
+{
+    WSASocketRecord* rec;
+    SocketEventMap* map;
+
+    rec = wsa_socket_lookup(s);
+    if (rec == NULL) {
+        return NULL;
+    }
+    map = (SocketEventMap*)rec->event_select;
+    if (map == NULL || map->gen != __atomic_load_n(&rec->gen, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    return map;
+}
+
+/*
+ * Stop the monitor of a map that is being replaced or torn down. The
+ * socket leaves the map's epoll set now, while its descriptor is still
+ * ours; the thread frees the map once it sees running cleared.
+ */
+static void event_map_retire(SocketEventMap* map)
+{
+    pthread_mutex_lock(&map->mutex);
+    epoll_ctl(map->epoll_fd, EPOLL_CTL_DEL, (int)map->sock, NULL);
+    map->running = 0;
+    pthread_mutex_unlock(&map->mutex);
+}
+
+/* closesocket() hook: the association ends with the socket */
+static void event_select_on_close(SOCKET s)
+{
+    WSASocketRecord* rec;
+    SocketEventMap* map;
+
+    pthread_mutex_lock(&g_map_mutex);
+    map = event_map_find(s);
+    if (map != NULL) {
+        event_map_retire(map);
+        rec = wsa_socket_lookup(s);
+        rec->event_select = NULL;
+    }
+    pthread_mutex_unlock(&g_map_mutex);
+}
+
+static void event_select_init(void)
+{
+    wsa_add_close_hook(event_select_on_close);
+}
+
 /* Thread function for monitoring socket events */
 static void* event_monitor_thread(void* arg)
 {
@@ -270,47 +327,100 @@ static void* event_monitor_thread(void* arg)
             break;
         }
 
-        for (i = 0; i < nfds; i++) {
+        /* A retired map's event may already be closed by its owner */
+        pthread_mutex_lock(&map->mutex);
+        for (i = 0; i < nfds && map->running; i++) {
             event_obj = (WSAEventStruct*)map->event;
             if (event_obj != NULL) {
-                WSASetEvent(map->event);
+                WSA_PROBE2(eventselect__deliver, map->sock, events[i].events);
+                WSASetEvent_internal(map->event);
             }
         }
+        pthread_mutex_unlock(&map->mutex);
     }
 
+    close(map->epoll_fd);
+    pthread_mutex_destroy(&map->mutex);
+    wsa_pool_free(&g_event_map_pool, map);
     return NULL;
 }
 
 int WSAAPI WSAEventSelect(SOCKET s, WSAEVENT hEventObject, long lNetworkEvents)
 {
+    WSASocketRecord* rec;
     SocketEventMap* map;
     SocketEventMap* existing;
     struct epoll_event ev;
     int epoll_fd;
     uint32_t epoll_events;
+    WSA_STATS_SCOPE(WSAEventSelect);
+
+    rec = wsa_socket_record(s);
+    if (rec == NULL) {
+        g_wsa_last_error = WSAENOTSOCK;
+        return SOCKET_ERROR;
+    }
+
+    /* FD_ACCEPT would miss connections steered to the hidden shards */
+    if (lNetworkEvents != 0 && wsa_listener_sharded(s)) {
+        g_wsa_last_error = WSAEINVAL;
+        return SOCKET_ERROR;
+    }
+
+    pthread_once(&g_event_select_once, event_select_init);
+
+    /* Setup epoll events */
+    epoll_events = 0;
+    if (lNetworkEvents & (FD_READ | FD_ACCEPT)) {
+        epoll_events |= EPOLLIN;
+    }
+    if (lNetworkEvents & (FD_WRITE | FD_CONNECT)) {
+        epoll_events |= EPOLLOUT;
+    }
+    if (lNetworkEvents & FD_OOB) {
+        epoll_events |= EPOLLPRI;
+    }
+    if (lNetworkEvents & FD_CLOSE) {
+        epoll_events |= EPOLLRDHUP;
+    }
 
     /* Find existing mapping */
     pthread_mutex_lock(&g_map_mutex);
 
-    existing = g_socket_event_map;
-    while (existing != NULL) {
-        if (existing->sock == s) {
-            break;
+    existing = event_map_find(s);
+
+    /* lNetworkEvents 0 cancels the association and stops its monitor */
+    if (lNetworkEvents == 0) {
+        if (existing != NULL) {
+            event_map_retire(existing);
+            rec->event_select = NULL;
         }
-        existing = existing->next;
+        pthread_mutex_unlock(&g_map_mutex);
+        g_wsa_last_error = 0;
+        return 0;
     }
 
     if (existing != NULL) {
         /* Update existing mapping */
+        ev.events = epoll_events;
+        ev.data.fd = (int)s;
+        pthread_mutex_lock(&existing->mutex);
+        if (epoll_ctl(existing->epoll_fd, EPOLL_CTL_MOD, (int)s, &ev) < 0) {
+            set_wsa_error_from_errno();
+            pthread_mutex_unlock(&existing->mutex);
+            pthread_mutex_unlock(&g_map_mutex);
+            return SOCKET_ERROR;
+        }
         existing->event = hEventObject;
         existing->network_events = lNetworkEvents;
+        pthread_mutex_unlock(&existing->mutex);
         pthread_mutex_unlock(&g_map_mutex);
         g_wsa_last_error = 0;
         return 0;
     }
 
     /* Create new mapping */
-    map = (SocketEventMap*)malloc(sizeof(SocketEventMap));
+    map = (SocketEventMap*)wsa_pool_alloc(&g_event_map_pool);
     if (map == NULL) {
         pthread_mutex_unlock(&g_map_mutex);
         g_wsa_last_error = WSA_NOT_ENOUGH_MEMORY;
@@ -319,53 +429,37 @@ int WSAAPI WSAEventSelect(SOCKET s, WSAEVENT hEventObject, long lNetworkEvents)
 
     epoll_fd = epoll_create1(EPOLL_CLOEXEC);
     if (epoll_fd < 0) {
-        free(map);
+        set_wsa_error_from_errno();
+        wsa_pool_free(&g_event_map_pool, map);
         pthread_mutex_unlock(&g_map_mutex);
-        g_wsa_last_error = WSAENETDOWN;
         return SOCKET_ERROR;
     }
 
-    /* Setup epoll events */
-    epoll_events = 0;
-    if (lNetworkEvents & (FD_READ | FD_ACCEPT)) {
-        epoll_events |= EPOLLIN;
-    }
-    if (lNetworkEvents & (FD_WRITE | FD_CONNECT)) {
-        epoll_events |= EPOLLOUT;
-    }
-    if (lNetworkEvents & FD_OOB) {
-        epoll_events |= EPOLLPRI;
-    }
-    if (lNetworkEvents & FD_CLOSE) {
-        epoll_events |= EPOLLRDHUP;
-    }
-
     ev.events = epoll_events;
     ev.data.fd = (int)s;
 
     if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, (int)s, &ev) < 0) {
+        set_wsa_error_from_errno();
         close(epoll_fd);
-        free(map);
+        wsa_pool_free(&g_event_map_pool, map);
         pthread_mutex_unlock(&g_map_mutex);
-        g_wsa_last_error = WSAENETDOWN;
         return SOCKET_ERROR;
     }
 
     map->sock = s;
+    map->gen = __atomic_load_n(&rec->gen, __ATOMIC_ACQUIRE);
     map->event = hEventObject;
     map->network_events = lNetworkEvents;
+    map->pending_events = 0;
     map->epoll_fd = epoll_fd;
     map->running = 1;
     pthread_mutex_init(&map->mutex, NULL);
-    map->next = g_socket_event_map;
-    g_socket_event_map = map;
 
     /* Create monitoring thread */
     if (pthread_create(&map->thread, NULL, event_monitor_thread, map) != 0) {
-        g_socket_event_map = map->next;
         close(epoll_fd);
         pthread_mutex_destroy(&map->mutex);
-        free(map);
+        wsa_pool_free(&g_event_map_pool, map);
         pthread_mutex_unlock(&g_map_mutex);
         g_wsa_last_error = WSAENETDOWN;
         return SOCKET_ERROR;
@@ -373,6 +467,11 @@ int WSAAPI WSAEventSelect(SOCKET s, WSAEVENT hEventObject, long lNetworkEvents)
 
     pthread_detach(map->thread);
 
+    if (rec->event_select != NULL) {
+        event_map_retire((SocketEventMap*)rec->event_select);
+    }
+    rec->event_select = map;
+
     pthread_mutex_unlock(&g_map_mutex);
 
     /* Set socket to non-blocking */
@@ -393,7 +492,9 @@ int WSAAPI WSAEnumNetworkEvents(SOCKET s, WSAEVENT hEventObject,
 {
     SocketEventMap* map;
     int error;
+    int bit;
     socklen_t errlen;
+    WSA_STATS_SCOPE(WSAEnumNetworkEvents);
 
     if (lpNetworkEvents == NULL) {
         g_wsa_last_error = WSAEFAULT;
@@ -405,12 +506,16 @@ int WSAAPI WSAEnumNetworkEvents(SOCKET s, WSAEVENT hEventObject,
     /* Find socket mapping */
     pthread_mutex_lock(&g_map_mutex);
 
-    map = g_socket_event_map;
-    while (map != NULL) {
-        if (map->sock == s) {
-            break;
+    map = event_map_find(s);
+
+    if (map != NULL && map->pending_events != 0) {
+        lpNetworkEvents->lNetworkEvents = map->pending_events;
+        for (bit = 0; bit < FD_MAX_EVENTS; bit++) {
+            if (map->pending_events & (1L << bit)) {
+                lpNetworkEvents->iErrorCode[bit] = map->pending_errors[bit];
+            }
         }
-        map = map->next;
+        map->pending_events = 0;
     }
 
     pthread_mutex_unlock(&g_map_mutex);
@@ -431,7 +536,7 @@ int WSAAPI WSAEnumNetworkEvents(SOCKET s, WSAEVENT hEventObject,
 
     /* Reset event if provided */
     if (hEventObject != NULL) {
-        WSAResetEvent(hEventObject);
+        WSAResetEvent_internal(hEventObject);
     }
 
     g_wsa_last_error = 0;
@@ -440,26 +545,716 @@ int WSAAPI WSAEnumNetworkEvents(SOCKET s, WSAEVENT hEventObject,
 
 /* ============================================================================
  * WSAAsyncSelect Implementation
+ *
+ * Window messages are emulated with per-hWnd queues fed by one reactor
+ * thread that watches every registered socket in a shared epoll set
+ * (EPOLLET | EPOLLONESHOT): a socket reports once and stays quiet until
+ * re-armed. As on Windows, FD_READ, FD_ACCEPT and FD_OOB come back once
+ * the application has taken the message (checked on its next dequeue
+ * call), FD_WRITE only after a send fails with WSAEWOULDBLOCK, and
+ * FD_CONNECT and FD_CLOSE are posted once.
  * ============================================================================ */
 
+#define ASYNC_SELECT_EVENTS  (FD_READ | FD_WRITE | FD_OOB | FD_ACCEPT | FD_CONNECT | FD_CLOSE | \
+                              FD_ROUTING_INTERFACE_CHANGE | FD_ADDRESS_LIST_CHANGE)
+#define ASYNC_DEQUEUE_EVENTS (FD_READ | FD_ACCEPT | FD_OOB)
+#define ASYNC_DEFER_MS       20
+
+typedef struct AsyncSelectEntry {
+    HANDLE hWnd;
+    unsigned int wMsg;
+    long lEvent;            /* Events requested by WSAAsyncSelect */
+    long enabled;           /* Events that may be posted now */
+    unsigned int gen;       /* Close generation at registration */
+    int outstanding;        /* Messages queued but not yet taken */
+    unsigned char in_use;
+    unsigned char listening;
+    unsigned char connecting;
+    unsigned char closed;
+    unsigned char rearm_pending;
+    unsigned char deferred;
+} AsyncSelectEntry;
+
+typedef struct AsyncQueuedMsg {
+    WSAASYNCMSG msg;
+    unsigned long long seq;
+} AsyncQueuedMsg;
+
+typedef struct AsyncMsgQueue {
+    HANDLE hWnd;
+    AsyncQueuedMsg* ring;
+    unsigned int head;
+    unsigned int count;
+    unsigned int capacity;
+    struct AsyncMsgQueue* next;
+} AsyncMsgQueue;
+
+static pthread_mutex_t g_reactor_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_msg_cond;
+static pthread_once_t g_reactor_once = PTHREAD_ONCE_INIT;
+static int g_reactor_epfd = -1;
+static int g_async_select_used = 0;
+
+static int* g_rearm_list = NULL;                  /* Taken, awaiting re-arm */
+static int g_rearm_count = 0;
+static int g_rearm_capacity = 0;
+static int* g_deferred_list = NULL;               /* Connect not started yet */
+static int g_deferred_count = 0;
+static int g_deferred_capacity = 0;
+static AsyncMsgQueue* g_msg_queues = NULL;
+static unsigned long long g_msg_seq = 0;
+
+/* WSAAsyncSelect entry of fd, NULL if it was never registered; g_reactor_mutex held */
+static AsyncSelectEntry* async_entry(int fd)
+{
+    WSASocketRecord* rec;
+
+    rec = wsa_socket_lookup((SOCKET)fd);
+    return rec != NULL ? (AsyncSelectEntry*)rec->async_select : NULL;
+}
+
+static DWORD async_now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (DWORD)((unsigned long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+static int async_push_fd(int** list, int* count, int* capacity, int fd)
+{
+    int* grown;
+    int new_capacity;
+
+    if (*count == *capacity) {
+        new_capacity = *capacity > 0 ? *capacity * 2 : 32;
+        grown = (int*)realloc(*list, (size_t)new_capacity * sizeof(int));
+        if (grown == NULL) {
+            return -1;
+        }
+        *list = grown;
+        *capacity = new_capacity;
+    }
+    (*list)[(*count)++] = fd;
+    return 0;
+}
+
+static int async_socket_error(int fd)
+{
+    int err;
+    socklen_t len;
+
+    err = 0;
+    len = sizeof(err);
+    getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len);
+    return err;
+}
+
+static uint32_t async_epoll_mask(const AsyncSelectEntry* e)
+{
+    uint32_t mask;
+
+    mask = EPOLLET | EPOLLONESHOT;
+    if (e->enabled & (FD_READ | FD_ACCEPT)) {
+        mask |= EPOLLIN;
+    }
+    if (e->enabled & (FD_WRITE | FD_CONNECT)) {
+        mask |= EPOLLOUT;
+    }
+    if (e->enabled & FD_OOB) {
+        mask |= EPOLLPRI;
+    }
+    if ((e->enabled & FD_CLOSE) && !e->closed) {
+        mask |= EPOLLRDHUP;
+    }
+    return mask;
+}
+
+static void async_rearm(int fd, const AsyncSelectEntry* e)
+{
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = async_epoll_mask(e);
+    ev.data.fd = fd;
+    epoll_ctl(g_reactor_epfd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+static AsyncMsgQueue* async_find_queue(HANDLE hWnd, int create)
+{
+    AsyncMsgQueue* q;
+
+    for (q = g_msg_queues; q != NULL; q = q->next) {
+        if (q->hWnd == hWnd) {
+            return q;
+        }
+    }
+    if (!create) {
+        return NULL;
+    }
+
+    q = (AsyncMsgQueue*)calloc(1, sizeof(AsyncMsgQueue));
+    if (q == NULL) {
+        return NULL;
+    }
+    q->hWnd = hWnd;
+    q->next = g_msg_queues;
+    g_msg_queues = q;
+    return q;
+}
+
+/* Queue a notification for the entry's window; called with the reactor lock */
+static void async_post(AsyncSelectEntry* e, int fd, long event, int err)
+{
+    AsyncMsgQueue* q;
+    AsyncQueuedMsg* ring;
+    AsyncQueuedMsg* slot;
+    unsigned int capacity;
+    unsigned int i;
+
+    q = async_find_queue(e->hWnd, 1);
+    if (q == NULL) {
+        return;
+    }
+
+    if (q->count == q->capacity) {
+        capacity = q->capacity > 0 ? q->capacity * 2 : 64;
+        ring = (AsyncQueuedMsg*)malloc(capacity * sizeof(AsyncQueuedMsg));
+        if (ring == NULL) {
+            return;
+        }
+        for (i = 0; i < q->count; i++) {
+            ring[i] = q->ring[(q->head + i) % q->capacity];
+        }
+        free(q->ring);
+        q->ring = ring;
+        q->head = 0;
+        q->capacity = capacity;
+    }
+
+    slot = &q->ring[(q->head + q->count) % q->capacity];
+    slot->msg.hWnd = e->hWnd;
+    slot->msg.message = e->wMsg;
+    slot->msg.wParam = (UINT_PTR)fd;
+    slot->msg.lParam = WSAMAKESELECTREPLY(event, errno_to_wsa_error(err));
+    slot->msg.time = async_now_ms();
+    slot->seq = ++g_msg_seq;
+    q->count++;
+
+    e->enabled &= ~event;
+    e->outstanding++;
+    pthread_cond_broadcast(&g_msg_cond);
+}
+
+/* Translate one epoll report into Winsock notifications */
+static void async_dispatch(int fd, uint32_t events)
+{
+    AsyncSelectEntry* e;
+    int err;
+    int pending;
+    struct sockaddr_storage peer;
+    socklen_t len;
+
+    e = async_entry(fd);
+    if (e == NULL || !e->in_use || e->gen != wsa_close_generation(fd)) {
+        return;
+    }
+
+    if (e->connecting) {
+        err = async_socket_error(fd);
+        len = sizeof(peer);
+        if (err != 0) {
+            /* Failed connect: FD_CONNECT carries the error, nothing else follows */
+            e->connecting = 0;
+            e->closed = 1;
+            if (e->enabled & FD_CONNECT) {
+                async_post(e, fd, FD_CONNECT, err);
+            }
+            e->enabled = 0;
+            return;
+        } else if (getpeername(fd, (struct sockaddr*)&peer, &len) == 0) {
+            e->connecting = 0;
+            if (e->enabled & FD_CONNECT) {
+                async_post(e, fd, FD_CONNECT, 0);
+            }
+        } else {
+            len = sizeof(err);
+            if (getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &err, &len) == 0 && err) {
+                e->connecting = 0;
+                e->listening = 1;
+            } else {
+                /* connect()/listen() not called yet; look again shortly */
+                if (!e->deferred &&
+                    async_push_fd(&g_deferred_list, &g_deferred_count,
+                                  &g_deferred_capacity, fd) == 0) {
+                    e->deferred = 1;
+                }
+                return;
+            }
+        }
+    }
+
+    if ((events & EPOLLOUT) && (e->enabled & FD_WRITE)) {
+        async_post(e, fd, FD_WRITE, 0);
+    }
+
+    if (events & EPOLLIN) {
+        if (e->listening) {
+            if (e->enabled & FD_ACCEPT) {
+                async_post(e, fd, FD_ACCEPT, 0);
+            }
+        } else if (e->enabled & FD_READ) {
+            pending = 1;
+            if (events & (EPOLLRDHUP | EPOLLHUP)) {
+                /* At end of stream only unread data is worth an FD_READ */
+                if (ioctl(fd, FIONREAD, &pending) < 0) {
+                    pending = 0;
+                }
+            }
+            if (pending > 0) {
+                async_post(e, fd, FD_READ, 0);
+            }
+        }
+    }
+
+    if ((events & EPOLLPRI) && (e->enabled & FD_OOB)) {
+        async_post(e, fd, FD_OOB, 0);
+    }
+
+    if ((events & (EPOLLRDHUP | EPOLLHUP)) && !e->closed) {
+        e->closed = 1;
+        if (e->enabled & FD_CLOSE) {
+            async_post(e, fd, FD_CLOSE,
+                       (events & EPOLLERR) ? async_socket_error(fd) : 0);
+        }
+    }
+
+    /*
+     * The socket stays disarmed: re-armed when its messages are taken, or
+     * never if nothing was posted, rather than spinning on HUP or ERR.
+     */
+}
+
+static void* async_reactor_thread(void* arg)
+{
+    struct epoll_event events[64];
+    AsyncSelectEntry* e;
+    DWORD last_retry;
+    int timeout;
+    int fd;
+    int n;
+    int i;
+
+    (void)arg;
+
+    last_retry = async_now_ms();
+    while (1) {
+        pthread_mutex_lock(&g_reactor_mutex);
+        timeout = g_deferred_count > 0 ? ASYNC_DEFER_MS : -1;
+        pthread_mutex_unlock(&g_reactor_mutex);
+
+        n = epoll_wait(g_reactor_epfd, events, 64, timeout);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        pthread_mutex_lock(&g_reactor_mutex);
+        for (i = 0; i < n; i++) {
+            async_dispatch(events[i].data.fd, events[i].events);
+        }
+        if (g_deferred_count > 0 && async_now_ms() - last_retry >= ASYNC_DEFER_MS) {
+            /* Give sockets waiting for connect()/listen() another look */
+            last_retry = async_now_ms();
+            for (i = 0; i < g_deferred_count; i++) {
+                fd = g_deferred_list[i];
+                e = async_entry(fd);
+                e->deferred = 0;
+                if (e->in_use && e->gen == wsa_close_generation(fd)) {
+                    async_rearm(fd, e);
+                }
+            }
+            g_deferred_count = 0;
+        }
+        pthread_mutex_unlock(&g_reactor_mutex);
+    }
+
+    return NULL;
+}
+
+/*
+ * closesocket() hook: drop s from the reactor before its descriptor goes
+ * away (a dup() would otherwise keep it registered) and free the entry
+ * for the next owner. Messages already queued are still delivered.
+ */
+static void async_select_on_close(SOCKET s)
+{
+    AsyncSelectEntry* e;
+    int fd;
+
+    fd = (int)s;
+    pthread_mutex_lock(&g_reactor_mutex);
+    e = async_entry(fd);
+    if (e != NULL && e->in_use && e->gen == wsa_close_generation(fd)) {
+        epoll_ctl(g_reactor_epfd, EPOLL_CTL_DEL, fd, NULL);
+        e->in_use = 0;
+    }
+    pthread_mutex_unlock(&g_reactor_mutex);
+}
+
+static void async_reactor_init(void)
+{
+    pthread_condattr_t attr;
+    pthread_t thread;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&g_msg_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    g_reactor_epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (g_reactor_epfd < 0) {
+        return;
+    }
+
+    if (pthread_create(&thread, NULL, async_reactor_thread, NULL) != 0) {
+        close(g_reactor_epfd);
+        g_reactor_epfd = -1;
+        return;
+    }
+    pthread_detach(thread);
+
+    wsa_add_close_hook(async_select_on_close);
+}
+
+/* Re-arm sockets whose messages the application has taken */
+static void async_process_rearms(void)
+{
+    AsyncSelectEntry* e;
+    int pending;
+    int fd;
+    int i;
+
+    for (i = 0; i < g_rearm_count; i++) {
+        fd = g_rearm_list[i];
+        e = async_entry(fd);
+        e->rearm_pending = 0;
+        if (!e->in_use || e->outstanding > 0 || e->gen != wsa_close_generation(fd)) {
+            continue;
+        }
+        e->enabled |= e->lEvent & ASYNC_DEQUEUE_EVENTS;
+        if (e->closed && (e->enabled & FD_READ)) {
+            if (ioctl(fd, FIONREAD, &pending) < 0 || pending <= 0) {
+                e->enabled &= ~FD_READ;
+            }
+        }
+        async_rearm(fd, e);
+    }
+    g_rearm_count = 0;
+}
+
+/* Pick the queue whose next message is oldest (hWnd NULL) */
+static AsyncMsgQueue* async_next_queue(HANDLE hWnd)
+{
+    AsyncMsgQueue* q;
+    AsyncMsgQueue* best;
+
+    if (hWnd != NULL) {
+        q = async_find_queue(hWnd, 0);
+        return (q != NULL && q->count > 0) ? q : NULL;
+    }
+
+    best = NULL;
+    for (q = g_msg_queues; q != NULL; q = q->next) {
+        if (q->count > 0 &&
+            (best == NULL || q->ring[q->head].seq < best->ring[best->head].seq)) {
+            best = q;
+        }
+    }
+    return best;
+}
+
+static int async_take(HANDLE hWnd, LPWSAASYNCMSG lpMsgs, int nMax, BOOL fRemove)
+{
+    AsyncMsgQueue* q;
+    AsyncSelectEntry* e;
+    int fd;
+    int n;
+
+    n = 0;
+    while (n < nMax) {
+        q = async_next_queue(hWnd);
+        if (q == NULL) {
+            break;
+        }
+        lpMsgs[n++] = q->ring[q->head].msg;
+        if (!fRemove) {
+            break;
+        }
+
+        fd = (int)q->ring[q->head].msg.wParam;
+        q->head = (q->head + 1) % q->capacity;
+        q->count--;
+
+        e = async_entry(fd);
+        if (e != NULL && e->outstanding > 0 && --e->outstanding == 0 && !e->rearm_pending &&
+            async_push_fd(&g_rearm_list, &g_rearm_count, &g_rearm_capacity, fd) == 0) {
+            e->rearm_pending = 1;
+        }
+    }
+    return n;
+}
+
+static int async_dequeue(HANDLE hWnd, LPWSAASYNCMSG lpMsgs, int nMax,
+                         DWORD dwMilliseconds, BOOL fRemove)
+{
+    struct timespec deadline;
+    int n;
+    int rc;
+
+    pthread_once(&g_reactor_once, async_reactor_init);
+
+    if (dwMilliseconds != 0 && dwMilliseconds != WSA_INFINITE) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += dwMilliseconds / 1000;
+        deadline.tv_nsec += (long)(dwMilliseconds % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    pthread_mutex_lock(&g_reactor_mutex);
+
+    /* The previous messages have been handled by now */
+    async_process_rearms();
+
+    while (1) {
+        n = async_take(hWnd, lpMsgs, nMax, fRemove);
+        if (n > 0 || dwMilliseconds == 0) {
+            break;
+        }
+        if (dwMilliseconds == WSA_INFINITE) {
+            pthread_cond_wait(&g_msg_cond, &g_reactor_mutex);
+        } else {
+            rc = pthread_cond_timedwait(&g_msg_cond, &g_reactor_mutex, &deadline);
+            if (rc == ETIMEDOUT) {
+                n = async_take(hWnd, lpMsgs, nMax, fRemove);
+                break;
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&g_reactor_mutex);
+    return n;
+}
+
 int WSAAPI WSAAsyncSelect(SOCKET s, HANDLE hWnd, unsigned int wMsg, long lEvent)
 {
-    (void)s;
-    (void)hWnd;
-    (void)wMsg;
-    (void)lEvent;
+    WSASocketRecord* rec;
+    AsyncSelectEntry* e;
+    struct epoll_event ev;
+    struct sockaddr_storage peer;
+    socklen_t len;
+    unsigned int gen;
+    int registered;
+    int type;
+    int listening;
+    int flags;
+    int fd;
+    int r;
+    WSA_STATS_SCOPE(WSAAsyncSelect);
+
+    fd = (int)s;
+    if (wsa_socket_info(s, NULL, &type, NULL) < 0) {
+        set_wsa_error_from_errno();
+        return SOCKET_ERROR;
+    }
 
-    /* WSAAsyncSelect requires Windows message queue */
-    /* Not fully supported on Linux, but we accept the call */
+    /* As for WSAEventSelect, a sharded listener cannot report FD_ACCEPT */
+    if (lEvent != 0 && (hWnd == NULL || wsa_listener_sharded(s))) {
+        g_wsa_last_error = WSAEINVAL;
+        return SOCKET_ERROR;
+    }
+
+    pthread_once(&g_reactor_once, async_reactor_init);
+    if (g_reactor_epfd < 0) {
+        g_wsa_last_error = WSAENETDOWN;
+        return SOCKET_ERROR;
+    }
+
+    listening = 0;
+    len = sizeof(listening);
+    getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &len);
+    gen = wsa_close_generation(fd);
+
+    rec = wsa_socket_record(s);
+    if (rec == NULL) {
+        g_wsa_last_error = WSAENOTSOCK;
+        return SOCKET_ERROR;
+    }
+
+    pthread_mutex_lock(&g_reactor_mutex);
+
+    /* Entries stay with the record for its next owner; gen tells them apart */
+    e = (AsyncSelectEntry*)rec->async_select;
+    if (e == NULL) {
+        e = (AsyncSelectEntry*)calloc(1, sizeof(AsyncSelectEntry));
+        if (e == NULL) {
+            pthread_mutex_unlock(&g_reactor_mutex);
+            g_wsa_last_error = WSAENOBUFS;
+            return SOCKET_ERROR;
+        }
+        rec->async_select = e;
+    }
+    registered = e->in_use && e->gen == gen;
+
+    /* lEvent 0 cancels; messages already queued are still delivered */
+    if (lEvent == 0) {
+        if (registered) {
+            epoll_ctl(g_reactor_epfd, EPOLL_CTL_DEL, fd, NULL);
+        }
+        e->in_use = 0;
+        pthread_mutex_unlock(&g_reactor_mutex);
+        g_wsa_last_error = 0;
+        return 0;
+    }
+
+    e->hWnd = hWnd;
+    e->wMsg = wMsg;
+    e->lEvent = lEvent & ASYNC_SELECT_EVENTS;
+    e->enabled = e->lEvent;
+    e->gen = gen;
+    e->outstanding = 0;
+    e->in_use = 1;
+    e->listening = (unsigned char)(listening != 0);
+    e->closed = 0;
+    len = sizeof(peer);
+    e->connecting = (unsigned char)(type == SOCK_STREAM && !listening &&
+                                    getpeername(fd, (struct sockaddr*)&peer, &len) < 0);
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = async_epoll_mask(e);
+    ev.data.fd = fd;
+    r = epoll_ctl(g_reactor_epfd, registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev);
+    if (r < 0 && errno == EEXIST) {
+        r = epoll_ctl(g_reactor_epfd, EPOLL_CTL_MOD, fd, &ev);
+    } else if (r < 0 && errno == ENOENT) {
+        r = epoll_ctl(g_reactor_epfd, EPOLL_CTL_ADD, fd, &ev);
+    }
+    if (r < 0) {
+        set_wsa_error_from_errno();
+        e->in_use = 0;
+        pthread_mutex_unlock(&g_reactor_mutex);
+        return SOCKET_ERROR;
+    }
+
+    __atomic_store_n(&g_async_select_used, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&g_reactor_mutex);
+
+    /* WSAAsyncSelect makes the socket non-blocking, as on Windows */
+    flags = fcntl(fd, F_GETFL, 0);
+    if (flags >= 0) {
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    }
 
     g_wsa_last_error = 0;
     return 0;
 }
 
+/*
+ * Re-enable notifications after the call that does so on Windows, e.g.
+ * FD_WRITE after a send that failed with WSAEWOULDBLOCK. Also re-arms a
+ * socket waiting for connect() to be called.
+ */
+void wsa_async_reenable(SOCKET s, long lEvent)
+{
+    AsyncSelectEntry* e;
+    int fd;
+
+    if (!__atomic_load_n(&g_async_select_used, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    fd = (int)s;
+    pthread_mutex_lock(&g_reactor_mutex);
+    e = async_entry(fd);
+    if (e != NULL && e->in_use && e->gen == wsa_close_generation(fd)) {
+        e->enabled |= e->lEvent & lEvent;
+        if (e->outstanding == 0) {
+            async_rearm(fd, e);
+        }
+    }
+    pthread_mutex_unlock(&g_reactor_mutex);
+}
+
+BOOL WSAAPI WSAGetAsyncMessage(LPWSAASYNCMSG lpMsg, HANDLE hWnd,
+                               DWORD dwMilliseconds)
+{
+    if (lpMsg == NULL) {
+        g_wsa_last_error = WSAEFAULT;
+        return FALSE;
+    }
+
+    if (async_dequeue(hWnd, lpMsg, 1, dwMilliseconds, TRUE) == 0) {
+        g_wsa_last_error = WSAETIMEDOUT;
+        return FALSE;
+    }
+
+    g_wsa_last_error = 0;
+    return TRUE;
+}
+
+BOOL WSAAPI WSAPeekAsyncMessage(LPWSAASYNCMSG lpMsg, HANDLE hWnd, BOOL fRemove)
+{
+    if (lpMsg == NULL) {
+        g_wsa_last_error = WSAEFAULT;
+        return FALSE;
+    }
+
+    g_wsa_last_error = 0;
+    return async_dequeue(hWnd, lpMsg, 1, 0, fRemove) > 0;
+}
+
+int WSAAPI WSAGetAsyncMessages(HANDLE hWnd, LPWSAASYNCMSG lpMsgs,
+                               int nMaxMessages, DWORD dwMilliseconds)
+{
+    int n;
+
+    if (lpMsgs == NULL || nMaxMessages <= 0) {
+        g_wsa_last_error = WSAEINVAL;
+        return SOCKET_ERROR;
+    }
+
+    n = async_dequeue(hWnd, lpMsgs, nMaxMessages, dwMilliseconds, TRUE);
+
+    g_wsa_last_error = 0;
+    return n;
+}
+
 /* ============================================================================
  * Async Name Resolution Functions
  * ============================================================================ */
 
+/* Unlink a finished request, unless WSACancelAsyncRequest already did, and free it */
+static void async_request_done(AsyncRequest* req)
+{
+    AsyncRequest** link;
+
+    pthread_mutex_lock(&g_async_mutex);
+    for (link = &g_async_requests; *link != NULL; link = &(*link)->next) {
+        if (*link == req) {
+            *link = req->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_async_mutex);
+
+    wsa_pool_free(&g_async_request_pool, req);
+}
+
 /* Thread function for async gethostbyname */
 static void* async_gethostbyname_thread(void* arg)
 {
@@ -469,16 +1264,20 @@ static void* async_gethostbyname_thread(void* arg)
     req = (AsyncRequest*)arg;
 
     if (req->cancelled) {
+        async_request_done(req);
         return NULL;
     }
 
+    WSA_PROBE2(dns__start, req, req->name);
     result = gethostbyname(req->name);
+    WSA_PROBE2(dns__done, req, result != NULL ? 0 : WSABASEERR + 1000 + h_errno);
 
     if (!req->cancelled && result != NULL) {
         /* Copy result to buffer */
         memcpy(req->buffer, result, sizeof(struct hostent));
     }
 
+    async_request_done(req);
     return NULL;
 }
 
@@ -487,8 +1286,17 @@ HANDLE WSAAPI WSAAsyncGetHostByName(HANDLE hWnd, unsigned int wMsg,
 {
     AsyncRequest* req;
     HANDLE handle;
+    pthread_t thread;
+    size_t name_len;
 
-    req = (AsyncRequest*)malloc(sizeof(AsyncRequest));
+    /* No DNS name is longer than 255 characters */
+    name_len = name != NULL ? strlen(name) : 0;
+    if (name == NULL || name_len >= sizeof(req->name)) {
+        g_wsa_last_error = WSAEINVAL;
+        return NULL;
+    }
+
+    req = (AsyncRequest*)wsa_pool_alloc(&g_async_request_pool);
     if (req == NULL) {
         g_wsa_last_error = WSA_NOT_ENOUGH_MEMORY;
         return NULL;
@@ -499,26 +1307,26 @@ HANDLE WSAAPI WSAAsyncGetHostByName(HANDLE hWnd, unsigned int wMsg,
     req->buffer = buf;
     req->buflen = buflen;
     req->type = 0;
-    req->name = strdup(name);
+    memcpy(req->name, name, name_len + 1);
     req->cancelled = 0;
 
     pthread_mutex_lock(&g_async_mutex);
     handle = (HANDLE)(intptr_t)g_async_handle_counter++;
+    req->handle = handle;
     req->next = g_async_requests;
     g_async_requests = req;
     pthread_mutex_unlock(&g_async_mutex);
 
-    if (pthread_create(&req->thread, NULL, async_gethostbyname_thread, req) != 0) {
+    if (pthread_create(&thread, NULL, async_gethostbyname_thread, req) != 0) {
         pthread_mutex_lock(&g_async_mutex);
         g_async_requests = req->next;
         pthread_mutex_unlock(&g_async_mutex);
-        free(req->name);
-        free(req);
+        wsa_pool_free(&g_async_request_pool, req);
         g_wsa_last_error = WSAENETDOWN;
         return NULL;
     }
 
-    pthread_detach(req->thread);
+    pthread_detach(thread);
 
     g_wsa_last_error = 0;
     return handle;
@@ -533,15 +1341,19 @@ static void* async_gethostbyaddr_thread(void* arg)
     req = (AsyncRequest*)arg;
 
     if (req->cancelled) {
+        async_request_done(req);
         return NULL;
     }
 
+    WSA_PROBE2(dns__start, req, req->addr);
     result = gethostbyaddr(req->addr, req->len, req->addr_type);
+    WSA_PROBE2(dns__done, req, result != NULL ? 0 : WSABASEERR + 1000 + h_errno);
 
     if (!req->cancelled && result != NULL) {
         memcpy(req->buffer, result, sizeof(struct hostent));
     }
 
+    async_request_done(req);
     return NULL;
 }
 
@@ -551,8 +1363,14 @@ HANDLE WSAAPI WSAAsyncGetHostByAddr(HANDLE hWnd, unsigned int wMsg,
 {
     AsyncRequest* req;
     HANDLE handle;
+    pthread_t thread;
+
+    if (addr == NULL || len <= 0 || len > (int)sizeof(req->addr)) {
+        g_wsa_last_error = WSAEFAULT;
+        return NULL;
+    }
 
-    req = (AsyncRequest*)malloc(sizeof(AsyncRequest));
+    req = (AsyncRequest*)wsa_pool_alloc(&g_async_request_pool);
     if (req == NULL) {
         g_wsa_last_error = WSA_NOT_ENOUGH_MEMORY;
         return NULL;
@@ -563,29 +1381,28 @@ HANDLE WSAAPI WSAAsyncGetHostByAddr(HANDLE hWnd, unsigned int wMsg,
     req->buffer = buf;
     req->buflen = buflen;
     req->type = 1;
-    req->addr = (char*)malloc(len);
-    memcpy(req->addr, addr, len);
+    memcpy(req->addr, addr, (size_t)len);
     req->len = len;
     req->addr_type = type;
     req->cancelled = 0;
 
     pthread_mutex_lock(&g_async_mutex);
     handle = (HANDLE)(intptr_t)g_async_handle_counter++;
+    req->handle = handle;
     req->next = g_async_requests;
     g_async_requests = req;
     pthread_mutex_unlock(&g_async_mutex);
 
-    if (pthread_create(&req->thread, NULL, async_gethostbyaddr_thread, req) != 0) {
+    if (pthread_create(&thread, NULL, async_gethostbyaddr_thread, req) != 0) {
         pthread_mutex_lock(&g_async_mutex);
         g_async_requests = req->next;
         pthread_mutex_unlock(&g_async_mutex);
-        free(req->addr);
-        free(req);
+        wsa_pool_free(&g_async_request_pool, req);
         g_wsa_last_error = WSAENETDOWN;
         return NULL;
     }
 
-    pthread_detach(req->thread);
+    pthread_detach(thread);
 
     g_wsa_last_error = 0;
     return handle;
@@ -606,7 +1423,7 @@ int WSAAPI WSACancelAsyncRequest(HANDLE hAsyncTaskHandle)
     req = g_async_requests;
 
     while (req != NULL) {
-        if ((HANDLE)(intptr_t)req == hAsyncTaskHandle) {
+        if (req->handle == hAsyncTaskHandle) {
             req->cancelled = 1;
             if (prev != NULL) {
                 prev->next = req->next;
@@ -632,4 +1449,70 @@ int WSAAPI WSACancelAsyncRequest(HANDLE hAsyncTaskHandle)
 #define WSA_WAIT_TIMEOUT         0x00000102
 #define FD_CONNECT_BIT           4
 
+/*
+ * Report an event raised outside the socket itself, such as an address
+ * list change, to whichever of WSAEventSelect and WSAAsyncSelect asked
+ * for it on s. err is an errno value, 0 for success.
+ */
+void wsa_notify_network_event(SOCKET s, long lEvent, int err)
+{
+    SocketEventMap* map;
+    AsyncSelectEntry* e;
+    int bit;
+    int fd;
+
+    pthread_mutex_lock(&g_map_mutex);
+    map = event_map_find(s);
+    if (map != NULL && (map->network_events & lEvent)) {
+        map->pending_events |= lEvent;
+        for (bit = 0; bit < FD_MAX_EVENTS; bit++) {
+            if (lEvent & (1L << bit)) {
+                map->pending_errors[bit] = errno_to_wsa_error(err);
+            }
+        }
+        if (map->event != NULL) {
+            WSA_PROBE2(eventselect__deliver, s, lEvent);
+            WSASetEvent_internal(map->event);
+        }
+    }
+    pthread_mutex_unlock(&g_map_mutex);
+
+    if (!__atomic_load_n(&g_async_select_used, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    fd = (int)s;
+    pthread_mutex_lock(&g_reactor_mutex);
+    e = async_entry(fd);
+    if (e != NULL && e->in_use && e->gen == wsa_close_generation(fd) && (e->lEvent & lEvent)) {
+        async_post(e, fd, lEvent, err);
+    }
+    pthread_mutex_unlock(&g_reactor_mutex);
+}
+
+/* Masks of the live WSAEventSelect / WSAAsyncSelect registrations, for SIO_SOCKET_STATS */
+void wsa_select_masks(SOCKET s, long* event_select, long* async_select)
+{
+    SocketEventMap* map;
+    AsyncSelectEntry* e;
+    int fd;
+
+    pthread_mutex_lock(&g_map_mutex);
+    map = event_map_find(s);
+    *event_select = map != NULL ? map->network_events : 0;
+    pthread_mutex_unlock(&g_map_mutex);
+
+    *async_select = 0;
+    if (!__atomic_load_n(&g_async_select_used, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    fd = (int)s;
+    pthread_mutex_lock(&g_reactor_mutex);
+    e = async_entry(fd);
+    if (e != NULL && e->in_use && e->gen == wsa_close_generation(fd)) {
+        *async_select = e->lEvent;
+    }
+    pthread_mutex_unlock(&g_reactor_mutex);
+}
+
 #endif /* __linux__ */
@@ -6,13 +6,12 @@
 #ifdef __linux__
 
 #include "winsock2_api.h"
+#include "wsa_internal.h"
+#include "mstcpip.h"
 #include <pthread.h>
 #include <sys/uio.h>
-
-extern __thread int g_wsa_last_error;
-
-static void set_wsa_error_from_errno(void);
-static int errno_to_wsa_error(int err);
+#include <time.h>
+#include <limits.h>
 
 /* ============================================================================
  * WSASocket Functions
@@ -25,6 +24,8 @@ SOCKET WSAAPI WSASocketA(int af, int type, int protocol,
     SOCKET s;
     int sock_type;
     int sock_flags;
+    long long record_start;
+    WSA_STATS_SCOPE(WSASocketA);
 
     (void)lpProtocolInfo; /* Unused on Linux */
     (void)g; /* Unused on Linux */
@@ -44,7 +45,9 @@ SOCKET WSAAPI WSASocketA(int af, int type, int protocol,
     }
 #endif
 
+    record_start = WSA_RECORD_START();
     s = (SOCKET)socket(af, sock_type | sock_flags, protocol);
+    WSA_RECORD(WSASocketA, s, type, s, record_start);
 
     if (s < 0) {
         set_wsa_error_from_errno();
@@ -54,43 +57,250 @@ SOCKET WSAAPI WSASocketA(int af, int type, int protocol,
     g_wsa_last_error = 0;
     return s;
 }
+WSA_HIDDEN_DEF(WSASocketA);
 
 SOCKET WSAAPI WSASocketW(int af, int type, int protocol,
                          LPWSAPROTOCOL_INFOW lpProtocolInfo,
                          unsigned int g, DWORD dwFlags)
 {
     /* Same as WSASocketA for Linux implementation */
-    return WSASocketA(af, type, protocol, (LPWSAPROTOCOL_INFOA)lpProtocolInfo, g, dwFlags);
+    return WSASocketA_internal(af, type, protocol, (LPWSAPROTOCOL_INFOA)lpProtocolInfo, g, dwFlags);
 }
 
 /* ============================================================================
  * WSAAccept
  * ============================================================================ */
 
+/*
+ * Connections a condition function deferred with CF_DEFER. Linux has
+ * already completed the handshake, so the connection is held here and
+ * offered again by the next WSAAccept on the same listener.
+ */
+typedef struct DeferredAccept {
+    SOCKET listener;
+    SOCKET s;
+    struct sockaddr_storage peer;
+    socklen_t peer_len;
+    struct DeferredAccept* next;
+} DeferredAccept;
+
+static DeferredAccept* g_deferred_accepts = NULL;
+static int g_deferred_count = 0;
+static pthread_mutex_t g_deferred_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t g_deferred_once = PTHREAD_ONCE_INIT;
+static WSAPool g_deferred_pool = WSA_POOL_INITIALIZER("DeferredAccept", sizeof(DeferredAccept));
+
+/* Reset rather than close gracefully, as Windows does for CF_REJECT */
+static void reject_connection(SOCKET s)
+{
+    struct linger lg;
+
+    lg.l_onoff = 1;
+    lg.l_linger = 0;
+    setsockopt((int)s, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+    close((int)s);
+}
+
+/* closesocket() hook: reset connections still deferred on the listener */
+static void deferred_on_close(SOCKET listener)
+{
+    DeferredAccept** link;
+    DeferredAccept* entry;
+
+    if (__atomic_load_n(&g_deferred_count, __ATOMIC_ACQUIRE) == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&g_deferred_mutex);
+    link = &g_deferred_accepts;
+    while (*link != NULL) {
+        entry = *link;
+        if (entry->listener == listener) {
+            *link = entry->next;
+            reject_connection(entry->s);
+            wsa_pool_free(&g_deferred_pool, entry);
+            __atomic_sub_fetch(&g_deferred_count, 1, __ATOMIC_RELEASE);
+        } else {
+            link = &entry->next;
+        }
+    }
+    pthread_mutex_unlock(&g_deferred_mutex);
+}
+
+static void deferred_init(void)
+{
+    wsa_add_close_hook(deferred_on_close);
+}
+
+/* Queue at the tail so deferred connections are offered in arrival order */
+static int defer_connection(SOCKET listener, SOCKET s,
+                            const struct sockaddr_storage* peer, socklen_t peer_len)
+{
+    DeferredAccept** link;
+    DeferredAccept* entry;
+
+    pthread_once(&g_deferred_once, deferred_init);
+
+    entry = (DeferredAccept*)wsa_pool_calloc(&g_deferred_pool);
+    if (entry == NULL) {
+        return -1;
+    }
+    entry->listener = listener;
+    entry->s = s;
+    entry->peer = *peer;
+    entry->peer_len = peer_len;
+
+    pthread_mutex_lock(&g_deferred_mutex);
+    link = &g_deferred_accepts;
+    while (*link != NULL) {
+        link = &(*link)->next;
+    }
+    *link = entry;
+    __atomic_add_fetch(&g_deferred_count, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&g_deferred_mutex);
+    return 0;
+}
+
+static SOCKET take_deferred_connection(SOCKET listener, struct sockaddr_storage* peer,
+                                       socklen_t* peer_len)
+{
+    DeferredAccept** link;
+    DeferredAccept* entry;
+    SOCKET s;
+
+    if (__atomic_load_n(&g_deferred_count, __ATOMIC_ACQUIRE) == 0) {
+        return INVALID_SOCKET;
+    }
+
+    s = INVALID_SOCKET;
+    pthread_mutex_lock(&g_deferred_mutex);
+    for (link = &g_deferred_accepts; *link != NULL; link = &(*link)->next) {
+        entry = *link;
+        if (entry->listener == listener) {
+            *link = entry->next;
+            s = entry->s;
+            *peer = entry->peer;
+            *peer_len = entry->peer_len;
+            wsa_pool_free(&g_deferred_pool, entry);
+            __atomic_sub_fetch(&g_deferred_count, 1, __ATOMIC_RELEASE);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_deferred_mutex);
+    return s;
+}
+
 SOCKET WSAAPI WSAAccept(SOCKET s, struct sockaddr* addr, int* addrlen,
-                        void* lpfnCondition, DWORD_PTR dwCallbackData)
+                        LPCONDITIONPROC lpfnCondition, DWORD_PTR dwCallbackData)
 {
+    struct sockaddr_storage peer;
+    struct sockaddr_storage local;
+    socklen_t peer_len;
+    socklen_t local_len;
+    WSASocketRecord* rec;
+    WSABUF caller_id;
+    WSABUF callee_id;
+    GROUP g;
     SOCKET new_sock;
     socklen_t len;
+    int verdict;
+    long long record_start;
+    WSA_STATS_SCOPE(WSAAccept);
+
+    if (lpfnCondition == NULL) {
+        if (addrlen != NULL) {
+            len = (socklen_t)*addrlen;
+        } else {
+            len = 0;
+        }
 
-    (void)lpfnCondition; /* Condition function not supported */
-    (void)dwCallbackData;
+        record_start = WSA_RECORD_START();
+        new_sock = (SOCKET)wsa_listener_accept(s, addr, addrlen != NULL ? &len : NULL);
+        WSA_RECORD(WSAAccept, s, 0, new_sock, record_start);
 
-    if (addrlen != NULL) {
-        len = (socklen_t)*addrlen;
-    } else {
-        len = 0;
+        if (new_sock < 0) {
+            set_wsa_error_from_errno();
+            return INVALID_SOCKET;
+        }
+
+        if (addrlen != NULL) {
+            *addrlen = (int)len;
+        }
+
+        g_wsa_last_error = 0;
+        return new_sock;
     }
 
-    new_sock = (SOCKET)accept((int)s, addr, addrlen != NULL ? &len : NULL);
+    new_sock = take_deferred_connection(s, &peer, &peer_len);
+    if (new_sock == INVALID_SOCKET) {
+        peer_len = sizeof(peer);
+        record_start = WSA_RECORD_START();
+        new_sock = (SOCKET)wsa_listener_accept(s, (struct sockaddr*)&peer, &peer_len);
+        WSA_RECORD(WSAAccept, s, 0, new_sock, record_start);
+        if (new_sock < 0) {
+            set_wsa_error_from_errno();
+            return INVALID_SOCKET;
+        }
+    }
 
-    if (new_sock < 0) {
-        set_wsa_error_from_errno();
+    /* No room for the peer address: keep the connection for the next call */
+    if (addr != NULL && addrlen != NULL && (*addrlen < 0 || (socklen_t)*addrlen < peer_len)) {
+        if (defer_connection(s, new_sock, &peer, peer_len) < 0) {
+            reject_connection(new_sock);
+        }
+        g_wsa_last_error = WSAEFAULT;
         return INVALID_SOCKET;
     }
 
-    if (addrlen != NULL) {
-        *addrlen = (int)len;
+    local_len = sizeof(local);
+    if (getsockname((int)new_sock, (struct sockaddr*)&local, &local_len) < 0) {
+        local_len = 0;
+    }
+    caller_id.buf = (char*)&peer;
+    caller_id.len = peer_len;
+    callee_id.buf = (char*)&local;
+    callee_id.len = local_len;
+    g = 0;
+
+    /* TCP carries no connect data or QOS, so those are NULL as on Windows */
+    verdict = lpfnCondition(&caller_id, NULL, NULL, NULL,
+                            &callee_id, NULL, &g, dwCallbackData);
+
+    switch (verdict) {
+        case CF_ACCEPT:
+            break;
+
+        case CF_DEFER:
+            /* Only a listener with SO_CONDITIONAL_ACCEPT may defer, as on Windows */
+            rec = wsa_socket_lookup(s);
+            if (rec == NULL ||
+                !(__atomic_load_n(&rec->opt_flags, __ATOMIC_ACQUIRE) & WSA_OPT_CONDITIONAL_ACCEPT)) {
+                reject_connection(new_sock);
+                g_wsa_last_error = WSAEINVAL;
+                return INVALID_SOCKET;
+            }
+            if (defer_connection(s, new_sock, &peer, peer_len) < 0) {
+                reject_connection(new_sock);
+                g_wsa_last_error = WSAENOBUFS;
+                return INVALID_SOCKET;
+            }
+            g_wsa_last_error = WSATRY_AGAIN;
+            return INVALID_SOCKET;
+
+        case CF_REJECT:
+            reject_connection(new_sock);
+            g_wsa_last_error = WSAECONNREFUSED;
+            return INVALID_SOCKET;
+
+        default:
+            reject_connection(new_sock);
+            g_wsa_last_error = WSAEINVAL;
+            return INVALID_SOCKET;
+    }
+
+    if (addr != NULL && addrlen != NULL) {
+        memcpy(addr, &peer, peer_len);
+        *addrlen = (int)peer_len;
     }
 
     g_wsa_last_error = 0;
@@ -106,13 +316,20 @@ int WSAAPI WSAConnect(SOCKET s, const struct sockaddr* name, int namelen,
                       LPQOS lpSQOS, LPQOS lpGQOS)
 {
     int result;
+    long long record_start;
+    WSA_STATS_SCOPE(WSAConnect);
 
     (void)lpCallerData; /* Not supported on Linux */
     (void)lpCalleeData;
     (void)lpSQOS;
     (void)lpGQOS;
 
+    record_start = WSA_RECORD_START();
     result = connect((int)s, name, (socklen_t)namelen);
+    WSA_RECORD(WSAConnect, s, 0, result, record_start);
+
+    /* A WSAAsyncSelect registration made before connect() can arm now */
+    wsa_async_reenable(s, 0);
 
     if (result < 0) {
         set_wsa_error_from_errno();
@@ -123,6 +340,524 @@ int WSAAPI WSAConnect(SOCKET s, const struct sockaddr* name, int namelen,
     return 0;
 }
 
+/* ============================================================================
+ * WSAConnectByName / WSAConnectByList (Happy Eyeballs, RFC 8305)
+ *
+ * Candidates are interleaved by address family and started one after
+ * another on private non-blocking sockets, a new attempt every
+ * HE_ATTEMPT_DELAY_MS or as soon as the previous one fails. The first
+ * socket to connect is dup'ed onto the caller's descriptor and every
+ * other attempt is closed, which aborts its handshake.
+ * ============================================================================ */
+
+#define HE_ATTEMPT_DELAY_MS 250
+#define HE_MAX_CANDIDATES   64
+
+typedef struct HeCandidate {
+    struct sockaddr_storage addr;
+    socklen_t addrlen;
+} HeCandidate;
+
+/* Socket options carried over from the caller's socket to each attempt */
+static const struct {
+    int level;
+    int name;
+    socklen_t len;
+} g_he_inherited_opts[] = {
+    { SOL_SOCKET,  SO_RCVBUF,    sizeof(int) },
+    { SOL_SOCKET,  SO_SNDBUF,    sizeof(int) },
+    { SOL_SOCKET,  SO_KEEPALIVE, sizeof(int) },
+    { SOL_SOCKET,  SO_LINGER,    sizeof(struct linger) },
+    { IPPROTO_TCP, TCP_NODELAY,  sizeof(int) }
+};
+
+static long long he_now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Append addr to the candidate list in the form the caller's socket can
+ * use: IPv4 destinations become v4-mapped on an AF_INET6 socket, IPv6
+ * destinations are dropped for an AF_INET socket.
+ */
+static int he_add_candidate(HeCandidate* list, int count, int sock_family,
+                            const struct sockaddr* addr, socklen_t addrlen)
+{
+    HeCandidate* c;
+    struct sockaddr_in6* sin6;
+    const struct sockaddr_in* sin;
+
+    if (count >= HE_MAX_CANDIDATES || addr == NULL) {
+        return count;
+    }
+
+    c = &list[count];
+    memset(c, 0, sizeof(*c));
+
+    if (addr->sa_family == AF_INET && addrlen >= (socklen_t)sizeof(struct sockaddr_in)) {
+        sin = (const struct sockaddr_in*)addr;
+        if (sock_family == AF_INET) {
+            memcpy(&c->addr, sin, sizeof(*sin));
+            c->addrlen = sizeof(*sin);
+        } else {
+            sin6 = (struct sockaddr_in6*)&c->addr;
+            sin6->sin6_family = AF_INET6;
+            sin6->sin6_port = sin->sin_port;
+            sin6->sin6_addr.s6_addr[10] = 0xff;
+            sin6->sin6_addr.s6_addr[11] = 0xff;
+            memcpy(&sin6->sin6_addr.s6_addr[12], &sin->sin_addr, 4);
+            c->addrlen = sizeof(*sin6);
+        }
+        return count + 1;
+    }
+
+    if (addr->sa_family == AF_INET6 && sock_family == AF_INET6 &&
+        addrlen >= (socklen_t)sizeof(struct sockaddr_in6)) {
+        memcpy(&c->addr, addr, sizeof(struct sockaddr_in6));
+        c->addrlen = sizeof(struct sockaddr_in6);
+        return count + 1;
+    }
+
+    return count;
+}
+
+static int he_is_v4(const HeCandidate* c)
+{
+    const struct sockaddr_in6* sin6;
+
+    if (c->addr.ss_family == AF_INET) {
+        return 1;
+    }
+    sin6 = (const struct sockaddr_in6*)&c->addr;
+    return IN6_IS_ADDR_V4MAPPED(&sin6->sin6_addr);
+}
+
+/*
+ * Reorder candidates so families alternate, starting with the family of
+ * the first (most preferred) entry; order within a family is preserved.
+ */
+static void he_interleave(HeCandidate* list, int count)
+{
+    HeCandidate sorted[HE_MAX_CANDIDATES];
+    int first_v4;
+    int i, a, b, n;
+
+    if (count < 3) {
+        return;
+    }
+
+    first_v4 = he_is_v4(&list[0]);
+    a = 0;
+    b = 0;
+    n = 0;
+    while (n < count) {
+        while (a < count && he_is_v4(&list[a]) != first_v4) {
+            a++;
+        }
+        if (a < count) {
+            sorted[n++] = list[a++];
+        }
+        while (b < count && he_is_v4(&list[b]) == first_v4) {
+            b++;
+        }
+        if (b < count) {
+            sorted[n++] = list[b++];
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        list[i] = sorted[i];
+    }
+}
+
+/* Start a non-blocking connect; returns the fd or -1 with errno set */
+static int he_start_attempt(SOCKET s, int sock_family, const HeCandidate* c,
+                            int* connected)
+{
+    int fd;
+    int off;
+    unsigned char optval[sizeof(struct linger) > sizeof(int) ?
+                         sizeof(struct linger) : sizeof(int)];
+    socklen_t optlen;
+    size_t i;
+
+    fd = socket(sock_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+    if (fd < 0) {
+        return -1;
+    }
+
+    if (sock_family == AF_INET6) {
+        off = 0;
+        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+    }
+
+    for (i = 0; i < sizeof(g_he_inherited_opts) / sizeof(g_he_inherited_opts[0]); i++) {
+        optlen = g_he_inherited_opts[i].len;
+        if (getsockopt((int)s, g_he_inherited_opts[i].level,
+                       g_he_inherited_opts[i].name, optval, &optlen) == 0) {
+            setsockopt(fd, g_he_inherited_opts[i].level,
+                       g_he_inherited_opts[i].name, optval, optlen);
+        }
+    }
+
+    *connected = 0;
+    if (connect(fd, (const struct sockaddr*)&c->addr, c->addrlen) == 0) {
+        *connected = 1;
+    } else if (errno != EINPROGRESS) {
+        off = errno;
+        close(fd);
+        errno = off;
+        return -1;
+    }
+
+    return fd;
+}
+
+/*
+ * Race the candidates. On success the winning connection has replaced
+ * the caller's descriptor and its index is returned; on failure -1 is
+ * returned with g_wsa_last_error set.
+ */
+static int he_race(SOCKET s, int sock_family, HeCandidate* list, int count,
+                   const struct timeval* timeout)
+{
+    struct pollfd pfds[HE_MAX_CANDIDATES];
+    int owner[HE_MAX_CANDIDATES];
+    long long deadline;
+    long long next_start;
+    long long now;
+    int active;
+    int next;
+    int winner;
+    int last_error;
+    int connected;
+    int wait_ms;
+    int fd;
+    int err;
+    int i, j;
+    int ready;
+    int fl_orig;
+    int fd_flags;
+    socklen_t len;
+
+    fl_orig = fcntl((int)s, F_GETFL);
+    fd_flags = fcntl((int)s, F_GETFD);
+
+    deadline = -1;
+    if (timeout != NULL) {
+        deadline = he_now_ms() + (long long)timeout->tv_sec * 1000 +
+                   timeout->tv_usec / 1000;
+    }
+
+    active = 0;
+    next = 0;
+    winner = -1;
+    last_error = WSAEHOSTUNREACH;
+    next_start = he_now_ms();
+
+    while (winner < 0 && (active > 0 || next < count)) {
+        now = he_now_ms();
+        if (deadline >= 0 && now >= deadline) {
+            last_error = WSAETIMEDOUT;
+            break;
+        }
+
+        /* Start the next attempt when its turn has come */
+        if (next < count && (active == 0 || now >= next_start)) {
+            fd = he_start_attempt(s, sock_family, &list[next], &connected);
+            if (fd < 0) {
+                last_error = errno_to_wsa_error(errno);
+                next++;
+                continue;
+            }
+            pfds[active].fd = fd;
+            pfds[active].events = POLLOUT;
+            pfds[active].revents = 0;
+            owner[active] = next;
+            active++;
+            next++;
+            next_start = now + HE_ATTEMPT_DELAY_MS;
+            if (connected) {
+                winner = active - 1;
+                break;
+            }
+        }
+
+        wait_ms = -1;
+        if (next < count) {
+            wait_ms = (int)(next_start - now);
+        }
+        if (deadline >= 0 && (wait_ms < 0 || deadline - now < wait_ms)) {
+            wait_ms = (int)(deadline - now);
+        }
+        if (wait_ms < 0 && next < count) {
+            wait_ms = 0;
+        }
+
+        ready = poll(pfds, (nfds_t)active, wait_ms);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            last_error = errno_to_wsa_error(errno);
+            break;
+        }
+
+        for (i = 0; i < active && ready > 0; i++) {
+            if (pfds[i].revents == 0) {
+                continue;
+            }
+            ready--;
+            err = 0;
+            len = sizeof(err);
+            getsockopt(pfds[i].fd, SOL_SOCKET, SO_ERROR, &err, &len);
+            if (err == 0 && !(pfds[i].revents & (POLLERR | POLLHUP))) {
+                winner = i;
+                break;
+            }
+
+            /* Failed attempt: drop it and let the next one start now */
+            last_error = errno_to_wsa_error(err != 0 ? err : ECONNREFUSED);
+            close(pfds[i].fd);
+            for (j = i; j < active - 1; j++) {
+                pfds[j] = pfds[j + 1];
+                owner[j] = owner[j + 1];
+            }
+            active--;
+            i--;
+            next_start = now;
+        }
+    }
+
+    /* Install the winner on the caller's socket and abort the rest */
+    if (winner >= 0) {
+        if (dup3(pfds[winner].fd, (int)s,
+                 (fd_flags >= 0 && (fd_flags & FD_CLOEXEC)) ? O_CLOEXEC : 0) < 0) {
+            last_error = errno_to_wsa_error(errno);
+            winner = -1;
+        } else if (fl_orig >= 0 && !(fl_orig & O_NONBLOCK)) {
+            fcntl((int)s, F_SETFL, fcntl((int)s, F_GETFL) & ~O_NONBLOCK);
+        }
+        if (winner >= 0) {
+            winner = owner[winner];
+        }
+    }
+
+    for (i = 0; i < active; i++) {
+        close(pfds[i].fd);
+    }
+
+    if (winner < 0) {
+        g_wsa_last_error = last_error;
+    }
+    return winner;
+}
+
+/* Report local/remote addresses of a freshly connected socket */
+static BOOL he_finish(SOCKET s, LPDWORD LocalAddressLength, LPSOCKADDR LocalAddress,
+                      LPDWORD RemoteAddressLength, LPSOCKADDR RemoteAddress)
+{
+    struct sockaddr_storage ss;
+    socklen_t len;
+
+    if (LocalAddressLength != NULL && LocalAddress != NULL) {
+        len = sizeof(ss);
+        if (getsockname((int)s, (struct sockaddr*)&ss, &len) < 0) {
+            set_wsa_error_from_errno();
+            return FALSE;
+        }
+        if (*LocalAddressLength < (DWORD)len) {
+            *LocalAddressLength = (DWORD)len;
+            g_wsa_last_error = WSAEFAULT;
+            return FALSE;
+        }
+        memcpy(LocalAddress, &ss, len);
+        *LocalAddressLength = (DWORD)len;
+    }
+
+    if (RemoteAddressLength != NULL && RemoteAddress != NULL) {
+        len = sizeof(ss);
+        if (getpeername((int)s, (struct sockaddr*)&ss, &len) < 0) {
+            set_wsa_error_from_errno();
+            return FALSE;
+        }
+        if (*RemoteAddressLength < (DWORD)len) {
+            *RemoteAddressLength = (DWORD)len;
+            g_wsa_last_error = WSAEFAULT;
+            return FALSE;
+        }
+        memcpy(RemoteAddress, &ss, len);
+        *RemoteAddressLength = (DWORD)len;
+    }
+
+    g_wsa_last_error = 0;
+    return TRUE;
+}
+
+static int he_socket_family(SOCKET s)
+{
+    struct sockaddr_storage ss;
+    socklen_t len;
+    int type;
+
+    if (wsa_socket_info(s, NULL, &type, NULL) < 0) {
+        set_wsa_error_from_errno();
+        return -1;
+    }
+    if (type != SOCK_STREAM) {
+        g_wsa_last_error = WSAEOPNOTSUPP;
+        return -1;
+    }
+
+    len = sizeof(ss);
+    if (getsockname((int)s, (struct sockaddr*)&ss, &len) < 0) {
+        set_wsa_error_from_errno();
+        return -1;
+    }
+    if (ss.ss_family != AF_INET && ss.ss_family != AF_INET6) {
+        g_wsa_last_error = WSAEAFNOSUPPORT;
+        return -1;
+    }
+    return ss.ss_family;
+}
+
+BOOL WSAAPI WSAConnectByList(SOCKET s, PSOCKET_ADDRESS_LIST SocketAddress,
+                             LPDWORD LocalAddressLength, LPSOCKADDR LocalAddress,
+                             LPDWORD RemoteAddressLength, LPSOCKADDR RemoteAddress,
+                             const struct timeval* timeout,
+                             LPWSAOVERLAPPED Reserved)
+{
+    HeCandidate list[HE_MAX_CANDIDATES];
+    int family;
+    int count;
+    int i;
+
+    if (Reserved != NULL || SocketAddress == NULL || SocketAddress->iAddressCount <= 0) {
+        g_wsa_last_error = WSAEINVAL;
+        return FALSE;
+    }
+
+    family = he_socket_family(s);
+    if (family < 0) {
+        return FALSE;
+    }
+
+    count = 0;
+    for (i = 0; i < SocketAddress->iAddressCount; i++) {
+        count = he_add_candidate(list, count, family,
+                                 SocketAddress->Address[i].lpSockaddr,
+                                 (socklen_t)SocketAddress->Address[i].iSockaddrLength);
+    }
+    if (count == 0) {
+        g_wsa_last_error = WSAEAFNOSUPPORT;
+        return FALSE;
+    }
+
+    he_interleave(list, count);
+
+    if (he_race(s, family, list, count, timeout) < 0) {
+        return FALSE;
+    }
+
+    return he_finish(s, LocalAddressLength, LocalAddress,
+                     RemoteAddressLength, RemoteAddress);
+}
+
+BOOL WSAAPI WSAConnectByNameA(SOCKET s, LPCSTR nodename, LPCSTR servicename,
+                              LPDWORD LocalAddressLength, LPSOCKADDR LocalAddress,
+                              LPDWORD RemoteAddressLength, LPSOCKADDR RemoteAddress,
+                              const struct timeval* timeout,
+                              LPWSAOVERLAPPED Reserved)
+{
+    HeCandidate list[HE_MAX_CANDIDATES];
+    struct addrinfo hints;
+    struct addrinfo* result;
+    struct addrinfo* ai;
+    int family;
+    int count;
+    int ret;
+
+    if (Reserved != NULL || nodename == NULL || servicename == NULL) {
+        g_wsa_last_error = WSAEINVAL;
+        return FALSE;
+    }
+
+    family = he_socket_family(s);
+    if (family < 0) {
+        return FALSE;
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = (family == AF_INET) ? AF_INET : AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    hints.ai_flags = AI_ADDRCONFIG;
+
+    ret = getaddrinfo(nodename, servicename, &hints, &result);
+    if (ret != 0) {
+        switch (ret) {
+            case EAI_AGAIN:   g_wsa_last_error = WSATRY_AGAIN; break;
+            case EAI_SERVICE: g_wsa_last_error = WSATYPE_NOT_FOUND; break;
+            case EAI_NONAME:  g_wsa_last_error = WSAHOST_NOT_FOUND; break;
+            case EAI_MEMORY:  g_wsa_last_error = WSA_NOT_ENOUGH_MEMORY; break;
+            default:          g_wsa_last_error = WSANO_RECOVERY; break;
+        }
+        return FALSE;
+    }
+
+    /* getaddrinfo already applies RFC 6724 destination ordering */
+    count = 0;
+    for (ai = result; ai != NULL; ai = ai->ai_next) {
+        count = he_add_candidate(list, count, family, ai->ai_addr, ai->ai_addrlen);
+    }
+    freeaddrinfo(result);
+
+    if (count == 0) {
+        g_wsa_last_error = WSAHOST_NOT_FOUND;
+        return FALSE;
+    }
+
+    he_interleave(list, count);
+
+    if (he_race(s, family, list, count, timeout) < 0) {
+        return FALSE;
+    }
+
+    return he_finish(s, LocalAddressLength, LocalAddress,
+                     RemoteAddressLength, RemoteAddress);
+}
+WSA_HIDDEN_DEF(WSAConnectByNameA);
+
+BOOL WSAAPI WSAConnectByNameW(SOCKET s, LPWSTR nodename, LPWSTR servicename,
+                              LPDWORD LocalAddressLength, LPSOCKADDR LocalAddress,
+                              LPDWORD RemoteAddressLength, LPSOCKADDR RemoteAddress,
+                              const struct timeval* timeout,
+                              LPWSAOVERLAPPED Reserved)
+{
+    char node_buffer[256];
+    char service_buffer[64];
+
+    if (nodename == NULL || servicename == NULL) {
+        g_wsa_last_error = WSAEINVAL;
+        return FALSE;
+    }
+
+    if (wcstombs(node_buffer, nodename, sizeof(node_buffer)) >= sizeof(node_buffer) ||
+        wcstombs(service_buffer, servicename, sizeof(service_buffer)) >= sizeof(service_buffer)) {
+        g_wsa_last_error = WSAEINVAL;
+        return FALSE;
+    }
+
+    return WSAConnectByNameA_internal(s, node_buffer, service_buffer,
+                                      LocalAddressLength, LocalAddress,
+                                      RemoteAddressLength, RemoteAddress,
+                                      timeout, Reserved);
+}
+
 /* ============================================================================
  * WSASend / WSARecv Functions
  * ============================================================================ */
@@ -135,6 +870,8 @@ int WSAAPI WSASend(SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
     struct iovec* iov;
     ssize_t result;
     DWORD i;
+    long long record_start;
+    WSA_STATS_SCOPE(WSASend);
 
     (void)lpOverlapped; /* Overlapped I/O not fully supported */
     (void)lpCompletionRoutine;
@@ -145,7 +882,7 @@ int WSAAPI WSASend(SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
     }
 
     /* Allocate iovec array */
-    iov = (struct iovec*)malloc(dwBufferCount * sizeof(struct iovec));
+    iov = wsa_iov_alloc(dwBufferCount);
     if (iov == NULL) {
         g_wsa_last_error = WSA_NOT_ENOUGH_MEMORY;
         return SOCKET_ERROR;
@@ -157,15 +894,25 @@ int WSAAPI WSASend(SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
         iov[i].iov_len = lpBuffers[i].len;
     }
 
+    record_start = WSA_RECORD_START();
+    WSA_PROBE2(wsasend__start, s, dwBufferCount);
     result = writev((int)s, iov, (int)dwBufferCount);
+    WSA_PROBE3(wsasend__done, s, result, WSA_PROBE_ERROR(result));
+    WSA_RECORD_IO(WSASend, s, lpBuffers, dwBufferCount, result, record_start);
 
-    free(iov);
+    wsa_iov_free(iov, dwBufferCount);
 
     if (result < 0) {
         set_wsa_error_from_errno();
+        wsa_socket_count_send(s, -1);
+        if (g_wsa_last_error == WSAEWOULDBLOCK) {
+            wsa_async_reenable(s, FD_WRITE);
+        }
         return SOCKET_ERROR;
     }
 
+    WSA_STATS_BYTES(result);
+    wsa_socket_count_send(s, result);
     if (lpNumberOfBytesSent != NULL) {
         *lpNumberOfBytesSent = (DWORD)result;
     }
@@ -184,6 +931,8 @@ int WSAAPI WSASendTo(SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
     struct iovec* iov;
     ssize_t result;
     DWORD i;
+    long long record_start;
+    WSA_STATS_SCOPE(WSASendTo);
 
     (void)lpOverlapped;
     (void)lpCompletionRoutine;
@@ -194,7 +943,7 @@ int WSAAPI WSASendTo(SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
     }
 
     /* Allocate iovec array */
-    iov = (struct iovec*)malloc(dwBufferCount * sizeof(struct iovec));
+    iov = wsa_iov_alloc(dwBufferCount);
     if (iov == NULL) {
         g_wsa_last_error = WSA_NOT_ENOUGH_MEMORY;
         return SOCKET_ERROR;
@@ -213,15 +962,25 @@ int WSAAPI WSASendTo(SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
     msg.msg_iov = iov;
     msg.msg_iovlen = dwBufferCount;
 
+    record_start = WSA_RECORD_START();
+    WSA_PROBE2(wsasendto__start, s, dwBufferCount);
     result = sendmsg((int)s, &msg, (int)dwFlags);
+    WSA_PROBE3(wsasendto__done, s, result, WSA_PROBE_ERROR(result));
+    WSA_RECORD_IO(WSASendTo, s, lpBuffers, dwBufferCount, result, record_start);
 
-    free(iov);
+    wsa_iov_free(iov, dwBufferCount);
 
     if (result < 0) {
         set_wsa_error_from_errno();
+        wsa_socket_count_send(s, -1);
+        if (g_wsa_last_error == WSAEWOULDBLOCK) {
+            wsa_async_reenable(s, FD_WRITE);
+        }
         return SOCKET_ERROR;
     }
 
+    WSA_STATS_BYTES(result);
+    wsa_socket_count_send(s, result);
     if (lpNumberOfBytesSent != NULL) {
         *lpNumberOfBytesSent = (DWORD)result;
     }
@@ -238,6 +997,8 @@ int WSAAPI WSARecv(SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
     struct iovec* iov;
     ssize_t result;
     DWORD i;
+    long long record_start;
+    WSA_STATS_SCOPE(WSARecv);
 
     (void)lpOverlapped;
     (void)lpCompletionRoutine;
@@ -248,7 +1009,7 @@ int WSAAPI WSARecv(SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
     }
 
     /* Allocate iovec array */
-    iov = (struct iovec*)malloc(dwBufferCount * sizeof(struct iovec));
+    iov = wsa_iov_alloc(dwBufferCount);
     if (iov == NULL) {
         g_wsa_last_error = WSA_NOT_ENOUGH_MEMORY;
         return SOCKET_ERROR;
@@ -260,15 +1021,22 @@ int WSAAPI WSARecv(SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
         iov[i].iov_len = lpBuffers[i].len;
     }
 
+    record_start = WSA_RECORD_START();
+    WSA_PROBE2(wsarecv__start, s, dwBufferCount);
     result = readv((int)s, iov, (int)dwBufferCount);
+    WSA_PROBE3(wsarecv__done, s, result, WSA_PROBE_ERROR(result));
+    WSA_RECORD_IO(WSARecv, s, lpBuffers, dwBufferCount, result, record_start);
 
-    free(iov);
+    wsa_iov_free(iov, dwBufferCount);
 
     if (result < 0) {
         set_wsa_error_from_errno();
+        wsa_socket_count_recv(s, -1);
         return SOCKET_ERROR;
     }
 
+    WSA_STATS_BYTES(result);
+    wsa_socket_count_recv(s, result);
     if (lpNumberOfBytesRecvd != NULL) {
         *lpNumberOfBytesRecvd = (DWORD)result;
     }
@@ -291,6 +1059,8 @@ int WSAAPI WSARecvFrom(SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
     struct iovec* iov;
     ssize_t result;
     DWORD i;
+    long long record_start;
+    WSA_STATS_SCOPE(WSARecvFrom);
 
     (void)lpOverlapped;
     (void)lpCompletionRoutine;
@@ -301,7 +1071,7 @@ int WSAAPI WSARecvFrom(SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
     }
 
     /* Allocate iovec array */
-    iov = (struct iovec*)malloc(dwBufferCount * sizeof(struct iovec));
+    iov = wsa_iov_alloc(dwBufferCount);
     if (iov == NULL) {
         g_wsa_last_error = WSA_NOT_ENOUGH_MEMORY;
         return SOCKET_ERROR;
@@ -322,15 +1092,22 @@ int WSAAPI WSARecvFrom(SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
     msg.msg_iov = iov;
     msg.msg_iovlen = dwBufferCount;
 
+    record_start = WSA_RECORD_START();
+    WSA_PROBE2(wsarecvfrom__start, s, dwBufferCount);
     result = recvmsg((int)s, &msg, lpFlags != NULL ? (int)*lpFlags : 0);
+    WSA_PROBE3(wsarecvfrom__done, s, result, WSA_PROBE_ERROR(result));
+    WSA_RECORD_IO(WSARecvFrom, s, lpBuffers, dwBufferCount, result, record_start);
 
-    free(iov);
+    wsa_iov_free(iov, dwBufferCount);
 
     if (result < 0) {
         set_wsa_error_from_errno();
+        wsa_socket_count_recv(s, -1);
         return SOCKET_ERROR;
     }
 
+    WSA_STATS_BYTES(result);
+    wsa_socket_count_recv(s, result);
     if (lpNumberOfBytesRecvd != NULL) {
         *lpNumberOfBytesRecvd = (DWORD)result;
     }
@@ -359,6 +1136,8 @@ int WSAAPI WSARecvMsg(SOCKET s, LPWSAMSG lpMsg, DWORD* lpdwNumberOfBytesRecvd,
     struct iovec* iov;
     ssize_t result;
     DWORD i;
+    long long record_start;
+    WSA_STATS_SCOPE(WSARecvMsg);
 
     (void)lpOverlapped;
     (void)lpCompletionRoutine;
@@ -370,7 +1149,7 @@ int WSAAPI WSARecvMsg(SOCKET s, LPWSAMSG lpMsg, DWORD* lpdwNumberOfBytesRecvd,
 
     /* Allocate iovec array */
     if (lpMsg->dwBufferCount > 0) {
-        iov = (struct iovec*)malloc(lpMsg->dwBufferCount * sizeof(struct iovec));
+        iov = wsa_iov_alloc(lpMsg->dwBufferCount);
         if (iov == NULL) {
             g_wsa_last_error = WSA_NOT_ENOUGH_MEMORY;
             return SOCKET_ERROR;
@@ -394,17 +1173,24 @@ int WSAAPI WSARecvMsg(SOCKET s, LPWSAMSG lpMsg, DWORD* lpdwNumberOfBytesRecvd,
     msg.msg_control = lpMsg->Control.buf;
     msg.msg_controllen = lpMsg->Control.len;
 
+    record_start = WSA_RECORD_START();
+    WSA_PROBE2(wsarecvmsg__start, s, lpMsg->dwBufferCount);
     result = recvmsg((int)s, &msg, (int)lpMsg->dwFlags);
+    WSA_PROBE3(wsarecvmsg__done, s, result, WSA_PROBE_ERROR(result));
+    WSA_RECORD_IO(WSARecvMsg, s, lpMsg->lpBuffers, lpMsg->dwBufferCount, result, record_start);
 
     if (iov != NULL) {
-        free(iov);
+        wsa_iov_free(iov, lpMsg->dwBufferCount);
     }
 
     if (result < 0) {
         set_wsa_error_from_errno();
+        wsa_socket_count_recv(s, -1);
         return SOCKET_ERROR;
     }
 
+    WSA_STATS_BYTES(result);
+    wsa_socket_count_recv(s, result);
     if (lpdwNumberOfBytesRecvd != NULL) {
         *lpdwNumberOfBytesRecvd = (DWORD)result;
     }
@@ -426,6 +1212,8 @@ int WSAAPI WSASendMsg(SOCKET s, LPWSAMSG lpMsg, DWORD dwFlags,
     struct iovec* iov;
     ssize_t result;
     DWORD i;
+    long long record_start;
+    WSA_STATS_SCOPE(WSASendMsg);
 
     (void)lpOverlapped;
     (void)lpCompletionRoutine;
@@ -437,7 +1225,7 @@ int WSAAPI WSASendMsg(SOCKET s, LPWSAMSG lpMsg, DWORD dwFlags,
 
     /* Allocate iovec array */
     if (lpMsg->dwBufferCount > 0) {
-        iov = (struct iovec*)malloc(lpMsg->dwBufferCount * sizeof(struct iovec));
+        iov = wsa_iov_alloc(lpMsg->dwBufferCount);
         if (iov == NULL) {
             g_wsa_last_error = WSA_NOT_ENOUGH_MEMORY;
             return SOCKET_ERROR;
@@ -461,17 +1249,27 @@ int WSAAPI WSASendMsg(SOCKET s, LPWSAMSG lpMsg, DWORD dwFlags,
     msg.msg_control = lpMsg->Control.buf;
     msg.msg_controllen = lpMsg->Control.len;
 
+    record_start = WSA_RECORD_START();
+    WSA_PROBE2(wsasendmsg__start, s, lpMsg->dwBufferCount);
     result = sendmsg((int)s, &msg, (int)dwFlags);
+    WSA_PROBE3(wsasendmsg__done, s, result, WSA_PROBE_ERROR(result));
+    WSA_RECORD_IO(WSASendMsg, s, lpMsg->lpBuffers, lpMsg->dwBufferCount, result, record_start);
 
     if (iov != NULL) {
-        free(iov);
+        wsa_iov_free(iov, lpMsg->dwBufferCount);
     }
 
     if (result < 0) {
         set_wsa_error_from_errno();
+        wsa_socket_count_send(s, -1);
+        if (g_wsa_last_error == WSAEWOULDBLOCK) {
+            wsa_async_reenable(s, FD_WRITE);
+        }
         return SOCKET_ERROR;
     }
 
+    WSA_STATS_BYTES(result);
+    wsa_socket_count_send(s, result);
     if (lpNumberOfBytesSent != NULL) {
         *lpNumberOfBytesSent = (DWORD)result;
     }
@@ -480,6 +1278,222 @@ int WSAAPI WSASendMsg(SOCKET s, LPWSAMSG lpMsg, DWORD dwFlags,
     return 0;
 }
 
+/* ============================================================================
+ * WSAIoctl - TCP Vendor Codes (mstcpip.h)
+ * ============================================================================ */
+
+/* Kernel struct tcp_info past the fields glibc declares (same layout) */
+typedef struct LinuxTcpInfo {
+    struct tcp_info base;
+    uint64_t pacing_rate;
+    uint64_t max_pacing_rate;
+    uint64_t bytes_acked;
+    uint64_t bytes_received;
+    uint32_t segs_out;
+    uint32_t segs_in;
+    uint32_t notsent_bytes;
+    uint32_t min_rtt;
+    uint32_t data_segs_in;
+    uint32_t data_segs_out;
+    uint64_t delivery_rate;
+    uint64_t busy_time;
+    uint64_t rwnd_limited;
+    uint64_t sndbuf_limited;
+    uint32_t delivered;
+    uint32_t delivered_ce;
+    uint64_t bytes_sent;
+    uint64_t bytes_retrans;
+    uint32_t dsack_dups;
+    uint32_t reord_seen;
+    uint32_t rcv_ooopack;
+    uint32_t snd_wnd;
+} LinuxTcpInfo;
+
+/* Linux TCP_* states (tcpi_state) to TCPSTATE */
+static const unsigned char g_tcp_state_map[] = {
+    TCPSTATE_CLOSED,        /* 0 unused */
+    TCPSTATE_ESTABLISHED,   /* TCP_ESTABLISHED */
+    TCPSTATE_SYN_SENT,      /* TCP_SYN_SENT */
+    TCPSTATE_SYN_RCVD,      /* TCP_SYN_RECV */
+    TCPSTATE_FIN_WAIT_1,    /* TCP_FIN_WAIT1 */
+    TCPSTATE_FIN_WAIT_2,    /* TCP_FIN_WAIT2 */
+    TCPSTATE_TIME_WAIT,     /* TCP_TIME_WAIT */
+    TCPSTATE_CLOSED,        /* TCP_CLOSE */
+    TCPSTATE_CLOSE_WAIT,    /* TCP_CLOSE_WAIT */
+    TCPSTATE_LAST_ACK,      /* TCP_LAST_ACK */
+    TCPSTATE_LISTEN,        /* TCP_LISTEN */
+    TCPSTATE_CLOSING        /* TCP_CLOSING */
+};
+
+static int is_tcp_socket(SOCKET s)
+{
+    int type;
+    int protocol;
+
+    if (wsa_socket_info(s, NULL, &type, &protocol) < 0) {
+        set_wsa_error_from_errno();
+        return -1;
+    }
+    if (type != SOCK_STREAM || (protocol != 0 && protocol != IPPROTO_TCP)) {
+        g_wsa_last_error = WSAEOPNOTSUPP;
+        return 0;
+    }
+    return 1;
+}
+
+/* Milliseconds to whole seconds for TCP_KEEPIDLE/TCP_KEEPINTVL, at least 1 */
+static int keepalive_seconds(ULONG ms)
+{
+    ULONG seconds;
+
+    seconds = (ms + 999) / 1000;
+    if (seconds < 1) {
+        seconds = 1;
+    }
+    return seconds > (ULONG)INT_MAX ? INT_MAX : (int)seconds;
+}
+
+static int ioctl_keepalive_vals(SOCKET s, LPVOID lpvInBuffer, DWORD cbInBuffer)
+{
+    const struct tcp_keepalive* ka;
+    int enable;
+    int idle;
+    int interval;
+    int count;
+
+    if (lpvInBuffer == NULL || cbInBuffer < sizeof(struct tcp_keepalive)) {
+        g_wsa_last_error = WSAEFAULT;
+        return SOCKET_ERROR;
+    }
+    if (is_tcp_socket(s) != 1) {
+        return SOCKET_ERROR;
+    }
+
+    ka = (const struct tcp_keepalive*)lpvInBuffer;
+    enable = ka->onoff != 0;
+    if (enable) {
+        idle = keepalive_seconds(ka->keepalivetime);
+        interval = keepalive_seconds(ka->keepaliveinterval);
+        /* Windows sends a fixed 10 probes before dropping the connection */
+        count = 10;
+        if (setsockopt((int)s, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle)) < 0 ||
+            setsockopt((int)s, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval)) < 0 ||
+            setsockopt((int)s, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count)) < 0) {
+            set_wsa_error_from_errno();
+            return SOCKET_ERROR;
+        }
+    }
+    if (setsockopt((int)s, SOL_SOCKET, SO_KEEPALIVE, &enable, sizeof(enable)) < 0) {
+        set_wsa_error_from_errno();
+        return SOCKET_ERROR;
+    }
+
+    g_wsa_last_error = 0;
+    return 0;
+}
+
+/*
+ * Linux loopback needs no fast path of its own; the latency it buys on
+ * Windows comes from skipping the stack, so the nearest equivalent is
+ * to stop Nagle from holding back small writes.
+ */
+static int ioctl_loopback_fast_path(SOCKET s, LPVOID lpvInBuffer, DWORD cbInBuffer)
+{
+    int enable;
+
+    if (lpvInBuffer == NULL || cbInBuffer < sizeof(int)) {
+        g_wsa_last_error = WSAEFAULT;
+        return SOCKET_ERROR;
+    }
+    if (is_tcp_socket(s) != 1) {
+        return SOCKET_ERROR;
+    }
+
+    enable = *(const int*)lpvInBuffer != 0;
+    if (enable && setsockopt((int)s, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable)) < 0) {
+        set_wsa_error_from_errno();
+        return SOCKET_ERROR;
+    }
+
+    g_wsa_last_error = 0;
+    return 0;
+}
+
+/* Kernel TCP_INFO of s as TCP_INFO_v0; SOCKET_ERROR for non-TCP sockets */
+int wsa_tcp_info_v0(SOCKET s, TCP_INFO_v0* out)
+{
+    LinuxTcpInfo info;
+    socklen_t len;
+    int rcvbuf;
+    uint32_t mss;
+
+    if (is_tcp_socket(s) != 1) {
+        return SOCKET_ERROR;
+    }
+
+    memset(&info, 0, sizeof(info));
+    len = sizeof(info);
+    if (getsockopt((int)s, IPPROTO_TCP, TCP_INFO, &info, &len) < 0) {
+        set_wsa_error_from_errno();
+        return SOCKET_ERROR;
+    }
+    rcvbuf = 0;
+    len = sizeof(rcvbuf);
+    getsockopt((int)s, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &len);
+
+    /*
+     * Fields newer than the running kernel stay zero. Linux has no duplicate
+     * ACK or connection age counters; retransmit and timeout figures are
+     * the nearest ones it keeps.
+     */
+    memset(out, 0, sizeof(*out));
+    mss = info.base.tcpi_snd_mss;
+    out->State = info.base.tcpi_state < sizeof(g_tcp_state_map) ?
+                 g_tcp_state_map[info.base.tcpi_state] : TCPSTATE_CLOSED;
+    out->Mss = mss;
+    out->TimestampsEnabled = (info.base.tcpi_options & TCPI_OPT_TIMESTAMPS) != 0;
+    out->RttUs = info.base.tcpi_rtt;
+    out->MinRttUs = info.min_rtt;
+    out->BytesInFlight = info.base.tcpi_unacked * mss;
+    out->Cwnd = info.base.tcpi_snd_cwnd * mss;
+    out->SndWnd = info.snd_wnd;
+    out->RcvWnd = info.base.tcpi_rcv_space;
+    out->RcvBuf = (DWORD)rcvbuf;
+    out->BytesOut = (DWORD)info.bytes_sent;
+    out->BytesIn = (DWORD)info.bytes_received;
+    out->BytesReordered = info.reord_seen * mss;
+    out->BytesRetrans = (DWORD)info.bytes_retrans;
+    out->FastRetrans = info.base.tcpi_total_retrans;
+    out->TimeoutEpisodes = info.base.tcpi_backoff;
+    out->SynRetrans = (BYTE)(out->State == TCPSTATE_SYN_SENT ? info.base.tcpi_retransmits : 0);
+    return 0;
+}
+
+static int ioctl_tcp_info(SOCKET s, LPVOID lpvInBuffer, DWORD cbInBuffer,
+                          LPVOID lpvOutBuffer, DWORD cbOutBuffer,
+                          DWORD* lpcbBytesReturned)
+{
+    if (lpvInBuffer == NULL || cbInBuffer < sizeof(DWORD) ||
+        lpvOutBuffer == NULL || cbOutBuffer < sizeof(TCP_INFO_v0)) {
+        g_wsa_last_error = WSAEFAULT;
+        return SOCKET_ERROR;
+    }
+    /* Only TCP_INFO_v0 is available */
+    if (*(const DWORD*)lpvInBuffer != 0) {
+        g_wsa_last_error = WSAEINVAL;
+        return SOCKET_ERROR;
+    }
+    if (wsa_tcp_info_v0(s, (TCP_INFO_v0*)lpvOutBuffer) == SOCKET_ERROR) {
+        return SOCKET_ERROR;
+    }
+
+    if (lpcbBytesReturned != NULL) {
+        *lpcbBytesReturned = sizeof(TCP_INFO_v0);
+    }
+    g_wsa_last_error = 0;
+    return 0;
+}
+
 /* ============================================================================
  * WSAIoctl
  * ============================================================================ */
@@ -492,11 +1506,7 @@ int WSAAPI WSAIoctl(SOCKET s, DWORD dwIoControlCode,
                     LPWSAOVERLAPPED_COMPLETION_ROUTINE lpCompletionRoutine)
 {
     int result;
-
-    (void)cbInBuffer;
-    (void)cbOutBuffer;
-    (void)lpOverlapped;
-    (void)lpCompletionRoutine;
+    WSA_STATS_SCOPE(WSAIoctl);
 
     /* Handle specific I/O control codes */
     switch (dwIoControlCode) {
@@ -504,6 +1514,14 @@ int WSAAPI WSAIoctl(SOCKET s, DWORD dwIoControlCode,
         case FIONBIO:
         case FIOASYNC:
         case SIOCATMARK:
+            if (dwIoControlCode == FIONBIO && lpvInBuffer != NULL &&
+                cbInBuffer >= sizeof(unsigned long) &&
+                wsa_listener_fionbio(s, (const unsigned long*)lpvInBuffer)) {
+                if (lpcbBytesReturned != NULL) {
+                    *lpcbBytesReturned = sizeof(unsigned long);
+                }
+                break;
+            }
             result = ioctl((int)s, (unsigned long)dwIoControlCode,
                           lpvInBuffer != NULL ? lpvInBuffer : lpvOutBuffer);
             if (result < 0) {
@@ -532,6 +1550,55 @@ int WSAAPI WSAIoctl(SOCKET s, DWORD dwIoControlCode,
             g_wsa_last_error = WSAEOPNOTSUPP;
             return SOCKET_ERROR;
 
+        case SIO_ADDRESS_LIST_CHANGE:
+        case SIO_ROUTING_INTERFACE_CHANGE:
+            if (lpcbBytesReturned != NULL) {
+                *lpcbBytesReturned = 0;
+            }
+            return wsa_netchange_ioctl(s,
+                                       dwIoControlCode == SIO_ADDRESS_LIST_CHANGE ?
+                                       WSA_NETCHANGE_ADDRESS : WSA_NETCHANGE_ROUTE,
+                                       lpOverlapped, lpCompletionRoutine);
+
+        case SIO_KEEPALIVE_VALS:
+            if (lpcbBytesReturned != NULL) {
+                *lpcbBytesReturned = 0;
+            }
+            return ioctl_keepalive_vals(s, lpvInBuffer, cbInBuffer);
+
+        case SIO_LOOPBACK_FAST_PATH:
+            if (lpcbBytesReturned != NULL) {
+                *lpcbBytesReturned = 0;
+            }
+            return ioctl_loopback_fast_path(s, lpvInBuffer, cbInBuffer);
+
+        case SIO_ACCEPT_SHARDS:
+            if (lpcbBytesReturned != NULL) {
+                *lpcbBytesReturned = 0;
+            }
+            return wsa_accept_shards_ioctl(s, lpvInBuffer, cbInBuffer);
+
+        case SIO_ACCEPT_DENYLIST:
+            if (lpcbBytesReturned != NULL) {
+                *lpcbBytesReturned = 0;
+            }
+            return wsa_accept_denylist_ioctl(s, lpvInBuffer, cbInBuffer);
+
+        case SIO_TCP_INFO:
+            return ioctl_tcp_info(s, lpvInBuffer, cbInBuffer,
+                                  lpvOutBuffer, cbOutBuffer, lpcbBytesReturned);
+
+        case SIO_SOCKET_STATS:
+            return wsa_socket_stats_ioctl(s, lpvOutBuffer, cbOutBuffer, lpcbBytesReturned);
+
+        case SIO_ADDRESS_LIST_QUERY:
+            return wsa_address_list_query(s, lpvOutBuffer, cbOutBuffer, lpcbBytesReturned);
+
+        case SIO_ROUTING_INTERFACE_QUERY:
+            return wsa_routing_interface_query(lpvInBuffer, cbInBuffer,
+                                               lpvOutBuffer, cbOutBuffer,
+                                               lpcbBytesReturned);
+
         default:
             g_wsa_last_error = WSAEINVAL;
             return SOCKET_ERROR;
@@ -624,60 +1691,4 @@ int WSAAPI WSASocketPair(int af, int type, int protocol, SOCKET socks[2])
     return 0;
 }
 
-/* Helper function implementations */
-static int errno_to_wsa_error(int err)
-{
-    switch (err) {
-        case 0: return 0;
-        case EINTR: return WSAEINTR;
-        case EBADF: return WSAEBADF;
-        case EACCES: return WSAEACCES;
-        case EFAULT: return WSAEFAULT;
-        case EINVAL: return WSAEINVAL;
-        case EMFILE: return WSAEMFILE;
-        case EWOULDBLOCK: return WSAEWOULDBLOCK;
-        case EINPROGRESS: return WSAEINPROGRESS;
-        case EALREADY: return WSAEALREADY;
-        case ENOTSOCK: return WSAENOTSOCK;
-        case EDESTADDRREQ: return WSAEDESTADDRREQ;
-        case EMSGSIZE: return WSAEMSGSIZE;
-        case EPROTOTYPE: return WSAEPROTOTYPE;
-        case ENOPROTOOPT: return WSAENOPROTOOPT;
-        case EPROTONOSUPPORT: return WSAEPROTONOSUPPORT;
-        case ESOCKTNOSUPPORT: return WSAESOCKTNOSUPPORT;
-        case EOPNOTSUPP: return WSAEOPNOTSUPP;
-        case EPFNOSUPPORT: return WSAEPFNOSUPPORT;
-        case EAFNOSUPPORT: return WSAEAFNOSUPPORT;
-        case EADDRINUSE: return WSAEADDRINUSE;
-        case EADDRNOTAVAIL: return WSAEADDRNOTAVAIL;
-        case ENETDOWN: return WSAENETDOWN;
-        case ENETUNREACH: return WSAENETUNREACH;
-        case ENETRESET: return WSAENETRESET;
-        case ECONNABORTED: return WSAECONNABORTED;
-        case ECONNRESET: return WSAECONNRESET;
-        case ENOBUFS: return WSAENOBUFS;
-        case EISCONN: return WSAEISCONN;
-        case ENOTCONN: return WSAENOTCONN;
-        case ESHUTDOWN: return WSAESHUTDOWN;
-        case ETOOMANYREFS: return WSAETOOMANYREFS;
-        case ETIMEDOUT: return WSAETIMEDOUT;
-        case ECONNREFUSED: return WSAECONNREFUSED;
-        case ELOOP: return WSAELOOP;
-        case ENAMETOOLONG: return WSAENAMETOOLONG;
-        case EHOSTDOWN: return WSAEHOSTDOWN;
-        case EHOSTUNREACH: return WSAEHOSTUNREACH;
-        case ENOTEMPTY: return WSAENOTEMPTY;
-        case EUSERS: return WSAEUSERS;
-        case EDQUOT: return WSAEDQUOT;
-        case ESTALE: return WSAESTALE;
-        case EREMOTE: return WSAEREMOTE;
-        default: return WSABASEERR + err;
-    }
-}
-
-static void set_wsa_error_from_errno(void)
-{
-    g_wsa_last_error = errno_to_wsa_error(errno);
-}
-
 #endif /* __linux__ */
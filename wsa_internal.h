@@ -0,0 +1,374 @@
+/*
+ * Winsock Wrapper Internal Definitions
+ * Shared by the library sources only; not installed with the public headers
+ */
+
+#ifndef _WSA_INTERNAL_H
+#define _WSA_INTERNAL_H
+
+#ifdef __linux__
+
+#include "winsock2_api.h"
+
+/* Library code calls the kernel's socket options and accept() directly */
+#undef setsockopt
+#undef getsockopt
+#undef accept
+
+/* ============================================================================
+ * Internal Aliases (wsa_alias.h)
+ * ============================================================================ */
+
+#include "wsa_alias.h"
+
+/* Event calls made from the netlink listener and the overlapped helpers */
+WSA_HIDDEN_PROTO(WSASetEvent);
+WSA_HIDDEN_PROTO(WSAResetEvent);
+WSA_HIDDEN_PROTO(WSAWaitForMultipleEvents);
+
+/* ============================================================================
+ * errno to WSA Error Translation
+ * ============================================================================ */
+
+/* g_wsa_last_error is deprecated for applications only */
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+
+/*
+ * g_wsa_errno_table (winsock2.c) is indexed by errno and holds the WSA
+ * code for every errno with a Winsock equivalent, 0 otherwise. Unmapped
+ * values follow the Winsock convention WSABASEERR + errno.
+ */
+#define WSA_ERRNO_TABLE_SIZE 256
+
+extern const unsigned short g_wsa_errno_table[WSA_ERRNO_TABLE_SIZE];
+
+static inline int errno_to_wsa_error(int err)
+{
+    int code;
+
+    /* Success and would-block dominate on non-blocking sockets */
+    if (err == 0) {
+        return 0;
+    }
+    if (err == EAGAIN) {
+        return WSAEWOULDBLOCK;
+    }
+
+    if ((unsigned int)err >= WSA_ERRNO_TABLE_SIZE) {
+        return WSABASEERR + err;
+    }
+    code = g_wsa_errno_table[err];
+    return code != 0 ? code : WSABASEERR + err;
+}
+
+static inline void set_wsa_error_from_errno(void)
+{
+    g_wsa_last_error = errno_to_wsa_error(errno);
+}
+
+/* ============================================================================
+ * Socket Table (wsa_socket.c)
+ * ============================================================================ */
+
+#define WSA_CACHE_LINE 64
+
+/* Windows-only option state kept in WSASocketRecord.opt_flags */
+#define WSA_OPT_EXCLUSIVEADDRUSE   0x1
+#define WSA_OPT_CONDITIONAL_ACCEPT 0x2
+#define WSA_OPT_NONBLOCKING        0x4  /* FIONBIO of a sharded listener, whose fd never blocks */
+
+/*
+ * Per-descriptor state shared by the modules. closesocket() clears the
+ * cached fields and bumps gen; module-owned pointers survive and carry
+ * the generation they were set up under.
+ */
+typedef struct __attribute__((aligned(WSA_CACHE_LINE))) WSASocketRecord {
+    unsigned int gen;           /* Times closesocket() closed this descriptor */
+    unsigned int info_gen;      /* gen + 1 while family/type/protocol are valid */
+    int family;
+    int type;
+    int protocol;
+    unsigned int opt_flags;     /* WSA_OPT_* */
+    void* event_select;         /* WSAEventSelect state (wsa_events.c) */
+    void* async_select;         /* WSAAsyncSelect state (wsa_events.c) */
+    unsigned long long bytes_sent;      /* Traffic since the socket was opened */
+    unsigned long long bytes_received;
+    unsigned long long msgs_sent;       /* Successful send/receive calls */
+    unsigned long long msgs_received;
+    unsigned long long send_blocked;    /* Calls that failed with WSAEWOULDBLOCK */
+    unsigned long long recv_blocked;
+} WSASocketRecord;
+
+/* Record of s, NULL if s is out of range; lookup never allocates */
+WSASocketRecord* wsa_socket_record(SOCKET s);
+WSASocketRecord* wsa_socket_lookup(SOCKET s);
+
+/* Number of times closesocket() has closed fd */
+unsigned int wsa_close_generation(int fd);
+
+/* Cached SO_DOMAIN/SO_TYPE/SO_PROTOCOL; -1 with errno on failure */
+int wsa_socket_info(SOCKET s, int* family, int* type, int* protocol);
+
+/* Run hook(s) from closesocket() before s is closed; -1 when the list is full */
+int wsa_add_close_hook(void (*hook)(SOCKET s));
+
+/* closesocket() bookkeeping: run the hooks and retire the record */
+void wsa_socket_close(SOCKET s);
+
+/* Call fn for every record that has been allocated, stopping when it returns nonzero */
+int wsa_socket_foreach(int (*fn)(SOCKET s, WSASocketRecord* rec, void* ctx), void* ctx);
+
+/*
+ * Account a send or receive call on s: result is the byte count, or
+ * negative with g_wsa_last_error set. Relaxed atomics only, no syscalls.
+ */
+static inline void wsa_socket_count_send(SOCKET s, long long result)
+{
+    WSASocketRecord* rec;
+
+    rec = wsa_socket_record(s);
+    if (rec == NULL) {
+        return;
+    }
+    if (result >= 0) {
+        __atomic_fetch_add(&rec->bytes_sent, (unsigned long long)result, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&rec->msgs_sent, 1, __ATOMIC_RELAXED);
+    } else if (g_wsa_last_error == WSAEWOULDBLOCK) {
+        __atomic_fetch_add(&rec->send_blocked, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static inline void wsa_socket_count_recv(SOCKET s, long long result)
+{
+    WSASocketRecord* rec;
+
+    rec = wsa_socket_record(s);
+    if (rec == NULL) {
+        return;
+    }
+    if (result >= 0) {
+        __atomic_fetch_add(&rec->bytes_received, (unsigned long long)result, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&rec->msgs_received, 1, __ATOMIC_RELAXED);
+    } else if (g_wsa_last_error == WSAEWOULDBLOCK) {
+        __atomic_fetch_add(&rec->recv_blocked, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/* ============================================================================
+ * Record Pools (wsa_pool.c)
+ * ============================================================================ */
+
+#include "wsa_pool.h"
+
+/*
+ * iovec arrays for the WSABUF-based calls: up to WSA_IOV_POOLED entries
+ * come from a pool, longer arrays from malloc. Pass the same count to
+ * wsa_iov_free.
+ */
+#define WSA_IOV_POOLED 64
+
+struct iovec;
+struct iovec* wsa_iov_alloc(DWORD count);
+void wsa_iov_free(struct iovec* iov, DWORD count);
+
+/* ============================================================================
+ * Call Statistics (wsa_stats.c)
+ * ============================================================================ */
+
+/* Instrumented functions, in report order; also the call recorder's function ids */
+#define WSA_STATS_FUNCTIONS(X) \
+    X(WSASocketA) X(closesocket) X(ioctlsocket) X(WSAAccept) X(WSAConnect) \
+    X(AcceptEx) X(ConnectEx) X(TransmitFile) \
+    X(WSASend) X(WSASendTo) X(WSASendMsg) X(WSARecv) X(WSARecvFrom) X(WSARecvMsg) \
+    X(WSAIoctl) X(WSASetSockOpt) X(WSAGetSockOpt) X(WSAPoll) X(WSASelect) \
+    X(WSAEventSelect) X(WSAEnumNetworkEvents) X(WSAWaitForMultipleEvents) \
+    X(WSAAsyncSelect) X(WSAStringToAddressA) X(WSAAddressToStringA)
+
+#define WSA_STATS_ENUM(name) WSA_STAT_##name,
+enum { WSA_STATS_FUNCTIONS(WSA_STATS_ENUM) WSA_STAT_COUNT };
+#undef WSA_STATS_ENUM
+
+#ifdef WSA_STATS
+
+#include <time.h>
+
+extern int g_wsa_stats_enabled;
+
+typedef struct WSAStatsScope {
+    int function;
+    long long start;        /* 0 when collection was off on entry */
+    long long bytes;
+} WSAStatsScope;
+
+static inline WSAStatsScope wsa_stats_enter(int function)
+{
+    WSAStatsScope scope;
+    struct timespec ts;
+
+    scope.function = function;
+    scope.bytes = 0;
+    scope.start = 0;
+    if (__builtin_expect(__atomic_load_n(&g_wsa_stats_enabled, __ATOMIC_RELAXED), 0)) {
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        scope.start = (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec + 1;
+    }
+    return scope;
+}
+
+/* Record the call; the outcome is read from g_wsa_last_error */
+void wsa_stats_leave(WSAStatsScope* scope);
+
+/*
+ * Time the rest of the enclosing function, which must leave
+ * g_wsa_last_error set on every return. Place after the declarations.
+ */
+#define WSA_STATS_SCOPE(name) \
+    WSAStatsScope wsa_stats_scope __attribute__((cleanup(wsa_stats_leave))) = \
+        wsa_stats_enter(WSA_STAT_##name)
+#define WSA_STATS_BYTES(n) (wsa_stats_scope.bytes = (long long)(n))
+
+#else
+
+#define WSA_STATS_SCOPE(name) ((void)0)
+#define WSA_STATS_BYTES(n)    ((void)0)
+
+#endif /* WSA_STATS */
+
+/* ============================================================================
+ * Call Recorder (wsa_record.c)
+ * ============================================================================ */
+
+extern int g_wsa_recording;
+
+long long wsa_record_now(void);
+
+/* Append one record; errno is preserved and read when result is negative */
+void wsa_record_call(int function, SOCKET s, long long size, long long result,
+                     long long start);
+void wsa_record_io(int function, SOCKET s, const WSABUF* buffers, DWORD count,
+                   long long result, long long start);
+
+/* Start stamp for WSA_RECORD: 0, and nothing else done, unless recording */
+#define WSA_RECORD_START() \
+    (__builtin_expect(__atomic_load_n(&g_wsa_recording, __ATOMIC_RELAXED), 0) ? \
+     wsa_record_now() : 0)
+
+/* Place right after the syscall, before errno can change */
+#define WSA_RECORD(name, s, size, result, start) \
+    do { \
+        if (__builtin_expect((start) != 0, 0)) { \
+            wsa_record_call(WSA_STAT_##name, s, size, result, start); \
+        } \
+    } while (0)
+
+#define WSA_RECORD_IO(name, s, buffers, count, result, start) \
+    do { \
+        if (__builtin_expect((start) != 0, 0)) { \
+            wsa_record_io(WSA_STAT_##name, s, buffers, count, result, start); \
+        } \
+    } while (0)
+
+/* ============================================================================
+ * Static Tracepoints
+ *
+ * USDT probes under the "winsock" provider for perf and bpftrace, e.g.
+ * usdt:./libws2_32.so:winsock:wsasend__done. With <sys/sdt.h> a probe is
+ * a single nop plus an ELF note, so it costs nothing until a tracer
+ * attaches; without the header (or with PROBES=0) the macros vanish and
+ * their arguments are not evaluated. Error arguments are WSA codes.
+ * ============================================================================ */
+
+#if !defined(WSA_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define WSA_PROBES 1
+#endif
+#endif
+
+#ifdef WSA_PROBES
+#define WSA_PROBE1(name, a)             DTRACE_PROBE1(winsock, name, a)
+#define WSA_PROBE2(name, a, b)          DTRACE_PROBE2(winsock, name, a, b)
+#define WSA_PROBE3(name, a, b, c)       DTRACE_PROBE3(winsock, name, a, b, c)
+#else
+/* sizeof keeps probe-only variables "used" without evaluating anything */
+#define WSA_PROBE1(name, a)             ((void)sizeof(a))
+#define WSA_PROBE2(name, a, b)          ((void)sizeof(a), (void)sizeof(b))
+#define WSA_PROBE3(name, a, b, c)       ((void)sizeof(a), (void)sizeof(b), (void)sizeof(c))
+#endif
+
+/* Error argument for a probe placed right after a syscall returning result */
+#define WSA_PROBE_ERROR(result) ((result) < 0 ? errno_to_wsa_error(errno) : 0)
+
+/* ============================================================================
+ * Socket Notification Hooks (wsa_events.c)
+ * ============================================================================ */
+
+/* Re-enable lEvent notifications for s after the call that does so on Windows */
+void wsa_async_reenable(SOCKET s, long lEvent);
+
+/* Raise lEvent (e.g. FD_ADDRESS_LIST_CHANGE) for s; err is an errno value */
+void wsa_notify_network_event(SOCKET s, long lEvent, int err);
+
+/* Events requested by WSAEventSelect and WSAAsyncSelect on s, 0 when none */
+void wsa_select_masks(SOCKET s, long* event_select, long* async_select);
+
+/* ============================================================================
+ * Network Change Notification and Queries (wsa_netlink.c)
+ * ============================================================================ */
+
+#define WSA_NETCHANGE_ADDRESS 0x1   /* SIO_ADDRESS_LIST_CHANGE */
+#define WSA_NETCHANGE_ROUTE   0x2   /* SIO_ROUTING_INTERFACE_CHANGE */
+
+/* Start, queue or wait for a change notification request on s */
+int wsa_netchange_ioctl(SOCKET s, int kind, LPWSAOVERLAPPED lpOverlapped,
+                        LPWSAOVERLAPPED_COMPLETION_ROUTINE lpCompletionRoutine);
+
+/* Overlapped change notifications still pending on s */
+DWORD wsa_netchange_pending(SOCKET s);
+
+/* SIO_ADDRESS_LIST_QUERY / SIO_ROUTING_INTERFACE_QUERY from the snapshot */
+int wsa_address_list_query(SOCKET s, LPVOID lpvOutBuffer, DWORD cbOutBuffer,
+                           DWORD* lpcbBytesReturned);
+int wsa_routing_interface_query(LPVOID lpvInBuffer, DWORD cbInBuffer,
+                                LPVOID lpvOutBuffer, DWORD cbOutBuffer,
+                                DWORD* lpcbBytesReturned);
+
+/* ============================================================================
+ * Accept Sharding (wsa_shard.c)
+ * ============================================================================ */
+
+/* accept() that draws from every SIO_ACCEPT_SHARDS listener of s */
+int wsa_listener_accept(SOCKET s, struct sockaddr* addr, socklen_t* addrlen);
+
+/* setsockopt() on s and every shard of it; -1 with errno if s fails */
+int wsa_listener_setsockopt(SOCKET s, int level, int optname,
+                            const void* optval, socklen_t optlen);
+
+/* Nonzero if SIO_ACCEPT_SHARDS was issued on s */
+int wsa_listener_sharded(SOCKET s);
+
+/* FIONBIO on a sharded listener; 0 if s has no running shards to handle it */
+int wsa_listener_fionbio(SOCKET s, const unsigned long* argp);
+
+/* SIO_ACCEPT_SHARDS */
+int wsa_accept_shards_ioctl(SOCKET s, LPVOID lpvInBuffer, DWORD cbInBuffer);
+
+/* SIO_ACCEPT_DENYLIST (wsa_denylist.c) */
+int wsa_accept_denylist_ioctl(SOCKET s, LPVOID lpvInBuffer, DWORD cbInBuffer);
+
+/* ============================================================================
+ * Per-Socket Statistics (wsa_sockstats.c)
+ * ============================================================================ */
+
+struct _TCP_INFO_v0;
+
+/* Kernel TCP_INFO of s mapped to TCP_INFO_v0 (wsa_extended.c) */
+int wsa_tcp_info_v0(SOCKET s, struct _TCP_INFO_v0* out);
+
+/* SIO_SOCKET_STATS */
+int wsa_socket_stats_ioctl(SOCKET s, LPVOID lpvOutBuffer, DWORD cbOutBuffer,
+                           DWORD* lpcbBytesReturned);
+
+#endif /* __linux__ */
+
+#endif /* _WSA_INTERNAL_H */
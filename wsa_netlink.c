@@ -0,0 +1,913 @@
+/*
+ * WSA Network Change Notification and Interface Queries
+ * Implements SIO_ADDRESS_LIST_CHANGE and SIO_ROUTING_INTERFACE_CHANGE on a
+ * single rtnetlink listener shared by every socket in the process, and
+ * SIO_ADDRESS_LIST_QUERY / SIO_ROUTING_INTERFACE_QUERY from a cached
+ * address and route snapshot that the listener keeps current
+ */
+
+#ifdef __linux__
+
+#include "winsock2_api.h"
+#include "wsa_internal.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+/* ============================================================================
+ * Pending Requests
+ *
+ * A request completes on the first matching change after it was issued.
+ * Overlapped requests complete through Internal/hEvent and the completion
+ * routine; requests on non-blocking sockets without an OVERLAPPED raise
+ * FD_ADDRESS_LIST_CHANGE / FD_ROUTING_INTERFACE_CHANGE instead. Each
+ * request fires once and must be issued again for the next change.
+ * ============================================================================ */
+
+typedef struct NetChangeRequest {
+    SOCKET s;
+    unsigned int gen;       /* Close generation when issued */
+    int kind;               /* WSA_NETCHANGE_ADDRESS or WSA_NETCHANGE_ROUTE */
+    LPWSAOVERLAPPED lpOverlapped;
+    LPWSAOVERLAPPED_COMPLETION_ROUTINE lpCompletionRoutine;
+    struct NetChangeRequest* next;
+} NetChangeRequest;
+
+/* A thread blocked in the ioctl; closesocket() sets aborted */
+typedef struct NetChangeWaiter {
+    SOCKET s;
+    unsigned int gen;
+    int aborted;
+    struct NetChangeWaiter* next;
+} NetChangeWaiter;
+
+static pthread_mutex_t g_netchange_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_netchange_cond = PTHREAD_COND_INITIALIZER;
+static pthread_once_t g_netchange_once = PTHREAD_ONCE_INIT;
+static int g_netchange_fd = -1;
+static NetChangeRequest* g_netchange_pending = NULL;
+static NetChangeWaiter* g_netchange_waiters = NULL;
+static WSAPool g_netchange_pool = WSA_POOL_INITIALIZER("NetChangeRequest", sizeof(NetChangeRequest));
+static unsigned long g_address_seq = 0;  /* Changes seen, for blocking waiters */
+static unsigned long g_route_seq = 0;
+
+static void netchange_finish(NetChangeRequest* r, int error)
+{
+    LPWSAOVERLAPPED ov;
+
+    ov = r->lpOverlapped;
+    if (ov == NULL) {
+        if (error == 0) {
+            wsa_notify_network_event(r->s,
+                                     r->kind == WSA_NETCHANGE_ADDRESS ?
+                                     FD_ADDRESS_LIST_CHANGE : FD_ROUTING_INTERFACE_CHANGE,
+                                     0);
+        }
+        return;
+    }
+
+    /* Internal is published last; WSAGetOverlappedResult reads it first */
+    ov->InternalHigh = 0;
+    __atomic_store_n(&ov->Internal, (ULONG_PTR)error, __ATOMIC_RELEASE);
+
+    /* No APCs here: the routine runs on the listener thread */
+    if (r->lpCompletionRoutine != NULL) {
+        r->lpCompletionRoutine((DWORD)error, 0, ov, 0);
+    } else if (ov->hEvent != NULL) {
+        WSASetEvent_internal(ov->hEvent);
+    }
+}
+
+/* Complete every request waiting for one of kinds */
+static void netchange_complete(int kinds)
+{
+    NetChangeRequest** link;
+    NetChangeRequest* done;
+    NetChangeRequest* r;
+
+    done = NULL;
+
+    pthread_mutex_lock(&g_netchange_mutex);
+    if (kinds & WSA_NETCHANGE_ADDRESS) {
+        g_address_seq++;
+    }
+    if (kinds & WSA_NETCHANGE_ROUTE) {
+        g_route_seq++;
+    }
+    pthread_cond_broadcast(&g_netchange_cond);
+
+    link = &g_netchange_pending;
+    while (*link != NULL) {
+        r = *link;
+        if (r->kind & kinds) {
+            *link = r->next;
+            r->next = done;
+            done = r;
+        } else {
+            link = &r->next;
+        }
+    }
+    pthread_mutex_unlock(&g_netchange_mutex);
+
+    while (done != NULL) {
+        r = done;
+        done = r->next;
+        /* A socket closed in the meantime gets its request aborted */
+        netchange_finish(r, r->gen == wsa_close_generation((int)r->s) ?
+                            0 : WSA_OPERATION_ABORTED);
+        wsa_pool_free(&g_netchange_pool, r);
+    }
+}
+
+/*
+ * closesocket() hook: overlapped requests on s complete now with
+ * WSA_OPERATION_ABORTED, armed notifications are dropped and blocked
+ * callers return WSAEINTR, as on Windows.
+ */
+static void netchange_on_close(SOCKET s)
+{
+    NetChangeRequest** link;
+    NetChangeRequest* done;
+    NetChangeRequest* r;
+    NetChangeWaiter* w;
+    unsigned int gen;
+
+    done = NULL;
+    gen = wsa_close_generation((int)s);
+
+    pthread_mutex_lock(&g_netchange_mutex);
+    link = &g_netchange_pending;
+    while (*link != NULL) {
+        r = *link;
+        if (r->s == s && r->gen == gen) {
+            *link = r->next;
+            r->next = done;
+            done = r;
+        } else {
+            link = &r->next;
+        }
+    }
+    for (w = g_netchange_waiters; w != NULL; w = w->next) {
+        if (w->s == s && w->gen == gen) {
+            w->aborted = 1;
+        }
+    }
+    pthread_cond_broadcast(&g_netchange_cond);
+    pthread_mutex_unlock(&g_netchange_mutex);
+
+    while (done != NULL) {
+        r = done;
+        done = r->next;
+        netchange_finish(r, WSA_OPERATION_ABORTED);
+        wsa_pool_free(&g_netchange_pool, r);
+    }
+}
+
+DWORD wsa_netchange_pending(SOCKET s)
+{
+    NetChangeRequest* r;
+    unsigned int gen;
+    DWORD count;
+
+    count = 0;
+    gen = wsa_close_generation((int)s);
+    pthread_mutex_lock(&g_netchange_mutex);
+    for (r = g_netchange_pending; r != NULL; r = r->next) {
+        if (r->s == s && r->gen == gen && r->lpOverlapped != NULL) {
+            count++;
+        }
+    }
+    pthread_mutex_unlock(&g_netchange_mutex);
+    return count;
+}
+
+/* ============================================================================
+ * rtnetlink Listener
+ * ============================================================================ */
+
+static int netchange_classify(const char* buf, size_t len)
+{
+    const struct nlmsghdr* nh;
+    size_t offset;
+    int kinds;
+
+    kinds = 0;
+    offset = 0;
+    while (offset + sizeof(struct nlmsghdr) <= len) {
+        nh = (const struct nlmsghdr*)(buf + offset);
+        if (nh->nlmsg_len < sizeof(struct nlmsghdr) || offset + nh->nlmsg_len > len) {
+            break;
+        }
+
+        switch (nh->nlmsg_type) {
+            case RTM_NEWADDR:
+            case RTM_DELADDR:
+                kinds |= WSA_NETCHANGE_ADDRESS;
+                break;
+            case RTM_NEWROUTE:
+            case RTM_DELROUTE:
+            case RTM_NEWLINK:
+            case RTM_DELLINK:
+                kinds |= WSA_NETCHANGE_ROUTE;
+                break;
+            default:
+                break;
+        }
+        offset += NLMSG_ALIGN(nh->nlmsg_len);
+    }
+    return kinds;
+}
+
+static void* netchange_thread(void* arg)
+{
+    union {
+        struct nlmsghdr nh;
+        char raw[16384];
+    } buf;
+    ssize_t n;
+    int kinds;
+
+    (void)arg;
+
+    while (1) {
+        n = recv(g_netchange_fd, buf.raw, sizeof(buf.raw), 0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != ENOBUFS) {
+                break;
+            }
+            /* Receive queue overran: some changes were lost, assume all */
+            kinds = WSA_NETCHANGE_ADDRESS | WSA_NETCHANGE_ROUTE;
+        } else {
+            kinds = netchange_classify(buf.raw, (size_t)n);
+        }
+
+        if (kinds != 0) {
+            netchange_complete(kinds);
+        }
+    }
+
+    return NULL;
+}
+
+static void netchange_init(void)
+{
+    struct sockaddr_nl local;
+    pthread_t thread;
+    int fd;
+
+    fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (fd < 0) {
+        return;
+    }
+
+    memset(&local, 0, sizeof(local));
+    local.nl_family = AF_NETLINK;
+    local.nl_groups = RTMGRP_LINK |
+                      RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR |
+                      RTMGRP_IPV4_ROUTE | RTMGRP_IPV6_ROUTE;
+    if (bind(fd, (struct sockaddr*)&local, sizeof(local)) < 0) {
+        close(fd);
+        return;
+    }
+
+    g_netchange_fd = fd;
+    if (pthread_create(&thread, NULL, netchange_thread, NULL) != 0) {
+        close(fd);
+        g_netchange_fd = -1;
+        return;
+    }
+    pthread_detach(thread);
+
+    wsa_add_close_hook(netchange_on_close);
+}
+
+/* ============================================================================
+ * SIO_ADDRESS_LIST_CHANGE / SIO_ROUTING_INTERFACE_CHANGE
+ * ============================================================================ */
+
+/*
+ * Overlapped: queue and fail with WSA_IO_PENDING. Non-blocking socket:
+ * arm the FD_* notification and fail with WSAEWOULDBLOCK. Otherwise block
+ * until the next change. SIO_ROUTING_INTERFACE_CHANGE completes on any
+ * route change rather than only those affecting the given destination.
+ */
+int wsa_netchange_ioctl(SOCKET s, int kind, LPWSAOVERLAPPED lpOverlapped,
+                        LPWSAOVERLAPPED_COMPLETION_ROUTINE lpCompletionRoutine)
+{
+    NetChangeRequest* r;
+    NetChangeWaiter waiter;
+    NetChangeWaiter** link;
+    unsigned long* seq;
+    unsigned long start;
+    unsigned int gen;
+    int type;
+    int flags;
+
+    if (wsa_socket_info(s, NULL, &type, NULL) < 0) {
+        set_wsa_error_from_errno();
+        return SOCKET_ERROR;
+    }
+
+    pthread_once(&g_netchange_once, netchange_init);
+    if (g_netchange_fd < 0) {
+        g_wsa_last_error = WSAENETDOWN;
+        return SOCKET_ERROR;
+    }
+
+    flags = fcntl((int)s, F_GETFL, 0);
+    gen = wsa_close_generation((int)s);
+
+    if (lpOverlapped == NULL && !(flags >= 0 && (flags & O_NONBLOCK))) {
+        seq = kind == WSA_NETCHANGE_ADDRESS ? &g_address_seq : &g_route_seq;
+        waiter.s = s;
+        waiter.gen = gen;
+        waiter.aborted = 0;
+        pthread_mutex_lock(&g_netchange_mutex);
+        waiter.next = g_netchange_waiters;
+        g_netchange_waiters = &waiter;
+        start = *seq;
+        while (*seq == start && !waiter.aborted) {
+            pthread_cond_wait(&g_netchange_cond, &g_netchange_mutex);
+        }
+        link = &g_netchange_waiters;
+        while (*link != &waiter) {
+            link = &(*link)->next;
+        }
+        *link = waiter.next;
+        pthread_mutex_unlock(&g_netchange_mutex);
+        g_wsa_last_error = waiter.aborted ? WSAEINTR : 0;
+        return waiter.aborted ? SOCKET_ERROR : 0;
+    }
+
+    pthread_mutex_lock(&g_netchange_mutex);
+
+    if (lpOverlapped == NULL) {
+        /* Already armed: the pending notification covers this call too */
+        for (r = g_netchange_pending; r != NULL; r = r->next) {
+            if (r->s == s && r->gen == gen && r->kind == kind && r->lpOverlapped == NULL) {
+                pthread_mutex_unlock(&g_netchange_mutex);
+                g_wsa_last_error = WSAEWOULDBLOCK;
+                return SOCKET_ERROR;
+            }
+        }
+    }
+
+    r = (NetChangeRequest*)wsa_pool_alloc(&g_netchange_pool);
+    if (r == NULL) {
+        pthread_mutex_unlock(&g_netchange_mutex);
+        g_wsa_last_error = WSAENOBUFS;
+        return SOCKET_ERROR;
+    }
+    r->s = s;
+    r->gen = gen;
+    r->kind = kind;
+    r->lpOverlapped = lpOverlapped;
+    r->lpCompletionRoutine = lpOverlapped != NULL ? lpCompletionRoutine : NULL;
+    if (lpOverlapped != NULL) {
+        lpOverlapped->InternalHigh = 0;
+        lpOverlapped->Internal = STATUS_PENDING;
+        if (lpOverlapped->hEvent != NULL) {
+            WSAResetEvent_internal(lpOverlapped->hEvent);
+        }
+    }
+    r->next = g_netchange_pending;
+    g_netchange_pending = r;
+
+    pthread_mutex_unlock(&g_netchange_mutex);
+
+    g_wsa_last_error = lpOverlapped != NULL ? WSA_IO_PENDING : WSAEWOULDBLOCK;
+    return SOCKET_ERROR;
+}
+
+/* ============================================================================
+ * Address and Route Snapshot
+ *
+ * Dumped over rtnetlink on first use and again only after the listener
+ * has seen a change, so queries are answered from memory. Routes are
+ * kept sorted longest prefix first (then lowest metric), making the
+ * first match in a scan the longest-prefix match.
+ * ============================================================================ */
+
+typedef struct NetAddr {
+    int family;
+    int ifindex;
+    unsigned char addr[16];
+} NetAddr;
+
+typedef struct NetRoute {
+    int family;
+    int oif;
+    int dst_len;
+    unsigned int priority;
+    unsigned char local;        /* RTN_LOCAL: the destination is this host */
+    unsigned char has_prefsrc;
+    unsigned char dst[16];
+    unsigned char prefsrc[16];
+} NetRoute;
+
+typedef struct NetSnapshot {
+    NetAddr* addrs;
+    int addr_count;
+    int addr_capacity;
+    NetRoute* routes;
+    int route_count;
+    int route_capacity;
+} NetSnapshot;
+
+static pthread_mutex_t g_snapshot_mutex = PTHREAD_MUTEX_INITIALIZER;
+static NetSnapshot g_snapshot;
+static int g_snapshot_valid = 0;
+static unsigned long g_snapshot_address_seq = 0;
+static unsigned long g_snapshot_route_seq = 0;
+
+static int netsnap_addr_len(int family)
+{
+    return family == AF_INET ? 4 : 16;
+}
+
+static int netsnap_prefix_match(const unsigned char* a, const unsigned char* b, int bits)
+{
+    int bytes;
+    int rest;
+
+    bytes = bits / 8;
+    rest = bits % 8;
+    if (memcmp(a, b, (size_t)bytes) != 0) {
+        return 0;
+    }
+    if (rest != 0 && ((a[bytes] ^ b[bytes]) & (0xFF << (8 - rest)) & 0xFF) != 0) {
+        return 0;
+    }
+    return 1;
+}
+
+static void netsnap_parse_addr(const struct nlmsghdr* nh, NetSnapshot* snap)
+{
+    const struct ifaddrmsg* ifa;
+    const struct rtattr* rta;
+    const void* address;
+    const void* local;
+    NetAddr* grown;
+    NetAddr* a;
+    int len;
+
+    ifa = (const struct ifaddrmsg*)NLMSG_DATA(nh);
+    if ((ifa->ifa_family != AF_INET && ifa->ifa_family != AF_INET6) ||
+        (ifa->ifa_flags & (IFA_F_TENTATIVE | IFA_F_DADFAILED))) {
+        return;
+    }
+
+    address = NULL;
+    local = NULL;
+    len = (int)IFA_PAYLOAD(nh);
+    for (rta = IFA_RTA(ifa); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+        if ((int)RTA_PAYLOAD(rta) < netsnap_addr_len(ifa->ifa_family)) {
+            continue;
+        }
+        if (rta->rta_type == IFA_ADDRESS) {
+            address = RTA_DATA(rta);
+        } else if (rta->rta_type == IFA_LOCAL) {
+            local = RTA_DATA(rta);
+        }
+    }
+    /* IFA_ADDRESS is the peer on point-to-point links; IFA_LOCAL is ours */
+    if (local != NULL) {
+        address = local;
+    }
+    if (address == NULL) {
+        return;
+    }
+
+    if (snap->addr_count == snap->addr_capacity) {
+        grown = (NetAddr*)realloc(snap->addrs, (size_t)(snap->addr_capacity + 16) * sizeof(NetAddr));
+        if (grown == NULL) {
+            return;
+        }
+        snap->addrs = grown;
+        snap->addr_capacity += 16;
+    }
+    a = &snap->addrs[snap->addr_count++];
+    memset(a, 0, sizeof(*a));
+    a->family = ifa->ifa_family;
+    a->ifindex = (int)ifa->ifa_index;
+    memcpy(a->addr, address, (size_t)netsnap_addr_len(a->family));
+}
+
+static void netsnap_parse_route(const struct nlmsghdr* nh, NetSnapshot* snap)
+{
+    const struct rtmsg* rtm;
+    const struct rtattr* rta;
+    const struct rtnexthop* nhop;
+    NetRoute* grown;
+    NetRoute route;
+    unsigned int table;
+    int alen;
+    int len;
+
+    rtm = (const struct rtmsg*)NLMSG_DATA(nh);
+    if ((rtm->rtm_family != AF_INET && rtm->rtm_family != AF_INET6) ||
+        (rtm->rtm_type != RTN_UNICAST && rtm->rtm_type != RTN_LOCAL)) {
+        return;
+    }
+
+    memset(&route, 0, sizeof(route));
+    route.family = rtm->rtm_family;
+    route.dst_len = rtm->rtm_dst_len;
+    route.local = (unsigned char)(rtm->rtm_type == RTN_LOCAL);
+    alen = netsnap_addr_len(route.family);
+    table = rtm->rtm_table;
+
+    len = (int)RTM_PAYLOAD(nh);
+    for (rta = RTM_RTA(rtm); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+        switch (rta->rta_type) {
+            case RTA_DST:
+                if ((int)RTA_PAYLOAD(rta) >= alen) {
+                    memcpy(route.dst, RTA_DATA(rta), (size_t)alen);
+                }
+                break;
+            case RTA_PREFSRC:
+                if ((int)RTA_PAYLOAD(rta) >= alen) {
+                    memcpy(route.prefsrc, RTA_DATA(rta), (size_t)alen);
+                    route.has_prefsrc = 1;
+                }
+                break;
+            case RTA_OIF:
+                if (RTA_PAYLOAD(rta) >= sizeof(int)) {
+                    route.oif = *(const int*)RTA_DATA(rta);
+                }
+                break;
+            case RTA_PRIORITY:
+                if (RTA_PAYLOAD(rta) >= sizeof(unsigned int)) {
+                    route.priority = *(const unsigned int*)RTA_DATA(rta);
+                }
+                break;
+            case RTA_TABLE:
+                if (RTA_PAYLOAD(rta) >= sizeof(unsigned int)) {
+                    table = *(const unsigned int*)RTA_DATA(rta);
+                }
+                break;
+            case RTA_MULTIPATH:
+                /* Multipath routes carry the interface per next hop */
+                if (route.oif == 0 && RTA_PAYLOAD(rta) >= sizeof(struct rtnexthop)) {
+                    nhop = (const struct rtnexthop*)RTA_DATA(rta);
+                    route.oif = nhop->rtnh_ifindex;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    /* Policy routing is out of scope: the main and local tables only */
+    if (table != RT_TABLE_MAIN && table != RT_TABLE_LOCAL) {
+        return;
+    }
+
+    if (snap->route_count == snap->route_capacity) {
+        grown = (NetRoute*)realloc(snap->routes,
+                                   (size_t)(snap->route_capacity + 32) * sizeof(NetRoute));
+        if (grown == NULL) {
+            return;
+        }
+        snap->routes = grown;
+        snap->route_capacity += 32;
+    }
+    snap->routes[snap->route_count++] = route;
+}
+
+/* Run one rtnetlink dump and feed each reply to parse; 0 or an errno */
+static int netsnap_dump(int fd, unsigned short type, unsigned int seq, NetSnapshot* snap,
+                        void (*parse)(const struct nlmsghdr*, NetSnapshot*))
+{
+    struct {
+        struct nlmsghdr nh;
+        union {
+            struct ifaddrmsg ifa;
+            struct rtmsg rtm;
+        } body;
+    } req;
+    union {
+        struct nlmsghdr nh;
+        char raw[16384];
+    } buf;
+    const struct nlmsghdr* nh;
+    size_t offset;
+    ssize_t n;
+
+    memset(&req, 0, sizeof(req));
+    req.nh.nlmsg_type = type;
+    req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.nh.nlmsg_seq = seq;
+    if (type == RTM_GETADDR) {
+        req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifaddrmsg));
+    } else {
+        req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
+    }
+    if (send(fd, &req, req.nh.nlmsg_len, 0) < 0) {
+        return errno;
+    }
+
+    while (1) {
+        n = recv(fd, buf.raw, sizeof(buf.raw), 0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+
+        offset = 0;
+        while (offset + sizeof(struct nlmsghdr) <= (size_t)n) {
+            nh = (const struct nlmsghdr*)(buf.raw + offset);
+            if (nh->nlmsg_len < sizeof(struct nlmsghdr) || offset + nh->nlmsg_len > (size_t)n) {
+                break;
+            }
+            if (nh->nlmsg_seq == seq) {
+                if (nh->nlmsg_type == NLMSG_DONE) {
+                    return 0;
+                }
+                if (nh->nlmsg_type == NLMSG_ERROR) {
+                    return EIO;
+                }
+                parse(nh, snap);
+            }
+            offset += NLMSG_ALIGN(nh->nlmsg_len);
+        }
+    }
+}
+
+static int netsnap_route_order(const void* a, const void* b)
+{
+    const NetRoute* ra;
+    const NetRoute* rb;
+
+    ra = (const NetRoute*)a;
+    rb = (const NetRoute*)b;
+    if (ra->dst_len != rb->dst_len) {
+        return rb->dst_len - ra->dst_len;
+    }
+    /* Local routes beat unicast ones of the same length, like the local table */
+    if (ra->local != rb->local) {
+        return rb->local - ra->local;
+    }
+    return ra->priority < rb->priority ? -1 : ra->priority > rb->priority;
+}
+
+/* Make g_snapshot current; called with g_snapshot_mutex held */
+static int netsnap_refresh(void)
+{
+    NetSnapshot fresh;
+    unsigned long address_seq;
+    unsigned long route_seq;
+    int fd;
+    int err;
+
+    pthread_once(&g_netchange_once, netchange_init);
+    if (g_netchange_fd < 0) {
+        return ENETDOWN;
+    }
+
+    pthread_mutex_lock(&g_netchange_mutex);
+    address_seq = g_address_seq;
+    route_seq = g_route_seq;
+    pthread_mutex_unlock(&g_netchange_mutex);
+
+    if (g_snapshot_valid && address_seq == g_snapshot_address_seq &&
+        route_seq == g_snapshot_route_seq) {
+        return 0;
+    }
+
+    fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (fd < 0) {
+        return errno;
+    }
+
+    memset(&fresh, 0, sizeof(fresh));
+    err = netsnap_dump(fd, RTM_GETADDR, 1, &fresh, netsnap_parse_addr);
+    if (err == 0) {
+        err = netsnap_dump(fd, RTM_GETROUTE, 2, &fresh, netsnap_parse_route);
+    }
+    close(fd);
+    if (err != 0) {
+        free(fresh.addrs);
+        free(fresh.routes);
+        return err;
+    }
+
+    if (fresh.route_count > 1) {
+        qsort(fresh.routes, (size_t)fresh.route_count, sizeof(NetRoute), netsnap_route_order);
+    }
+
+    free(g_snapshot.addrs);
+    free(g_snapshot.routes);
+    g_snapshot = fresh;
+    /* A change during the dump moves the counters on, forcing a re-dump */
+    g_snapshot_address_seq = address_seq;
+    g_snapshot_route_seq = route_seq;
+    g_snapshot_valid = 1;
+    return 0;
+}
+
+static socklen_t netsnap_to_sockaddr(const NetAddr* a, struct sockaddr_storage* ss)
+{
+    struct sockaddr_in* sin;
+    struct sockaddr_in6* sin6;
+
+    memset(ss, 0, sizeof(*ss));
+    if (a->family == AF_INET) {
+        sin = (struct sockaddr_in*)ss;
+        sin->sin_family = AF_INET;
+        memcpy(&sin->sin_addr, a->addr, 4);
+        return sizeof(struct sockaddr_in);
+    }
+
+    sin6 = (struct sockaddr_in6*)ss;
+    sin6->sin6_family = AF_INET6;
+    memcpy(&sin6->sin6_addr, a->addr, 16);
+    if (IN6_IS_ADDR_LINKLOCAL(&sin6->sin6_addr)) {
+        sin6->sin6_scope_id = (uint32_t)a->ifindex;
+    }
+    return sizeof(struct sockaddr_in6);
+}
+
+/* Pick the source address for dst over route r; called with the snapshot lock */
+static const NetAddr* netsnap_source(const NetRoute* r, const unsigned char* dst, NetAddr* scratch)
+{
+    const NetAddr* fallback;
+    const NetAddr* a;
+    int alen;
+    int i;
+
+    alen = netsnap_addr_len(r->family);
+    if (r->local) {
+        scratch->family = r->family;
+        scratch->ifindex = r->oif;
+        memcpy(scratch->addr, r->has_prefsrc ? r->prefsrc : dst, (size_t)alen);
+        return scratch;
+    }
+    if (r->has_prefsrc) {
+        scratch->family = r->family;
+        scratch->ifindex = r->oif;
+        memcpy(scratch->addr, r->prefsrc, (size_t)alen);
+        return scratch;
+    }
+
+    /* Otherwise an address on the outgoing interface, preferring one whose
+     * own prefix route covers the destination */
+    fallback = NULL;
+    for (i = 0; i < g_snapshot.addr_count; i++) {
+        a = &g_snapshot.addrs[i];
+        if (a->family != r->family || a->ifindex != r->oif) {
+            continue;
+        }
+        if (fallback == NULL) {
+            fallback = a;
+        }
+        if (r->dst_len > 0 && netsnap_prefix_match(a->addr, dst, r->dst_len)) {
+            return a;
+        }
+    }
+    return fallback;
+}
+
+int wsa_address_list_query(SOCKET s, LPVOID lpvOutBuffer, DWORD cbOutBuffer,
+                           DWORD* lpcbBytesReturned)
+{
+    struct sockaddr_storage local;
+    struct sockaddr_storage ss;
+    LPSOCKET_ADDRESS_LIST list;
+    socklen_t len;
+    size_t needed;
+    size_t offset;
+    int count;
+    int err;
+    int i;
+
+    len = sizeof(local);
+    if (getsockname((int)s, (struct sockaddr*)&local, &len) < 0) {
+        set_wsa_error_from_errno();
+        return SOCKET_ERROR;
+    }
+
+    pthread_mutex_lock(&g_snapshot_mutex);
+    err = netsnap_refresh();
+    if (err != 0) {
+        pthread_mutex_unlock(&g_snapshot_mutex);
+        g_wsa_last_error = errno_to_wsa_error(err);
+        return SOCKET_ERROR;
+    }
+
+    /* Addresses of the socket's own family, laid out after the array */
+    count = 0;
+    needed = 0;
+    for (i = 0; i < g_snapshot.addr_count; i++) {
+        if (g_snapshot.addrs[i].family == local.ss_family) {
+            count++;
+            needed += netsnap_to_sockaddr(&g_snapshot.addrs[i], &ss);
+        }
+    }
+    offset = offsetof(SOCKET_ADDRESS_LIST, Address) + (size_t)count * sizeof(SOCKET_ADDRESS);
+    needed += offset;
+
+    if (lpcbBytesReturned != NULL) {
+        *lpcbBytesReturned = (DWORD)needed;
+    }
+    if (lpvOutBuffer == NULL || cbOutBuffer < needed) {
+        pthread_mutex_unlock(&g_snapshot_mutex);
+        g_wsa_last_error = WSAEFAULT;
+        return SOCKET_ERROR;
+    }
+
+    list = (LPSOCKET_ADDRESS_LIST)lpvOutBuffer;
+    list->iAddressCount = count;
+    count = 0;
+    for (i = 0; i < g_snapshot.addr_count; i++) {
+        if (g_snapshot.addrs[i].family != local.ss_family) {
+            continue;
+        }
+        len = netsnap_to_sockaddr(&g_snapshot.addrs[i], &ss);
+        memcpy((char*)lpvOutBuffer + offset, &ss, len);
+        list->Address[count].lpSockaddr = (LPSOCKADDR)((char*)lpvOutBuffer + offset);
+        list->Address[count].iSockaddrLength = (INT)len;
+        offset += len;
+        count++;
+    }
+    pthread_mutex_unlock(&g_snapshot_mutex);
+
+    g_wsa_last_error = 0;
+    return 0;
+}
+
+int wsa_routing_interface_query(LPVOID lpvInBuffer, DWORD cbInBuffer,
+                                LPVOID lpvOutBuffer, DWORD cbOutBuffer,
+                                DWORD* lpcbBytesReturned)
+{
+    const struct sockaddr* dest;
+    const NetRoute* r;
+    const NetAddr* src;
+    struct sockaddr_storage ss;
+    unsigned char dst[16];
+    NetAddr scratch;
+    socklen_t len;
+    int family;
+    int err;
+    int i;
+
+    dest = (const struct sockaddr*)lpvInBuffer;
+    if (dest == NULL || cbInBuffer < sizeof(struct sockaddr_in)) {
+        g_wsa_last_error = WSAEFAULT;
+        return SOCKET_ERROR;
+    }
+    family = dest->sa_family;
+    if (family == AF_INET) {
+        memcpy(dst, &((const struct sockaddr_in*)dest)->sin_addr, 4);
+    } else if (family == AF_INET6 && cbInBuffer >= sizeof(struct sockaddr_in6)) {
+        memcpy(dst, &((const struct sockaddr_in6*)dest)->sin6_addr, 16);
+    } else {
+        g_wsa_last_error = family == AF_INET6 ? WSAEFAULT : WSAEAFNOSUPPORT;
+        return SOCKET_ERROR;
+    }
+
+    pthread_mutex_lock(&g_snapshot_mutex);
+    err = netsnap_refresh();
+    if (err != 0) {
+        pthread_mutex_unlock(&g_snapshot_mutex);
+        g_wsa_last_error = errno_to_wsa_error(err);
+        return SOCKET_ERROR;
+    }
+
+    src = NULL;
+    for (i = 0; i < g_snapshot.route_count && src == NULL; i++) {
+        r = &g_snapshot.routes[i];
+        if (r->family == family && netsnap_prefix_match(r->dst, dst, r->dst_len)) {
+            memset(&scratch, 0, sizeof(scratch));
+            src = netsnap_source(r, dst, &scratch);
+        }
+    }
+    if (src == NULL) {
+        pthread_mutex_unlock(&g_snapshot_mutex);
+        g_wsa_last_error = WSAENETUNREACH;
+        return SOCKET_ERROR;
+    }
+
+    len = netsnap_to_sockaddr(src, &ss);
+    pthread_mutex_unlock(&g_snapshot_mutex);
+
+    if (lpcbBytesReturned != NULL) {
+        *lpcbBytesReturned = (DWORD)len;
+    }
+    if (lpvOutBuffer == NULL || cbOutBuffer < len) {
+        g_wsa_last_error = WSAEFAULT;
+        return SOCKET_ERROR;
+    }
+    memcpy(lpvOutBuffer, &ss, len);
+
+    g_wsa_last_error = 0;
+    return 0;
+}
+
+#endif /* __linux__ */
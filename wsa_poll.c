@@ -0,0 +1,553 @@
+/*
+ * WSAPoll Implementation
+ * Implements WSAPoll on poll(), with an optional per-thread epoll mode,
+ * and select() over Winsock fd_sets
+ */
+
+#ifdef __linux__
+
+#include "winsock2_api.h"
+#include "wsa_internal.h"
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <limits.h>
+
+/* WSAPOLLFD arrays are handed to the kernel without conversion */
+typedef char wsa_pollfd_layout_check[(sizeof(SOCKET) == sizeof(int) &&
+                                      sizeof(WSAPOLLFD) == 8) ? 1 : -1];
+
+/* ============================================================================
+ * Event Translation
+ * ============================================================================ */
+
+/*
+ * Windows defines POLLIN as POLLRDNORM | POLLRDBAND and POLLOUT as
+ * POLLWRNORM, so callers may test either name. Linux masks revents with
+ * the exact bits requested; the table adds the companion bit back.
+ */
+#define POLL_MIRROR_KEY(ev) ((((ev) & POLLIN)     ? 1 : 0) | \
+                             (((ev) & POLLOUT)    ? 2 : 0) | \
+                             (((ev) & POLLRDNORM) ? 4 : 0) | \
+                             (((ev) & POLLWRNORM) ? 8 : 0))
+
+#define POLL_MIRROR(k) ((short)((((k) & 1) ? POLLRDNORM : 0) | \
+                                (((k) & 2) ? POLLWRNORM : 0) | \
+                                (((k) & 4) ? POLLIN     : 0) | \
+                                (((k) & 8) ? POLLOUT    : 0)))
+
+static const short g_poll_mirror[16] = {
+    POLL_MIRROR(0),  POLL_MIRROR(1),  POLL_MIRROR(2),  POLL_MIRROR(3),
+    POLL_MIRROR(4),  POLL_MIRROR(5),  POLL_MIRROR(6),  POLL_MIRROR(7),
+    POLL_MIRROR(8),  POLL_MIRROR(9),  POLL_MIRROR(10), POLL_MIRROR(11),
+    POLL_MIRROR(12), POLL_MIRROR(13), POLL_MIRROR(14), POLL_MIRROR(15)
+};
+
+#define POLL_REQUEST_MASK (POLLIN | POLLPRI | POLLOUT | POLLRDNORM | \
+                           POLLRDBAND | POLLWRNORM | POLLWRBAND)
+
+/* ============================================================================
+ * Per-Thread epoll State
+ * ============================================================================ */
+
+/* Registration of one descriptor, indexed by fd */
+typedef struct PollSlot {
+    unsigned int stamp;     /* Last call that listed this fd */
+    unsigned int gen;       /* Close generation at registration */
+    ULONG index;            /* Position in that call's array */
+    short events;           /* Registered interest */
+    unsigned char registered;
+} PollSlot;
+
+typedef struct PollState {
+    int mode;
+    int epfd;
+    unsigned int stamp;
+    PollSlot* slots;
+    int slot_count;
+    int* registered;        /* fds currently in epfd */
+    int registered_count;
+    int registered_capacity;
+    struct epoll_event* events;
+    ULONG event_capacity;
+    struct pollfd* pfds;    /* select() conversion buffer */
+    unsigned int pfd_capacity;
+} PollState;
+
+#define POLL_FALLBACK (-2)
+
+static __thread PollState* t_poll_state = NULL;
+static pthread_key_t g_poll_key;
+static pthread_once_t g_poll_key_once = PTHREAD_ONCE_INIT;
+
+static void poll_state_reset(PollState* st)
+{
+    if (st->epfd >= 0) {
+        close(st->epfd);
+        st->epfd = -1;
+    }
+    free(st->slots);
+    free(st->registered);
+    free(st->events);
+    free(st->pfds);
+    st->slots = NULL;
+    st->slot_count = 0;
+    st->registered = NULL;
+    st->registered_count = 0;
+    st->registered_capacity = 0;
+    st->events = NULL;
+    st->event_capacity = 0;
+    st->pfds = NULL;
+    st->pfd_capacity = 0;
+    st->stamp = 0;
+}
+
+static void poll_state_destroy(void* arg)
+{
+    PollState* st;
+
+    st = (PollState*)arg;
+    poll_state_reset(st);
+    free(st);
+}
+
+static void poll_key_init(void)
+{
+    pthread_key_create(&g_poll_key, poll_state_destroy);
+}
+
+static PollState* poll_state_get(void)
+{
+    PollState* st;
+
+    if (t_poll_state != NULL) {
+        return t_poll_state;
+    }
+
+    pthread_once(&g_poll_key_once, poll_key_init);
+
+    st = (PollState*)calloc(1, sizeof(PollState));
+    if (st == NULL) {
+        return NULL;
+    }
+    st->mode = WSA_POLL_MODE_POLL;
+    st->epfd = -1;
+    pthread_setspecific(g_poll_key, st);
+    t_poll_state = st;
+    return st;
+}
+
+static int poll_grow_slots(PollState* st, int fd)
+{
+    PollSlot* slots;
+    int count;
+
+    count = st->slot_count > 0 ? st->slot_count : 64;
+    while (count <= fd) {
+        count *= 2;
+    }
+
+    slots = (PollSlot*)realloc(st->slots, (size_t)count * sizeof(PollSlot));
+    if (slots == NULL) {
+        return -1;
+    }
+    memset(slots + st->slot_count, 0, (size_t)(count - st->slot_count) * sizeof(PollSlot));
+    st->slots = slots;
+    st->slot_count = count;
+    return 0;
+}
+
+/* Start a new call; slots stamped with the returned value belong to it */
+static void poll_next_stamp(PollState* st)
+{
+    int k;
+
+    if (++st->stamp == 0) {
+        /* Stamp wrapped: forget old stamps so none look current */
+        for (k = 0; k < st->slot_count; k++) {
+            st->slots[k].stamp = 0;
+        }
+        st->stamp = 1;
+    }
+}
+
+static int poll_track(PollState* st, int fd)
+{
+    int* list;
+    int capacity;
+
+    if (st->registered_count == st->registered_capacity) {
+        capacity = st->registered_capacity > 0 ? st->registered_capacity * 2 : 64;
+        list = (int*)realloc(st->registered, (size_t)capacity * sizeof(int));
+        if (list == NULL) {
+            return -1;
+        }
+        st->registered = list;
+        st->registered_capacity = capacity;
+    }
+    st->registered[st->registered_count++] = fd;
+    return 0;
+}
+
+/* Bring epfd in line with fdArray; returns entries flagged POLLNVAL */
+static int poll_sync_registrations(PollState* st, LPWSAPOLLFD fdArray, ULONG fds)
+{
+    struct epoll_event ev;
+    PollSlot* slot;
+    unsigned int gen;
+    short want;
+    int invalid;
+    int fd;
+    int op;
+    int r;
+    ULONG i;
+    int j;
+
+    invalid = 0;
+
+    for (i = 0; i < fds; i++) {
+        fd = (int)fdArray[i].fd;
+        fdArray[i].revents = 0;
+        if (fd < 0) {
+            continue;
+        }
+
+        if (fd >= st->slot_count && poll_grow_slots(st, fd) < 0) {
+            return POLL_FALLBACK;
+        }
+        slot = &st->slots[fd];
+
+        /* The same descriptor twice cannot be told apart in epoll results */
+        if (slot->stamp == st->stamp) {
+            return POLL_FALLBACK;
+        }
+        slot->stamp = st->stamp;
+        slot->index = i;
+
+        want = (short)(fdArray[i].events & POLL_REQUEST_MASK);
+        gen = wsa_close_generation(fd);
+        if (slot->registered && slot->gen == gen && slot->events == want) {
+            continue;
+        }
+
+        memset(&ev, 0, sizeof(ev));
+        ev.events = (unsigned short)want;
+        ev.data.fd = fd;
+
+        op = (slot->registered && slot->gen == gen) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        r = epoll_ctl(st->epfd, op, fd, &ev);
+        if (r < 0 && op == EPOLL_CTL_ADD && errno == EEXIST) {
+            r = epoll_ctl(st->epfd, EPOLL_CTL_MOD, fd, &ev);
+        } else if (r < 0 && op == EPOLL_CTL_MOD && errno == ENOENT) {
+            r = epoll_ctl(st->epfd, EPOLL_CTL_ADD, fd, &ev);
+        }
+
+        if (r < 0) {
+            if (errno != EBADF) {
+                /* Regular files and the like cannot be watched by epoll */
+                return POLL_FALLBACK;
+            }
+            /* Closed without closesocket(); clear the stamp so it is pruned */
+            fdArray[i].revents = POLLNVAL;
+            invalid++;
+            slot->stamp = 0;
+            continue;
+        }
+
+        if (!slot->registered) {
+            if (poll_track(st, fd) < 0) {
+                epoll_ctl(st->epfd, EPOLL_CTL_DEL, fd, NULL);
+                return POLL_FALLBACK;
+            }
+            slot->registered = 1;
+        }
+        slot->events = want;
+        slot->gen = gen;
+    }
+
+    /* Drop descriptors that were not listed in this call */
+    for (j = 0; j < st->registered_count; ) {
+        fd = st->registered[j];
+        if (st->slots[fd].stamp == st->stamp) {
+            j++;
+            continue;
+        }
+        epoll_ctl(st->epfd, EPOLL_CTL_DEL, fd, NULL);
+        st->slots[fd].registered = 0;
+        st->registered[j] = st->registered[--st->registered_count];
+    }
+
+    return invalid;
+}
+
+static int poll_with_epoll(PollState* st, LPWSAPOLLFD fdArray, ULONG fds, INT timeout)
+{
+    struct epoll_event* events;
+    int invalid;
+    int n;
+    int k;
+
+    if (st->epfd < 0) {
+        st->epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (st->epfd < 0) {
+            return POLL_FALLBACK;
+        }
+    }
+
+    if (st->event_capacity < fds) {
+        events = (struct epoll_event*)realloc(st->events, fds * sizeof(struct epoll_event));
+        if (events == NULL) {
+            return POLL_FALLBACK;
+        }
+        st->events = events;
+        st->event_capacity = fds;
+    }
+
+    poll_next_stamp(st);
+
+    invalid = poll_sync_registrations(st, fdArray, fds);
+    if (invalid < 0) {
+        return invalid;
+    }
+
+    n = epoll_wait(st->epfd, st->events,
+                   fds > (ULONG)INT_MAX ? INT_MAX : (int)fds,
+                   invalid > 0 ? 0 : timeout);
+    if (n < 0) {
+        return -1;
+    }
+
+    for (k = 0; k < n; k++) {
+        fdArray[st->slots[st->events[k].data.fd].index].revents =
+            (short)(st->events[k].events & 0xffff);
+    }
+
+    return n + invalid;
+}
+
+/* ============================================================================
+ * WSAPoll
+ * ============================================================================ */
+
+int WSAAPI WSAPoll(LPWSAPOLLFD fdArray, ULONG fds, INT timeout)
+{
+    PollState* st;
+    int result;
+    ULONG i;
+    WSA_STATS_SCOPE(WSAPoll);
+
+    if (fdArray == NULL && fds > 0) {
+        g_wsa_last_error = WSAEFAULT;
+        return SOCKET_ERROR;
+    }
+
+    result = POLL_FALLBACK;
+    st = t_poll_state;
+    if (st != NULL && st->mode == WSA_POLL_MODE_EPOLL && fds > 0) {
+        result = poll_with_epoll(st, fdArray, fds, timeout);
+    }
+    if (result == POLL_FALLBACK) {
+        result = poll(fdArray, (nfds_t)fds, timeout);
+    }
+
+    if (result < 0) {
+        set_wsa_error_from_errno();
+        return SOCKET_ERROR;
+    }
+
+    if (result > 0) {
+        for (i = 0; i < fds; i++) {
+            fdArray[i].revents |= g_poll_mirror[POLL_MIRROR_KEY(fdArray[i].revents)];
+        }
+    }
+
+    g_wsa_last_error = 0;
+    return result;
+}
+
+/*
+ * Select how WSAPoll works on the calling thread. The epoll mode keeps
+ * registrations between calls, so a call costs one epoll_wait plus one
+ * epoll_ctl per changed entry instead of a kernel scan of every entry.
+ * It relies on closesocket() to notice reused descriptor numbers.
+ */
+int WSAAPI WSASetPollMode(DWORD dwMode)
+{
+    PollState* st;
+
+    if (dwMode != WSA_POLL_MODE_POLL && dwMode != WSA_POLL_MODE_EPOLL) {
+        g_wsa_last_error = WSAEINVAL;
+        return SOCKET_ERROR;
+    }
+
+    st = poll_state_get();
+    if (st == NULL) {
+        g_wsa_last_error = WSA_NOT_ENOUGH_MEMORY;
+        return SOCKET_ERROR;
+    }
+
+    if (dwMode == WSA_POLL_MODE_POLL) {
+        poll_state_reset(st);
+    }
+    st->mode = (int)dwMode;
+
+    g_wsa_last_error = 0;
+    return 0;
+}
+
+/* ============================================================================
+ * select() over Winsock fd_sets
+ * ============================================================================ */
+
+/* Add every socket of set to the pollfd buffer, merging repeats */
+static int select_collect(PollState* st, fd_set* set, short events, unsigned int* count)
+{
+    PollSlot* slot;
+    unsigned int i;
+    int fd;
+
+    if (set == NULL) {
+        return 0;
+    }
+
+    for (i = 0; i < set->fd_count; i++) {
+        fd = (int)set->fd_array[i];
+        if (fd < 0) {
+            return -1;
+        }
+        if (fd >= st->slot_count && poll_grow_slots(st, fd) < 0) {
+            return -1;
+        }
+        slot = &st->slots[fd];
+        if (slot->stamp == st->stamp) {
+            st->pfds[slot->index].events |= events;
+            continue;
+        }
+        slot->stamp = st->stamp;
+        slot->index = *count;
+        st->pfds[*count].fd = fd;
+        st->pfds[*count].events = events;
+        st->pfds[*count].revents = 0;
+        (*count)++;
+    }
+    return 0;
+}
+
+/* Keep only the sockets whose revents match ready; returns how many remain */
+static int select_filter(PollState* st, fd_set* set, short ready, short unless)
+{
+    short revents;
+    unsigned int i;
+    unsigned int kept;
+
+    if (set == NULL) {
+        return 0;
+    }
+
+    kept = 0;
+    for (i = 0; i < set->fd_count; i++) {
+        revents = st->pfds[st->slots[set->fd_array[i]].index].revents;
+        if ((revents & ready) && !(revents & unless)) {
+            set->fd_array[kept++] = set->fd_array[i];
+        }
+    }
+    set->fd_count = kept;
+    return (int)kept;
+}
+
+/*
+ * The sets are converted to one pollfd array held per thread, so a call
+ * costs O(sockets in the sets) however high the descriptor numbers are.
+ * Readiness follows Windows: closed or reset connections are readable,
+ * and a failed connect shows up in exceptfds rather than writefds.
+ */
+int WSAAPI WSASelect(int nfds, fd_set* readfds, fd_set* writefds,
+                     fd_set* exceptfds, const struct timeval* timeout)
+{
+    PollState* st;
+    struct pollfd* pfds;
+    struct timespec ts;
+    unsigned int total;
+    unsigned int count;
+    unsigned int i;
+    int result;
+    WSA_STATS_SCOPE(WSASelect);
+
+    (void)nfds; /* Ignored, as on Windows */
+
+    total = (readfds != NULL ? readfds->fd_count : 0) +
+            (writefds != NULL ? writefds->fd_count : 0) +
+            (exceptfds != NULL ? exceptfds->fd_count : 0);
+    if (total == 0) {
+        g_wsa_last_error = WSAEINVAL;
+        return SOCKET_ERROR;
+    }
+
+    if (timeout != NULL && (timeout->tv_sec < 0 || timeout->tv_usec < 0)) {
+        g_wsa_last_error = WSAEINVAL;
+        return SOCKET_ERROR;
+    }
+
+    st = poll_state_get();
+    if (st == NULL) {
+        g_wsa_last_error = WSAENOBUFS;
+        return SOCKET_ERROR;
+    }
+
+    if (st->pfd_capacity < total) {
+        pfds = (struct pollfd*)realloc(st->pfds, total * sizeof(struct pollfd));
+        if (pfds == NULL) {
+            g_wsa_last_error = WSAENOBUFS;
+            return SOCKET_ERROR;
+        }
+        st->pfds = pfds;
+        st->pfd_capacity = total;
+    }
+
+    poll_next_stamp(st);
+    count = 0;
+    if (select_collect(st, readfds, POLLIN, &count) < 0 ||
+        select_collect(st, writefds, POLLOUT, &count) < 0 ||
+        select_collect(st, exceptfds, POLLPRI, &count) < 0) {
+        g_wsa_last_error = WSAENOTSOCK;
+        return SOCKET_ERROR;
+    }
+
+    if (timeout != NULL) {
+        ts.tv_sec = timeout->tv_sec + timeout->tv_usec / 1000000;
+        ts.tv_nsec = (timeout->tv_usec % 1000000) * 1000;
+    }
+
+    result = ppoll(st->pfds, (nfds_t)count, timeout != NULL ? &ts : NULL, NULL);
+    if (result < 0) {
+        set_wsa_error_from_errno();
+        return SOCKET_ERROR;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (st->pfds[i].revents & POLLNVAL) {
+            g_wsa_last_error = WSAENOTSOCK;
+            return SOCKET_ERROR;
+        }
+    }
+
+    result = select_filter(st, readfds, POLLIN | POLLHUP | POLLERR, 0) +
+             select_filter(st, writefds, POLLOUT, POLLERR) +
+             select_filter(st, exceptfds, POLLPRI | POLLERR, 0);
+
+    g_wsa_last_error = 0;
+    return result;
+}
+
+int WSAAPI __WSAFDIsSet(SOCKET fd, fd_set* set)
+{
+    unsigned int i;
+
+    for (i = 0; i < set->fd_count; i++) {
+        if (set->fd_array[i] == fd) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+#endif /* __linux__ */
@@ -0,0 +1,252 @@
+/*
+ * Record Pools for Winsock Wrapper
+ * Thread-caching slab allocator behind the per-operation records (event
+ * objects, EventSelect maps, async lookup requests, deferred accepts,
+ * network change requests) and the iovec arrays of the scatter/gather
+ * calls
+ */
+
+#ifdef __linux__
+
+#include "winsock2_api.h"
+#include "wsa_internal.h"
+#include "wsa_pool.h"
+
+#define POOL_MAX           16       /* Pools with a thread cache */
+#define POOL_BATCH         32       /* Objects moved to or from the shared list at once */
+#define POOL_CACHE_MAX     (2 * POOL_BATCH)
+#define POOL_SLAB_OBJECTS  32
+#define POOL_ALIGN         16
+
+static WSAPool g_iov_pool = WSA_POOL_INITIALIZER("iovec", WSA_IOV_POOLED * sizeof(struct iovec));
+
+#ifndef WSA_NO_POOL
+
+typedef struct PoolObject {
+    struct PoolObject* next;
+} PoolObject;
+
+typedef struct PoolCache {
+    PoolObject* head;
+    unsigned int count;
+} PoolCache;
+
+static __thread PoolCache t_pool_cache[POOL_MAX];
+static __thread int t_pool_registered = 0;
+
+static WSAPool* g_pools[POOL_MAX];
+static int g_pool_count = 0;
+static pthread_mutex_t g_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t g_pool_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_pool_key;
+
+/* ============================================================================
+ * Thread Caches
+ * ============================================================================ */
+
+/* Hand the first n cached objects back to the shared list */
+static void pool_flush(WSAPool* pool, PoolCache* cache, unsigned int n)
+{
+    PoolObject* first;
+    PoolObject* last;
+    unsigned int i;
+
+    if (n == 0 || cache->head == NULL) {
+        return;
+    }
+    first = cache->head;
+    last = first;
+    for (i = 1; i < n && last->next != NULL; i++) {
+        last = last->next;
+    }
+    cache->head = last->next;
+    cache->count -= i;
+
+    pthread_mutex_lock(&pool->mutex);
+    last->next = (PoolObject*)pool->free_list;
+    pool->free_list = first;
+    pool->free_count += i;
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+/* Thread exit: everything cached goes back for other threads to use */
+static void pool_thread_exit(void* arg)
+{
+    int count;
+    int i;
+
+    (void)arg;
+    t_pool_registered = 0;
+    count = __atomic_load_n(&g_pool_count, __ATOMIC_ACQUIRE);
+    for (i = 0; i < count; i++) {
+        pool_flush(g_pools[i], &t_pool_cache[i], t_pool_cache[i].count);
+    }
+}
+
+static void pool_key_init(void)
+{
+    pthread_key_create(&g_pool_key, pool_thread_exit);
+}
+
+/* Cache of pool for the calling thread, or NULL when every slot is taken */
+static PoolCache* pool_cache(WSAPool* pool)
+{
+    int id;
+
+    id = __atomic_load_n(&pool->id, __ATOMIC_ACQUIRE);
+    if (id < 0) {
+        pthread_mutex_lock(&g_pool_mutex);
+        if (pool->id < 0 && g_pool_count < POOL_MAX) {
+            g_pools[g_pool_count] = pool;
+            __atomic_store_n(&pool->id, g_pool_count, __ATOMIC_RELEASE);
+            __atomic_store_n(&g_pool_count, g_pool_count + 1, __ATOMIC_RELEASE);
+        }
+        id = pool->id;
+        pthread_mutex_unlock(&g_pool_mutex);
+        if (id < 0) {
+            return NULL;
+        }
+    }
+
+    /* A non-NULL key value is what makes the destructor run */
+    if (!t_pool_registered) {
+        pthread_once(&g_pool_key_once, pool_key_init);
+        pthread_setspecific(g_pool_key, (void*)1);
+        t_pool_registered = 1;
+    }
+    return &t_pool_cache[id];
+}
+
+/* Take a batch from the shared list, carving a new slab when it is empty */
+static int pool_refill(WSAPool* pool, PoolCache* cache)
+{
+    PoolObject* obj;
+    size_t stride;
+    char* slab;
+    void* mem;
+    int i;
+
+    pthread_mutex_lock(&pool->mutex);
+    for (i = 0; i < POOL_BATCH && pool->free_list != NULL; i++) {
+        obj = (PoolObject*)pool->free_list;
+        pool->free_list = obj->next;
+        obj->next = cache->head;
+        cache->head = obj;
+    }
+    pool->free_count -= (unsigned long)i;
+    if (i > 0) {
+        pthread_mutex_unlock(&pool->mutex);
+        cache->count += (unsigned int)i;
+        return 0;
+    }
+
+    stride = (pool->size + POOL_ALIGN - 1) & ~(size_t)(POOL_ALIGN - 1);
+    if (stride < sizeof(PoolObject)) {
+        stride = POOL_ALIGN;
+    }
+    if (posix_memalign(&mem, WSA_CACHE_LINE, stride * POOL_SLAB_OBJECTS) != 0) {
+        pthread_mutex_unlock(&pool->mutex);
+        return -1;
+    }
+    pool->slab_objects += POOL_SLAB_OBJECTS;
+    pthread_mutex_unlock(&pool->mutex);
+
+    /* Push in reverse so the cache hands out the slab front to back */
+    slab = (char*)mem;
+    for (i = POOL_SLAB_OBJECTS - 1; i >= 0; i--) {
+        obj = (PoolObject*)(slab + (size_t)i * stride);
+        obj->next = cache->head;
+        cache->head = obj;
+    }
+    cache->count += POOL_SLAB_OBJECTS;
+    return 0;
+}
+
+/* ============================================================================
+ * Allocation
+ * ============================================================================ */
+
+void* wsa_pool_alloc(WSAPool* pool)
+{
+    PoolCache* cache;
+    PoolObject* obj;
+
+    cache = pool_cache(pool);
+    if (cache == NULL) {
+        return malloc(pool->size);
+    }
+    if (cache->head == NULL && pool_refill(pool, cache) < 0) {
+        return NULL;
+    }
+    obj = cache->head;
+    cache->head = obj->next;
+    cache->count--;
+    return obj;
+}
+
+void wsa_pool_free(WSAPool* pool, void* object)
+{
+    PoolCache* cache;
+    PoolObject* obj;
+
+    if (object == NULL) {
+        return;
+    }
+    cache = pool_cache(pool);
+    if (cache == NULL) {
+        free(object);
+        return;
+    }
+    obj = (PoolObject*)object;
+    obj->next = cache->head;
+    cache->head = obj;
+    if (++cache->count > POOL_CACHE_MAX) {
+        pool_flush(pool, cache, POOL_BATCH);
+    }
+}
+
+#else
+
+void* wsa_pool_alloc(WSAPool* pool)
+{
+    return malloc(pool->size);
+}
+
+void wsa_pool_free(WSAPool* pool, void* object)
+{
+    (void)pool;
+    free(object);
+}
+
+#endif /* WSA_NO_POOL */
+
+void* wsa_pool_calloc(WSAPool* pool)
+{
+    void* object;
+
+    object = wsa_pool_alloc(pool);
+    if (object != NULL) {
+        memset(object, 0, pool->size);
+    }
+    return object;
+}
+
+/* Arrays longer than WSA_IOV_POOLED are rare enough to leave to malloc */
+struct iovec* wsa_iov_alloc(DWORD count)
+{
+    if (count <= WSA_IOV_POOLED) {
+        return (struct iovec*)wsa_pool_alloc(&g_iov_pool);
+    }
+    return (struct iovec*)malloc(count * sizeof(struct iovec));
+}
+
+void wsa_iov_free(struct iovec* iov, DWORD count)
+{
+    if (count <= WSA_IOV_POOLED) {
+        wsa_pool_free(&g_iov_pool, iov);
+    } else {
+        free(iov);
+    }
+}
+
+#endif /* __linux__ */
@@ -0,0 +1,44 @@
+/*
+ * Winsock Wrapper Record Pools
+ * Fixed-size allocator for the library's internal records. Kept apart
+ * from wsa_internal.h so the Winsock 1.1 sources, built on winsock.h,
+ * can use it too
+ */
+
+#ifndef _WSA_POOL_H
+#define _WSA_POOL_H
+
+#ifdef __linux__
+
+#include <pthread.h>
+#include <stddef.h>
+
+/*
+ * One pool per record type. Each thread keeps a free list per pool and
+ * trades objects with the shared list in batches, so a steady stream of
+ * allocations and frees stays on the thread and off the heap. Objects
+ * are carved from slabs that are never returned to the system. Define
+ * as a static with WSA_POOL_INITIALIZER; build with POOL=0
+ * (WSA_NO_POOL) to use malloc/free instead, e.g. under a sanitizer.
+ */
+typedef struct WSAPool {
+    const char* name;
+    size_t size;
+    int id;                     /* Thread cache slot, assigned on first use */
+    pthread_mutex_t mutex;
+    void* free_list;            /* Shared objects, linked through their first word */
+    unsigned long free_count;
+    unsigned long slab_objects; /* Carved so far */
+} WSAPool;
+
+#define WSA_POOL_INITIALIZER(name, size) \
+    { (name), (size), -1, PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0 }
+
+/* Contents are undefined on return, as with malloc() */
+void* wsa_pool_alloc(WSAPool* pool);
+void* wsa_pool_calloc(WSAPool* pool);
+void wsa_pool_free(WSAPool* pool, void* object);
+
+#endif /* __linux__ */
+
+#endif /* _WSA_POOL_H */
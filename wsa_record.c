@@ -0,0 +1,394 @@
+/*
+ * Call Recorder for Winsock Wrapper
+ * Socket lifecycle and send/receive calls appended to a per-thread ring
+ * without locks and written to a binary trace by a background thread;
+ * replay_winsock re-drives a trace against loopback
+ */
+
+#ifdef __linux__
+
+#include "winsock2_api.h"
+#include "wsa_internal.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <time.h>
+
+#define RECORD_RING_SIZE  8192      /* Records per thread, a power of two */
+#define RECORD_FLUSH_MS   10
+
+/*
+ * Single producer (the owning thread) and single consumer (the flusher):
+ * the owner fills entries and publishes head, the flusher writes them
+ * out and publishes tail. A full ring drops the record.
+ */
+typedef struct RecordRing {
+    WSATRACERECORD entries[RECORD_RING_SIZE];
+    unsigned int head __attribute__((aligned(WSA_CACHE_LINE)));
+    unsigned int tail __attribute__((aligned(WSA_CACHE_LINE)));
+    unsigned long long dropped;
+    int orphaned;                   /* Owner exited; freed once drained */
+    unsigned short thread;
+    struct RecordRing* next;
+} RecordRing;
+
+#define RECORD_NAME(name) #name,
+static const char* const g_record_names[WSA_STAT_COUNT] = {
+    WSA_STATS_FUNCTIONS(RECORD_NAME)
+};
+#undef RECORD_NAME
+
+int g_wsa_recording = 0;
+
+static __thread RecordRing* t_record_ring = NULL;
+static pthread_mutex_t g_record_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t g_record_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_record_key;
+static RecordRing* g_record_rings = NULL;
+static unsigned short g_record_threads = 0;
+static int g_record_fd = -1;
+static long long g_record_epoch = 0;        /* wsa_record_now() at start */
+static unsigned long long g_record_dropped = 0;  /* From rings already freed */
+static pthread_t g_record_flusher;
+static int g_record_stop = 0;
+
+long long wsa_record_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* ============================================================================
+ * Per-Thread Rings
+ * ============================================================================ */
+
+/* Free the rings of exited threads; called with g_record_mutex held */
+static void record_free_orphans(void)
+{
+    RecordRing** link;
+    RecordRing* ring;
+
+    link = &g_record_rings;
+    while ((ring = *link) != NULL) {
+        if (__atomic_load_n(&ring->orphaned, __ATOMIC_ACQUIRE)) {
+            g_record_dropped += ring->dropped;
+            *link = ring->next;
+            free(ring);
+            continue;
+        }
+        link = &ring->next;
+    }
+}
+
+static void record_thread_exit(void* arg)
+{
+    RecordRing* ring;
+
+    ring = (RecordRing*)arg;
+    t_record_ring = NULL;
+    pthread_mutex_lock(&g_record_mutex);
+    __atomic_store_n(&ring->orphaned, 1, __ATOMIC_RELEASE);
+    /* No recording, so no flusher to drain and free it */
+    if (g_record_fd < 0) {
+        record_free_orphans();
+    }
+    pthread_mutex_unlock(&g_record_mutex);
+}
+
+static void record_key_init(void)
+{
+    pthread_key_create(&g_record_key, record_thread_exit);
+}
+
+static RecordRing* record_ring_create(void)
+{
+    RecordRing* ring;
+    void* mem;
+
+    pthread_once(&g_record_key_once, record_key_init);
+    if (posix_memalign(&mem, WSA_CACHE_LINE, sizeof(RecordRing)) != 0) {
+        return NULL;
+    }
+    ring = (RecordRing*)mem;
+    memset(ring, 0, sizeof(*ring));
+
+    pthread_mutex_lock(&g_record_mutex);
+    ring->thread = g_record_threads++;
+    ring->next = g_record_rings;
+    g_record_rings = ring;
+    pthread_mutex_unlock(&g_record_mutex);
+
+    pthread_setspecific(g_record_key, ring);
+    t_record_ring = ring;
+    return ring;
+}
+
+static inline unsigned int record_clamp(long long value)
+{
+    if (value < 0) {
+        return 0;
+    }
+    return value > 0xFFFFFFFFLL ? 0xFFFFFFFFu : (unsigned int)value;
+}
+
+void wsa_record_call(int function, SOCKET s, long long size, long long result,
+                     long long start)
+{
+    RecordRing* ring;
+    WSATRACERECORD* e;
+    unsigned int head;
+    long long offset;
+    long long now;
+    int saved_errno;
+
+    saved_errno = errno;
+    now = wsa_record_now();
+
+    ring = t_record_ring;
+    if (ring == NULL) {
+        ring = record_ring_create();
+        if (ring == NULL) {
+            errno = saved_errno;
+            return;
+        }
+    }
+
+    head = ring->head;
+    if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= RECORD_RING_SIZE) {
+        __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+        errno = saved_errno;
+        return;
+    }
+
+    e = &ring->entries[head & (RECORD_RING_SIZE - 1)];
+    offset = start - __atomic_load_n(&g_record_epoch, __ATOMIC_RELAXED);
+    e->ullTimestampNs = offset > 0 ? (ULONGLONG)offset : 0;
+    e->dwDurationNs = record_clamp(now - start);
+    e->wFunction = (WORD)function;
+    e->wThread = ring->thread;
+    e->iSocket = (INT)s;
+    e->iError = result < 0 ? errno_to_wsa_error(saved_errno) : 0;
+    e->dwSize = record_clamp(size);
+    e->iResult = result < 0 ? -1 : (INT)(result > 0x7FFFFFFFLL ? 0x7FFFFFFFLL : result);
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+    errno = saved_errno;
+}
+
+void wsa_record_io(int function, SOCKET s, const WSABUF* buffers, DWORD count,
+                   long long result, long long start)
+{
+    long long size;
+    DWORD i;
+
+    size = 0;
+    for (i = 0; buffers != NULL && i < count; i++) {
+        size += buffers[i].len;
+    }
+    wsa_record_call(function, s, size, result, start);
+}
+
+/* ============================================================================
+ * Flusher
+ * ============================================================================ */
+
+static int record_write(const void* data, size_t len)
+{
+    const char* p;
+    ssize_t n;
+
+    p = (const char*)data;
+    while (len > 0) {
+        n = write(g_record_fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/* Write out what every ring holds and free drained rings of exited threads */
+static void record_drain(void)
+{
+    RecordRing** link;
+    RecordRing* ring;
+    unsigned int head;
+    unsigned int tail;
+    unsigned int first;
+    unsigned int n;
+
+    pthread_mutex_lock(&g_record_mutex);
+    link = &g_record_rings;
+    while ((ring = *link) != NULL) {
+        /* Read orphaned first: a ring seen orphaned has no more writes */
+        if (__atomic_load_n(&ring->orphaned, __ATOMIC_ACQUIRE)) {
+            head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+            tail = ring->tail;
+            if (head == tail) {
+                g_record_dropped += ring->dropped;
+                *link = ring->next;
+                free(ring);
+                continue;
+            }
+        }
+        head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        tail = ring->tail;
+        while (tail != head) {
+            first = tail & (RECORD_RING_SIZE - 1);
+            n = head - tail;
+            if (n > RECORD_RING_SIZE - first) {
+                n = RECORD_RING_SIZE - first;
+            }
+            if (g_record_fd >= 0) {
+                record_write(&ring->entries[first], n * sizeof(WSATRACERECORD));
+            }
+            tail += n;
+        }
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+        link = &ring->next;
+    }
+    pthread_mutex_unlock(&g_record_mutex);
+}
+
+static void* record_flush_thread(void* arg)
+{
+    struct timespec interval;
+
+    (void)arg;
+    interval.tv_sec = 0;
+    interval.tv_nsec = RECORD_FLUSH_MS * 1000000L;
+    while (!__atomic_load_n(&g_record_stop, __ATOMIC_ACQUIRE)) {
+        nanosleep(&interval, NULL);
+        record_drain();
+    }
+    record_drain();
+    return NULL;
+}
+
+/* ============================================================================
+ * Control
+ * ============================================================================ */
+
+int WSAAPI WSAStartRecording(const char* pszPath)
+{
+    WSATRACEHEADER header;
+    char name[WSA_TRACE_NAME_LEN];
+    struct timespec ts;
+    RecordRing* ring;
+    int i;
+
+    if (pszPath == NULL) {
+        g_wsa_last_error = WSAEFAULT;
+        return SOCKET_ERROR;
+    }
+
+    pthread_mutex_lock(&g_record_mutex);
+    if (g_record_fd >= 0) {
+        pthread_mutex_unlock(&g_record_mutex);
+        g_wsa_last_error = WSAEALREADY;
+        return SOCKET_ERROR;
+    }
+    g_record_fd = open(pszPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (g_record_fd < 0) {
+        pthread_mutex_unlock(&g_record_mutex);
+        set_wsa_error_from_errno();
+        return SOCKET_ERROR;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    memset(&header, 0, sizeof(header));
+    memcpy(header.szMagic, WSA_TRACE_MAGIC, sizeof(header.szMagic));
+    header.dwVersion = WSA_TRACE_VERSION;
+    header.dwRecordSize = sizeof(WSATRACERECORD);
+    header.dwFunctionCount = WSA_STAT_COUNT;
+    header.ullStartTimeNs = (ULONGLONG)ts.tv_sec * 1000000000ULL + (ULONGLONG)ts.tv_nsec;
+    record_write(&header, sizeof(header));
+    for (i = 0; i < WSA_STAT_COUNT; i++) {
+        memset(name, 0, sizeof(name));
+        strncpy(name, g_record_names[i], sizeof(name) - 1);
+        record_write(name, sizeof(name));
+    }
+
+    /* Late records of a previous recording are not part of this one */
+    for (ring = g_record_rings; ring != NULL; ring = ring->next) {
+        __atomic_store_n(&ring->tail, __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE),
+                         __ATOMIC_RELEASE);
+        __atomic_store_n(&ring->dropped, 0, __ATOMIC_RELAXED);
+    }
+    g_record_dropped = 0;
+    g_record_stop = 0;
+    __atomic_store_n(&g_record_epoch, wsa_record_now(), __ATOMIC_RELAXED);
+
+    if (pthread_create(&g_record_flusher, NULL, record_flush_thread, NULL) != 0) {
+        close(g_record_fd);
+        g_record_fd = -1;
+        pthread_mutex_unlock(&g_record_mutex);
+        g_wsa_last_error = WSAENOBUFS;
+        return SOCKET_ERROR;
+    }
+    __atomic_store_n(&g_wsa_recording, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&g_record_mutex);
+
+    g_wsa_last_error = 0;
+    return 0;
+}
+WSA_HIDDEN_DEF(WSAStartRecording);
+
+int WSAAPI WSAStopRecording(void)
+{
+    RecordRing* ring;
+    ULONGLONG dropped;
+
+    pthread_mutex_lock(&g_record_mutex);
+    if (g_record_fd < 0 || g_record_stop) {
+        pthread_mutex_unlock(&g_record_mutex);
+        g_wsa_last_error = WSAEINVAL;
+        return SOCKET_ERROR;
+    }
+    __atomic_store_n(&g_wsa_recording, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&g_record_stop, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&g_record_mutex);
+
+    pthread_join(g_record_flusher, NULL);
+
+    pthread_mutex_lock(&g_record_mutex);
+    dropped = g_record_dropped;
+    for (ring = g_record_rings; ring != NULL; ring = ring->next) {
+        dropped += __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+    }
+    pwrite(g_record_fd, &dropped, sizeof(dropped), offsetof(WSATRACEHEADER, ullDropped));
+    /* Threads that exited after the final drain left their rings behind */
+    record_free_orphans();
+    close(g_record_fd);
+    g_record_fd = -1;
+    pthread_mutex_unlock(&g_record_mutex);
+
+    g_wsa_last_error = 0;
+    return 0;
+}
+WSA_HIDDEN_DEF(WSAStopRecording);
+
+/* WSA_RECORD=<path> records from load until exit */
+static void record_atexit(void)
+{
+    WSAStopRecording_internal();
+}
+
+__attribute__((constructor))
+static void record_init(void)
+{
+    const char* path;
+
+    path = getenv("WSA_RECORD");
+    if (path != NULL && path[0] != '\0' && WSAStartRecording_internal(path) == 0) {
+        atexit(record_atexit);
+    }
+}
+
+#endif /* __linux__ */
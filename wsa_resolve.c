@@ -0,0 +1,530 @@
+/*
+ * Batch Name Resolution Functions
+ * Implements GetNameInfoBatchA/W with de-duplication, a bounded worker pool
+ * and a reverse-lookup cache
+ */
+
+#ifdef __linux__
+
+#include "winsock2_api.h"
+#include "ws2tcpip.h"
+#include "wsa_internal.h"
+#include <pthread.h>
+#include <wchar.h>
+#include <time.h>
+
+/* Cache geometry: direct-mapped, names longer than the slot are not cached */
+#define NAMEINFO_CACHE_SLOTS    4096
+#define NAMEINFO_CACHE_NAMELEN  256
+
+#define NAMEINFO_DEFAULT_POSITIVE_TTL   300
+#define NAMEINFO_DEFAULT_NEGATIVE_TTL   30
+#define NAMEINFO_DEFAULT_MAX_WORKERS    16
+#define NAMEINFO_MAX_WORKERS_LIMIT      256
+
+/* Largest batch; keeps the de-duplication table size within a DWORD */
+#define NAMEINFO_BATCH_MAX              (1u << 24)
+
+/* Flags that change the result of a reverse lookup */
+#define NAMEINFO_KEY_FLAGS (NI_NOFQDN | NI_NAMEREQD)
+
+/* Lookup key: address, scope and the result-affecting flags */
+typedef struct NameInfoKey {
+    int family;
+    int flags;
+    uint32_t scope_id;
+    unsigned char addr[16];
+} NameInfoKey;
+
+typedef struct NameInfoCacheEntry {
+    NameInfoKey key;
+    time_t expires;
+    int result;
+    int valid;
+    char name[NAMEINFO_CACHE_NAMELEN];
+} NameInfoCacheEntry;
+
+/* One unique address of a batch */
+typedef struct NameInfoJob {
+    NameInfoKey key;
+    const struct sockaddr* sa;
+    socklen_t salen;
+    int result;
+    int cached;
+    char name[NI_MAXHOST];
+} NameInfoJob;
+
+typedef struct NameInfoWork {
+    NameInfoJob* jobs;
+    DWORD* pending;
+    DWORD pending_count;
+    DWORD next;
+    DWORD max_workers;
+    int flags;
+    pthread_mutex_t mutex;
+} NameInfoWork;
+
+static NameInfoCacheEntry* g_nameinfo_cache = NULL;
+static pthread_mutex_t g_nameinfo_mutex = PTHREAD_MUTEX_INITIALIZER;
+static DWORD g_nameinfo_positive_ttl = NAMEINFO_DEFAULT_POSITIVE_TTL;
+static DWORD g_nameinfo_negative_ttl = NAMEINFO_DEFAULT_NEGATIVE_TTL;
+static DWORD g_nameinfo_max_workers = NAMEINFO_DEFAULT_MAX_WORKERS;
+
+/* ============================================================================
+ * Key and Cache Helpers
+ * ============================================================================ */
+
+static time_t monotonic_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+static int make_key(const struct sockaddr* sa, socklen_t salen, int flags,
+                    NameInfoKey* key)
+{
+    memset(key, 0, sizeof(*key));
+    key->flags = flags & NAMEINFO_KEY_FLAGS;
+
+    if (sa->sa_family == AF_INET && salen >= (socklen_t)sizeof(struct sockaddr_in)) {
+        const struct sockaddr_in* sin;
+        sin = (const struct sockaddr_in*)sa;
+        key->family = AF_INET;
+        memcpy(key->addr, &sin->sin_addr, 4);
+        return 0;
+    }
+
+    if (sa->sa_family == AF_INET6 && salen >= (socklen_t)sizeof(struct sockaddr_in6)) {
+        const struct sockaddr_in6* sin6;
+        sin6 = (const struct sockaddr_in6*)sa;
+        key->family = AF_INET6;
+        key->scope_id = sin6->sin6_scope_id;
+        memcpy(key->addr, &sin6->sin6_addr, 16);
+        return 0;
+    }
+
+    return -1;
+}
+
+static uint32_t hash_key(const NameInfoKey* key)
+{
+    const unsigned char* p;
+    uint32_t h;
+    size_t i;
+
+    /* FNV-1a */
+    p = (const unsigned char*)key;
+    h = 2166136261u;
+    for (i = 0; i < sizeof(*key); i++) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* Caller holds g_nameinfo_mutex */
+static int cache_lookup(const NameInfoKey* key, time_t now, NameInfoJob* job)
+{
+    NameInfoCacheEntry* entry;
+
+    if (g_nameinfo_cache == NULL) {
+        return 0;
+    }
+
+    entry = &g_nameinfo_cache[hash_key(key) & (NAMEINFO_CACHE_SLOTS - 1)];
+    if (!entry->valid || entry->expires <= now ||
+        memcmp(&entry->key, key, sizeof(*key)) != 0) {
+        return 0;
+    }
+
+    job->result = entry->result;
+    memcpy(job->name, entry->name, strlen(entry->name) + 1);
+    return 1;
+}
+
+/* Caller holds g_nameinfo_mutex */
+static void cache_store(const NameInfoJob* job, time_t now)
+{
+    NameInfoCacheEntry* entry;
+    DWORD ttl;
+    size_t len;
+
+    if (g_nameinfo_cache == NULL) {
+        g_nameinfo_cache = (NameInfoCacheEntry*)calloc(NAMEINFO_CACHE_SLOTS,
+                                                       sizeof(NameInfoCacheEntry));
+        if (g_nameinfo_cache == NULL) {
+            return;
+        }
+    }
+
+    /* Only cache answers and authoritative misses, not transient failures */
+    if (job->result != 0 && job->result != EAI_NONAME) {
+        return;
+    }
+
+    ttl = job->result == 0 ? g_nameinfo_positive_ttl : g_nameinfo_negative_ttl;
+    if (ttl == 0) {
+        return;
+    }
+
+    len = job->result == 0 ? strlen(job->name) : 0;
+    if (len >= NAMEINFO_CACHE_NAMELEN) {
+        return;
+    }
+
+    entry = &g_nameinfo_cache[hash_key(&job->key) & (NAMEINFO_CACHE_SLOTS - 1)];
+    entry->key = job->key;
+    entry->expires = now + (time_t)ttl;
+    entry->result = job->result;
+    memcpy(entry->name, job->name, len);
+    entry->name[len] = '\0';
+    entry->valid = 1;
+}
+
+/* ============================================================================
+ * Worker Pool
+ * ============================================================================ */
+
+static void* nameinfo_worker_thread(void* arg)
+{
+    NameInfoWork* work;
+    NameInfoJob* job;
+    DWORD idx;
+
+    work = (NameInfoWork*)arg;
+
+    while (1) {
+        pthread_mutex_lock(&work->mutex);
+        idx = work->next++;
+        pthread_mutex_unlock(&work->mutex);
+
+        if (idx >= work->pending_count) {
+            break;
+        }
+
+        job = &work->jobs[work->pending[idx]];
+        WSA_PROBE1(nameinfo__start, job);
+        job->result = getnameinfo(job->sa, job->salen, job->name, sizeof(job->name),
+                                  NULL, 0, work->flags);
+        WSA_PROBE2(nameinfo__done, job, job->result);
+        if (job->result != 0) {
+            job->name[0] = '\0';
+        }
+    }
+
+    return NULL;
+}
+
+/* Resolve every job that missed the cache with at most max_workers threads */
+static void run_workers(NameInfoWork* work)
+{
+    pthread_t threads[NAMEINFO_MAX_WORKERS_LIMIT];
+    DWORD nthreads;
+    DWORD started;
+    DWORD i;
+
+    nthreads = work->max_workers;
+    if (nthreads > work->pending_count) {
+        nthreads = work->pending_count;
+    }
+
+    /* The calling thread is always one of the workers */
+    started = 0;
+    for (i = 1; i < nthreads; i++) {
+        if (pthread_create(&threads[started], NULL, nameinfo_worker_thread, work) != 0) {
+            break;
+        }
+        started++;
+    }
+
+    nameinfo_worker_thread(work);
+
+    for (i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+/*
+ * Core of the batch API: de-duplicate, answer from cache, resolve the rest,
+ * then hand each input its job index through job_of.
+ */
+static int resolve_batch(const SOCKADDR_STORAGE* lpAddresses, DWORD dwCount,
+                         INT Flags, NameInfoJob** jobs_out, DWORD** job_of_out)
+{
+    NameInfoJob* jobs;
+    DWORD* job_of;
+    DWORD* table;
+    DWORD* pending;
+    DWORD table_size;
+    DWORD njobs;
+    DWORD npending;
+    NameInfoWork work;
+    time_t now;
+    DWORD i;
+
+    table_size = 16;
+    while (table_size < dwCount * 2) {
+        table_size <<= 1;
+    }
+
+    jobs = (NameInfoJob*)malloc(dwCount * sizeof(NameInfoJob));
+    job_of = (DWORD*)malloc(dwCount * sizeof(DWORD));
+    pending = (DWORD*)malloc(dwCount * sizeof(DWORD));
+    table = (DWORD*)malloc(table_size * sizeof(DWORD));
+    if (jobs == NULL || job_of == NULL || pending == NULL || table == NULL) {
+        free(jobs);
+        free(job_of);
+        free(pending);
+        free(table);
+        return WSA_NOT_ENOUGH_MEMORY;
+    }
+
+    /* De-duplicate through an open-addressing table of job indices */
+    memset(table, 0xFF, table_size * sizeof(DWORD));
+    njobs = 0;
+
+    for (i = 0; i < dwCount; i++) {
+        const struct sockaddr* sa;
+        NameInfoKey key;
+        DWORD slot;
+
+        sa = (const struct sockaddr*)&lpAddresses[i];
+        if (make_key(sa, sizeof(lpAddresses[i]), Flags, &key) != 0) {
+            /* Unsupported family: resolve on its own so the error is per entry */
+            memset(&key, 0, sizeof(key));
+            key.family = -1 - (int)i;
+        }
+
+        slot = hash_key(&key) & (table_size - 1);
+        while (table[slot] != (DWORD)-1 &&
+               memcmp(&jobs[table[slot]].key, &key, sizeof(key)) != 0) {
+            slot = (slot + 1) & (table_size - 1);
+        }
+
+        if (table[slot] == (DWORD)-1) {
+            table[slot] = njobs;
+            jobs[njobs].key = key;
+            jobs[njobs].sa = sa;
+            jobs[njobs].salen = sizeof(lpAddresses[i]);
+            jobs[njobs].cached = 0;
+            jobs[njobs].result = 0;
+            jobs[njobs].name[0] = '\0';
+            njobs++;
+        }
+        job_of[i] = table[slot];
+    }
+
+    free(table);
+
+    /* Answer what we can from the cache */
+    now = monotonic_seconds();
+    npending = 0;
+
+    pthread_mutex_lock(&g_nameinfo_mutex);
+    work.max_workers = g_nameinfo_max_workers;
+    for (i = 0; i < njobs; i++) {
+        if (jobs[i].key.family > 0 && cache_lookup(&jobs[i].key, now, &jobs[i])) {
+            jobs[i].cached = 1;
+        } else {
+            pending[npending++] = i;
+        }
+    }
+    pthread_mutex_unlock(&g_nameinfo_mutex);
+
+    if (npending > 0) {
+        work.jobs = jobs;
+        work.pending = pending;
+        work.pending_count = npending;
+        work.next = 0;
+        work.flags = Flags;
+        pthread_mutex_init(&work.mutex, NULL);
+
+        run_workers(&work);
+
+        pthread_mutex_destroy(&work.mutex);
+
+        now = monotonic_seconds();
+        pthread_mutex_lock(&g_nameinfo_mutex);
+        for (i = 0; i < npending; i++) {
+            if (jobs[pending[i]].key.family > 0) {
+                cache_store(&jobs[pending[i]], now);
+            }
+        }
+        pthread_mutex_unlock(&g_nameinfo_mutex);
+    }
+
+    free(pending);
+
+    *jobs_out = jobs;
+    *job_of_out = job_of;
+    return 0;
+}
+
+/* ============================================================================
+ * Batch Reverse Lookup API
+ * ============================================================================ */
+
+int WSAAPI GetNameInfoBatchA(const SOCKADDR_STORAGE* lpAddresses, DWORD dwCount,
+                             char* pNodeBuffers, DWORD NodeBufferSize,
+                             INT Flags, INT* lpiResults)
+{
+    NameInfoJob* jobs;
+    DWORD* job_of;
+    int resolved;
+    int error;
+    DWORD i;
+
+    if (lpAddresses == NULL || pNodeBuffers == NULL || NodeBufferSize == 0) {
+        g_wsa_last_error = WSAEFAULT;
+        return SOCKET_ERROR;
+    }
+
+    if (dwCount > NAMEINFO_BATCH_MAX) {
+        g_wsa_last_error = WSAEINVAL;
+        return SOCKET_ERROR;
+    }
+    if (dwCount == 0) {
+        g_wsa_last_error = 0;
+        return 0;
+    }
+
+    /* Numeric lookups never touch DNS: no pool, no cache */
+    if (Flags & NI_NUMERICHOST) {
+        resolved = 0;
+        for (i = 0; i < dwCount; i++) {
+            char* node;
+            int result;
+            node = pNodeBuffers + (size_t)i * NodeBufferSize;
+            result = getnameinfo((const struct sockaddr*)&lpAddresses[i],
+                                 sizeof(lpAddresses[i]), node, NodeBufferSize,
+                                 NULL, 0, Flags);
+            if (result != 0) {
+                node[0] = '\0';
+            } else {
+                resolved++;
+            }
+            if (lpiResults != NULL) {
+                lpiResults[i] = result;
+            }
+        }
+        g_wsa_last_error = 0;
+        return resolved;
+    }
+
+    error = resolve_batch(lpAddresses, dwCount, Flags, &jobs, &job_of);
+    if (error != 0) {
+        g_wsa_last_error = error;
+        return SOCKET_ERROR;
+    }
+
+    resolved = 0;
+    for (i = 0; i < dwCount; i++) {
+        NameInfoJob* job;
+        char* node;
+        int result;
+        size_t len;
+
+        job = &jobs[job_of[i]];
+        node = pNodeBuffers + (size_t)i * NodeBufferSize;
+        result = job->result;
+
+        if (result == 0) {
+            len = strlen(job->name);
+            if (len >= NodeBufferSize) {
+                result = EAI_OVERFLOW;
+            } else {
+                memcpy(node, job->name, len + 1);
+                resolved++;
+            }
+        }
+
+        if (result != 0) {
+            node[0] = '\0';
+        }
+        if (lpiResults != NULL) {
+            lpiResults[i] = result;
+        }
+    }
+
+    free(jobs);
+    free(job_of);
+
+    g_wsa_last_error = 0;
+    return resolved;
+}
+WSA_HIDDEN_DEF(GetNameInfoBatchA);
+
+int WSAAPI GetNameInfoBatchW(const SOCKADDR_STORAGE* lpAddresses, DWORD dwCount,
+                             wchar_t* pNodeBuffers, DWORD NodeBufferSize,
+                             INT Flags, INT* lpiResults)
+{
+    char* narrow;
+    int resolved;
+    DWORD i;
+
+    if (lpAddresses == NULL || pNodeBuffers == NULL || NodeBufferSize == 0) {
+        g_wsa_last_error = WSAEFAULT;
+        return SOCKET_ERROR;
+    }
+    if (dwCount > NAMEINFO_BATCH_MAX) {
+        g_wsa_last_error = WSAEINVAL;
+        return SOCKET_ERROR;
+    }
+
+    narrow = (char*)malloc((size_t)dwCount * NodeBufferSize + 1);
+    if (narrow == NULL) {
+        g_wsa_last_error = WSA_NOT_ENOUGH_MEMORY;
+        return SOCKET_ERROR;
+    }
+
+    resolved = GetNameInfoBatchA_internal(lpAddresses, dwCount, narrow, NodeBufferSize,
+                                          Flags, lpiResults);
+    if (resolved == SOCKET_ERROR) {
+        free(narrow);
+        return SOCKET_ERROR;
+    }
+
+    /* Convert to wide strings */
+    for (i = 0; i < dwCount; i++) {
+        wchar_t* node;
+        node = pNodeBuffers + (size_t)i * NodeBufferSize;
+        if (mbstowcs(node, narrow + (size_t)i * NodeBufferSize, NodeBufferSize) == (size_t)-1) {
+            node[0] = L'\0';
+        }
+    }
+
+    free(narrow);
+
+    g_wsa_last_error = 0;
+    return resolved;
+}
+
+int WSAAPI WSASetNameInfoCacheParams(DWORD dwPositiveTtl, DWORD dwNegativeTtl,
+                                     DWORD dwMaxWorkers)
+{
+    if (dwMaxWorkers == 0 || dwMaxWorkers > NAMEINFO_MAX_WORKERS_LIMIT) {
+        g_wsa_last_error = WSAEINVAL;
+        return SOCKET_ERROR;
+    }
+
+    pthread_mutex_lock(&g_nameinfo_mutex);
+    g_nameinfo_positive_ttl = dwPositiveTtl;
+    g_nameinfo_negative_ttl = dwNegativeTtl;
+    g_nameinfo_max_workers = dwMaxWorkers;
+    pthread_mutex_unlock(&g_nameinfo_mutex);
+
+    g_wsa_last_error = 0;
+    return 0;
+}
+
+void WSAAPI WSAFlushNameInfoCache(void)
+{
+    pthread_mutex_lock(&g_nameinfo_mutex);
+    if (g_nameinfo_cache != NULL) {
+        memset(g_nameinfo_cache, 0, NAMEINFO_CACHE_SLOTS * sizeof(NameInfoCacheEntry));
+    }
+    pthread_mutex_unlock(&g_nameinfo_mutex);
+}
+
+#endif /* __linux__ */
@@ -0,0 +1,610 @@
+/*
+ * Accept Sharding for Winsock Wrapper
+ * Spreads one listening SOCKET over SO_REUSEPORT listeners, one per CPU,
+ * with a reuseport BPF program steering each connection to the listener
+ * of the CPU that received it
+ */
+
+#ifdef __linux__
+
+#include "winsock2_api.h"
+#include "wsa_internal.h"
+#include "mstcpip.h"
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <linux/filter.h>
+
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#define SO_ATTACH_REUSEPORT_CBPF 51
+#endif
+
+#ifndef EPOLLEXCLUSIVE
+#define EPOLLEXCLUSIVE (1u << 28)
+#endif
+
+#define SHARD_MAX 256
+#define SHARD_WAIT_MS 10            /* Longest sleep before a blocked thread looks again */
+
+/* ============================================================================
+ * Shard Groups
+ * ============================================================================ */
+
+/*
+ * The application's socket is shard 0; the other shards are hidden
+ * listeners created on the first accept, once the socket is bound and
+ * listening. From then on every shard is non-blocking: the caller's
+ * FIONBIO mode moves to WSA_OPT_NONBLOCKING in the socket record and
+ * wsa_listener_accept does the blocking. A group is referenced by the
+ * table and by every thread inside wsa_listener_accept.
+ *
+ * A blocked thread sleeps on the epoll set of its own CPU's shard. Every
+ * shard is also in steal_epfd, watched by at most one thread at a time
+ * (the stealer). Both registrations are EPOLLEXCLUSIVE, the shard's own
+ * set first, so a connection wakes one thread of its shard and reaches
+ * the stealer only when that shard has no thread waiting.
+ */
+typedef struct ShardGroup {
+    SOCKET s;
+    int count;                  /* Shards requested, including shard 0 */
+    int ready;                  /* Shards created; fds[0..started) valid */
+    int started;                /* Listeners in fds, including shard 0 */
+    int closed;                 /* Set by closesocket */
+    int refs;
+    int stealing;               /* A thread is waiting on steal_epfd */
+    int steal_epfd;             /* Every shard; -1 until started */
+    pthread_mutex_t start_mutex;
+    struct ShardGroup* next;
+    int fds[SHARD_MAX];         /* fds[0] is s */
+    int epfds[SHARD_MAX];       /* epfds[i] watches fds[i] alone */
+} ShardGroup;
+
+static ShardGroup* g_shard_groups = NULL;
+static int g_shard_group_count = 0;
+static pthread_rwlock_t g_shard_lock = PTHREAD_RWLOCK_INITIALIZER;
+static pthread_once_t g_shard_once = PTHREAD_ONCE_INIT;
+
+static void shard_release(ShardGroup* group)
+{
+    int i;
+
+    if (__atomic_sub_fetch(&group->refs, 1, __ATOMIC_ACQ_REL) != 0) {
+        return;
+    }
+    for (i = 1; i < group->started; i++) {
+        close(group->fds[i]);
+    }
+    if (group->steal_epfd >= 0) {
+        for (i = 0; i < group->count; i++) {
+            close(group->epfds[i]);
+        }
+        close(group->steal_epfd);
+    }
+    pthread_mutex_destroy(&group->start_mutex);
+    free(group);
+}
+
+static ShardGroup* shard_acquire(SOCKET s)
+{
+    ShardGroup* group;
+
+    /* Listeners without shards never touch the lock */
+    if (__atomic_load_n(&g_shard_group_count, __ATOMIC_ACQUIRE) == 0) {
+        return NULL;
+    }
+
+    pthread_rwlock_rdlock(&g_shard_lock);
+    for (group = g_shard_groups; group != NULL; group = group->next) {
+        if (group->s == s) {
+            __atomic_add_fetch(&group->refs, 1, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+    pthread_rwlock_unlock(&g_shard_lock);
+    return group;
+}
+
+/* closesocket() hook: stop the hidden shards and wake threads waiting on them */
+static void shard_on_close(SOCKET s)
+{
+    ShardGroup** link;
+    ShardGroup* group;
+    int i;
+
+    if (__atomic_load_n(&g_shard_group_count, __ATOMIC_ACQUIRE) == 0) {
+        return;
+    }
+
+    group = NULL;
+    pthread_rwlock_wrlock(&g_shard_lock);
+    for (link = &g_shard_groups; *link != NULL; link = &(*link)->next) {
+        if ((*link)->s == s) {
+            group = *link;
+            *link = group->next;
+            __atomic_sub_fetch(&g_shard_group_count, 1, __ATOMIC_RELEASE);
+            break;
+        }
+    }
+    pthread_rwlock_unlock(&g_shard_lock);
+
+    if (group == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&group->start_mutex);
+    __atomic_store_n(&group->closed, 1, __ATOMIC_RELEASE);
+    for (i = 1; i < group->started; i++) {
+        shutdown(group->fds[i], SHUT_RDWR);
+    }
+    pthread_mutex_unlock(&group->start_mutex);
+
+    shard_release(group);
+}
+
+static void shard_init(void)
+{
+    wsa_add_close_hook(shard_on_close);
+}
+
+/* Reuseport program: pick listener (receiving CPU % count) of the group */
+static void shard_attach_steering(int fd, int count)
+{
+    struct sock_filter code[3] = {
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, (__u32)(SKF_AD_OFF + SKF_AD_CPU)),
+        BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, (__u32)count),
+        BPF_STMT(BPF_RET | BPF_A, 0)
+    };
+    struct sock_fprog prog;
+
+    prog.len = 3;
+    prog.filter = code;
+
+    /* Without it the kernel hashes connections across the group instead */
+    setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog));
+}
+
+/* Give a new shard the socket filter (e.g. SIO_ACCEPT_DENYLIST) of shard 0 */
+static void shard_copy_filter(int from, int to)
+{
+    struct sock_filter* code;
+    struct sock_fprog prog;
+    socklen_t count;
+
+    /* SO_GET_FILTER lengths count instructions, not bytes */
+    count = 0;
+    if (getsockopt(from, SOL_SOCKET, SO_GET_FILTER, NULL, &count) < 0 || count == 0) {
+        return;
+    }
+    code = (struct sock_filter*)calloc(count, sizeof(struct sock_filter));
+    if (code == NULL) {
+        return;
+    }
+    if (getsockopt(from, SOL_SOCKET, SO_GET_FILTER, code, &count) == 0) {
+        prog.len = (unsigned short)count;
+        prog.filter = code;
+        setsockopt(to, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog));
+    }
+    free(code);
+}
+
+/* Backlog given to listen() on fd; TCP_INFO reports it for a listener */
+static int shard_backlog(int fd)
+{
+    struct tcp_info info;
+    socklen_t len;
+
+    memset(&info, 0, sizeof(info));
+    len = sizeof(info);
+    if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len) < 0 ||
+        info.tcpi_state != TCP_LISTEN) {
+        return SOMAXCONN;
+    }
+    return (int)info.tcpi_sacked;
+}
+
+/* Wake one waiter per connection on fd; kernels before 4.5 wake them all */
+static int shard_watch(int epfd, int fd, int index)
+{
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+    ev.data.u32 = (__u32)index;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == 0) {
+        return 0;
+    }
+    ev.events = EPOLLIN;
+    return epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+/* One epoll set per shard plus steal_epfd; all or none */
+static int shard_create_epolls(ShardGroup* group)
+{
+    int i;
+
+    group->steal_epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (group->steal_epfd < 0) {
+        return -1;
+    }
+    for (i = 0; i < group->count; i++) {
+        group->epfds[i] = epoll_create1(EPOLL_CLOEXEC);
+        if (group->epfds[i] < 0) {
+            while (--i >= 0) {
+                close(group->epfds[i]);
+            }
+            close(group->steal_epfd);
+            group->steal_epfd = -1;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Create shards 1..count-1 on the address of the listening socket. They
+ * join the reuseport group in listen() order, which is the index the
+ * steering program returns. Called with start_mutex held; a socket that
+ * is not listening yet is left alone so accept() reports the error.
+ */
+static void shard_start(ShardGroup* group)
+{
+    struct sockaddr_storage addr;
+    WSASocketRecord* rec;
+    socklen_t len;
+    socklen_t optlen;
+    int domain;
+    int listening;
+    int backlog;
+    int v6only;
+    int flags;
+    int one;
+    int fd;
+    int i;
+
+    listening = 0;
+    optlen = sizeof(int);
+    if (getsockopt((int)group->s, SOL_SOCKET, SO_ACCEPTCONN, &listening, &optlen) < 0 ||
+        !listening) {
+        return;
+    }
+
+    domain = AF_INET;
+    wsa_socket_info(group->s, &domain, NULL, NULL);
+    v6only = 0;
+    optlen = sizeof(int);
+    if (domain == AF_INET6) {
+        getsockopt((int)group->s, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, &optlen);
+    }
+    len = sizeof(addr);
+    rec = wsa_socket_record(group->s);
+    flags = fcntl((int)group->s, F_GETFL);
+    if (getsockname((int)group->s, (struct sockaddr*)&addr, &len) < 0 ||
+        rec == NULL || flags < 0 || shard_create_epolls(group) < 0 ||
+        shard_watch(group->epfds[0], (int)group->s, 0) < 0 ||
+        shard_watch(group->steal_epfd, (int)group->s, 0) < 0 ||
+        fcntl((int)group->s, F_SETFL, flags | O_NONBLOCK) < 0) {
+        __atomic_store_n(&group->ready, 1, __ATOMIC_RELEASE);
+        return;
+    }
+    backlog = shard_backlog((int)group->s);
+
+    one = 1;
+    for (i = 1; i < group->count; i++) {
+        fd = socket(domain, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+        if (fd < 0) {
+            break;
+        }
+        if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0 ||
+            (domain == AF_INET6 &&
+             setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only)) < 0) ||
+            bind(fd, (struct sockaddr*)&addr, len) < 0 ||
+            listen(fd, backlog) < 0 ||
+            shard_watch(group->epfds[i], fd, i) < 0 ||
+            shard_watch(group->steal_epfd, fd, i) < 0) {
+            close(fd);
+            break;
+        }
+        shard_copy_filter((int)group->s, fd);
+        group->fds[i] = fd;
+        group->started = i + 1;
+    }
+
+    if (group->started > 1) {
+        shard_attach_steering((int)group->s, group->started);
+        if (flags & O_NONBLOCK) {
+            __atomic_or_fetch(&rec->opt_flags, WSA_OPT_NONBLOCKING, __ATOMIC_ACQ_REL);
+        } else {
+            __atomic_and_fetch(&rec->opt_flags, ~WSA_OPT_NONBLOCKING, __ATOMIC_ACQ_REL);
+        }
+    } else {
+        /* No hidden shards: plain accept() on s in the caller's mode */
+        fcntl((int)group->s, F_SETFL, flags);
+    }
+    __atomic_store_n(&group->ready, 1, __ATOMIC_RELEASE);
+}
+
+/* ============================================================================
+ * Accept
+ * ============================================================================ */
+
+/* Non-blocking accept on shard i; 0 on EAGAIN, -1 with errno on failure */
+static int shard_try_accept(ShardGroup* group, int i, struct sockaddr* addr,
+                            socklen_t* addrlen, socklen_t len)
+{
+    int fd;
+
+    if (addrlen != NULL) {
+        *addrlen = len;
+    }
+    fd = accept(group->fds[i], addr, addrlen);
+    if (fd >= 0) {
+        return fd;
+    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNABORTED) {
+        return 0;
+    }
+    return -1;
+}
+
+int wsa_listener_accept(SOCKET s, struct sockaddr* addr, socklen_t* addrlen)
+{
+    ShardGroup* group;
+    WSASocketRecord* rec;
+    struct epoll_event ev;
+    socklen_t len;
+    int count;
+    int home;
+    int cpu;
+    int fd;
+    int n;
+
+    group = shard_acquire(s);
+    if (group == NULL) {
+        return accept((int)s, addr, addrlen);
+    }
+
+    if (!__atomic_load_n(&group->ready, __ATOMIC_ACQUIRE)) {
+        pthread_mutex_lock(&group->start_mutex);
+        if (!group->ready && !group->closed) {
+            shard_start(group);
+        }
+        pthread_mutex_unlock(&group->start_mutex);
+    }
+    count = group->started;
+    if (count <= 1) {
+        shard_release(group);
+        return accept((int)s, addr, addrlen);
+    }
+
+    /* The shard the steering program picks for this CPU */
+    rec = wsa_socket_record(s);
+    cpu = sched_getcpu();
+    home = cpu > 0 ? cpu % count : 0;
+    len = addrlen != NULL ? *addrlen : 0;
+
+    for (;;) {
+        fd = shard_try_accept(group, home, addr, addrlen, len);
+        if (fd != 0) {
+            break;
+        }
+
+        /* A connection on a shard nobody waits on; one syscall, no scan */
+        n = epoll_wait(group->steal_epfd, &ev, 1, 0);
+        if (n > 0 && ev.data.u32 < (__u32)count) {
+            fd = shard_try_accept(group, (int)ev.data.u32, addr, addrlen, len);
+            if (fd != 0) {
+                break;
+            }
+        }
+
+        if (__atomic_load_n(&group->closed, __ATOMIC_ACQUIRE)) {
+            errno = ENOTSOCK;
+            fd = -1;
+            break;
+        }
+        if (rec == NULL ||
+            (__atomic_load_n(&rec->opt_flags, __ATOMIC_ACQUIRE) & WSA_OPT_NONBLOCKING)) {
+            errno = EWOULDBLOCK;
+            fd = -1;
+            break;
+        }
+
+        /* Sleep on the home shard, or cover every shard if no one else does */
+        if (!__atomic_exchange_n(&group->stealing, 1, __ATOMIC_ACQ_REL)) {
+            n = epoll_wait(group->steal_epfd, &ev, 1, SHARD_WAIT_MS);
+            __atomic_store_n(&group->stealing, 0, __ATOMIC_RELEASE);
+            if (n > 0 && ev.data.u32 < (__u32)count) {
+                fd = shard_try_accept(group, (int)ev.data.u32, addr, addrlen, len);
+                if (fd != 0) {
+                    break;
+                }
+            }
+        } else {
+            n = epoll_wait(group->epfds[home], &ev, 1, SHARD_WAIT_MS);
+        }
+        if (n < 0) {
+            fd = -1;
+            break;
+        }
+    }
+
+    shard_release(group);
+    return fd;
+}
+
+/* Apply a socket option to s and, for a sharded listener, to every shard */
+int wsa_listener_setsockopt(SOCKET s, int level, int optname,
+                            const void* optval, socklen_t optlen)
+{
+    ShardGroup* group;
+    int i;
+
+    if (setsockopt((int)s, level, optname, optval, optlen) < 0) {
+        return -1;
+    }
+
+    group = shard_acquire(s);
+    if (group == NULL) {
+        return 0;
+    }
+    pthread_mutex_lock(&group->start_mutex);
+    for (i = 1; i < group->started; i++) {
+        setsockopt(group->fds[i], level, optname, optval, optlen);
+    }
+    pthread_mutex_unlock(&group->start_mutex);
+    shard_release(group);
+    return 0;
+}
+
+int wsa_listener_sharded(SOCKET s)
+{
+    ShardGroup* group;
+
+    group = shard_acquire(s);
+    if (group == NULL) {
+        return 0;
+    }
+    shard_release(group);
+    return 1;
+}
+
+/* Once the shards run, FIONBIO changes only the mode wsa_listener_accept emulates */
+int wsa_listener_fionbio(SOCKET s, const unsigned long* argp)
+{
+    ShardGroup* group;
+    WSASocketRecord* rec;
+    int handled;
+
+    group = shard_acquire(s);
+    if (group == NULL) {
+        return 0;
+    }
+    pthread_mutex_lock(&group->start_mutex);
+    handled = group->started > 1;
+    rec = wsa_socket_record(s);
+    if (handled && rec != NULL) {
+        if (*argp != 0) {
+            __atomic_or_fetch(&rec->opt_flags, WSA_OPT_NONBLOCKING, __ATOMIC_ACQ_REL);
+        } else {
+            __atomic_and_fetch(&rec->opt_flags, ~WSA_OPT_NONBLOCKING, __ATOMIC_ACQ_REL);
+        }
+    }
+    pthread_mutex_unlock(&group->start_mutex);
+    shard_release(group);
+    return handled;
+}
+
+/* ============================================================================
+ * SIO_ACCEPT_SHARDS
+ * ============================================================================ */
+
+/* Input is a DWORD shard count; 0 means one per online CPU */
+int wsa_accept_shards_ioctl(SOCKET s, LPVOID lpvInBuffer, DWORD cbInBuffer)
+{
+    struct sockaddr_storage addr;
+    socklen_t len;
+    ShardGroup* group;
+    ShardGroup* existing;
+    long event_select;
+    long async_select;
+    long cpus;
+    DWORD count;
+    int type;
+    int domain;
+    int reuseport;
+    int bound;
+    int one;
+
+    if (lpvInBuffer == NULL || cbInBuffer < sizeof(DWORD)) {
+        g_wsa_last_error = WSAEFAULT;
+        return SOCKET_ERROR;
+    }
+
+    if (wsa_socket_info(s, &domain, &type, NULL) < 0) {
+        set_wsa_error_from_errno();
+        return SOCKET_ERROR;
+    }
+    if (type != SOCK_STREAM || (domain != AF_INET && domain != AF_INET6)) {
+        g_wsa_last_error = WSAEOPNOTSUPP;
+        return SOCKET_ERROR;
+    }
+
+    /* FD_ACCEPT is raised by s alone, so it would miss the other shards */
+    wsa_select_masks(s, &event_select, &async_select);
+    if (event_select != 0 || async_select != 0) {
+        g_wsa_last_error = WSAEINVAL;
+        return SOCKET_ERROR;
+    }
+
+    /* The shards can only share the port if SO_REUSEPORT was set before bind */
+    len = sizeof(addr);
+    if (getsockname((int)s, (struct sockaddr*)&addr, &len) < 0) {
+        set_wsa_error_from_errno();
+        return SOCKET_ERROR;
+    }
+    bound = domain == AF_INET ?
+            ((struct sockaddr_in*)&addr)->sin_port != 0 :
+            ((struct sockaddr_in6*)&addr)->sin6_port != 0;
+    reuseport = 0;
+    len = sizeof(int);
+    getsockopt((int)s, SOL_SOCKET, SO_REUSEPORT, &reuseport, &len);
+    if (bound && !reuseport) {
+        g_wsa_last_error = WSAEINVAL;
+        return SOCKET_ERROR;
+    }
+
+    count = *(const DWORD*)lpvInBuffer;
+    if (count == 0) {
+        cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        count = cpus > 0 ? (DWORD)cpus : 1;
+    }
+    if (count > SHARD_MAX) {
+        count = SHARD_MAX;
+    }
+
+    one = 1;
+    if (setsockopt((int)s, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0) {
+        set_wsa_error_from_errno();
+        return SOCKET_ERROR;
+    }
+
+    group = (ShardGroup*)calloc(1, sizeof(ShardGroup));
+    if (group == NULL) {
+        g_wsa_last_error = WSAENOBUFS;
+        return SOCKET_ERROR;
+    }
+    group->s = s;
+    group->count = (int)count;
+    group->started = 1;
+    group->refs = 1;
+    group->steal_epfd = -1;
+    group->fds[0] = (int)s;
+    pthread_mutex_init(&group->start_mutex, NULL);
+
+    pthread_once(&g_shard_once, shard_init);
+
+    pthread_rwlock_wrlock(&g_shard_lock);
+    for (existing = g_shard_groups; existing != NULL; existing = existing->next) {
+        if (existing->s == s) {
+            break;
+        }
+    }
+    if (existing == NULL) {
+        group->next = g_shard_groups;
+        g_shard_groups = group;
+        __atomic_add_fetch(&g_shard_group_count, 1, __ATOMIC_RELEASE);
+    }
+    pthread_rwlock_unlock(&g_shard_lock);
+
+    if (existing != NULL) {
+        pthread_mutex_destroy(&group->start_mutex);
+        free(group);
+        g_wsa_last_error = WSAEINVAL;
+        return SOCKET_ERROR;
+    }
+
+    g_wsa_last_error = 0;
+    return 0;
+}
+
+#endif /* __linux__ */
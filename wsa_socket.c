@@ -0,0 +1,226 @@
+/*
+ * Socket Table for Winsock Wrapper
+ * One cache-line-aligned record per descriptor holding the state every
+ * module keeps about a SOCKET, with the close generation that tells a
+ * reused descriptor from the socket that used to own it
+ */
+
+#ifdef __linux__
+
+#include "winsock2_api.h"
+#include "wsa_internal.h"
+#include <pthread.h>
+
+/*
+ * Records live in pages allocated on first use and never freed, so a
+ * record pointer stays valid for the life of the process and lookups
+ * need no lock.
+ */
+#define SOCKET_PAGE_SIZE  256
+#define SOCKET_PAGE_COUNT 4096
+
+static WSASocketRecord* g_socket_pages[SOCKET_PAGE_COUNT];
+
+/* Module cleanup run by closesocket; hooks are only ever appended */
+#define CLOSE_HOOK_MAX 8
+
+static void (*g_close_hooks[CLOSE_HOOK_MAX])(SOCKET s);
+static int g_close_hook_count = 0;
+static pthread_mutex_t g_close_hook_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* ============================================================================
+ * Lookup
+ * ============================================================================ */
+
+WSASocketRecord* wsa_socket_lookup(SOCKET s)
+{
+    WSASocketRecord* page;
+
+    if (s < 0 || s >= SOCKET_PAGE_SIZE * SOCKET_PAGE_COUNT) {
+        return NULL;
+    }
+    page = __atomic_load_n(&g_socket_pages[s / SOCKET_PAGE_SIZE], __ATOMIC_ACQUIRE);
+    if (page == NULL) {
+        return NULL;
+    }
+    return &page[s % SOCKET_PAGE_SIZE];
+}
+
+WSASocketRecord* wsa_socket_record(SOCKET s)
+{
+    WSASocketRecord* page;
+    WSASocketRecord* expected;
+    void* mem;
+
+    if (s < 0 || s >= SOCKET_PAGE_SIZE * SOCKET_PAGE_COUNT) {
+        return NULL;
+    }
+    page = __atomic_load_n(&g_socket_pages[s / SOCKET_PAGE_SIZE], __ATOMIC_ACQUIRE);
+    if (page == NULL) {
+        if (posix_memalign(&mem, WSA_CACHE_LINE,
+                           SOCKET_PAGE_SIZE * sizeof(WSASocketRecord)) != 0) {
+            return NULL;
+        }
+        memset(mem, 0, SOCKET_PAGE_SIZE * sizeof(WSASocketRecord));
+        page = (WSASocketRecord*)mem;
+        expected = NULL;
+        if (!__atomic_compare_exchange_n(&g_socket_pages[s / SOCKET_PAGE_SIZE],
+                                         &expected, page, 0,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            free(page);
+            page = expected;
+        }
+    }
+    return &page[s % SOCKET_PAGE_SIZE];
+}
+
+unsigned int wsa_close_generation(int fd)
+{
+    WSASocketRecord* rec;
+
+    rec = wsa_socket_lookup((SOCKET)fd);
+    if (rec == NULL) {
+        return 0;
+    }
+    return __atomic_load_n(&rec->gen, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * Family, type and protocol of s, read from the kernel once per
+ * generation. Returns 0, or -1 with errno set.
+ */
+int wsa_socket_info(SOCKET s, int* family, int* type, int* protocol)
+{
+    WSASocketRecord* rec;
+    unsigned int gen;
+    socklen_t len;
+    int values[3];
+
+    rec = wsa_socket_record(s);
+    if (rec != NULL) {
+        gen = __atomic_load_n(&rec->gen, __ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&rec->info_gen, __ATOMIC_ACQUIRE) == gen + 1) {
+            values[0] = rec->family;
+            values[1] = rec->type;
+            values[2] = rec->protocol;
+            if (family != NULL) {
+                *family = values[0];
+            }
+            if (type != NULL) {
+                *type = values[1];
+            }
+            if (protocol != NULL) {
+                *protocol = values[2];
+            }
+            return 0;
+        }
+    } else {
+        gen = 0;
+    }
+
+    len = sizeof(int);
+    if (getsockopt((int)s, SOL_SOCKET, SO_DOMAIN, &values[0], &len) < 0) {
+        return -1;
+    }
+    len = sizeof(int);
+    if (getsockopt((int)s, SOL_SOCKET, SO_TYPE, &values[1], &len) < 0) {
+        return -1;
+    }
+    len = sizeof(int);
+    if (getsockopt((int)s, SOL_SOCKET, SO_PROTOCOL, &values[2], &len) < 0) {
+        values[2] = 0;
+    }
+
+    if (rec != NULL) {
+        rec->family = values[0];
+        rec->type = values[1];
+        rec->protocol = values[2];
+        __atomic_store_n(&rec->info_gen, gen + 1, __ATOMIC_RELEASE);
+    }
+
+    if (family != NULL) {
+        *family = values[0];
+    }
+    if (type != NULL) {
+        *type = values[1];
+    }
+    if (protocol != NULL) {
+        *protocol = values[2];
+    }
+    return 0;
+}
+
+/* ============================================================================
+ * Lifetime
+ * ============================================================================ */
+
+int wsa_add_close_hook(void (*hook)(SOCKET s))
+{
+    int count;
+
+    pthread_mutex_lock(&g_close_hook_mutex);
+    count = g_close_hook_count;
+    if (count == CLOSE_HOOK_MAX) {
+        pthread_mutex_unlock(&g_close_hook_mutex);
+        return -1;
+    }
+    g_close_hooks[count] = hook;
+    __atomic_store_n(&g_close_hook_count, count + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&g_close_hook_mutex);
+    return 0;
+}
+
+/*
+ * Called by closesocket() before the descriptor is released: module
+ * hooks run first, then the record's cached state is dropped and the
+ * generation moves on so stale references stop matching.
+ */
+void wsa_socket_close(SOCKET s)
+{
+    WSASocketRecord* rec;
+    int count;
+    int i;
+
+    count = __atomic_load_n(&g_close_hook_count, __ATOMIC_ACQUIRE);
+    for (i = 0; i < count; i++) {
+        g_close_hooks[i](s);
+    }
+
+    rec = wsa_socket_record(s);
+    if (rec == NULL) {
+        return;
+    }
+    __atomic_store_n(&rec->info_gen, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&rec->opt_flags, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&rec->bytes_sent, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&rec->bytes_received, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&rec->msgs_sent, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&rec->msgs_received, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&rec->send_blocked, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&rec->recv_blocked, 0, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&rec->gen, 1, __ATOMIC_RELEASE);
+}
+
+int wsa_socket_foreach(int (*fn)(SOCKET s, WSASocketRecord* rec, void* ctx), void* ctx)
+{
+    WSASocketRecord* page;
+    int result;
+    int p;
+    int i;
+
+    for (p = 0; p < SOCKET_PAGE_COUNT; p++) {
+        page = __atomic_load_n(&g_socket_pages[p], __ATOMIC_ACQUIRE);
+        if (page == NULL) {
+            continue;
+        }
+        for (i = 0; i < SOCKET_PAGE_SIZE; i++) {
+            result = fn((SOCKET)(p * SOCKET_PAGE_SIZE + i), &page[i], ctx);
+            if (result != 0) {
+                return result;
+            }
+        }
+    }
+    return 0;
+}
+
+#endif /* __linux__ */
@@ -0,0 +1,490 @@
+/*
+ * WSA Socket Option Translation
+ * Implements setsockopt/getsockopt with Windows option names, levels and
+ * value formats on top of the Linux socket options
+ */
+
+#ifdef __linux__
+
+#include "winsock2_api.h"
+#include "wsa_internal.h"
+#include <limits.h>
+
+/* Windows SOL_SOCKET, accepted alongside the Linux value */
+#define WSA_SOL_SOCKET 0xffff
+
+/* ============================================================================
+ * Translation Table
+ * ============================================================================ */
+
+typedef enum SockOptKind {
+    SOCKOPT_BOOL,           /* BOOL of any width; Linux wants an int */
+    SOCKOPT_MS_TIMEOUT,     /* DWORD milliseconds <-> struct timeval */
+    SOCKOPT_LINGER,         /* u_short pair <-> struct linger */
+    SOCKOPT_DONTLINGER,     /* Inverse of l_onoff */
+    SOCKOPT_BUFSIZE,        /* Linux reports twice the size that was set */
+    SOCKOPT_ERROR,          /* errno -> WSA error code */
+    SOCKOPT_EXCLUSIVE,      /* SO_EXCLUSIVEADDRUSE, kept in the socket record */
+    SOCKOPT_SHADOW,         /* Recorded only, in the socket record */
+    SOCKOPT_NOOP,           /* Accepted and ignored */
+    SOCKOPT_MAX_MSG_SIZE,   /* Derived from the socket type */
+    SOCKOPT_DONTFRAGMENT    /* IP_MTU_DISCOVER */
+} SockOptKind;
+
+#define SOCKOPT_GET 0x1
+#define SOCKOPT_SET 0x2
+#define SOCKOPT_RW  (SOCKOPT_GET | SOCKOPT_SET)
+
+typedef struct SockOptEntry {
+    int level;
+    int optname;
+    int linux_level;
+    int linux_optname;
+    unsigned char kind;
+    unsigned char access;
+} SockOptEntry;
+
+/* Options not listed here go to the kernel unchanged */
+static const SockOptEntry g_sockopt_table[] = {
+    { SOL_SOCKET,   SO_DEBUG,                  SOL_SOCKET,   SO_DEBUG,       SOCKOPT_BOOL,         SOCKOPT_RW  },
+    { SOL_SOCKET,   SO_REUSEADDR,              SOL_SOCKET,   SO_REUSEADDR,   SOCKOPT_BOOL,         SOCKOPT_RW  },
+    { SOL_SOCKET,   SO_KEEPALIVE,              SOL_SOCKET,   SO_KEEPALIVE,   SOCKOPT_BOOL,         SOCKOPT_RW  },
+    { SOL_SOCKET,   SO_DONTROUTE,              SOL_SOCKET,   SO_DONTROUTE,   SOCKOPT_BOOL,         SOCKOPT_RW  },
+    { SOL_SOCKET,   SO_BROADCAST,              SOL_SOCKET,   SO_BROADCAST,   SOCKOPT_BOOL,         SOCKOPT_RW  },
+    { SOL_SOCKET,   SO_OOBINLINE,              SOL_SOCKET,   SO_OOBINLINE,   SOCKOPT_BOOL,         SOCKOPT_RW  },
+    { SOL_SOCKET,   SO_ACCEPTCONN,             SOL_SOCKET,   SO_ACCEPTCONN,  SOCKOPT_BOOL,         SOCKOPT_GET },
+    { SOL_SOCKET,   SO_RCVTIMEO,               SOL_SOCKET,   SO_RCVTIMEO,    SOCKOPT_MS_TIMEOUT,   SOCKOPT_RW  },
+    { SOL_SOCKET,   SO_SNDTIMEO,               SOL_SOCKET,   SO_SNDTIMEO,    SOCKOPT_MS_TIMEOUT,   SOCKOPT_RW  },
+    { SOL_SOCKET,   SO_LINGER,                 SOL_SOCKET,   SO_LINGER,      SOCKOPT_LINGER,       SOCKOPT_RW  },
+    { SOL_SOCKET,   SO_DONTLINGER,             SOL_SOCKET,   SO_LINGER,      SOCKOPT_DONTLINGER,   SOCKOPT_RW  },
+    { SOL_SOCKET,   SO_RCVBUF,                 SOL_SOCKET,   SO_RCVBUF,      SOCKOPT_BUFSIZE,      SOCKOPT_RW  },
+    { SOL_SOCKET,   SO_SNDBUF,                 SOL_SOCKET,   SO_SNDBUF,      SOCKOPT_BUFSIZE,      SOCKOPT_RW  },
+    { SOL_SOCKET,   SO_ERROR,                  SOL_SOCKET,   SO_ERROR,       SOCKOPT_ERROR,        SOCKOPT_GET },
+    { SOL_SOCKET,   SO_EXCLUSIVEADDRUSE,       SOL_SOCKET,   SO_REUSEADDR,   SOCKOPT_EXCLUSIVE,    SOCKOPT_RW  },
+    { SOL_SOCKET,   SO_CONDITIONAL_ACCEPT,     0,            0,              SOCKOPT_SHADOW,       SOCKOPT_RW  },
+    { SOL_SOCKET,   SO_UPDATE_ACCEPT_CONTEXT,  0,            0,              SOCKOPT_NOOP,         SOCKOPT_SET },
+    { SOL_SOCKET,   SO_UPDATE_CONNECT_CONTEXT, 0,            0,              SOCKOPT_NOOP,         SOCKOPT_SET },
+    { SOL_SOCKET,   SO_MAX_MSG_SIZE,           SOL_SOCKET,   SO_TYPE,        SOCKOPT_MAX_MSG_SIZE, SOCKOPT_GET },
+    { IPPROTO_TCP,  TCP_NODELAY,               IPPROTO_TCP,  TCP_NODELAY,    SOCKOPT_BOOL,         SOCKOPT_RW  },
+    { IPPROTO_IP,   IP_DONTFRAGMENT,           IPPROTO_IP,   IP_MTU_DISCOVER, SOCKOPT_DONTFRAGMENT, SOCKOPT_RW },
+    { IPPROTO_IP,   IP_HDRINCL,                IPPROTO_IP,   IP_HDRINCL,     SOCKOPT_BOOL,         SOCKOPT_RW  },
+    { IPPROTO_IPV6, IPV6_V6ONLY,               IPPROTO_IPV6, IPV6_V6ONLY,    SOCKOPT_BOOL,         SOCKOPT_RW  }
+};
+
+#define SOCKOPT_TABLE_SIZE ((int)(sizeof(g_sockopt_table) / sizeof(g_sockopt_table[0])))
+
+static const SockOptEntry* sockopt_lookup(int level, int optname)
+{
+    int i;
+
+    if (level == WSA_SOL_SOCKET) {
+        level = SOL_SOCKET;
+    }
+    for (i = 0; i < SOCKOPT_TABLE_SIZE; i++) {
+        if (g_sockopt_table[i].level == level && g_sockopt_table[i].optname == optname) {
+            return &g_sockopt_table[i];
+        }
+    }
+    return NULL;
+}
+
+/* ============================================================================
+ * Shadow Options
+ *
+ * Options the kernel has no slot for are WSA_OPT_* bits in the socket
+ * record, which closesocket() clears so a reused descriptor starts clean.
+ * ============================================================================ */
+
+static unsigned int shadow_get(SOCKET s)
+{
+    WSASocketRecord* rec;
+
+    rec = wsa_socket_lookup(s);
+    if (rec == NULL) {
+        return 0;
+    }
+    return __atomic_load_n(&rec->opt_flags, __ATOMIC_ACQUIRE);
+}
+
+static int shadow_set(SOCKET s, unsigned int flag, int on)
+{
+    WSASocketRecord* rec;
+
+    rec = wsa_socket_record(s);
+    if (rec == NULL) {
+        return -1;
+    }
+    if (on) {
+        __atomic_or_fetch(&rec->opt_flags, flag, __ATOMIC_ACQ_REL);
+    } else {
+        __atomic_and_fetch(&rec->opt_flags, ~flag, __ATOMIC_ACQ_REL);
+    }
+    return 0;
+}
+
+/* ============================================================================
+ * setsockopt / getsockopt
+ * ============================================================================ */
+
+/* Read a Windows integer or BOOL option of 1 to 4 bytes */
+static int sockopt_read_int(const char* optval, int optlen)
+{
+    DWORD dw;
+    WORD w;
+
+    if (optlen >= (int)sizeof(DWORD)) {
+        memcpy(&dw, optval, sizeof(dw));
+        return (int)dw;
+    }
+    if (optlen >= (int)sizeof(WORD)) {
+        memcpy(&w, optval, sizeof(w));
+        return (int)w;
+    }
+    return (unsigned char)optval[0];
+}
+
+/* Store an integer option; WSAEFAULT if the caller offered less than an int */
+static int sockopt_write_int(char* optval, int* optlen, int value)
+{
+    if (*optlen < (int)sizeof(int)) {
+        g_wsa_last_error = WSAEFAULT;
+        return SOCKET_ERROR;
+    }
+    memcpy(optval, &value, sizeof(int));
+    *optlen = sizeof(int);
+    return 0;
+}
+
+/* Store a BOOL option in as many bytes as the caller offered (1 for BOOLEAN) */
+static void sockopt_write_bool(char* optval, int* optlen, int value)
+{
+    if (*optlen >= (int)sizeof(int)) {
+        memcpy(optval, &value, sizeof(int));
+        *optlen = sizeof(int);
+    } else {
+        optval[0] = (char)(value != 0);
+        *optlen = 1;
+    }
+}
+
+static int sockopt_kernel_int(SOCKET s, int level, int optname, int* value)
+{
+    socklen_t len;
+
+    len = sizeof(*value);
+    if (getsockopt((int)s, level, optname, value, &len) < 0) {
+        set_wsa_error_from_errno();
+        return SOCKET_ERROR;
+    }
+    return 0;
+}
+
+/* SO_TYPE from the socket record; also how emulated options reject non-sockets */
+static int sockopt_socket_type(SOCKET s, int* type)
+{
+    if (wsa_socket_info(s, NULL, type, NULL) < 0) {
+        set_wsa_error_from_errno();
+        return SOCKET_ERROR;
+    }
+    return 0;
+}
+
+int WSAAPI WSASetSockOpt(SOCKET s, int level, int optname,
+                         const char* optval, int optlen)
+{
+    const SockOptEntry* e;
+    struct linger lg;
+    struct timeval tv;
+    socklen_t len;
+    DWORD ms;
+    int value;
+    int result;
+    WSA_STATS_SCOPE(WSASetSockOpt);
+
+    e = sockopt_lookup(level, optname);
+    if (e == NULL) {
+        if (level == WSA_SOL_SOCKET) {
+            level = SOL_SOCKET;
+        }
+        if (optlen < 0) {
+            g_wsa_last_error = WSAEFAULT;
+            return SOCKET_ERROR;
+        }
+        /* Unlisted options (e.g. SO_ATTACH_FILTER) reach every accept shard */
+        if (wsa_listener_setsockopt(s, level, optname, optval, (socklen_t)optlen) < 0) {
+            set_wsa_error_from_errno();
+            return SOCKET_ERROR;
+        }
+        g_wsa_last_error = 0;
+        return 0;
+    }
+
+    if (!(e->access & SOCKOPT_SET)) {
+        g_wsa_last_error = WSAENOPROTOOPT;
+        return SOCKET_ERROR;
+    }
+    if (e->kind != SOCKOPT_NOOP && (optval == NULL || optlen < 1)) {
+        g_wsa_last_error = WSAEFAULT;
+        return SOCKET_ERROR;
+    }
+
+    switch (e->kind) {
+        case SOCKOPT_MS_TIMEOUT:
+            /* A full timeval is native Linux code; anything else is a DWORD */
+            if (optlen >= (int)sizeof(struct timeval)) {
+                result = setsockopt((int)s, e->linux_level, e->linux_optname,
+                                    optval, (socklen_t)optlen);
+                break;
+            }
+            if (optlen < (int)sizeof(DWORD)) {
+                g_wsa_last_error = WSAEFAULT;
+                return SOCKET_ERROR;
+            }
+            memcpy(&ms, optval, sizeof(ms));
+            tv.tv_sec = (time_t)(ms / 1000);
+            tv.tv_usec = (suseconds_t)((ms % 1000) * 1000);
+            result = setsockopt((int)s, e->linux_level, e->linux_optname, &tv, sizeof(tv));
+            break;
+
+        case SOCKOPT_LINGER:
+            if (optlen >= (int)sizeof(struct linger)) {
+                result = setsockopt((int)s, e->linux_level, e->linux_optname,
+                                    optval, (socklen_t)optlen);
+                break;
+            }
+            if (optlen < 2 * (int)sizeof(u_short)) {
+                g_wsa_last_error = WSAEFAULT;
+                return SOCKET_ERROR;
+            }
+            /* Windows struct linger is two u_shorts */
+            lg.l_onoff = ((const u_short*)optval)[0];
+            lg.l_linger = ((const u_short*)optval)[1];
+            result = setsockopt((int)s, e->linux_level, e->linux_optname, &lg, sizeof(lg));
+            break;
+
+        case SOCKOPT_DONTLINGER:
+            len = sizeof(lg);
+            memset(&lg, 0, sizeof(lg));
+            getsockopt((int)s, SOL_SOCKET, SO_LINGER, &lg, &len);
+            lg.l_onoff = sockopt_read_int(optval, optlen) == 0;
+            result = setsockopt((int)s, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+            break;
+
+        case SOCKOPT_EXCLUSIVE:
+            value = sockopt_read_int(optval, optlen) != 0;
+            if (value) {
+                /* Exclusive and shared use are mutually exclusive, as on Windows */
+                if (sockopt_kernel_int(s, SOL_SOCKET, SO_REUSEADDR, &result) == SOCKET_ERROR) {
+                    return SOCKET_ERROR;
+                }
+                if (result) {
+                    g_wsa_last_error = WSAEINVAL;
+                    return SOCKET_ERROR;
+                }
+            }
+            if (shadow_set(s, WSA_OPT_EXCLUSIVEADDRUSE, value) < 0) {
+                g_wsa_last_error = WSAENOBUFS;
+                return SOCKET_ERROR;
+            }
+            result = 0;
+            break;
+
+        case SOCKOPT_SHADOW:
+            if (sockopt_socket_type(s, &value) == SOCKET_ERROR) {
+                return SOCKET_ERROR;
+            }
+            if (shadow_set(s, WSA_OPT_CONDITIONAL_ACCEPT,
+                           sockopt_read_int(optval, optlen) != 0) < 0) {
+                g_wsa_last_error = WSAENOBUFS;
+                return SOCKET_ERROR;
+            }
+            result = 0;
+            break;
+
+        case SOCKOPT_NOOP:
+            /* Linux sockets already carry their accept/connect context */
+            result = sockopt_socket_type(s, &value);
+            if (result == SOCKET_ERROR) {
+                return SOCKET_ERROR;
+            }
+            break;
+
+        case SOCKOPT_DONTFRAGMENT:
+            value = sockopt_read_int(optval, optlen) ? IP_PMTUDISC_DO : IP_PMTUDISC_DONT;
+            result = setsockopt((int)s, e->linux_level, e->linux_optname, &value, sizeof(value));
+            break;
+
+        default:
+            /* SOCKOPT_BOOL, SOCKOPT_BUFSIZE: widen to the int Linux expects */
+            value = sockopt_read_int(optval, optlen);
+            if (e->linux_optname == SO_REUSEADDR && e->linux_level == SOL_SOCKET &&
+                value && (shadow_get(s) & WSA_OPT_EXCLUSIVEADDRUSE)) {
+                g_wsa_last_error = WSAEINVAL;
+                return SOCKET_ERROR;
+            }
+            result = setsockopt((int)s, e->linux_level, e->linux_optname, &value, sizeof(value));
+            break;
+    }
+
+    if (result < 0) {
+        set_wsa_error_from_errno();
+        return SOCKET_ERROR;
+    }
+    g_wsa_last_error = 0;
+    return 0;
+}
+
+int WSAAPI WSAGetSockOpt(SOCKET s, int level, int optname,
+                         char* optval, int* optlen)
+{
+    const SockOptEntry* e;
+    struct sockaddr_storage local;
+    struct linger lg;
+    struct timeval tv;
+    socklen_t len;
+    DWORD ms;
+    int value;
+    WSA_STATS_SCOPE(WSAGetSockOpt);
+
+    if (optval == NULL || optlen == NULL || *optlen < 1) {
+        g_wsa_last_error = WSAEFAULT;
+        return SOCKET_ERROR;
+    }
+
+    e = sockopt_lookup(level, optname);
+    if (e == NULL) {
+        if (level == WSA_SOL_SOCKET) {
+            level = SOL_SOCKET;
+        }
+        len = (socklen_t)*optlen;
+        if (getsockopt((int)s, level, optname, optval, &len) < 0) {
+            set_wsa_error_from_errno();
+            return SOCKET_ERROR;
+        }
+        *optlen = (int)len;
+        g_wsa_last_error = 0;
+        return 0;
+    }
+
+    if (!(e->access & SOCKOPT_GET)) {
+        g_wsa_last_error = WSAENOPROTOOPT;
+        return SOCKET_ERROR;
+    }
+
+    switch (e->kind) {
+        case SOCKOPT_MS_TIMEOUT:
+            len = sizeof(tv);
+            if (getsockopt((int)s, e->linux_level, e->linux_optname, &tv, &len) < 0) {
+                set_wsa_error_from_errno();
+                return SOCKET_ERROR;
+            }
+            if (*optlen >= (int)sizeof(struct timeval)) {
+                memcpy(optval, &tv, sizeof(tv));
+                *optlen = sizeof(tv);
+                break;
+            }
+            if (*optlen < (int)sizeof(DWORD)) {
+                g_wsa_last_error = WSAEFAULT;
+                return SOCKET_ERROR;
+            }
+            ms = (DWORD)tv.tv_sec * 1000 + (DWORD)(tv.tv_usec / 1000);
+            memcpy(optval, &ms, sizeof(ms));
+            *optlen = sizeof(ms);
+            break;
+
+        case SOCKOPT_LINGER:
+        case SOCKOPT_DONTLINGER:
+            len = sizeof(lg);
+            if (getsockopt((int)s, SOL_SOCKET, SO_LINGER, &lg, &len) < 0) {
+                set_wsa_error_from_errno();
+                return SOCKET_ERROR;
+            }
+            if (e->kind == SOCKOPT_DONTLINGER) {
+                sockopt_write_bool(optval, optlen, !lg.l_onoff);
+            } else if (*optlen >= (int)sizeof(struct linger)) {
+                memcpy(optval, &lg, sizeof(lg));
+                *optlen = sizeof(lg);
+            } else if (*optlen >= 2 * (int)sizeof(u_short)) {
+                ((u_short*)optval)[0] = (u_short)lg.l_onoff;
+                ((u_short*)optval)[1] = (u_short)lg.l_linger;
+                *optlen = 2 * sizeof(u_short);
+            } else {
+                g_wsa_last_error = WSAEFAULT;
+                return SOCKET_ERROR;
+            }
+            break;
+
+        case SOCKOPT_BUFSIZE:
+            if (sockopt_kernel_int(s, e->linux_level, e->linux_optname, &value) == SOCKET_ERROR) {
+                return SOCKET_ERROR;
+            }
+            /* Linux doubles the requested size for bookkeeping overhead */
+            if (sockopt_write_int(optval, optlen, value / 2) == SOCKET_ERROR) {
+                return SOCKET_ERROR;
+            }
+            break;
+
+        case SOCKOPT_ERROR:
+            if (sockopt_kernel_int(s, e->linux_level, e->linux_optname, &value) == SOCKET_ERROR) {
+                return SOCKET_ERROR;
+            }
+            if (sockopt_write_int(optval, optlen, errno_to_wsa_error(value)) == SOCKET_ERROR) {
+                return SOCKET_ERROR;
+            }
+            break;
+
+        case SOCKOPT_EXCLUSIVE:
+        case SOCKOPT_SHADOW:
+            if (sockopt_socket_type(s, &value) == SOCKET_ERROR) {
+                return SOCKET_ERROR;
+            }
+            sockopt_write_bool(optval, optlen,
+                               (shadow_get(s) &
+                                (e->kind == SOCKOPT_EXCLUSIVE ?
+                                 WSA_OPT_EXCLUSIVEADDRUSE : WSA_OPT_CONDITIONAL_ACCEPT)) != 0);
+            break;
+
+        case SOCKOPT_MAX_MSG_SIZE:
+            if (sockopt_socket_type(s, &value) == SOCKET_ERROR) {
+                return SOCKET_ERROR;
+            }
+            if (*optlen < (int)sizeof(DWORD)) {
+                g_wsa_last_error = WSAEFAULT;
+                return SOCKET_ERROR;
+            }
+            if (value == SOCK_STREAM) {
+                /* No message boundary, so no limit */
+                ms = 0xFFFFFFFFu;
+            } else {
+                len = sizeof(local);
+                local.ss_family = AF_INET;
+                getsockname((int)s, (struct sockaddr*)&local, &len);
+                /* 65535 less the UDP header, and the IPv4 header where it counts */
+                ms = local.ss_family == AF_INET6 ? 65527 : 65507;
+            }
+            memcpy(optval, &ms, sizeof(ms));
+            *optlen = sizeof(ms);
+            break;
+
+        case SOCKOPT_DONTFRAGMENT:
+            if (sockopt_kernel_int(s, e->linux_level, e->linux_optname, &value) == SOCKET_ERROR) {
+                return SOCKET_ERROR;
+            }
+            sockopt_write_bool(optval, optlen,
+                               value == IP_PMTUDISC_DO || value == IP_PMTUDISC_PROBE);
+            break;
+
+        default:
+            /* SOCKOPT_BOOL */
+            if (sockopt_kernel_int(s, e->linux_level, e->linux_optname, &value) == SOCKET_ERROR) {
+                return SOCKET_ERROR;
+            }
+            sockopt_write_bool(optval, optlen, value);
+            break;
+    }
+
+    g_wsa_last_error = 0;
+    return 0;
+}
+
+#endif /* __linux__ */
@@ -0,0 +1,138 @@
+/*
+ * Per-Socket Statistics
+ * SIO_SOCKET_STATS and WSAEnumSocketStats: the traffic counters the
+ * send/receive calls keep in the socket table, the notification state
+ * of wsa_events.c and wsa_netlink.c, and the kernel's TCP_INFO
+ */
+
+#ifdef __linux__
+
+#include "winsock2_api.h"
+#include "wsa_internal.h"
+#include "mstcpip.h"
+#include <sys/stat.h>
+
+typedef struct SocketStatsEnum {
+    LPWSA_SOCKET_STATS stats;
+    DWORD capacity;
+    DWORD count;
+} SocketStatsEnum;
+
+/*
+ * Snapshot of s. The counters are read without a lock, so a call in
+ * flight may or may not be included. Returns 0, or -1 with
+ * g_wsa_last_error set when s is not a socket.
+ */
+static int socket_stats_fill(SOCKET s, WSASocketRecord* rec, WSA_SOCKET_STATS* out)
+{
+    int family;
+    int type;
+    int protocol;
+    long event_select;
+    long async_select;
+
+    if (wsa_socket_info(s, &family, &type, &protocol) < 0) {
+        set_wsa_error_from_errno();
+        return -1;
+    }
+
+    memset(out, 0, sizeof(*out));
+    out->Socket = s;
+    out->Family = family;
+    out->Type = type;
+    out->Protocol = protocol;
+    wsa_select_masks(s, &event_select, &async_select);
+    out->EventSelectMask = event_select;
+    out->AsyncSelectMask = async_select;
+    out->PendingOverlapped = wsa_netchange_pending(s);
+    if (rec != NULL) {
+        out->BytesSent = __atomic_load_n(&rec->bytes_sent, __ATOMIC_RELAXED);
+        out->BytesReceived = __atomic_load_n(&rec->bytes_received, __ATOMIC_RELAXED);
+        out->MessagesSent = __atomic_load_n(&rec->msgs_sent, __ATOMIC_RELAXED);
+        out->MessagesReceived = __atomic_load_n(&rec->msgs_received, __ATOMIC_RELAXED);
+        out->SendWouldBlock = __atomic_load_n(&rec->send_blocked, __ATOMIC_RELAXED);
+        out->ReceiveWouldBlock = __atomic_load_n(&rec->recv_blocked, __ATOMIC_RELAXED);
+    }
+    if ((family == AF_INET || family == AF_INET6) && type == SOCK_STREAM) {
+        out->TcpInfoValid = wsa_tcp_info_v0(s, &out->TcpInfo) == 0;
+    }
+    return 0;
+}
+
+int wsa_socket_stats_ioctl(SOCKET s, LPVOID lpvOutBuffer, DWORD cbOutBuffer,
+                           DWORD* lpcbBytesReturned)
+{
+    if (lpvOutBuffer == NULL || cbOutBuffer < sizeof(WSA_SOCKET_STATS)) {
+        g_wsa_last_error = WSAEFAULT;
+        return SOCKET_ERROR;
+    }
+    if (socket_stats_fill(s, wsa_socket_lookup(s), (WSA_SOCKET_STATS*)lpvOutBuffer) < 0) {
+        return SOCKET_ERROR;
+    }
+
+    if (lpcbBytesReturned != NULL) {
+        *lpcbBytesReturned = sizeof(WSA_SOCKET_STATS);
+    }
+    g_wsa_last_error = 0;
+    return 0;
+}
+
+/*
+ * A record belongs to a socket the library has seen when its type is
+ * cached or it has counted traffic; the descriptor must still be an
+ * open socket, since a plain close() leaves the record behind.
+ */
+static int socket_stats_visit(SOCKET s, WSASocketRecord* rec, void* ctx)
+{
+    SocketStatsEnum* e;
+    WSA_SOCKET_STATS stats;
+    struct stat st;
+    unsigned int gen;
+
+    e = (SocketStatsEnum*)ctx;
+    gen = __atomic_load_n(&rec->gen, __ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&rec->info_gen, __ATOMIC_ACQUIRE) != gen + 1 &&
+        __atomic_load_n(&rec->msgs_sent, __ATOMIC_RELAXED) == 0 &&
+        __atomic_load_n(&rec->msgs_received, __ATOMIC_RELAXED) == 0 &&
+        __atomic_load_n(&rec->send_blocked, __ATOMIC_RELAXED) == 0 &&
+        __atomic_load_n(&rec->recv_blocked, __ATOMIC_RELAXED) == 0) {
+        return 0;
+    }
+    if (fstat((int)s, &st) < 0 || !S_ISSOCK(st.st_mode)) {
+        return 0;
+    }
+    if (e->count < e->capacity) {
+        if (socket_stats_fill(s, rec, &e->stats[e->count]) < 0) {
+            return 0;
+        }
+    } else if (socket_stats_fill(s, rec, &stats) < 0) {
+        return 0;
+    }
+    e->count++;
+    return 0;
+}
+
+int WSAAPI WSAEnumSocketStats(LPWSA_SOCKET_STATS lpStats, DWORD* lpdwCount)
+{
+    SocketStatsEnum e;
+
+    if (lpdwCount == NULL || (lpStats == NULL && *lpdwCount != 0)) {
+        g_wsa_last_error = WSAEFAULT;
+        return SOCKET_ERROR;
+    }
+
+    e.stats = lpStats;
+    e.capacity = *lpdwCount;
+    e.count = 0;
+    wsa_socket_foreach(socket_stats_visit, &e);
+
+    *lpdwCount = e.count;
+    if (e.count > e.capacity) {
+        g_wsa_last_error = WSAEFAULT;
+        return SOCKET_ERROR;
+    }
+    g_wsa_last_error = 0;
+    return 0;
+}
+
+#endif /* __linux__ */
@@ -0,0 +1,510 @@
+/*
+ * Call Statistics for Winsock Wrapper
+ * Per-function call, error, byte and latency counters kept per thread and
+ * merged when read; compiled in with WSA_STATS, otherwise the query API
+ * reports WSAEOPNOTSUPP
+ */
+
+#ifdef __linux__
+
+#include "winsock2_api.h"
+#include "wsa_internal.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <unistd.h>
+
+/* Log-linear buckets: exact below 8 ns, then 4 per power of two */
+#define STATS_SUB_BITS 2
+
+#ifdef WSA_STATS
+
+/* Called ahead of their definitions */
+WSA_HIDDEN_PROTO(WSADumpCallStats);
+WSA_HIDDEN_PROTO(WSACallStatsPercentile);
+
+/* Error slots: codes below 1200 as is, WSABASEERR codes after them */
+#define STATS_LOW_CODES   1200
+#define STATS_WSA_CODES   1200
+#define STATS_ERROR_SLOTS (STATS_LOW_CODES + STATS_WSA_CODES)
+
+typedef struct StatsCounters {
+    unsigned long long calls;
+    unsigned long long errors;
+    unsigned long long bytes;
+    unsigned long long total_ns;
+    unsigned long long hist[WSA_STATS_BUCKETS];
+} StatsCounters;
+
+/* One block per thread, written only by its owner and summed by readers */
+typedef struct __attribute__((aligned(WSA_CACHE_LINE))) StatsBlock {
+    StatsCounters functions[WSA_STAT_COUNT];
+    unsigned long long error_codes[STATS_ERROR_SLOTS];
+    struct StatsBlock* next;
+} StatsBlock;
+
+#define STATS_NAME(name) #name,
+static const char* const g_stats_names[WSA_STAT_COUNT] = {
+    WSA_STATS_FUNCTIONS(STATS_NAME)
+};
+#undef STATS_NAME
+
+int g_wsa_stats_enabled = 0;
+
+static __thread StatsBlock* t_stats_block = NULL;
+static pthread_mutex_t g_stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t g_stats_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_stats_key;
+static StatsBlock* g_stats_blocks = NULL;       /* Live threads */
+static StatsBlock g_stats_retired;              /* Folded in from exited threads */
+static StatsBlock g_stats_baseline;             /* Totals at the last reset */
+
+/* Counters are single-writer; relaxed stores keep concurrent reads whole */
+static inline void stat_add(unsigned long long* counter, unsigned long long value)
+{
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + value,
+                     __ATOMIC_RELAXED);
+}
+
+static int stats_bucket(unsigned long long ns)
+{
+    int msb;
+    int index;
+
+    if (ns < (1ULL << (STATS_SUB_BITS + 1))) {
+        return (int)ns;
+    }
+    msb = 63 - __builtin_clzll(ns);
+    index = (1 << (STATS_SUB_BITS + 1)) + (msb - STATS_SUB_BITS - 1) * (1 << STATS_SUB_BITS) +
+            (int)((ns >> (msb - STATS_SUB_BITS)) & ((1 << STATS_SUB_BITS) - 1));
+    return index < WSA_STATS_BUCKETS ? index : WSA_STATS_BUCKETS - 1;
+}
+
+static int stats_error_slot(int code)
+{
+    if (code > 0 && code < STATS_LOW_CODES) {
+        return code;
+    }
+    if (code >= WSABASEERR && code < WSABASEERR + STATS_WSA_CODES) {
+        return STATS_LOW_CODES + code - WSABASEERR;
+    }
+    return 0;   /* Anything else is counted under 0 */
+}
+
+static void stats_merge(StatsBlock* into, const StatsBlock* from)
+{
+    const unsigned long long* src;
+    unsigned long long* dst;
+    size_t count;
+    size_t i;
+
+    src = (const unsigned long long*)from;
+    dst = (unsigned long long*)into;
+    count = offsetof(StatsBlock, next) / sizeof(unsigned long long);
+    for (i = 0; i < count; i++) {
+        dst[i] += __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+    }
+}
+
+/* Thread exit: fold the block into the retired totals */
+static void stats_thread_exit(void* arg)
+{
+    StatsBlock* block;
+    StatsBlock** link;
+
+    block = (StatsBlock*)arg;
+    pthread_mutex_lock(&g_stats_mutex);
+    for (link = &g_stats_blocks; *link != NULL; link = &(*link)->next) {
+        if (*link == block) {
+            *link = block->next;
+            break;
+        }
+    }
+    stats_merge(&g_stats_retired, block);
+    pthread_mutex_unlock(&g_stats_mutex);
+    t_stats_block = NULL;
+    free(block);
+}
+
+static void stats_key_init(void)
+{
+    pthread_key_create(&g_stats_key, stats_thread_exit);
+}
+
+static StatsBlock* stats_thread_block(void)
+{
+    StatsBlock* block;
+    void* mem;
+
+    if (t_stats_block != NULL) {
+        return t_stats_block;
+    }
+    pthread_once(&g_stats_key_once, stats_key_init);
+    if (posix_memalign(&mem, WSA_CACHE_LINE, sizeof(StatsBlock)) != 0) {
+        return NULL;
+    }
+    block = (StatsBlock*)mem;
+    memset(block, 0, sizeof(StatsBlock));
+
+    pthread_mutex_lock(&g_stats_mutex);
+    block->next = g_stats_blocks;
+    g_stats_blocks = block;
+    pthread_mutex_unlock(&g_stats_mutex);
+
+    pthread_setspecific(g_stats_key, block);
+    t_stats_block = block;
+    return block;
+}
+
+void wsa_stats_leave(WSAStatsScope* scope)
+{
+    StatsBlock* block;
+    StatsCounters* c;
+    struct timespec ts;
+    unsigned long long ns;
+    int error;
+
+    if (scope->start == 0) {
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ns = (unsigned long long)((long long)ts.tv_sec * 1000000000LL + ts.tv_nsec + 1 - scope->start);
+
+    block = stats_thread_block();
+    if (block == NULL) {
+        return;
+    }
+    c = &block->functions[scope->function];
+    stat_add(&c->calls, 1);
+    stat_add(&c->total_ns, ns);
+    stat_add(&c->hist[stats_bucket(ns)], 1);
+    if (scope->bytes > 0) {
+        stat_add(&c->bytes, (unsigned long long)scope->bytes);
+    }
+
+    /* A pending overlapped operation is not a failure */
+    error = g_wsa_last_error;
+    if (error != 0 && error != WSA_IO_PENDING) {
+        stat_add(&c->errors, 1);
+        stat_add(&block->error_codes[stats_error_slot(error)], 1);
+    }
+}
+
+/* Totals since the last reset; g_stats_mutex held */
+static void stats_snapshot(StatsBlock* out)
+{
+    const unsigned long long* base;
+    unsigned long long* dst;
+    StatsBlock* block;
+    size_t count;
+    size_t i;
+
+    memset(out, 0, sizeof(StatsBlock));
+    stats_merge(out, &g_stats_retired);
+    for (block = g_stats_blocks; block != NULL; block = block->next) {
+        stats_merge(out, block);
+    }
+
+    base = (const unsigned long long*)&g_stats_baseline;
+    dst = (unsigned long long*)out;
+    count = offsetof(StatsBlock, next) / sizeof(unsigned long long);
+    for (i = 0; i < count; i++) {
+        dst[i] -= base[i];
+    }
+}
+
+/* WSA_STATS=1 enables collection, WSA_STATS_DUMP=<seconds> dumps to stderr */
+static void* stats_dump_thread(void* arg)
+{
+    unsigned int interval;
+
+    interval = (unsigned int)(unsigned long)arg;
+    while (1) {
+        sleep(interval);
+        WSADumpCallStats_internal(2);
+    }
+    return NULL;
+}
+
+__attribute__((constructor))
+static void stats_init(void)
+{
+    const char* value;
+    pthread_t thread;
+    long interval;
+
+    value = getenv("WSA_STATS");
+    if (value != NULL && atoi(value) != 0) {
+        __atomic_store_n(&g_wsa_stats_enabled, 1, __ATOMIC_RELAXED);
+    }
+
+    value = getenv("WSA_STATS_DUMP");
+    interval = value != NULL ? atol(value) : 0;
+    if (interval > 0) {
+        __atomic_store_n(&g_wsa_stats_enabled, 1, __ATOMIC_RELAXED);
+        if (pthread_create(&thread, NULL, stats_dump_thread, (void*)(unsigned long)interval) == 0) {
+            pthread_detach(thread);
+        }
+    }
+}
+
+/* ============================================================================
+ * Query API
+ * ============================================================================ */
+
+int WSAAPI WSASetCallStats(BOOL fEnable)
+{
+    __atomic_store_n(&g_wsa_stats_enabled, fEnable ? 1 : 0, __ATOMIC_RELAXED);
+    g_wsa_last_error = 0;
+    return 0;
+}
+
+int WSAAPI WSAGetCallStats(LPWSACALLSTATS lpStats, DWORD* lpdwCount)
+{
+    StatsBlock* snapshot;
+    StatsCounters* c;
+    int i;
+
+    if (lpdwCount == NULL || (lpStats == NULL && *lpdwCount != 0)) {
+        g_wsa_last_error = WSAEFAULT;
+        return SOCKET_ERROR;
+    }
+    if (*lpdwCount < WSA_STAT_COUNT) {
+        *lpdwCount = WSA_STAT_COUNT;
+        g_wsa_last_error = WSAEFAULT;
+        return SOCKET_ERROR;
+    }
+
+    snapshot = (StatsBlock*)malloc(sizeof(StatsBlock));
+    if (snapshot == NULL) {
+        g_wsa_last_error = WSAENOBUFS;
+        return SOCKET_ERROR;
+    }
+    pthread_mutex_lock(&g_stats_mutex);
+    stats_snapshot(snapshot);
+    pthread_mutex_unlock(&g_stats_mutex);
+
+    for (i = 0; i < WSA_STAT_COUNT; i++) {
+        c = &snapshot->functions[i];
+        lpStats[i].pszFunction = g_stats_names[i];
+        lpStats[i].ullCalls = c->calls;
+        lpStats[i].ullErrors = c->errors;
+        lpStats[i].ullBytes = c->bytes;
+        lpStats[i].ullTotalNs = c->total_ns;
+        memcpy(lpStats[i].ullHistogram, c->hist, sizeof(c->hist));
+    }
+    free(snapshot);
+
+    *lpdwCount = WSA_STAT_COUNT;
+    g_wsa_last_error = 0;
+    return 0;
+}
+WSA_HIDDEN_DEF(WSAGetCallStats);
+
+int WSAAPI WSAGetErrorStats(LPWSAERRORSTATS lpStats, DWORD* lpdwCount)
+{
+    StatsBlock* snapshot;
+    DWORD needed;
+    DWORD n;
+    int slot;
+
+    if (lpdwCount == NULL || (lpStats == NULL && *lpdwCount != 0)) {
+        g_wsa_last_error = WSAEFAULT;
+        return SOCKET_ERROR;
+    }
+
+    snapshot = (StatsBlock*)malloc(sizeof(StatsBlock));
+    if (snapshot == NULL) {
+        g_wsa_last_error = WSAENOBUFS;
+        return SOCKET_ERROR;
+    }
+    pthread_mutex_lock(&g_stats_mutex);
+    stats_snapshot(snapshot);
+    pthread_mutex_unlock(&g_stats_mutex);
+
+    needed = 0;
+    for (slot = 0; slot < STATS_ERROR_SLOTS; slot++) {
+        if (snapshot->error_codes[slot] != 0) {
+            needed++;
+        }
+    }
+    if (*lpdwCount < needed) {
+        free(snapshot);
+        *lpdwCount = needed;
+        g_wsa_last_error = WSAEFAULT;
+        return SOCKET_ERROR;
+    }
+
+    n = 0;
+    for (slot = 0; slot < STATS_ERROR_SLOTS; slot++) {
+        if (snapshot->error_codes[slot] != 0) {
+            lpStats[n].iError = slot < STATS_LOW_CODES ? slot :
+                                WSABASEERR + slot - STATS_LOW_CODES;
+            lpStats[n].ullCount = snapshot->error_codes[slot];
+            n++;
+        }
+    }
+    free(snapshot);
+
+    *lpdwCount = n;
+    g_wsa_last_error = 0;
+    return 0;
+}
+WSA_HIDDEN_DEF(WSAGetErrorStats);
+
+int WSAAPI WSAResetCallStats(void)
+{
+    StatsBlock* snapshot;
+
+    snapshot = (StatsBlock*)malloc(sizeof(StatsBlock));
+    if (snapshot == NULL) {
+        g_wsa_last_error = WSAENOBUFS;
+        return SOCKET_ERROR;
+    }
+
+    /* Writers are never stopped: the reset moves the baseline instead */
+    pthread_mutex_lock(&g_stats_mutex);
+    stats_snapshot(snapshot);
+    stats_merge(&g_stats_baseline, snapshot);
+    pthread_mutex_unlock(&g_stats_mutex);
+
+    free(snapshot);
+    g_wsa_last_error = 0;
+    return 0;
+}
+
+int WSAAPI WSADumpCallStats(int fd)
+{
+    WSACALLSTATS* stats;
+    WSAERRORSTATS errors[64];
+    DWORD count;
+    DWORD i;
+
+    count = WSA_STAT_COUNT;
+    stats = (WSACALLSTATS*)malloc(count * sizeof(WSACALLSTATS));
+    if (stats == NULL) {
+        g_wsa_last_error = WSAENOBUFS;
+        return SOCKET_ERROR;
+    }
+    if (WSAGetCallStats_internal(stats, &count) == SOCKET_ERROR) {
+        free(stats);
+        return SOCKET_ERROR;
+    }
+
+    dprintf(fd, "%-26s %12s %10s %14s %10s %10s %10s %10s\n", "function", "calls",
+            "errors", "bytes", "mean ns", "p50 ns", "p99 ns", "p99.9 ns");
+    for (i = 0; i < count; i++) {
+        if (stats[i].ullCalls == 0) {
+            continue;
+        }
+        dprintf(fd, "%-26s %12llu %10llu %14llu %10llu %10llu %10llu %10llu\n",
+                stats[i].pszFunction,
+                (unsigned long long)stats[i].ullCalls,
+                (unsigned long long)stats[i].ullErrors,
+                (unsigned long long)stats[i].ullBytes,
+                (unsigned long long)(stats[i].ullTotalNs / stats[i].ullCalls),
+                (unsigned long long)WSACallStatsPercentile_internal(&stats[i], 0.50),
+                (unsigned long long)WSACallStatsPercentile_internal(&stats[i], 0.99),
+                (unsigned long long)WSACallStatsPercentile_internal(&stats[i], 0.999));
+    }
+    free(stats);
+
+    count = sizeof(errors) / sizeof(errors[0]);
+    if (WSAGetErrorStats_internal(errors, &count) == 0) {
+        for (i = 0; i < count; i++) {
+            dprintf(fd, "error %-20d %12llu\n", errors[i].iError,
+                    (unsigned long long)errors[i].ullCount);
+        }
+    }
+
+    g_wsa_last_error = 0;
+    return 0;
+}
+WSA_HIDDEN_DEF(WSADumpCallStats);
+
+#else /* !WSA_STATS */
+
+int WSAAPI WSASetCallStats(BOOL fEnable)
+{
+    (void)fEnable;
+    g_wsa_last_error = WSAEOPNOTSUPP;
+    return SOCKET_ERROR;
+}
+
+int WSAAPI WSAGetCallStats(LPWSACALLSTATS lpStats, DWORD* lpdwCount)
+{
+    (void)lpStats;
+    (void)lpdwCount;
+    g_wsa_last_error = WSAEOPNOTSUPP;
+    return SOCKET_ERROR;
+}
+
+int WSAAPI WSAGetErrorStats(LPWSAERRORSTATS lpStats, DWORD* lpdwCount)
+{
+    (void)lpStats;
+    (void)lpdwCount;
+    g_wsa_last_error = WSAEOPNOTSUPP;
+    return SOCKET_ERROR;
+}
+
+int WSAAPI WSAResetCallStats(void)
+{
+    g_wsa_last_error = WSAEOPNOTSUPP;
+    return SOCKET_ERROR;
+}
+
+int WSAAPI WSADumpCallStats(int fd)
+{
+    (void)fd;
+    g_wsa_last_error = WSAEOPNOTSUPP;
+    return SOCKET_ERROR;
+}
+
+#endif /* WSA_STATS */
+
+/* Highest latency in nanoseconds counted in bucket dwBucket */
+ULONGLONG WSAAPI WSACallStatsBucketLimit(DWORD dwBucket)
+{
+    int msb;
+    int sub;
+    int index;
+
+    if (dwBucket >= WSA_STATS_BUCKETS) {
+        return ~(ULONGLONG)0;
+    }
+    index = (int)dwBucket;
+    if (index < (1 << (STATS_SUB_BITS + 1))) {
+        return (ULONGLONG)index;
+    }
+    index -= 1 << (STATS_SUB_BITS + 1);
+    msb = index / (1 << STATS_SUB_BITS) + STATS_SUB_BITS + 1;
+    sub = index % (1 << STATS_SUB_BITS);
+    return (((ULONGLONG)((1 << STATS_SUB_BITS) + sub + 1)) << (msb - STATS_SUB_BITS)) - 1;
+}
+WSA_HIDDEN_DEF(WSACallStatsBucketLimit);
+
+ULONGLONG WSAAPI WSACallStatsPercentile(const WSACALLSTATS* lpStats, double dPercentile)
+{
+    ULONGLONG rank;
+    ULONGLONG seen;
+    DWORD i;
+
+    if (lpStats == NULL || lpStats->ullCalls == 0) {
+        return 0;
+    }
+    rank = (ULONGLONG)(dPercentile * (double)lpStats->ullCalls + 0.5);
+    if (rank == 0) {
+        rank = 1;
+    }
+    seen = 0;
+    for (i = 0; i < WSA_STATS_BUCKETS; i++) {
+        seen += lpStats->ullHistogram[i];
+        if (seen >= rank) {
+            return WSACallStatsBucketLimit_internal(i);
+        }
+    }
+    return WSACallStatsBucketLimit_internal(WSA_STATS_BUCKETS - 1);
+}
+WSA_HIDDEN_DEF(WSACallStatsPercentile);
+
+#endif /* __linux__ */
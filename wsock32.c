@@ -6,9 +6,14 @@
 #ifdef __linux__
 
 #include "winsock.h"
+#include "wsa_alias.h"
+#include "wsa_pool.h"
 #include <pthread.h>
 #include <sys/time.h>
 
+/* Defined in winsock2.c */
+WSA_HIDDEN_PROTO(WSASetLastError);
+
 /* Thread-local storage for blocking state */
 static __thread BOOL g_blocking_in_progress = FALSE;
 static __thread BOOL g_blocking_cancelled = FALSE;
@@ -31,7 +36,7 @@ LPWSABLOCKINGHOOK WSAAPI WSASetBlockingHook(LPWSABLOCKINGHOOK lpBlockFunc)
     LPWSABLOCKINGHOOK prev_hook;
 
     if (lpBlockFunc == NULL) {
-        WSASetLastError(WSAEINVAL);
+        WSASetLastError_internal(WSAEINVAL);
         return NULL;
     }
 
@@ -50,7 +55,7 @@ int WSAAPI WSAUnhookBlockingHook(void)
 int WSAAPI WSACancelBlockingCall(void)
 {
     if (!g_blocking_in_progress) {
-        WSASetLastError(WSAEINVAL);
+        WSASetLastError_internal(WSAEINVAL);
         return SOCKET_ERROR;
     }
 
@@ -67,14 +72,12 @@ BOOL WSAAPI WSAIsBlocking(void)
  * Winsock 1.1 Async Service/Protocol Resolution
  * ============================================================================ */
 
-/* Async request structure for service/protocol lookups */
+/* Async request structure for service/protocol lookups; the lookup thread frees it */
 typedef struct AsyncServiceRequest {
-    pthread_t thread;
     HANDLE hWnd;
     unsigned int wMsg;
     char* buffer;
     int buflen;
-    int completed;
     int error;
     /* Request parameters */
     union {
@@ -95,6 +98,9 @@ typedef struct AsyncServiceRequest {
     } params;
 } AsyncServiceRequest;
 
+static WSAPool g_service_request_pool =
+    WSA_POOL_INITIALIZER("AsyncServiceRequest", sizeof(AsyncServiceRequest));
+
 /* Thread function for async getservbyname */
 static void* async_getservbyname_thread(void* arg)
 {
@@ -113,7 +119,7 @@ static void* async_getservbyname_thread(void* arg)
         req->error = WSAHOST_NOT_FOUND;
     }
 
-    req->completed = 1;
+    wsa_pool_free(&g_service_request_pool, req);
     return NULL;
 }
 
@@ -122,15 +128,16 @@ HANDLE WSAAPI WSAAsyncGetServByName(HANDLE hWnd, unsigned int wMsg,
                                     char* buf, int buflen)
 {
     AsyncServiceRequest* req;
+    pthread_t thread;
 
     if (name == NULL || buf == NULL || buflen < sizeof(struct servent)) {
-        WSASetLastError(WSAEINVAL);
+        WSASetLastError_internal(WSAEINVAL);
         return NULL;
     }
 
-    req = (AsyncServiceRequest*)malloc(sizeof(AsyncServiceRequest));
+    req = (AsyncServiceRequest*)wsa_pool_alloc(&g_service_request_pool);
     if (req == NULL) {
-        WSASetLastError(WSAENOBUFS);
+        WSASetLastError_internal(WSAENOBUFS);
         return NULL;
     }
 
@@ -144,13 +151,13 @@ HANDLE WSAAPI WSAAsyncGetServByName(HANDLE hWnd, unsigned int wMsg,
         strncpy(req->params.servbyname.proto, proto, sizeof(req->params.servbyname.proto) - 1);
     }
 
-    if (pthread_create(&req->thread, NULL, async_getservbyname_thread, req) != 0) {
-        free(req);
-        WSASetLastError(WSAENOBUFS);
+    if (pthread_create(&thread, NULL, async_getservbyname_thread, req) != 0) {
+        wsa_pool_free(&g_service_request_pool, req);
+        WSASetLastError_internal(WSAENOBUFS);
         return NULL;
     }
 
-    pthread_detach(req->thread);
+    pthread_detach(thread);
     return (HANDLE)req;
 }
 
@@ -172,7 +179,7 @@ static void* async_getservbyport_thread(void* arg)
         req->error = WSAHOST_NOT_FOUND;
     }
 
-    req->completed = 1;
+    wsa_pool_free(&g_service_request_pool, req);
     return NULL;
 }
 
@@ -181,15 +188,16 @@ HANDLE WSAAPI WSAAsyncGetServByPort(HANDLE hWnd, unsigned int wMsg,
                                     char* buf, int buflen)
 {
     AsyncServiceRequest* req;
+    pthread_t thread;
 
     if (buf == NULL || buflen < sizeof(struct servent)) {
-        WSASetLastError(WSAEINVAL);
+        WSASetLastError_internal(WSAEINVAL);
         return NULL;
     }
 
-    req = (AsyncServiceRequest*)malloc(sizeof(AsyncServiceRequest));
+    req = (AsyncServiceRequest*)wsa_pool_alloc(&g_service_request_pool);
     if (req == NULL) {
-        WSASetLastError(WSAENOBUFS);
+        WSASetLastError_internal(WSAENOBUFS);
         return NULL;
     }
 
@@ -203,13 +211,13 @@ HANDLE WSAAPI WSAAsyncGetServByPort(HANDLE hWnd, unsigned int wMsg,
         strncpy(req->params.servbyport.proto, proto, sizeof(req->params.servbyport.proto) - 1);
     }
 
-    if (pthread_create(&req->thread, NULL, async_getservbyport_thread, req) != 0) {
-        free(req);
-        WSASetLastError(WSAENOBUFS);
+    if (pthread_create(&thread, NULL, async_getservbyport_thread, req) != 0) {
+        wsa_pool_free(&g_service_request_pool, req);
+        WSASetLastError_internal(WSAENOBUFS);
         return NULL;
     }
 
-    pthread_detach(req->thread);
+    pthread_detach(thread);
     return (HANDLE)req;
 }
 
@@ -230,7 +238,7 @@ static void* async_getprotobyname_thread(void* arg)
         req->error = WSAHOST_NOT_FOUND;
     }
 
-    req->completed = 1;
+    wsa_pool_free(&g_service_request_pool, req);
     return NULL;
 }
 
@@ -238,15 +246,16 @@ HANDLE WSAAPI WSAAsyncGetProtoByName(HANDLE hWnd, unsigned int wMsg,
                                      const char* name, char* buf, int buflen)
 {
     AsyncServiceRequest* req;
+    pthread_t thread;
 
     if (name == NULL || buf == NULL || buflen < sizeof(struct protoent)) {
-        WSASetLastError(WSAEINVAL);
+        WSASetLastError_internal(WSAEINVAL);
         return NULL;
     }
 
-    req = (AsyncServiceRequest*)malloc(sizeof(AsyncServiceRequest));
+    req = (AsyncServiceRequest*)wsa_pool_alloc(&g_service_request_pool);
     if (req == NULL) {
-        WSASetLastError(WSAENOBUFS);
+        WSASetLastError_internal(WSAENOBUFS);
         return NULL;
     }
 
@@ -257,13 +266,13 @@ HANDLE WSAAPI WSAAsyncGetProtoByName(HANDLE hWnd, unsigned int wMsg,
     req->buflen = buflen;
     strncpy(req->params.protobyname.name, name, sizeof(req->params.protobyname.name) - 1);
 
-    if (pthread_create(&req->thread, NULL, async_getprotobyname_thread, req) != 0) {
-        free(req);
-        WSASetLastError(WSAENOBUFS);
+    if (pthread_create(&thread, NULL, async_getprotobyname_thread, req) != 0) {
+        wsa_pool_free(&g_service_request_pool, req);
+        WSASetLastError_internal(WSAENOBUFS);
         return NULL;
     }
 
-    pthread_detach(req->thread);
+    pthread_detach(thread);
     return (HANDLE)req;
 }
 
@@ -284,7 +293,7 @@ static void* async_getprotobynumber_thread(void* arg)
         req->error = WSAHOST_NOT_FOUND;
     }
 
-    req->completed = 1;
+    wsa_pool_free(&g_service_request_pool, req);
     return NULL;
 }
 
@@ -292,15 +301,16 @@ HANDLE WSAAPI WSAAsyncGetProtoByNumber(HANDLE hWnd, unsigned int wMsg,
                                        int number, char* buf, int buflen)
 {
     AsyncServiceRequest* req;
+    pthread_t thread;
 
     if (buf == NULL || buflen < sizeof(struct protoent)) {
-        WSASetLastError(WSAEINVAL);
+        WSASetLastError_internal(WSAEINVAL);
         return NULL;
     }
 
-    req = (AsyncServiceRequest*)malloc(sizeof(AsyncServiceRequest));
+    req = (AsyncServiceRequest*)wsa_pool_alloc(&g_service_request_pool);
     if (req == NULL) {
-        WSASetLastError(WSAENOBUFS);
+        WSASetLastError_internal(WSAENOBUFS);
         return NULL;
     }
 
@@ -311,13 +321,13 @@ HANDLE WSAAPI WSAAsyncGetProtoByNumber(HANDLE hWnd, unsigned int wMsg,
     req->buflen = buflen;
     req->params.protobynumber.number = number;
 
-    if (pthread_create(&req->thread, NULL, async_getprotobynumber_thread, req) != 0) {
-        free(req);
-        WSASetLastError(WSAENOBUFS);
+    if (pthread_create(&thread, NULL, async_getprotobynumber_thread, req) != 0) {
+        wsa_pool_free(&g_service_request_pool, req);
+        WSASetLastError_internal(WSAENOBUFS);
         return NULL;
     }
 
-    pthread_detach(req->thread);
+    pthread_detach(thread);
     return (HANDLE)req;
 }
 